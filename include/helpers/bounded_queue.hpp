@@ -0,0 +1,199 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include <type_traits>
+
+#if EPUB_LINUX_BUILD
+  #include <atomic>
+  #include <chrono>
+  #include <condition_variable>
+  #include <mutex>
+  #include <thread>
+#else
+  #include "freertos/FreeRTOS.h"
+  #include "freertos/queue.h"
+#endif
+
+/**
+ * class BoundedQueue - Typed message queue between threads
+ *
+ * A queue of at least Capacity messages, local to the process: two instances
+ * never interfere with each other. Messages are copied in and out of the
+ * queue and must be trivially copyable.
+ *
+ * On ESP32, this is a FreeRTOS queue using static storage. On Linux, this is
+ * a lock-free ring buffer supporting multiple senders and receivers (D.
+ * Vyukov's bounded queue). The mutex and condition variables are only used
+ * by a thread that still has to wait for a message (or for room in the
+ * queue) after having yielded a few times: when nobody waits, sending and
+ * receiving is done without locking nor system call.
+ *
+ * Timeouts are in milliseconds. WAIT_FOREVER blocks until the operation can
+ * be done, 0 returns immediately.
+ */
+
+template <typename T, size_t Capacity>
+class BoundedQueue
+{
+  static_assert(std::is_trivially_copyable<T>::value, "BoundedQueue messages must be trivially copyable");
+  static_assert(Capacity > 0, "BoundedQueue capacity must be at least 1");
+
+  public:
+    static constexpr int32_t WAIT_FOREVER = -1;
+
+    #if EPUB_LINUX_BUILD
+
+      BoundedQueue() : enqueue_pos(0), dequeue_pos(0), receivers_waiting(0), senders_waiting(0) {
+        for (uint32_t i = 0; i < SIZE; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+
+      bool send(const T & msg, int32_t timeout = WAIT_FOREVER) {
+        bool sent = try_send(msg);
+        for (int16_t i = 0; !sent && (timeout != 0) && (i < SPIN_COUNT); i++) {
+          std::this_thread::yield();
+          sent = try_send(msg);
+        }
+        if (!sent && (timeout != 0)) {
+          std::unique_lock<std::mutex> lock(mutex);
+          senders_waiting.fetch_add(1);
+          sent = wait(not_full, lock, timeout, [&]() { return try_send(msg); });
+          senders_waiting.fetch_sub(1);
+        }
+        if (sent) wake(not_empty, receivers_waiting);
+        return sent;
+      }
+
+      bool receive(T & msg, int32_t timeout = WAIT_FOREVER) {
+        bool received = try_receive(msg);
+        for (int16_t i = 0; !received && (timeout != 0) && (i < SPIN_COUNT); i++) {
+          std::this_thread::yield();
+          received = try_receive(msg);
+        }
+        if (!received && (timeout != 0)) {
+          std::unique_lock<std::mutex> lock(mutex);
+          receivers_waiting.fetch_add(1);
+          received = wait(not_empty, lock, timeout, [&]() { return try_receive(msg); });
+          receivers_waiting.fetch_sub(1);
+        }
+        if (received) wake(not_full, senders_waiting);
+        return received;
+      }
+
+    #else
+
+      BoundedQueue() {
+        queue = xQueueCreateStatic(Capacity, sizeof(T), storage, &queue_buffer);
+      }
+
+      inline bool send(const T & msg, int32_t timeout = WAIT_FOREVER) {
+        return xQueueSend(queue, &msg, ticks(timeout)) == pdTRUE;
+      }
+
+      inline bool receive(T & msg, int32_t timeout = WAIT_FOREVER) {
+        return xQueueReceive(queue, &msg, ticks(timeout)) == pdTRUE;
+      }
+
+    #endif
+
+  private:
+    #if EPUB_LINUX_BUILD
+
+      static constexpr uint32_t size_for(uint32_t capacity) {
+        uint32_t size = 1;
+        while (size < capacity) size <<= 1;
+        return size;
+      }
+
+      // Before waiting on the condition variable, the thread yields a few
+      // times, the other side being usually about to answer.
+      static constexpr int16_t SPIN_COUNT = 64;
+
+      // The ring size is a power of two such that positions can wrap around
+      static constexpr uint32_t SIZE = size_for(Capacity);
+      static constexpr uint32_t MASK = SIZE - 1;
+
+      struct Cell {
+        std::atomic<uint32_t> sequence;
+        T                     msg;
+      };
+
+      Cell                    cells[SIZE];
+      std::atomic<uint32_t>   enqueue_pos;
+      std::atomic<uint32_t>   dequeue_pos;
+      std::mutex              mutex;
+      std::condition_variable not_empty;
+      std::condition_variable not_full;
+      std::atomic<int16_t>    receivers_waiting;
+      std::atomic<int16_t>    senders_waiting;
+
+      bool try_send(const T & msg) {
+        Cell   * cell;
+        uint32_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+          cell = &cells[pos & MASK];
+          int32_t diff = (int32_t) (cell->sequence.load(std::memory_order_acquire) - pos);
+          if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+          }
+          else if (diff < 0) return false;  // Full
+          else pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+        cell->msg = msg;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+
+      bool try_receive(T & msg) {
+        Cell   * cell;
+        uint32_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+          cell = &cells[pos & MASK];
+          int32_t diff = (int32_t) (cell->sequence.load(std::memory_order_acquire) - (pos + 1));
+          if (diff == 0) {
+            if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+          }
+          else if (diff < 0) return false;  // Empty
+          else pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+        msg = cell->msg;
+        cell->sequence.store(pos + SIZE, std::memory_order_release);
+        return true;
+      }
+
+      // The waiting thread registers itself before checking the queue again
+      // (under the mutex), and the other side checks for waiting threads
+      // after its operation: a wakeup cannot be missed.
+      template <typename Pred>
+      bool wait(std::condition_variable & cond, std::unique_lock<std::mutex> & lock, int32_t timeout, Pred pred) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (timeout < 0) {
+          cond.wait(lock, pred);
+          return true;
+        }
+        return cond.wait_for(lock, std::chrono::milliseconds(timeout), pred);
+      }
+
+      void wake(std::condition_variable & cond, std::atomic<int16_t> & waiting) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) > 0) {
+          std::scoped_lock guard(mutex);
+          cond.notify_all();
+        }
+      }
+
+    #else
+
+      StaticQueue_t queue_buffer;
+      uint8_t       storage[Capacity * sizeof(T)];
+      QueueHandle_t queue;
+
+      static inline TickType_t ticks(int32_t timeout) {
+        return (timeout < 0) ? portMAX_DELAY : pdMS_TO_TICKS(timeout);
+      }
+
+    #endif
+};
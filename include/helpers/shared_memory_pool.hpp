@@ -0,0 +1,57 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+
+#include "memory_pool.hpp"
+
+#include <mutex>
+
+/**
+ * class SharedMemoryPool - Thread-safe MemoryPool wrapper
+ *
+ * The static pools used by the CSS, DOM and HTMLInterpreter classes are
+ * shared between the book viewer and all page locations retriever threads.
+ * Only the slot allocation/deallocation is guarded by the mutex. The
+ * element construction and destruction are done outside of it, such that
+ * a recursive deleteElement() (DOM nodes) will not deadlock.
+ */
+
+template <typename T, size_t BlockSize = 4096>
+class SharedMemoryPool
+{
+  private:
+    MemoryPool<T, BlockSize> pool;
+    std::mutex               mutex;
+
+  public:
+    typedef T * pointer;
+
+    template <class... Args> pointer newElement(Args &&... args) {
+      pointer result;
+      { std::scoped_lock guard(mutex);
+        result = pool.allocate();
+      }
+      new (result) T(std::forward<Args>(args)...);
+      return result;
+    }
+
+    void deleteElement(pointer p) {
+      if (p != nullptr) {
+        p->~T();
+        std::scoped_lock guard(mutex);
+        pool.deallocate(p);
+      }
+    }
+
+    pointer allocate() {
+      std::scoped_lock guard(mutex);
+      return pool.allocate();
+    }
+
+    void deallocate(pointer p) {
+      std::scoped_lock guard(mutex);
+      pool.deallocate(p);
+    }
+};
@@ -5,9 +5,10 @@
 #pragma once
 #include "global.hpp"
 
-#include <forward_list>
 #include <mutex>
 #include <memory>
+#include <string>
+#include <vector>
 
 #define MINIZ 1
 #define ZLIB  0
@@ -23,76 +24,257 @@ struct MallocDeleter {
   void operator()(void* p) { free(p); }
 };
 
+/**
+ * class Unzip - Access to the content of a zip file
+ * 
+ * The zip file directory (its content index, see open_zip_file()) is built
+ * once and is not modified until the zip file is closed. Files are read
+ * through readers (class Unzip::Reader): each one has its own read position,
+ * buffer and decompression state, and uses positioned reads (pread) on the
+ * zip file. As such, multiple threads can read files of the zip file at the
+ * same time. A reader keeps the directory it was opened with (and the zip
+ * file) available until it is closed, even if the zip file is closed in the
+ * meantime.
+ */
+
 class Unzip
 {
   private:
     static constexpr char const * TAG = "Unzip";
 
     static const int BUFFER_SIZE = 1024*16;
-    char buffer[BUFFER_SIZE];
+    char buffer[BUFFER_SIZE];   // Used to read the central directory
+
+    static constexpr uint32_t FILTER_PART_SIZE = 8 * 1024;  // Inflated between two Filter::process() calls
 
-    std::mutex mutex;
-    
     /**
      * @brief File descriptor inside the zip file
      * 
+     * The filename is located in the names arena, null terminated.
      */
+    #pragma pack(push, 1)
     struct FileEntry {
-      char * filename;
+      uint32_t filename;        // offset in names
+      uint32_t hash;            // of the filename
       uint32_t start_pos;       // in zip file
       uint32_t compressed_size; // in zip file
       uint32_t size;            // once decompressed
-      uint32_t current_pos;
       uint16_t method;          // compress method (0 = not compressed, 8 = DEFLATE)
+      uint16_t reserved;
     };
 
-    typedef std::forward_list<FileEntry *> FileEntries;
-    FileEntries file_entries;
-    FileEntries::iterator current_fe;
+    // Index file header. The file entries and the names arena follow.
+    struct IndexHeader {
+      char     magic[4];
+      uint8_t  version;
+      uint8_t  reserved;
+      uint16_t entry_count;
+      uint32_t zip_size;
+      uint32_t zip_mtime;
+      uint32_t names_size;
+      uint32_t checksum;        // of the entries and names
+    };
+    #pragma pack(pop)
+
+    static constexpr uint8_t  INDEX_VERSION = 1;
+    static constexpr uint16_t EMPTY_SLOT    = 0xFFFF;
+
+    typedef std::vector<FileEntry> FileEntries;
+
+    // The content of an opened zip file. Not modified once built.
+    struct Directory {
+      FILE                * file;
+      FileEntries           file_entries;   // in the central directory order
+      std::vector<char>     names;          // all filenames, one allocation
+      std::vector<uint16_t> slots;          // open addressing index of file_entries
 
-    uint32_t getuint32(const unsigned char * b) {
+      Directory() : file(nullptr) { }
+     ~Directory() { if (file != nullptr) fclose(file); }
+
+      const FileEntry * find(const char * filename) const;
+      inline const char * get_name(const FileEntry & entry) const { return &names[entry.filename]; }
+    };
+
+    typedef std::shared_ptr<const Directory> DirectoryPtr;
+
+    DirectoryPtr directory;
+    std::mutex   mutex;          // Protects directory
+
+    static uint32_t getuint32(const unsigned char * b) {
       return  ((uint32_t)b[0])        | 
              (((uint32_t)b[1]) <<  8) |
              (((uint32_t)b[2]) << 16) |
              (((uint32_t)b[3]) << 24) ;
     }
-    uint16_t getuint16(const unsigned char * b) {
+    static uint16_t getuint16(const unsigned char * b) {
       return  ((uint32_t)b[0])      |     
              (((uint32_t)b[1]) << 8);
     }
 
-    uint16_t repeat;
-    uint16_t remains;
-    uint16_t current;
-    bool     aborted;
+    static uint32_t hash(const char * str, uint32_t seed = 2166136261UL);
 
-    FILE * file; // Current File Descriptor
-    bool zip_file_is_open;
+    bool     read_central_directory(Directory & dir);
+    void     build_index(Directory & dir);
+    bool     load_index(Directory & dir, const char * index_filename, uint32_t zip_size, uint32_t zip_mtime);
+    void     save_index(const Directory & dir, const char * index_filename, uint32_t zip_size, uint32_t zip_mtime);
+    uint32_t index_checksum(const Directory & dir) const;
 
-    #if ZLIB
-      z_stream zstr;
-    #endif
-    #if MINIZ
-      mz_stream zstr;
-    #endif
+    inline DirectoryPtr get_directory() {
+      std::scoped_lock guard(mutex);
+      return directory;
+    }
 
   public:
+    /**
+     * class Unzip::Filter - Processing of a file content while it is 
+     * inflated
+     * 
+     * The data is processed in place, a part at a time, while still in the
+     * CPU cache (see get_file()).
+     */
+    class Filter
+    {
+      public:
+        virtual ~Filter() { }
+
+        /**
+         * @brief Process the data inflated so far
+         * 
+         * @param data The data not processed yet
+         * @param size The size of the data available
+         * @param last True if this is the end of the file
+         * @return The number of bytes processed. All of them if last is true.
+         *         The others are supplied again with the next call.
+         */
+        virtual uint32_t process(char * data, uint32_t size, bool last) = 0;
+    };
+
+    /**
+     * class Unzip::Reader - Sequential read of a file in the zip file
+     * 
+     * Independent of the other readers: not to be shared between threads.
+     */
+    class Reader
+    {
+      public:
+        Reader(Unzip & unzip);
+       ~Reader() { close(); }
+
+        /**
+         * @brief Prepare to read a file
+         * 
+         * @param file_size The file size once decompressed
+         * @return true The file was found
+         */
+        bool open(const char * filename, uint32_t & file_size);
+
+        /**
+         * @brief Read the next part of the file
+         * 
+         * @param data Where to put the data
+         * @param size In: the data capacity. Out: the number of bytes read,
+         *             less than the capacity only at the end of the file
+         * @return false Read or decompression error
+         */
+        bool read(char * data, uint32_t & size);
+
+        bool skip(uint32_t byte_count);
+        void close();
+
+        /**
+         * @brief Location of the file data in the zip file, once opened
+         */
+        inline uint32_t get_data_pos()  const { return data_pos; }
+        inline const FileEntry & get_entry() const { return *entry; }
+
+      private:
+        static constexpr char const * TAG = "UnzipReader";
+
+        Unzip           & unzip;
+        DirectoryPtr      dir;
+        const FileEntry * entry;
+        int               fd;
+        uint32_t          data_pos;     // Start of the file data in the zip file
+        uint32_t          pos;          // Next compressed data to read
+        uint32_t          remaining;    // Compressed data not read yet
+        char            * buffer;
+        bool              inflating, aborted;
+
+        #if ZLIB
+          z_stream zstr;
+        #endif
+        #if MINIZ
+          mz_stream zstr;
+        #endif
+
+        bool fill_buffer();
+    };
+
     Unzip();
-    bool open_zip_file(const char * zip_filename);
+
+    /**
+     * @brief Open a zip file and index its content
+     * 
+     * The content index is built from the central directory of the zip
+     * file. If index_filename is supplied, the index is saved there and is
+     * retrieved from it the next time the zip file is opened, as long as
+     * the zip file size and modification time are the same.
+     * 
+     * @param zip_filename The zip file
+     * @param index_filename The index file, nullptr if the index is not saved
+     * @return true The zip file is ready
+     */
+    bool open_zip_file(const char * zip_filename, const char * index_filename = nullptr);
     void close_zip_file();
     
     int32_t get_file_size(const char * filename);
-    std::unique_ptr<char[], MallocDeleter> get_file(const char * filename, uint32_t & file_size);
     bool    file_exists(const char * filename);
-    bool    open_file(const char * filename);
-    void    close_file();
+
+    /**
+     * @brief Retrieve a whole file, decompressed. Can be called by multiple
+     *        threads at the same time.
+     * 
+     * @param file_size The file size
+     * @param filter If not nullptr, processes the content as it is inflated
+     * @return The file content, null terminated. nullptr if not found.
+     */
+    std::unique_ptr<char[], MallocDeleter> get_file(const char * filename, uint32_t & file_size, Filter * filter = nullptr);
+
+    /**
+     * @brief Location of a file data in the zip file, for direct access
+     * 
+     * @param offset Data position in the zip file
+     * @param size Data size in the zip file
+     * @param method Compression method (0 = not compressed, 8 = DEFLATE)
+     * @return true The file was found
+     */
+    bool    get_file_location(const char * filename, uint32_t & offset, uint32_t & size, uint16_t & method);
+
+    int32_t get_file_count();
 
     #if !STB
+      /**
+       * @brief Sequential read of a file with the shared reader. The reader
+       *        is reserved from open_stream_file() to close_stream_file().
+       */
       bool   open_stream_file(const char * filename, uint32_t & file_size);
       bool   get_stream_data(char * data, uint32_t & size);
       bool   stream_skip(uint32_t byte_count);
       void   close_stream_file();
+
+      /**
+       * @brief Write a file decompressed, outside of the zip file
+       * 
+       * @param filename The file in the zip file
+       * @param dest_filename The file to write
+       * @return true The file was written
+       */
+      bool   extract_file(const char * filename, const std::string & dest_filename);
     #endif
+
+  private:
+    Reader     stream_reader;
+    std::mutex stream_mutex;     // Held from open_stream_file() to close_stream_file()
 };
 
 #if __UNZIP__
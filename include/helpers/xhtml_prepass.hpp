@@ -0,0 +1,45 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include "helpers/unzip.hpp"
+
+/**
+ * @brief XHTML item preparation, before parsing
+ *
+ * The content of an XHTML item is prepared in place, in a single pass
+ * done while the item is inflated (see Unzip::get_file()), that:
+ *
+ * - blanks the C comment markers surrounding the CDATA section markers in
+ *   scripts and style sheets, such that the CDATA section is seen by the
+ *   parser,
+ * - counts the <link> and <style> tags, for retrieve_css(),
+ * - gathers some statistics on the item content.
+ *
+ * The prepared item is kept in the item cache: loading it again is a copy.
+ */
+
+class XHTMLPrepass : public Unzip::Filter
+{
+  public:
+    struct Stats {
+      uint32_t text_size;     ///< Bytes of text, outside of tags
+      uint32_t tag_count;
+      uint16_t link_count;    ///< <link> tags
+      uint16_t style_count;   ///< <style> tags
+      uint16_t cdata_count;   ///< CDATA markers blanked
+    };
+
+    XHTMLPrepass() : stats{}, in_tag(false) { }
+
+    uint32_t process(char * data, uint32_t size, bool last) override;
+
+    inline const Stats & get_stats() const { return stats; }
+
+  private:
+    Stats stats;
+    bool  in_tag;
+};
@@ -22,7 +22,7 @@
 #include <iostream>
 #include <fstream>
 
-#include "memory_pool.hpp"
+#include "helpers/shared_memory_pool.hpp"
 #include "dom.hpp"
 #include "fonts.hpp"
 
@@ -392,11 +392,11 @@ class CSS
     RulesMap          rules_map;
     PropertySuiteList suites;     // Linear list of suites to be deleted when the instance will be destroyed.
 
-    static MemoryPool<Value>        value_pool;
-    static MemoryPool<Property>     property_pool;
-    static MemoryPool<Properties>   properties_pool;
-    static MemoryPool<SelectorNode> selector_node_pool;
-    static MemoryPool<Selector>     selector_pool;
+    static SharedMemoryPool<Value>        value_pool;
+    static SharedMemoryPool<Property>     property_pool;
+    static SharedMemoryPool<Properties>   properties_pool;
+    static SharedMemoryPool<SelectorNode> selector_node_pool;
+    static SharedMemoryPool<Selector>     selector_pool;
 
     void match(DOM::Node * node, RulesMap & to_rules);
     void  show(RulesMap & the_rules_map);
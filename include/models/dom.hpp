@@ -11,8 +11,9 @@
 #include <map>
 #include <sstream>
 #include <iterator>
+#include <mutex>
 
-#include "memory_pool.hpp"
+#include "helpers/shared_memory_pool.hpp"
 
 class DOM 
 {
@@ -119,7 +120,9 @@ class DOM
     Node * body;
 
     DOM() {
-      if (node_pool == nullptr) node_pool = new MemoryPool<Node>;
+      { std::scoped_lock guard(pool_mutex);
+        if (node_pool == nullptr) node_pool = new SharedMemoryPool<Node>;
+      }
       body = node_pool->newElement(nullptr, Tag::BODY);
     }
 
@@ -136,10 +139,12 @@ class DOM
     }
 
     static void delete_pool() {
+      std::scoped_lock guard(pool_mutex);
       delete node_pool;
       node_pool = nullptr;
     }
 
   private:
-    static MemoryPool<Node> * node_pool;
+    static SharedMemoryPool<Node> * node_pool;
+    static std::mutex               pool_mutex;
 };
@@ -5,6 +5,7 @@
 #pragma once
 #include "global.hpp"
 #include "helpers/unzip.hpp"
+#include "helpers/xhtml_prepass.hpp"
 #include <memory>
 
 #include "pugixml.hpp"
@@ -16,8 +17,22 @@
 
 #include <list>
 #include <forward_list>
+#include <vector>
 #include <map>
 #include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+// Where compressed fonts of books are extracted to be read on demand
+#ifndef EPUB_FONTS_FOLDER
+  #define EPUB_FONTS_FOLDER MAIN_FOLDER "/book_fonts"
+#endif
+
+// 1: The zip content index of a book is kept in <book>.zdx, such that the
+// zip central directory is not read again when the book is opened
+#ifndef EPUB_ZIP_INDEX
+  #define EPUB_ZIP_INDEX 1
+#endif
 
 class EPub
 {
@@ -34,6 +49,21 @@ class EPub
       CSS *              css;         ///< Ghost CSS created through merging css suites from css_list and css_cache.
       std::unique_ptr<char[], MallocDeleter> data;
       MediaType          media_type;
+      XHTMLPrepass::Stats stats;      ///< Gathered when the item is prepared for parsing
+    };
+
+    /**
+     * @brief An item of the OPF manifest
+     * 
+     * The id, href and media type point inside the OPF document.
+     */
+    struct ManifestEntry {
+      const char    * id;
+      const char    * href;
+      const char    * media_type;
+      std::string     filename;         ///< Zip entry name (href located, see filename_locate())
+      int16_t         itemref_index;    ///< Position in the spine, -1 if not in the spine
+      ObfuscationType obf_type;
     };
 
     // This struct contains the current parameters that influence
@@ -61,7 +91,6 @@ class EPub
 
     pugi::xml_document opf;    ///< The OPF document description.
     pugi::xml_document encryption;
-    pugi::xml_node     current_itemref;
 
     BinUUID            bin_uuid;
     ShaUUID            sha_uuid;
@@ -76,6 +105,13 @@ class EPub
     BookFormatParams   book_format_params;
 
     CSSList            css_cache;             ///< All css files in the ebook are maintained here.
+
+    // Lookup tables of the OPF, built once the book is opened
+    typedef std::unordered_map<std::string_view, int16_t> ManifestIndex;
+    std::vector<ManifestEntry> manifest;
+    std::vector<int16_t>       spine;                 ///< Manifest index of each itemref, -1 if not in the manifest
+    ManifestIndex              manifest_ids;          ///< id -> manifest index
+    ManifestIndex              manifest_filenames;    ///< Zip entry name -> manifest index
   
     bool               file_is_open;
     bool               encryption_present;
@@ -89,6 +125,8 @@ class EPub
     void      retrieve_fonts_from_css(CSS                  & css          );
     bool           get_encryption_xml();
     void                         sha1(const std::string    & data         );
+    void           build_opf_tables();
+    void           clear_opf_tables();
 
   public:
     EPub();
@@ -104,7 +142,7 @@ class EPub
                                       bool                   load         );
     std::unique_ptr<char[], MallocDeleter> retrieve_file(const char * fname, 
                                       uint32_t             & size         );
-    bool                     get_item(pugi::xml_node         itemref, 
+    bool                     get_item(int16_t                itemref_index, 
                                       ItemInfo             & item         );
     bool            get_item_at_index(int16_t                itemref_index);
     bool            get_item_at_index(int16_t                itemref_index,
@@ -113,7 +151,11 @@ class EPub
     bool                     get_keys();
     std::string       filename_locate(const char           * fname        );
     int16_t            get_item_count();
+    void               get_item_sizes(std::vector<int32_t> & sizes); ///< Uncompressed size of spine items, -1 if not XHTML
     void    update_book_format_params();
+    const ManifestEntry * get_manifest_entry(const char    * id           );
+    const ManifestEntry *  get_spine_entry(int16_t           itemref_index);
+    const ManifestEntry * find_manifest_entry(const std::string & filename);
     ObfuscationType get_file_obfuscation(const char        * filename     );
     void                      decrypt(void                 * buffer, 
                                       const uint32_t         size,
@@ -121,6 +163,40 @@ class EPub
     bool                    load_font(const std::string      filename, 
                                       const std::string      font_family, 
                                       const Fonts::FaceStyle style        );
+    bool                  stream_font(const std::string    & filename, 
+                                      const std::string    & font_family, 
+                                      const Fonts::FaceStyle style,
+                                      ObfuscationType        obf_type     );
+    bool                      get_key(ObfuscationType        obf_type,
+                                      const uint8_t       *& key,
+                                      uint8_t              & key_size,
+                                      uint16_t             & length       );
+
+    /**
+     * @brief Name of a font of a book once extracted in EPUB_FONTS_FOLDER
+     * 
+     * The name starts with a hash of the book file name (without its folder
+     * and extension), such that the fonts of a book can be found again when
+     * the book is deleted.
+     * 
+     * @param epub_filename The book file name
+     * @param filename The font file name inside the book
+     * @param offset The font location inside the book file
+     * @return std::string The extracted font file path
+     */
+    static std::string extracted_font_filename(const std::string & epub_filename,
+                                               const std::string & filename,
+                                               uint32_t            offset);
+
+    /**
+     * @brief Remove the fonts extracted from a book
+     * 
+     * To be called when the book is deleted.
+     * 
+     * @param epub_filename The book file name. Its extension is not considered.
+     */
+    static void remove_fonts(const std::string & epub_filename);
+
     /**
      * @brief Retrieve cover's filename
      *
@@ -6,14 +6,27 @@
 #include "global.hpp"
 
 #include "memory_pool.hpp"
+#include "models/glyph_table.hpp"
 
-#include <unordered_map>
-#include <forward_list>
+#include <atomic>
+#include <iterator>
 #include <mutex>
+#include <vector>
+
+#ifndef GLYPH_CACHE_BUDGET
+  #if EPUB_LINUX_BUILD
+    #define GLYPH_CACHE_BUDGET (16 * 1024 * 1024)
+  #else
+    #define GLYPH_CACHE_BUDGET (2 * 1024 * 1024)
+  #endif
+#endif
 
 class Font
 {
   public:
+    static constexpr uint16_t NO_SLAB      = 0xFFFF;
+    static constexpr uint16_t EVICTED_SLAB = 0xFFFE;
+
     struct Glyph {
       Dim             dim;
       int16_t         xoff, yoff;
@@ -21,21 +34,36 @@ class Font
       int16_t         pitch;
       int16_t         line_height;
       int16_t         ligature_and_kern_pgm_index;
+      std::atomic<uint16_t>
+                      slab;     ///< Slab holding the bitmap, NO_SLAB if none, EVICTED_SLAB if released
       unsigned char * buffer;
       void clear() {
         dim.height = dim.width = 0;
         xoff = yoff = 0;
         advance = pitch = line_height = 0;
         ligature_and_kern_pgm_index = 255;
+        slab   = NO_SLAB;
         buffer = nullptr;
       }
+      Glyph & operator=(const Glyph & other) {
+        dim         = other.dim;
+        xoff        = other.xoff;
+        yoff        = other.yoff;
+        advance     = other.advance;
+        pitch       = other.pitch;
+        line_height = other.line_height;
+        ligature_and_kern_pgm_index = other.ligature_and_kern_pgm_index;
+        slab.store(other.slab.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        buffer      = other.buffer;
+        return *this;
+      }
+      /// The bitmap has been released with its slab. It will be rasterized again.
+      inline bool is_evicted() const { return slab.load(std::memory_order_acquire) == EVICTED_SLAB; }
     };
     
   private:
     static constexpr char const * TAG = "Font";
 
-    std::mutex mutex;
-
   public:
     Font();
     virtual ~Font() {};
@@ -64,29 +92,137 @@ class Font
                               int16_t & kern,  
                               bool    & ignore_next);
 
+    /**
+     * @brief Get a glyph metrics, without its bitmap
+     * 
+     * Same as get_glyph(), but the glyph is not rasterized: the buffer is 
+     * nullptr and the dimensions are those of the glyph bounding box. The
+     * advance and line height are the same as the ones supplied by 
+     * get_glyph(). Used to lay out pages that are not shown, as when 
+     * computing the pages location. The metrics are kept in their own 
+     * cache, apart from the glyphs bitmap.
+     * 
+     * The default implementation returns the complete glyph.
+     */
+    virtual Glyph * get_glyph_metrics(uint32_t charcode, int16_t glyph_size) {
+      return get_glyph(charcode, glyph_size);
+    }
+
+    virtual Glyph * get_glyph_metrics(uint32_t  charcode, 
+                                      uint32_t  next_charcode, 
+                                      int16_t   glyph_size,
+                                      int16_t & kern,  
+                                      bool    & ignore_next) {
+      return get_glyph(charcode, next_charcode, glyph_size, kern, ignore_next);
+    }
+
     void clear_cache();
 
+    /**
+     * @brief Memory allocated for the glyphs bitmap
+     */
+    int32_t get_byte_pool_size();
+
+    /**
+     * @brief Glyph bitmap slabs
+     * 
+     * The bitmaps are kept in slabs, each slab holding glyphs of a single 
+     * size. The memory used by the slabs of all fonts is kept under the 
+     * GLYPH_CACHE_BUDGET by Fonts::trim_glyph_caches(), evicting whole slabs.
+     * The glyphs of an evicted slab stay in the cache without their bitmap
+     * (their metrics remain valid) and are rasterized again when required.
+     * A slab is referenced each time one of its glyphs is retrieved.
+     */
+    inline int16_t get_slab_count() const { return slabs.size(); }
+
+    /**
+     * @brief Number of slabs holding bitmaps (not evicted)
+     */
+    int16_t get_resident_slab_count();
+
+    /**
+     * @brief Mark the slab of a glyph as in use, for a glyph kept apart 
+     *        from the font (e.g. in the WordCache) and used again.
+     */
+    inline void reference(const Glyph * glyph) {
+      uint16_t slab = glyph->slab.load(std::memory_order_relaxed);
+      if (slab < EVICTED_SLAB) {
+        std::atomic<uint32_t> & word = slab_references[(slab >> 5) & 7];
+        uint32_t bit = 1U << (slab & 31);
+        if ((word.load(std::memory_order_relaxed) & bit) == 0) word.fetch_or(bit, std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * @brief Get and clear the reference flag of a slab
+     */
+    inline bool test_and_clear_slab_reference(int16_t idx) {
+      uint32_t bit = 1U << (idx & 31);
+      return (slab_references[(idx >> 5) & 7].fetch_and(~bit, std::memory_order_relaxed) & bit) != 0;
+    }
+
+    /**
+     * @brief Release a slab. Glyph bitmaps must not be in use by another thread.
+     * 
+     * The glyphs are marked as evicted before their bitmap is released: a
+     * reader checks again that the glyph is not evicted once it has
+     * referenced it (see get_glyph()).
+     * 
+     * @return int32_t The number of bytes released
+     */
+    int32_t evict_slab(int16_t idx);
+
+    static inline int32_t get_slabs_size()      { return slabs_size;      }
+    static inline int32_t get_slabs_peak_size() { return slabs_peak_size; }
+
+    /**
+     * @brief Number of glyphs rasterized (cache misses)
+     */
+    inline int32_t get_rasterized_count() const { return rasterized_count; }
+
     void get_size(const char * str, Dim * dim, int16_t glyph_size);
 
     inline void    set_fonts_cache_index(int16_t index) { fonts_cache_index = index; }
     inline int16_t get_fonts_cache_index()              { return fonts_cache_index;  }
-    uint8_t      * byte_pool_alloc(uint16_t size);
+
+    /**
+     * @brief Allocate a glyph bitmap in a slab of the current font size. 
+     *        The slab index is left in last_slab. Called with the mutex held.
+     */
+    inline uint8_t * byte_pool_alloc(uint16_t size) { return byte_pool_alloc(size, current_font_size); }
+    uint8_t        * byte_pool_alloc(uint16_t size, int16_t glyph_size);
+
+    /**
+     * @brief Save the glyphs rasterized so far, for the fonts that keep 
+     *        them (see GlyphAtlas).
+     */
+    inline void flush_glyphs() {
+      std::scoped_lock guard(mutex);
+      save_glyphs(false);
+    }
 
     /**
      * @brief Face normal line height
      * 
+     * The face metrics are kept by size: asking for them doesn't change 
+     * the face current size.
      * 
      * @return int32_t Normal line height of the face in pixels related to the glyph size
      */
-    virtual int32_t get_line_height(int16_t glyph_size) = 0;
+    inline int32_t get_line_height(int16_t glyph_size) {
+      int16_t line_height, descender_height;
+      return get_size_metrics(glyph_size, line_height, descender_height) ? line_height : 0;
+    }
 
     /**
      * @brief Get Face characters height related to the glyph size
      * 
      */
     virtual int32_t get_chars_height(int16_t glyph_size)  {
-      const Glyph * g = get_glyph_internal('E', glyph_size);
-      return (g == nullptr) ? 0 : (g->dim.height - get_descender_height(glyph_size));
+      int32_t descender_height = get_descender_height(glyph_size);
+      std::scoped_lock guard(mutex);
+      const Glyph * g = ready ? get_glyph_internal('E', glyph_size) : nullptr;
+      return (g == nullptr) ? 0 : (g->dim.height - descender_height);
     };
  
      /**
@@ -94,27 +230,50 @@ class Font
      * 
      * @return int32_t The face descender height in pixels related to the glyph size.
      */
-    virtual int32_t get_descender_height(int16_t glyph_size) = 0;
+    inline int32_t get_descender_height(int16_t glyph_size) {
+      int16_t line_height, descender_height;
+      return get_size_metrics(glyph_size, line_height, descender_height) ? descender_height : 0;
+    }
 
 protected:
-    static constexpr uint16_t BYTE_POOL_SIZE = 16384*2;
+    static constexpr uint16_t SLAB_SIZE = 8192;
+
+    std::mutex mutex; ///< Guards the face and the glyphs cache. Shared with the sub-classes.
+
+    typedef GlyphTable<Glyph>                    Glyphs; ///< Cache for the glyphs, by size and charcode
+
+    struct Slab {
+      uint8_t * pool;        ///< nullptr if evicted (entry available)
+      uint16_t  capacity;
+      uint16_t  used;
+      int16_t   glyph_size;
+    };
 
-    typedef std::unordered_map<uint32_t, Glyph *> Glyphs; ///< Cache for the glyphs' bitmap 
-    typedef std::unordered_map<int16_t,  Glyphs>  GlyphsCache;
-    typedef uint8_t                              BytePool[BYTE_POOL_SIZE];
-    typedef std::forward_list<BytePool *>        BytePools;
+    struct SizeMetrics {
+      std::atomic<int16_t> glyph_size;  ///< -1 = unused entry
+      int16_t              line_height;
+      int16_t              descender_height;
+    };
+    static constexpr int8_t SIZE_METRICS_COUNT = 8;
     
-    GlyphsCache        cache;
+    Glyphs             cache;            ///< Glyphs with their bitmap
+    Glyphs             metrics_cache;    ///< Glyphs metrics only (see get_glyph_metrics())
+    SizeMetrics        size_metrics[SIZE_METRICS_COUNT];
     int16_t            fonts_cache_index;
     int8_t             current_font_size;
     bool               ready;
     
     MemoryPool<Glyph>  bitmap_glyph_pool;
     
-    BytePools          byte_pools;
-    uint16_t           byte_pool_idx;
+    std::vector<Slab>     slabs;
+    std::atomic<uint32_t> slab_references[8];  ///< One bit per slab, modulo 256
+    uint16_t              last_slab;           ///< Slab of the last byte_pool_alloc()
+    std::atomic<int32_t>  rasterized_count;
 
-    void      add_buff_to_byte_pool();
+    static std::atomic<int32_t> slabs_size;       ///< All fonts
+    static std::atomic<int32_t> slabs_peak_size;
+
+    void release_slabs();
 
     unsigned char * memory_font;  ///< Buffer for memory fonts
 
@@ -152,6 +311,30 @@ protected:
      * @return true The font was found and retrieved.
      * @return false Some error (file not found, unsupported format).
      */
+    /**
+     * @brief Get the face metrics for a glyph size
+     * 
+     * Lock-free once the metrics of the size have been computed.
+     */
+    bool get_size_metrics(int16_t glyph_size, int16_t & line_height, int16_t & descender_height);
+
+    /**
+     * @brief Compute the face metrics for a glyph size. Called with the
+     *        mutex held.
+     * 
+     * @return false The face is not available or the size can't be set.
+     */
+    virtual bool compute_size_metrics(int16_t   glyph_size, 
+                                      int16_t & line_height, 
+                                      int16_t & descender_height) = 0;
+
+    /**
+     * @brief Save the glyphs rasterized so far. Called with the mutex held.
+     * 
+     * @param release True if the glyphs are about to be released
+     */
+    virtual void save_glyphs(bool release) { }
+
     virtual bool   set_font_face_from_memory(unsigned char * buffer, int32_t size) = 0;
     virtual Glyph *       get_glyph_internal(uint32_t charcode, int16_t glyph_size) = 0;
     virtual Glyph * adjust_ligature_and_kern(Glyph   * glyph, 
@@ -35,4 +35,16 @@ class FontFactory {
 
       return nullptr;
     }
+
+    static Font * 
+    create(const std::string & filename, 
+           FontStream *        stream) {
+      std::string ext = filename.substr(filename.find_last_of(".") + 1);
+
+      if ((ext == "ttf") || 
+          (ext == "otf")) return new TTF(stream);
+
+      delete stream;
+      return nullptr;
+    }
 }; 
\ No newline at end of file
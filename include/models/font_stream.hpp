@@ -0,0 +1,107 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include <ft2build.h>
+
+#include FT_FREETYPE_H
+#include FT_SYSTEM_H
+
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <string>
+
+/**
+ * class FontStream - Font data read from a file on demand
+ *
+ * Supplies a FreeType stream (FT_Stream) such that a face doesn't need the
+ * whole font file in memory. The data is read by blocks of BLOCK_SIZE bytes,
+ * the last BLOCK_COUNT blocks used being kept in memory.
+ *
+ * The font can be a part of a file (a font stored without compression in
+ * an EPub file) and can be obfuscated: the key is applied as blocks are
+ * read.
+ *
+ * The files are opened when required. As the number of files opened at
+ * the same time is limited on the device, at most MAX_OPEN_FILES are kept
+ * open for all streams. Not thread safe: used with the font mutex held.
+ */
+
+class FontStream
+{
+  public:
+    static constexpr uint16_t BLOCK_SIZE     = 4096;
+    static constexpr uint8_t  BLOCK_COUNT    = 8;
+    static constexpr uint8_t  MAX_OPEN_FILES = 3;
+
+    /**
+     * @brief Construct a new Font Stream object
+     *
+     * @param filename The file containing the font
+     * @param offset   Font location in the file
+     * @param size     Font size, 0 if up to the end of the file
+     */
+    FontStream(const std::string & filename, uint32_t offset = 0, uint32_t size = 0);
+   ~FontStream();
+
+    /**
+     * @brief Set the obfuscation key
+     *
+     * @param key      The key, applied cyclically
+     * @param key_size Key size in bytes (max 20)
+     * @param length   Number of bytes obfuscated at the beginning of the font
+     */
+    void set_key(const uint8_t * key, uint8_t key_size, uint16_t length);
+
+    /**
+     * @brief Read font data
+     *
+     * @return uint32_t The number of bytes read
+     */
+    uint32_t read(uint32_t pos, uint8_t * buffer, uint32_t count);
+
+    inline bool      is_ready() const { return ready;  }
+    inline uint32_t  get_size() const { return size;   }
+    inline FT_Stream get_stream()     { return &stream; }
+
+    inline int32_t   get_block_reads()    const { return block_reads; }
+    inline int32_t   get_resident_size()  const { return allocated_blocks * BLOCK_SIZE; }
+
+  private:
+    static constexpr char const * TAG = "FontStream";
+
+    struct Block {
+      int32_t   index;      ///< -1 = empty
+      uint32_t  stamp;      ///< Last use
+      uint8_t * data;
+    };
+
+    FT_StreamRec stream;
+    std::string  filename;
+    FILE       * file;
+    uint32_t     offset, size;
+    bool         ready;
+    Block        blocks[BLOCK_COUNT];
+    uint32_t     stamp;
+    int32_t      block_reads;
+    int16_t      allocated_blocks;
+    uint8_t      key[20];
+    uint8_t      key_size;
+    uint16_t     key_length;
+
+    static std::mutex              files_mutex;   ///< Serializes the files access
+    static std::list<FontStream *> open_streams;  ///< Most recently used first
+
+    Block * get_block(int32_t index);
+    bool    read_file(uint32_t pos, uint8_t * buffer, uint32_t count);
+    void    close_file();
+
+    static unsigned long read_stream(FT_Stream       stream,
+                                     unsigned long   offset,
+                                     unsigned char * buffer,
+                                     unsigned long   count);
+};
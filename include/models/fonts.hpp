@@ -10,6 +10,9 @@
 
 #include <vector>
 #include <mutex>
+#include <atomic>
+
+class FontStream;
 
 class Fonts
 {
@@ -115,6 +118,21 @@ class Fonts
              int32_t             size,
              const std::string & filename);
 
+    /**
+     * @brief Add a font read on demand
+     * 
+     * @param name Font name
+     * @param style Font style (bold, italic, normal)
+     * @param stream The font data, deleted if the font is not added
+     * @param filename Font file name (for its type)
+     * @return true The font was added
+     * @return false Some error occured 
+     */
+    bool add(const std::string & name, 
+             FaceStyle           style, 
+             FontStream        * stream,
+             const std::string & filename);
+
     FaceStyle adjust_font_style(FaceStyle style, FaceStyle font_style, FaceStyle font_weight) const;
 
     void check(int16_t index, FaceStyle style) const {
@@ -125,6 +143,39 @@ class Fonts
 
     void clear_glyph_caches();
 
+    /**
+     * @brief Keep the glyph bitmaps under a budget
+     * 
+     * When the slabs of all fonts are over budget, slabs are evicted 
+     * (CLOCK: a slab referenced since the last sweep gets a second chance)
+     * until a quarter of the budget is available. To be called when no 
+     * display list built with the current glyphs is still to be painted 
+     * and no page is being laid out by another thread (BookViewer holds 
+     * its render_mutex): the generation is incremented if some slab is 
+     * evicted.
+     * 
+     * @param budget Bytes of glyph bitmaps allowed
+     * @return true Some slab was evicted
+     */
+    bool trim_glyph_caches(int32_t budget = GLYPH_CACHE_BUDGET);
+
+    /**
+     * @brief Save the glyphs rasterized since the last call in the glyph
+     *        atlases. To be called once a page has been shown.
+     */
+    void save_glyphs();
+
+    /**
+     * @brief Number of glyphs rasterized by all fonts since they were loaded
+     */
+    int32_t get_rasterized_count();
+
+    /**
+     * @brief Incremented each time glyphs are released (fonts or caches cleared,
+     * font replaced). Glyph pointers kept from a previous generation are invalid.
+     */
+    inline uint16_t get_generation() const { return generation; }
+
     void adjust_default_font(uint8_t font_index);
 
     bool replace(int16_t             index,
@@ -135,6 +186,9 @@ class Fonts
     typedef std::vector<FontEntry> FontCache;
     FontCache font_cache;
     std::mutex mutex;
+    std::atomic<uint16_t> generation;
+    int16_t               clock_font;   ///< CLOCK hand (see trim_glyph_caches())
+    int16_t               clock_slab;
 
     uint8_t       font_count;
     char *        font_names[8];
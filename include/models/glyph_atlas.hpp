@@ -0,0 +1,148 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifndef GLYPH_ATLAS_FOLDER
+  #define GLYPH_ATLAS_FOLDER MAIN_FOLDER "/glyphs"
+#endif
+
+/**
+ * class GlyphAtlas - Glyphs rasterized in a previous session
+ *
+ * The glyph bitmaps and metrics of a font at one size, kept in a file of
+ * the GLYPH_ATLAS_FOLDER such that the glyphs don't have to be rasterized
+ * again after a restart or when a book is opened again.
+ *
+ * The file name is built from the font data hash, the glyph size and the
+ * pixel resolution. The header repeats them with the screen resolution and
+ * the format version: a file not matching is started over. A font modified
+ * has another hash, thus another atlas.
+ *
+ * Glyphs are grouped by blocks of BLOCK_SIZE code points. When opened, the
+ * records headers are scanned to index the blocks. A block is only read
+ * when one of its glyphs is required (load_block()). New glyphs are kept
+ * in memory (add()) and appended to the file by save(), one record per
+ * block. Every record is protected by a checksum: a damaged record is
+ * ignored, a file with a partially written record is started over.
+ *
+ * The kerning of the pairs met at this size (in pixels) are kept the same
+ * way, in the KERN_BLOCK block.
+ *
+ * Not thread safe: used with the font mutex held.
+ */
+
+class GlyphAtlas
+{
+  public:
+    static constexpr uint8_t BLOCK_SHIFT = 7;   ///< 128 code points by block
+
+    #pragma pack(push, 1)
+    struct GlyphRecord {    ///< Followed by pitch * height bitmap bytes
+      uint32_t code;
+      uint16_t width, height;
+      int16_t  xoff, yoff;
+      int16_t  advance;
+      int16_t  pitch;
+      int16_t  line_height;
+    };
+
+    struct KernRecord {
+      uint32_t left, right;
+      int16_t  kern;
+    };
+    #pragma pack(pop)
+
+    GlyphAtlas(uint32_t font_hash, int16_t glyph_size, uint8_t pixel_resolution);
+
+    /**
+     * @brief Retrieve the glyphs of a block, if any in the file. A block is
+     *        retrieved only once.
+     *
+     * @param data The glyph records of the block with their bitmap
+     * @return true Some glyphs were retrieved
+     */
+    bool load_block(uint32_t code, std::vector<uint8_t> & data);
+
+    /**
+     * @brief Keep a new glyph, to be saved. Ignored if already in the file.
+     */
+    void add(const GlyphRecord & glyph, const uint8_t * bitmap);
+
+    /**
+     * @brief Retrieve the kerning pairs, if any in the file. Retrieved only
+     *        once.
+     *
+     * @param data The kern records
+     * @return true Some pairs were retrieved
+     */
+    bool load_kerns(std::vector<KernRecord> & data);
+
+    /**
+     * @brief Keep a new kerning pair, to be saved.
+     */
+    void add_kern(uint32_t left, uint32_t right, int16_t kern);
+
+    /**
+     * @brief Append the new glyphs to the file
+     */
+    bool save();
+
+    inline bool has_pending() const { return !pending.empty(); }
+
+    static uint32_t hash(const void * data, int32_t size, uint32_t seed = 2166136261UL);
+
+    static void set_folder(const std::string & the_folder) { folder = the_folder; }
+    static const std::string & get_folder() { return folder; }
+
+    /**
+     * @brief Name of the atlas file of a font, size and pixel resolution
+     */
+    static std::string filename_of(uint32_t font_hash, int16_t glyph_size, uint8_t pixel_resolution);
+
+  private:
+    static constexpr char const * TAG     = "GlyphAtlas";
+    static constexpr uint8_t      VERSION    = 1;
+    static constexpr uint32_t     KERN_BLOCK = 0xFFFFFFFF;   ///< Out of the code points blocks
+
+    #pragma pack(push, 1)
+    struct Header {
+      char     magic[4];
+      uint8_t  version;
+      uint8_t  pixel_resolution;
+      int16_t  glyph_size;
+      uint32_t font_hash;
+      uint16_t resolution;
+      uint16_t reserved;
+    };
+
+    struct BlockHeader {
+      uint32_t block;
+      uint32_t size;       ///< Glyph records and bitmaps
+      uint32_t checksum;
+    };
+    #pragma pack(pop)
+
+    typedef std::unordered_map<uint32_t, std::vector<uint32_t>> BlockIndex;   ///< Block -> records offset
+    typedef std::unordered_map<uint32_t, std::vector<uint8_t>>  PendingBlocks;
+
+    static std::string folder;
+
+    Header                       header;
+    std::string                  filename;
+    bool                         opened, usable;
+    BlockIndex                   blocks;      ///< Blocks in the file not yet retrieved
+    std::unordered_set<uint32_t> known;       ///< Code points retrieved or pending
+    PendingBlocks                pending;
+
+    bool open();
+    bool create();
+    bool read_block(uint32_t block, std::vector<uint8_t> & data);
+};
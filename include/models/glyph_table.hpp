@@ -0,0 +1,255 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include "alloc.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <forward_list>
+#include <mutex>
+
+/**
+ * class GlyphTable - Glyphs of a font, by size and code point
+ *
+ * A flat open-addressing table (linear probing) whose key packs the glyph
+ * size and the code point in 32 bits, such that a lookup is a single probe
+ * sequence on one array, instead of the two hash maps lookups done before.
+ *
+ * In front of the table, a direct-indexed array holds the Latin-1 glyphs of
+ * one size: the size used by the text of the book most of the time. The
+ * array follows the size requested when Latin-1 glyphs are looked up many
+ * times in a row at another size (LATIN1_SWITCH_THRESHOLD).
+ *
+ * Readers (find()) are lock-free: entries are published with release
+ * stores, and a table that has grown is kept until clear() is called. The
+ * writers (insert(), clear()) are serialized by the table's own mutex.
+ * Entries are never removed, except by clear(), which must not be called
+ * while readers may still use the glyphs (the same is true for the glyphs
+ * themselves, released by the font at that time).
+ *
+ * Code points are limited to 21 bits and sizes to 10 bits.
+ */
+
+template <typename Glyph>
+class GlyphTable
+{
+  public:
+    static constexpr int16_t LATIN1_SWITCH_THRESHOLD = 64;
+
+    GlyphTable() : table(nullptr), count(0), latin1_tag(0), latin1_version(0), latin1_misses(0) {
+      for (auto & entry : latin1) entry.store(nullptr, std::memory_order_relaxed);
+    }
+
+   ~GlyphTable() {
+      release_tables();
+    }
+
+    Glyph * find(uint32_t code, int16_t size) {
+      if (code < 256) {
+        uint32_t tag = latin1_tag.load(std::memory_order_acquire);
+        if ((tag != 0) && ((int16_t)(tag & 0x3FF) == (size & 0x3FF))) {
+          Glyph * glyph = latin1[code].load(std::memory_order_acquire);
+          if ((glyph != nullptr) && (latin1_tag.load(std::memory_order_acquire) == tag)) {
+            if (latin1_misses.load(std::memory_order_relaxed) != 0) {
+              latin1_misses.store(0, std::memory_order_relaxed);
+            }
+            return glyph;
+          }
+        }
+        else if (latin1_misses.fetch_add(1, std::memory_order_relaxed) >=
+                 ((tag == 0) ? 0 : LATIN1_SWITCH_THRESHOLD)) {
+          switch_latin1(size);
+        }
+      }
+
+      return find_in_table(key_of(code, size));
+    }
+
+    /**
+     * @brief Add (or replace) a glyph
+     *
+     * @return false Unable to allocate the table (the glyph is not kept)
+     */
+    bool insert(uint32_t code, int16_t size, Glyph * glyph) {
+      std::scoped_lock guard(mutex);
+
+      uint32_t key = key_of(code, size);
+      Table  * t   = table.load(std::memory_order_relaxed);
+
+      if ((t == nullptr) || (((count + 1) << 1) > (t->mask + 1))) {
+        if ((t = grow(t)) == nullptr) return false;
+      }
+
+      Slot * slot = probe(t, key);
+      if (slot->key.load(std::memory_order_relaxed) == 0) count++;
+      slot->glyph.store(glyph, std::memory_order_relaxed);
+      slot->key.store(key, std::memory_order_release);
+
+      if (code < 256) {
+        uint32_t tag = latin1_tag.load(std::memory_order_relaxed);
+        if ((tag != 0) && ((tag & 0x3FF) == (uint32_t)(size & 0x3FF))) {
+          latin1[code].store(glyph, std::memory_order_release);
+        }
+      }
+
+      return true;
+    }
+
+    void clear() {
+      std::scoped_lock guard(mutex);
+
+      latin1_tag.store(0, std::memory_order_release);
+      for (auto & entry : latin1) entry.store(nullptr, std::memory_order_relaxed);
+      latin1_misses.store(0, std::memory_order_relaxed);
+
+      release_tables();
+      count = 0;
+    }
+
+    /**
+     * @brief Call f(glyph) for each glyph in the table. Not to be called
+     *        while glyphs are inserted.
+     */
+    template <typename F>
+    void for_each(F f) {
+      Table * t = table.load(std::memory_order_acquire);
+      if (t == nullptr) return;
+      for (uint32_t i = 0; i <= t->mask; i++) {
+        if (t->slots[i].key.load(std::memory_order_relaxed) != 0) {
+          f(t->slots[i].glyph.load(std::memory_order_relaxed));
+        }
+      }
+    }
+
+    inline int32_t get_count() const { return (int32_t) count; }
+
+    /**
+     * @brief Size whose Latin-1 glyphs are directly indexed, -1 if none
+     */
+    inline int16_t get_latin1_size() const {
+      uint32_t tag = latin1_tag.load(std::memory_order_acquire);
+      return (tag == 0) ? -1 : (tag & 0x3FF);
+    }
+
+  private:
+    static constexpr char const * TAG = "GlyphTable";
+    static constexpr uint32_t INITIAL_CAPACITY = 64;
+
+    struct Slot {
+      std::atomic<uint32_t> key;   ///< 0 = empty
+      std::atomic<Glyph *>  glyph;
+    };
+
+    struct Table {
+      uint32_t mask;
+      Slot   * slots;
+    };
+
+    std::mutex              mutex;      ///< Serializes the writers
+    std::atomic<Table *>    table;
+    std::forward_list<Table *>
+                            retired;    ///< Tables replaced by a larger one
+    uint32_t                count;
+    std::atomic<uint32_t>   latin1_tag; ///< version << 10 | size, 0 = none
+    uint32_t                latin1_version;
+    std::atomic<int16_t>    latin1_misses;
+    std::atomic<Glyph *>    latin1[256];
+
+    static inline uint32_t key_of(uint32_t code, int16_t size) {
+      return 0x80000000U | ((code & 0x1FFFFF) << 10) | (size & 0x3FF);
+    }
+
+    static inline uint32_t hash_of(uint32_t key) {
+      key ^= key >> 16;
+      key *= 0x7FEB352DU;
+      key ^= key >> 15;
+      key *= 0x846CA68BU;
+      key ^= key >> 16;
+      return key;
+    }
+
+    Glyph * find_in_table(uint32_t key) {
+      Table * t = table.load(std::memory_order_acquire);
+      if (t == nullptr) return nullptr;
+
+      for (uint32_t i = hash_of(key) & t->mask; ; i = (i + 1) & t->mask) {
+        uint32_t k = t->slots[i].key.load(std::memory_order_acquire);
+        if (k == key) return t->slots[i].glyph.load(std::memory_order_acquire);
+        if (k == 0) return nullptr;
+      }
+    }
+
+    /// The slot of key, or the empty slot where it goes. The table is never full.
+    static Slot * probe(Table * t, uint32_t key) {
+      for (uint32_t i = hash_of(key) & t->mask; ; i = (i + 1) & t->mask) {
+        uint32_t k = t->slots[i].key.load(std::memory_order_relaxed);
+        if ((k == key) || (k == 0)) return &t->slots[i];
+      }
+    }
+
+    Table * grow(Table * t) {
+      uint32_t capacity = (t == nullptr) ? INITIAL_CAPACITY : ((t->mask + 1) << 1);
+
+      Table * new_table = (Table *) allocate(sizeof(Table));
+      Slot  * slots     = (Slot  *) allocate(capacity * sizeof(Slot));
+      if ((new_table == nullptr) || (slots == nullptr)) {
+        LOG_E("Unable to allocate a glyph table of %u entries.", capacity);
+        if (new_table != nullptr) free(new_table);
+        if (slots     != nullptr) free(slots);
+        return nullptr;
+      }
+
+      memset((void *) slots, 0, capacity * sizeof(Slot));
+      new_table->mask  = capacity - 1;
+      new_table->slots = slots;
+
+      if (t != nullptr) {
+        for (uint32_t i = 0; i <= t->mask; i++) {
+          uint32_t key = t->slots[i].key.load(std::memory_order_relaxed);
+          if (key != 0) {
+            Slot * slot = probe(new_table, key);
+            slot->glyph.store(t->slots[i].glyph.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            slot->key.store(key, std::memory_order_relaxed);
+          }
+        }
+        retired.push_front(t);
+      }
+
+      table.store(new_table, std::memory_order_release);
+      return new_table;
+    }
+
+    void release_tables() {
+      Table * t = table.exchange(nullptr);
+      if (t != nullptr) retired.push_front(t);
+      for (auto * r : retired) {
+        free(r->slots);
+        free(r);
+      }
+      retired.clear();
+    }
+
+    /// Readers don't wait: if a writer is busy, the switch will be tried again.
+    void switch_latin1(int16_t size) {
+      std::unique_lock<std::mutex> guard(mutex, std::try_to_lock);
+      if (!guard.owns_lock()) return;
+
+      uint32_t tag = latin1_tag.load(std::memory_order_relaxed);
+      if ((tag != 0) && ((tag & 0x3FF) == (uint32_t)(size & 0x3FF))) return;
+
+      latin1_tag.store(0, std::memory_order_release);
+
+      for (uint32_t code = 0; code < 256; code++) {
+        latin1[code].store(find_in_table(key_of(code, size)), std::memory_order_release);
+      }
+
+      latin1_version = (latin1_version + 1) & 0x3FFFFF;
+      if (latin1_version == 0) latin1_version = 1;
+      latin1_misses.store(0, std::memory_order_relaxed);
+      latin1_tag.store((latin1_version << 10) | (size & 0x3FF), std::memory_order_release);
+    }
+};
@@ -20,7 +20,6 @@ class IBMF : public Font
     static constexpr char const * TAG = "IBMF";
 
     IBMFFont            * face;
-    std::mutex            mutex;
     IBMFFont::GlyphInfo * glyph_data;
 
   public:
@@ -53,30 +52,6 @@ class IBMF : public Font
                                      int16_t & kern, 
                                      bool    & ignore_next);
 
-  /**
-     * @brief Face normal line height
-     * 
-     * 
-     * @return int32_t Normal line height of the face in pixels
-     */
-    int32_t get_line_height(int16_t glyph_size) {
-      std::scoped_lock guard(mutex);
-      if (current_font_size != glyph_size) set_font_size(glyph_size); 
-      return (face == nullptr) ? 0 : (face->get_line_height()); 
-    }
-
-    /**
-     * @brief Face descender height
-     * 
-     * @return int32_t The face descender height in pixels related to
-     *                 the current font size.
-     */
-    int32_t get_descender_height(int16_t glyph_size) {
-      std::scoped_lock guard(mutex);
-      if (current_font_size != glyph_size) set_font_size(glyph_size);
-      return (face == nullptr) ? 0 : (face->get_descender_height()); 
-    }
-
   private:
     void clear_face();
     
@@ -105,6 +80,7 @@ class IBMF : public Font
      */
     bool set_font_size(int16_t size);
 
+    bool  compute_size_metrics(int16_t glyph_size, int16_t & line_height, int16_t & descender_height);
     Glyph * get_glyph_internal(uint32_t charcode, int16_t glyph_size);
 
     inline uint32_t translate(uint32_t charcode) { return face->translate(charcode); }
@@ -0,0 +1,123 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include "helpers/unzip.hpp"
+#include "helpers/xhtml_prepass.hpp"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Decompressed items kept in memory, in bytes (0 = no cache)
+#ifndef ITEM_CACHE_SIZE
+  #if EPUB_LINUX_BUILD
+    #define ITEM_CACHE_SIZE (4 * 1024 * 1024)
+  #else
+    #define ITEM_CACHE_SIZE (768 * 1024)
+  #endif
+#endif
+
+/**
+ * class ItemCache - Decompressed items of the current book
+ *
+ * The spine items are retrieved again and again: by the book viewer when
+ * moving between pages and chapters, and by the pages location retrievers.
+ * Each retrieval inflated the item from the EPub file. The items are kept
+ * here once decompressed, keyed by their zip entry name, up to a total of
+ * ITEM_CACHE_SIZE bytes. The least recently used items are forgotten first.
+ *
+ * A cached buffer is immutable and shared through refcounted handles: a
+ * handle keeps its buffer available even if it is removed from the cache.
+ * As pugixml parses its buffer in place, get_copy() supplies a private copy
+ * of the item to be parsed.
+ *
+ * XHTML items are prepared for parsing while inflated (see XHTMLPrepass):
+ * they are kept prepared, with their statistics.
+ *
+ * All methods are thread safe.
+ */
+
+class ItemCache
+{
+  public:
+    struct Buffer {
+      char   * data;     ///< Null terminated
+      uint32_t size;
+      int32_t  inflate_time;
+      bool     xhtml;    ///< Prepared by XHTMLPrepass
+      XHTMLPrepass::Stats stats;
+
+      Buffer() : data(nullptr), size(0), inflate_time(0), xhtml(false), stats{} { }
+     ~Buffer() { if (data != nullptr) free(data); }
+    };
+
+    typedef std::shared_ptr<const Buffer> Handle;
+
+    struct Stats {
+      int32_t hits;
+      int32_t misses;
+      int32_t inflate_time;  ///< Time spent inflating the missed items, in us
+      int32_t time_saved;    ///< Inflate time of the items found, in us
+    };
+
+    ItemCache(uint32_t budget);
+
+    /**
+     * @brief Retrieve an item, decompressing it if not in the cache
+     *
+     * @param filename The zip entry name
+     * @param xhtml True if the item is to be prepared for parsing as XHTML
+     * @return The item, nullptr if not found in the zip file
+     */
+    Handle get(const std::string & filename, bool xhtml = false);
+
+    /**
+     * @brief Retrieve an item in a buffer owned by the caller
+     *
+     * @param size The item size
+     * @return The item, null terminated. nullptr if not found.
+     */
+    std::unique_ptr<char[], MallocDeleter> get_copy(const std::string & filename, uint32_t & size);
+
+    void clear();
+
+    inline Stats get_stats() const {
+      return { .hits = hits, .misses = misses, .inflate_time = inflate_time, .time_saved = time_saved };
+    }
+
+    inline int16_t get_hit_rate() const {
+      int32_t total = hits + misses;
+      return (total == 0) ? 0 : (int64_t) hits * 100 / total;
+    }
+
+    inline uint32_t get_used_size() const { return used_size; }
+
+  private:
+    static constexpr char const * TAG = "ItemCache";
+
+    struct Entry {
+      std::string filename;
+      Handle      buffer;
+    };
+
+    std::mutex           mutex;
+    std::list<Entry>     entries;      ///< Most recently used first
+    uint32_t             budget;
+    uint32_t             used_size;
+    std::atomic<int32_t> hits, misses, inflate_time, time_saved;
+
+    Handle find(const std::string & filename, bool xhtml);
+    void    add(const std::string & filename, Handle buffer);
+};
+
+#if __ITEM_CACHE__
+  ItemCache item_cache(ITEM_CACHE_SIZE);
+#else
+  extern ItemCache item_cache;
+#endif
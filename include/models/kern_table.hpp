@@ -0,0 +1,226 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include "alloc.hpp"
+
+#include <ft2build.h>
+
+#include FT_FREETYPE_H
+
+#include <atomic>
+#include <cstring>
+#include <forward_list>
+#include <vector>
+
+/**
+ * class KernTable - Kerning of a TrueType / OpenType face
+ *
+ * The pairs adjustments of the face, in font units, by glyph index. They
+ * are retrieved once from the GPOS table (lookups of the 'kern' feature,
+ * pair adjustment subtables of format 1 and 2), or from the 'kern' table
+ * (format 0 subtables) when the font has no GPOS kerning.
+ *
+ * Format 1 subtables (pairs of glyphs) are merged in a sorted vector.
+ * Format 2 subtables (pairs of glyph classes) are kept as such, as their
+ * expansion could be large. As for the GPOS lookups, the first subtable
+ * covering a pair supplies its adjustment.
+ */
+
+class KernTable
+{
+  public:
+    KernTable() : loaded(false) { }
+
+    /**
+     * @brief Retrieve the kerning tables of the face
+     *
+     * @return true The face has some kerning
+     */
+    bool load(FT_Face face);
+
+    /**
+     * @brief Adjustment of the advance of the left glyph, in font units
+     */
+    int16_t get(uint16_t left, uint16_t right) const;
+
+    inline bool  is_loaded() const { return loaded; }
+    inline bool   is_empty() const { return pairs.empty() && class_subtables.empty(); }
+    inline int32_t get_pair_count() const { return pairs.size(); }
+
+    void clear();
+
+  private:
+    static constexpr char const * TAG = "KernTable";
+
+    struct Pair {
+      uint32_t key;        ///< left << 16 | right
+      int16_t  value;
+      uint16_t order;      ///< Subtable order
+    };
+
+    struct ClassRange {
+      uint16_t first, last;
+      uint16_t value;      ///< Class, or coverage index
+    };
+
+    struct ClassSubtable {
+      uint16_t                order;
+      std::vector<ClassRange> coverage;
+      std::vector<ClassRange> class1, class2;
+      uint16_t                class2_count;
+      std::vector<int16_t>    values;     ///< class1 * class2_count + class2
+    };
+
+    bool                       loaded;
+    std::vector<Pair>          pairs;
+    std::vector<ClassSubtable> class_subtables;
+
+    static bool find_range(const std::vector<ClassRange> & ranges, uint16_t glyph, uint16_t & value);
+
+    bool load_gpos(FT_Face face);
+    bool load_kern(FT_Face face);
+    void load_pair_subtable(const uint8_t * table, uint32_t size, uint32_t offset, uint16_t order);
+    bool load_ranges(const uint8_t * table, uint32_t size, uint32_t offset, bool coverage, std::vector<ClassRange> & ranges);
+};
+
+/**
+ * class KernPairs - Kerning of the codepoint pairs used, by glyph size
+ *
+ * The kerning of the pairs met in the text, in pixels, such that the face
+ * is only required the first time a pair is met at a size. Same principle
+ * as GlyphTable: a flat open-addressing table with lock-free readers. The
+ * pair, the size and the kerning are packed in a single 64 bits entry.
+ * The writers (insert(), clear()) must be serialized by the caller.
+ *
+ * Code points are limited to 21 bits, sizes to 10 bits and the kerning to
+ * +/- 1023 pixels. Up to MAX_PAIRS pairs are kept.
+ */
+
+class KernPairs
+{
+  public:
+    static constexpr int32_t MAX_PAIRS = 8192;
+
+    KernPairs() : table(nullptr), count(0) { }
+   ~KernPairs() { release_tables(); }
+
+    inline bool find(uint32_t left, uint32_t right, int16_t size, int16_t & kern) const {
+      Table * t = table.load(std::memory_order_acquire);
+      if (t == nullptr) return false;
+
+      uint64_t key = key_of(left, right, size);
+      for (uint32_t i = hash_of(key) & t->mask; ; i = (i + 1) & t->mask) {
+        uint64_t entry = t->slots[i].load(std::memory_order_acquire);
+        if ((entry & ~VALUE_MASK) == key) {
+          kern = ((int16_t)((entry & VALUE_MASK) << 5)) >> 5;   // Sign extension of the 11 bits
+          return true;
+        }
+        if (entry == 0) return false;
+      }
+    }
+
+    /**
+     * @brief Add a pair
+     *
+     * @return false The table is full, the pair is ignored
+     */
+    bool insert(uint32_t left, uint32_t right, int16_t size, int16_t kern) {
+      if (count >= MAX_PAIRS) return false;
+
+      Table * t = table.load(std::memory_order_relaxed);
+      if ((t == nullptr) || (((count + 1) << 1) > (int32_t)(t->mask + 1))) {
+        if ((t = grow(t)) == nullptr) return false;
+      }
+
+      uint64_t key = key_of(left, right, size);
+      std::atomic<uint64_t> * slot = probe(t, key);
+      if (slot->load(std::memory_order_relaxed) == 0) count++;
+      slot->store(key | (kern & VALUE_MASK), std::memory_order_release);
+      return true;
+    }
+
+    void clear() {
+      release_tables();
+      count = 0;
+    }
+
+    inline int32_t get_count() const { return count; }
+
+  private:
+    static constexpr char const * TAG = "KernPairs";
+    static constexpr uint32_t INITIAL_CAPACITY = 256;
+    static constexpr uint64_t VALUE_MASK       = 0x7FF;
+
+    struct Table {
+      uint32_t                mask;
+      std::atomic<uint64_t> * slots;   ///< 0 = empty
+    };
+
+    std::atomic<Table *>       table;
+    std::forward_list<Table *> retired;   ///< Tables replaced by a larger one
+    int32_t                    count;
+
+    static inline uint64_t key_of(uint32_t left, uint32_t right, int16_t size) {
+      return 0x8000000000000000ULL |
+             ((uint64_t)(left  & 0x1FFFFF) << 42) |
+             ((uint64_t)(right & 0x1FFFFF) << 21) |
+             ((uint64_t)(size  & 0x3FF)    << 11);
+    }
+
+    static inline uint32_t hash_of(uint64_t key) {
+      key ^= key >> 33;
+      key *= 0xFF51AFD7ED558CCDULL;
+      key ^= key >> 33;
+      return (uint32_t) key;
+    }
+
+    /// The slot of key, or the empty slot where it goes. The table is never full.
+    static std::atomic<uint64_t> * probe(Table * t, uint64_t key) {
+      for (uint32_t i = hash_of(key) & t->mask; ; i = (i + 1) & t->mask) {
+        uint64_t entry = t->slots[i].load(std::memory_order_relaxed);
+        if ((entry == 0) || ((entry & ~VALUE_MASK) == key)) return &t->slots[i];
+      }
+    }
+
+    Table * grow(Table * t) {
+      uint32_t capacity = (t == nullptr) ? INITIAL_CAPACITY : ((t->mask + 1) << 1);
+
+      Table                 * new_table = (Table *) allocate(sizeof(Table));
+      std::atomic<uint64_t> * slots     = (std::atomic<uint64_t> *) allocate(capacity * sizeof(std::atomic<uint64_t>));
+      if ((new_table == nullptr) || (slots == nullptr)) {
+        LOG_E("Unable to allocate a kerning table of %u entries.", capacity);
+        if (new_table != nullptr) free(new_table);
+        if (slots     != nullptr) free(slots);
+        return nullptr;
+      }
+
+      memset((void *) slots, 0, capacity * sizeof(std::atomic<uint64_t>));
+      new_table->mask  = capacity - 1;
+      new_table->slots = slots;
+
+      if (t != nullptr) {
+        for (uint32_t i = 0; i <= t->mask; i++) {
+          uint64_t entry = t->slots[i].load(std::memory_order_relaxed);
+          if (entry != 0) probe(new_table, entry & ~VALUE_MASK)->store(entry, std::memory_order_relaxed);
+        }
+        retired.push_front(t);
+      }
+
+      table.store(new_table, std::memory_order_release);
+      return new_table;
+    }
+
+    void release_tables() {
+      Table * t = table.exchange(nullptr);
+      if (t != nullptr) retired.push_front(t);
+      for (auto * r : retired) {
+        free(r->slots);
+        free(r);
+      }
+      retired.clear();
+    }
+};
@@ -0,0 +1,98 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include "models/page_index.hpp"
+#include "models/page_checkpoints.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * class LocsJournal - Pages location computed so far
+ *
+ * The .locs file is only written once the pages location of all items are
+ * known. To not lose the work done when the book is closed or the device
+ * goes to sleep before that, the pages and checkpoints of every item are
+ * appended to a journal file as soon as they are merged.
+ *
+ * When the computation is restarted for the same formatting parameters,
+ * the journal is replayed to seed the index, such that only the missing
+ * items are computed. The table of content offsets set while computing an
+ * item are journaled with it. The journal is removed once the .locs file
+ * is saved.
+ *
+ * File layout: a header (version, formatting parameters key, item count)
+ * followed by one record per item. Every record is protected by a
+ * checksum: a record partially written (power loss) is dropped with
+ * everything after it.
+ */
+
+class LocsJournal
+{
+  public:
+    struct TocOffset {
+      int16_t entry_index;  ///< Table of content entry
+      int16_t reserved;
+      int32_t offset;
+    };
+    typedef std::vector<TocOffset> TocOffsets;
+
+    LocsJournal() { }
+
+    /**
+     * @brief Open the journal of a book profile, replaying its content
+     *
+     * A journal from another profile, book version or layout revision is
+     * restarted.
+     *
+     * @return int16_t The number of items retrieved from the journal, -1 if
+     *                 the journal cannot be used
+     */
+    int16_t open(const std::string & filename, uint32_t key, int16_t item_count,
+                 PageIndex & page_index, PageCheckpoints & checkpoints, TocOffsets & toc_offsets);
+
+    /**
+     * @brief Append the pages location of an item
+     */
+    bool append(int16_t                       itemref_index, 
+                const PageIndex::Entries    & entries, 
+                const PageCheckpoints::Item & item_checkpoints,
+                const TocOffsets            & toc_offsets);
+
+    /**
+     * @brief Remove the journal file. Done once the .locs file is saved.
+     */
+    void remove();
+
+    inline bool is_open() const { return !filename.empty(); }
+
+  private:
+    static constexpr const char *  TAG         = "LocsJournal";
+    static constexpr const uint8_t JNL_VERSION = 1;
+
+    #pragma pack(push, 1)
+    struct Header {
+      uint8_t  version;
+      uint8_t  layout;       ///< LAYOUT_REVISION
+      int16_t  item_count;
+      uint32_t key;
+    };
+
+    struct RecordHeader {
+      int16_t  itemref_index;
+      int16_t  toc_count;
+      int32_t  entry_count;
+      int32_t  page_count;   ///< Number of pages with checkpoints (0 or entry_count)
+      int32_t  step_count;
+      uint32_t checksum;     ///< Of the entries, first steps, steps and toc offsets
+    };
+    #pragma pack(pop)
+
+    std::string filename;
+
+    bool create(const Header & header);
+};
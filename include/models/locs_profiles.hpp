@@ -0,0 +1,94 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * class LocsProfiles - Pages location files kept for a book
+ *
+ * The pages location (.locs), page checkpoints (.chk) and table of content
+ * (.toc) files of a book depend on the formatting parameters (font, font
+ * size, orientation, etc.). Instead of a single set of files, overwritten
+ * each time a parameter is changed, up to max_count profiles are kept per
+ * book, keyed by a hash of the formatting parameters:
+ *
+ *   <book>-<key>.locs, <book>-<key>.chk, <book>-<key>.toc
+ *
+ * The list of profiles is kept in the <book>.prof file, most recently used
+ * first. When a profile is added, the least recently used ones are removed
+ * until both the count and size budget are respected. The most recently
+ * used profile is never removed.
+ */
+
+class LocsProfiles
+{
+  public:
+    #pragma pack(push, 1)
+    struct Profile {
+      uint32_t key;
+      int32_t  size;  ///< .locs + .chk + .toc files size
+    };
+    #pragma pack(pop)
+
+    LocsProfiles(int8_t max_count, int32_t budget) :
+      max_count(max_count), budget(budget) { }
+
+    /**
+     * @brief Select the book and retrieve its list of profiles
+     */
+    void set_book(const std::string & epub_filename);
+
+    std::string get_filename(uint32_t key, const char * ext) const;
+
+    /**
+     * @brief Mark a profile as the most recently used one
+     *
+     * @return false The profile is unknown
+     */
+    bool touch(uint32_t key);
+
+    /**
+     * @brief Add (or refresh) a profile whose files have just been saved
+     *
+     * The least recently used profiles are removed as needed.
+     */
+    void add(uint32_t key);
+
+    /**
+     * @brief Remove a profile and its files
+     */
+    void remove(uint32_t key);
+
+    /**
+     * @brief Remove every profile files of a book, including files from
+     * previous versions (<book>.locs, <book>.toc) and the journals of
+     * computations not completed (<book>-<key>.jnl)
+     */
+    static void remove_all(const std::string & epub_filename);
+
+    /**
+     * @brief Hash of a formatting parameters structure (FNV-1a)
+     */
+    static uint32_t key_of(const void * params, int32_t size);
+
+    inline const std::vector<Profile> & get_profiles() const { return profiles; }
+    inline const std::string &          get_base()     const { return base;     }
+
+  private:
+    static constexpr const char *  TAG          = "LocsProfiles";
+    static constexpr const uint8_t PROF_VERSION = 1;
+
+    int8_t               max_count;
+    int32_t              budget;
+    std::string          base;      ///< Book filename without extension
+    std::vector<Profile> profiles;  ///< Most recently used first
+
+    void remove_files(uint32_t key) const;
+    bool save() const;
+    static int32_t file_size(const std::string & filename);
+};
@@ -0,0 +1,91 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * class PageCheckpoints - Where to resume the layout of a page
+ *
+ * For each page of a book, the path of XML nodes leading to the page
+ * start is kept, from the <body> node down. Every step is the index of
+ * the child node to go into and the item offset when entering it. As the
+ * offsets only depend on the item content, the HTMLInterpreter can go
+ * directly into the path nodes, bypassing the layout of all the preceding
+ * siblings.
+ *
+ * The format of the path ancestors is computed as usual when going down
+ * the path. A path may be truncated: the layout of the remaining nodes
+ * will then be done from the start of the last path node.
+ *
+ * The checkpoints are computed by the PageLocs retrievers, at the same
+ * time as the pages location, and saved in a .chk file beside the .locs
+ * file. They are not required: without them, a page is laid out from the
+ * beginning of its item.
+ */
+
+class PageCheckpoints
+{
+  public:
+    static constexpr const int8_t MAX_PATH_LENGTH = 8;
+
+    struct Step {
+      int32_t offset;       ///< Item offset when entering the node
+      int16_t child_index;  ///< Index of the node in its parent's children
+      int16_t reserved;
+    };
+
+    // Checkpoints of the pages of an item, in the same order as in the
+    // PageIndex: the steps of page pg are steps[first_step[pg]] to
+    // steps[first_step[pg + 1] - 1].
+    struct Item {
+      std::vector<int32_t> first_step;
+      std::vector<Step>    steps;
+
+      void clear() { first_step.clear(); steps.clear(); }
+      void add_page(const Step * path, int16_t length) {
+        if (first_step.empty()) first_step.push_back(0);
+        steps.insert(steps.end(), path, path + length);
+        first_step.push_back(steps.size());
+      }
+      inline int32_t get_page_count() const {
+        return first_step.empty() ? 0 : first_step.size() - 1;
+      }
+    };
+
+    void clear(int16_t item_count);
+
+    /**
+     * @brief Set the checkpoints of an item. The received item is left empty.
+     */
+    void set_item(int16_t itemref_index, Item & item);
+
+    /**
+     * @brief Retrieve the path to the start of page pg of an item
+     *
+     * @return false No checkpoint for this page
+     */
+    bool get(int16_t itemref_index, int32_t pg, const Step * & path, int16_t & length) const;
+
+    /**
+     * @brief Check that checkpoints are present for every page of an item
+     */
+    inline bool is_valid(int16_t itemref_index, int32_t page_count) const {
+      return (itemref_index >= 0) &&
+             (itemref_index < (int16_t) items.size()) &&
+             (items[itemref_index].get_page_count() == page_count);
+    }
+
+    bool load(const std::string & filename, int16_t item_count);
+    bool save(const std::string & filename) const;
+
+  private:
+    static constexpr const char *  TAG         = "PageCheckpoints";
+    static constexpr const uint8_t CHK_VERSION = 1;
+
+    std::vector<Item> items;
+};
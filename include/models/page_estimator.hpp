@@ -0,0 +1,77 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include <mutex>
+#include <vector>
+
+/**
+ * class PageEstimator - Approximate pages count and position
+ *
+ * While the pages location are being computed, the number of pages of an
+ * item not yet computed is estimated from its uncompressed size, as found in
+ * the zip central directory, using a bytes per page ratio calibrated with the
+ * items already computed. The position inside such an item is estimated in
+ * the same way with an offsets per page ratio. The estimation is refined each
+ * time an item is computed.
+ *
+ * Items that are not XHTML (images in the spine) have a negative size and are
+ * estimated as a single page.
+ *
+ * The retrievers add computed items while the viewer is retrieving the
+ * estimations: all methods are thread safe.
+ */
+
+class PageEstimator
+{
+  public:
+    /// Ratios used until the first item is computed
+    static constexpr int32_t DEFAULT_BYTES_PER_PAGE   = 3000;
+    static constexpr int32_t DEFAULT_OFFSETS_PER_PAGE = 1500;
+
+    PageEstimator() : computed_size(0), computed_pages(0), computed_offsets(0) { }
+
+    /**
+     * @brief Restart the estimation for a new book or formatting parameters
+     *
+     * @param item_sizes The uncompressed size of every spine item
+     */
+    void clear(const std::vector<int32_t> & item_sizes);
+
+    /**
+     * @brief Calibrate with an item whose pages location are now known
+     *
+     * @param page_count Number of visible pages of the item
+     * @param offset_count Offset just after the last page of the item
+     */
+    void set_item(int16_t itemref_index, int32_t page_count, int32_t offset_count);
+
+    int16_t get_page_count();
+
+    /**
+     * @brief Estimated page number of a position
+     *
+     * @param pg The page index in the item if the item is computed, -1 otherwise
+     * @return int16_t The page number (0 = first page), -1 if unknown
+     */
+    int16_t get_page_nbr(int16_t itemref_index, int32_t offset, int32_t pg = -1);
+
+  private:
+    static constexpr const char * TAG = "PageEstimator";
+
+    struct Item {
+      int32_t size;        ///< Uncompressed size, -1 if not XHTML
+      int32_t page_count;  ///< -1 if not computed yet
+    };
+
+    std::mutex        mutex;
+    std::vector<Item> items;
+    int64_t           computed_size;     ///< Sum of the size of the XHTML items computed
+    int64_t           computed_pages;    ///< Sum of their pages count
+    int64_t           computed_offsets;  ///< Sum of their offsets count
+
+    int32_t item_page_count(const Item & item) const;
+};
@@ -0,0 +1,178 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include <vector>
+#include <ostream>
+#include <atomic>
+
+/**
+ * class PageIndex - Flat pages location index
+ *
+ * Pages location of a book, kept as one sorted vector of {offset, size}
+ * per item (an HTML file in the spine). A page is identified by its item
+ * index and its position (pg) in the item's vector.
+ *
+ * Once all items are known, the first page number of each item is computed
+ * (prefix array), such that a page number can be found from a position and
+ * a position from a page number without going through all pages.
+ *
+ * Pages with a negative size are hidden: they are not counted nor displayed.
+ *
+ * The entries of an item are either owned by the index (computed items) or
+ * located in an external memory block (a memory mapped or loaded .locs file,
+ * see attach()). In the latter case, the block must remain available until
+ * the index is cleared.
+ *
+ * An item is published by set_item() at most once between two clear(): its
+ * computed flag is set last (release), and the item content is only accessed
+ * once is_computed() returned true (acquire). As such, set_item() can be
+ * called by a thread while others are reading items already published.
+ * Calls to set_item() must not be concurrent. All other modifiers
+ * (clear(), attach(), compute_page_numbers()) require exclusive access. The
+ * locking is done by the PageLocs class.
+ */
+
+class PageIndex
+{
+  public:
+    struct Entry {
+      int32_t offset;
+      int32_t size;
+    };
+    typedef std::vector<Entry> Entries;
+
+    // Item description as written in a .locs file, preceding the entries
+    struct ItemRecord {
+      int32_t first_entry;    ///< Index of the item's first entry in the file
+      int16_t first_page_nbr;
+      int16_t hidden_count;
+    };
+
+  private:
+    struct Item {
+      Entries           entries;
+      const Entry     * data;           ///< entries.data() or location in an external block
+      int32_t           size;
+      int16_t           first_page_nbr; ///< Page number of the first visible page of the item
+      int16_t           hidden_count;   ///< Number of hidden pages in the item
+      std::atomic<bool> computed;       ///< The item's pages location are known (published)
+      Item() : data(nullptr), size(0), first_page_nbr(0), hidden_count(0), computed(false) {}
+      Item(const Item & other) :
+               entries(other.entries),
+                  data((other.data == other.entries.data()) ? entries.data() : other.data),
+                  size(other.size),
+        first_page_nbr(other.first_page_nbr),
+          hidden_count(other.hidden_count),
+              computed(other.computed.load()) {}
+    };
+
+    std::vector<Item>    items;
+    std::atomic<int32_t> entry_count;
+    int16_t              page_count;
+
+  public:
+    PageIndex() : entry_count(0), page_count(0) {}
+
+    /**
+     * @brief Clear the index
+     *
+     * @param item_count The number of items in the book
+     */
+    void clear(int16_t item_count);
+
+    /**
+     * @brief Set the pages of an item
+     *
+     * The entries are expected to be sorted by offset. Their content is
+     * moved into the index, the received vector is left empty.
+     *
+     * @return false The item index is out of range
+     */
+    bool set_item(int16_t itemref_index, Entries & entries);
+
+    /**
+     * @brief Use item records and entries located in a memory block
+     *
+     * The block contains item_count ItemRecord followed by entry_count
+     * Entry. Nothing is copied: the block must stay available and unchanged
+     * until the next clear().
+     *
+     * @return false The records are not coherent
+     */
+    bool attach(const uint8_t * block, int16_t item_count, int32_t entry_count);
+
+    /**
+     * @brief Write item records and entries, as expected by attach()
+     */
+    bool write(std::ostream & out) const;
+
+    /**
+     * @brief Checksum of the data written by write()
+     */
+    uint32_t get_checksum() const;
+
+    static uint32_t checksum(const void * data, int32_t size, uint32_t hash = 2166136261UL);
+
+    inline int32_t get_serialized_size() const {
+      return items.size() * sizeof(ItemRecord) + entry_count * sizeof(Entry);
+    }
+
+    /**
+     * @brief Compute the first page number of every item
+     *
+     * @return int16_t The number of visible pages in the book
+     */
+    int16_t compute_page_numbers();
+
+    /**
+     * @brief Find the page starting exactly at offset
+     *
+     * @return int32_t The page position in the item, -1 if not found
+     */
+    int32_t find(int16_t itemref_index, int32_t offset) const;
+
+    /**
+     * @brief Find the page containing offset
+     *
+     * @return int32_t The page position in the item, -1 if not found
+     */
+    int32_t find_containing(int16_t itemref_index, int32_t offset) const;
+
+    /**
+     * @brief Page number of a page. Requires compute_page_numbers().
+     *
+     * @return int16_t The page number (0 = first page), -1 if hidden
+     */
+    int16_t get_page_nbr(int16_t itemref_index, int32_t pg) const;
+
+    /**
+     * @brief Retrieve the page position from a page number. Requires
+     * compute_page_numbers().
+     *
+     * @param page_nbr Page number (0 = first page)
+     * @return false page_nbr is out of range
+     */
+    bool get_page_pos(int16_t page_nbr, int16_t & itemref_index, int32_t & pg) const;
+
+    inline bool is_computed(int16_t itemref_index) const {
+      return (itemref_index >= 0) &&
+             (itemref_index < (int16_t) items.size()) &&
+             items[itemref_index].computed.load(std::memory_order_acquire);
+    }
+
+    inline int16_t get_item_count() const { return items.size(); }
+    inline int32_t get_entry_count() const { return entry_count; }
+    inline int16_t get_page_count() const { return page_count; }
+
+    inline int32_t get_item_size(int16_t itemref_index) const {
+      return items[itemref_index].size;
+    }
+
+    inline const Entry & get(int16_t itemref_index, int32_t pg) const {
+      return items[itemref_index].data[pg];
+    }
+};
@@ -7,12 +7,9 @@
 
 #include <thread>
 #include <mutex>
-#include <map>
-#include <set>
 
 #if EPUB_LINUX_BUILD
   #include <fcntl.h>
-  #include <mqueue.h>
   #include <sys/stat.h>
 #else
   #include "freertos/FreeRTOS.h"
@@ -23,6 +20,11 @@
 
 #include "models/epub.hpp"
 #include "models/dom.hpp"
+#include "models/page_index.hpp"
+#include "models/page_checkpoints.hpp"
+#include "models/locs_profiles.hpp"
+#include "models/locs_journal.hpp"
+#include "models/page_estimator.hpp"
 #include "viewers/page.hpp"
 #include "viewers/html_interpreter.hpp"
 
@@ -34,9 +36,41 @@
  * This class is used to compute every page locations for an ebook. This is
  * required to get fast retrieval of a page when required by the user. Page
  * locations are saved on disk once computed. Any change of font, font size,
- * screen orientation (portrait <-> landscape) will trigger a recomputation.
+ * screen orientation (portrait <-> landscape) will trigger a recomputation,
+ * unless the locations for these parameters have been kept from a previous
+ * computation (see LocsProfiles). The number of profiles kept per book and
+ * their total size are set with the PAGE_LOCS_PROFILE_COUNT and
+ * PAGE_LOCS_PROFILE_BUDGET defines.
+ *
+ * Items are journaled as soon as they are computed (see LocsJournal): a
+ * computation interrupted by closing the book or a reboot is resumed with
+ * the missing items only.
+ *
+ * The computation is done by a pool of retriever threads. Each of them lays
+ * out a complete item (an HTML file in the spine) using its own context, the
+ * resulting pages being merged in the pages map once the item is completed.
+ * A merged item is published atomically (see PageIndex): the readers are
+ * never blocked by the retrievers, and the retrievers never wait for the
+ * readers. The retrievers only serialize between themselves while merging.
+ * The number of retrievers can be forced at build time with the
+ * PAGE_LOCS_RETRIEVER_COUNT define (0 = one per core).
+ *
+ * Until all items are computed, the page count and page numbers are only
+ * available as estimations (see PageEstimator).
  */
 
+#ifndef PAGE_LOCS_RETRIEVER_COUNT
+  #define PAGE_LOCS_RETRIEVER_COUNT 0
+#endif
+
+#ifndef PAGE_LOCS_PROFILE_COUNT
+  #define PAGE_LOCS_PROFILE_COUNT 4
+#endif
+
+#ifndef PAGE_LOCS_PROFILE_BUDGET
+  #define PAGE_LOCS_PROFILE_BUDGET (512 * 1024)
+#endif
+
 class PageLocs
 {
   public:
@@ -62,108 +96,181 @@ class PageLocs
       }
       PageInfo() {};
     };
-    typedef std::pair<const PageId, PageInfo> PagePair;
+
+    static constexpr const int8_t MAX_RETRIEVER_COUNT = 8;
+
+    // Everything a retriever thread needs to compute the pages location
+    // of an item, independently of the other retrievers.
+    struct RetrieverContext {
+      Page               page_out;
+      EPub::ItemInfo     item_info;
+      PageIndex::Entries     pages;       ///< Pages found in the item, waiting to be merged
+      PageCheckpoints::Item  checkpoints; ///< Checkpoint of each page in pages
+      uint16_t               generation;  ///< Document generation the item is computed for
+    };
 
   private:
     static constexpr const char * TAG               = "PageLocs";
-    static constexpr const int8_t LOCS_FILE_VERSION = 3;
+    static constexpr const int8_t LOCS_FILE_VERSION = 4;
+
+    // .locs file header (version 4). It is followed by the PageIndex item
+    // records and page entries. Its size keeps them 32 bits aligned such that
+    // the file content can be used in place.
+    #pragma pack(push, 1)
+    struct LocsHeader {
+      int8_t                 version;
+      EPub::BookFormatParams format_params;
+      int16_t                item_count;
+      int16_t                page_count;   ///< Visible pages
+      int32_t                entry_count;  ///< All pages, including hidden ones
+      uint32_t               checksum;     ///< Of the item records and page entries
+      uint32_t               layout;       ///< LAYOUT_REVISION
+    };
+    #pragma pack(pop)
 
-    Page page_out;
+    uint8_t * locs_data;       ///< .locs file content used by the page_index (mmap on Linux)
+    int32_t   locs_data_size;
 
     bool    completed;
     int16_t page_count;
-
-    DOM * dom;
-    
-    struct PageCompare {
-      bool operator() (const PageId & lhs, const PageId & rhs) const { 
-        if (lhs.itemref_index < rhs.itemref_index) return true;
-        if (lhs.itemref_index > rhs.itemref_index) return false;
-        return lhs.offset < rhs.offset; 
-      }
-    };
-    typedef std::map<PageId, PageInfo, PageCompare> PagesMap;
-    typedef std::set<int16_t> ItemsSet;
+    int8_t  retriever_count;
+    int16_t reading_itemref;  ///< Last reading position sent to the state task
+    int32_t asap_wait_count;  ///< Number of times the user had to wait for an item (retrieve_asap())
+    int32_t asap_wait_time;   ///< Total time waited, in milliseconds
+    int32_t merge_wait_time;  ///< Total time retrievers waited for the merge_mutex, in microseconds
 
     std::recursive_timed_mutex  mutex;
+    std::mutex                  merge_mutex;  ///< One retriever at a time is merging its pages
 
     std::thread state_thread;
-    std::thread retriever_thread;
+    std::thread retriever_threads[MAX_RETRIEVER_COUNT];
 
-    PagesMap  pages_map;
-    ItemsSet  items_set;
-    int16_t   item_count;
+    PageIndex       page_index;
+    PageCheckpoints checkpoints;
+    int16_t         item_count;
 
     void show();
     bool retrieve_asap(int16_t itemref_index);
-    PagesMap::iterator check_and_find(const PageId & page_id);
+    bool    item_ready(int16_t itemref_index);    ///< Retrieve the item pages location if not already done
+    int32_t check_and_find(const PageId & page_id); ///< Position of the page in its item, -1 if not found
+    bool  step_forward(int16_t & itemref_index, int32_t & pg);
+    bool step_backward(int16_t & itemref_index, int32_t & pg);
+    bool get_first_page_id(PageId & id);
 
     // ----- Page Locations computation -----
     
-    EPub::ItemInfo         item_info;    
     EPub::BookFormatParams current_format_params;
+    LocsProfiles           profiles;
+    uint32_t               profile_key;   ///< Hash of current_format_params
+    LocsJournal            journal;
+    PageEstimator          estimator;
 
-    //int32_t           current_offset;          ///< Where we are in current item
-    //int32_t           start_of_page_offset;
-    int16_t           page_bottom;
-    bool              show_images;
-    //bool              start_of_paragraph;  ///< Required to manage paragraph indentation at beginning of new page.
-    
-    //bool           page_end(Page::Format & fmt);
-    //bool  page_locs_recurse(pugi::xml_node node, Page::Format fmt, DOM::Node * dom_node);
+    void insert_item(int16_t itemref_index, PageIndex::Entries & entries, PageCheckpoints::Item & item_checkpoints);
+    void calibrate_estimator(int16_t itemref_index); ///< Using a computed item
 
-    bool load(const std::string & epub_filename); ///< load pages location from .locs file
-    bool save(const std::string & epub_filename); ///< save pages location to .locs file
+    bool load(); ///< load pages location from the current profile .locs file
+    bool save(); ///< save pages location to the current profile .locs file
+    bool attach_locs_data();
+    bool map_locs_file(const std::string & filename);
+    void release_locs_data();
 
   public:
 
     PageLocs() : 
-      completed(false), 
-      page_count(0),
-      item_count(0)
+            locs_data(nullptr),
+       locs_data_size(0),
+            completed(false), 
+           page_count(0),
+      retriever_count(0),
+      reading_itemref(-1),
+      asap_wait_count(0),
+       asap_wait_time(0),
+      merge_wait_time(0),
+           item_count(0),
+             profiles(PAGE_LOCS_PROFILE_COUNT, PAGE_LOCS_PROFILE_BUDGET),
+          profile_key(0)
       { };
 
     void setup();
     void abort_threads();
-    bool build_page_locs(int16_t itemref_index);
+    bool build_page_locs(RetrieverContext & ctx, int16_t itemref_index);
+    bool           merge(RetrieverContext & ctx);
+
+    bool     get_next_page_id(const PageId & page_id, PageId & next_id, int16_t count = 1);
+    bool     get_prev_page_id(const PageId & page_id, PageId & prev_id, int     count = 1);
+    bool          get_page_id(const PageId & page_id, PageId & id);
+    bool get_page_id_from_nbr(int16_t page_nbr, PageId & id); ///< page_nbr starts at 1
+    bool        get_page_info(const PageId & page_id, PageInfo & info);
+
+    /**
+     * @brief Retrieve the checkpoint of a page, to be used by the HTMLInterpreter
+     *
+     * @param path Receives up to PageCheckpoints::MAX_PATH_LENGTH steps
+     * @return false No checkpoint available for the page
+     */
+    bool  get_page_checkpoint(const PageId & page_id, PageCheckpoints::Step * path, int16_t & length);
+    int16_t      get_page_nbr(const PageId & page_id);
+
+    /**
+     * @brief Page following (or preceding) a page, without waiting
+     *
+     * Only the items already computed are considered: no retrieval is
+     * requested and there is no wrap around at the ends of the book.
+     *
+     * @return false The page is not known yet
+     */
+    bool            peek_page(const PageId & page_id, bool forward, PageId & id, PageInfo & info);
+
+    /**
+     * @brief Page number and count, estimated if the computation is not completed
+     */
+    int16_t get_estimated_page_nbr(const PageId & page_id);
+    inline int16_t get_estimated_page_count() { return completed ? page_count : estimator.get_page_count(); }
+    inline bool                is_completed() { return completed; }
 
-    const PageId * get_next_page_id(const PageId & page_id, int16_t count = 1);
-    const PageId * get_prev_page_id(const PageId & page_id, int     count = 1);
-    const PageId *      get_page_id(const PageId & page_id                   );
-    const PageId *      get_page_id_from_nbr(int16_t page_nbr);
+    int32_t get_computed_page_count() { return page_index.get_entry_count(); }
+    int8_t      get_retriever_count() { return retriever_count;              }
+    int32_t     get_asap_wait_count() { return asap_wait_count;              }
+    int32_t      get_asap_wait_time() { return asap_wait_time;               }
+    int32_t     get_merge_wait_time() { return merge_wait_time;              }
 
-    uint16_t   get_current_itemref_index() { return item_info.itemref_index; }
-    const EPub::ItemInfo & get_item_info() { return item_info;               }
-    const PagesMap       & get_pages_map() { return pages_map;               }
+    /**
+     * @brief Inform the retrieval process of the item being read
+     *
+     * While the pages location are being computed, the items around the
+     * reading position are retrieved first, to limit the waits in
+     * retrieve_asap().
+     */
+    void set_reading_position(int16_t itemref_index);
+
+    /**
+     * @brief Item already known at document start (loaded from the journal)
+     *
+     * No locking: only used by the state task when a document is started,
+     * before any retriever is working on it.
+     */
+    inline bool is_item_computed(int16_t itemref_index) const { return page_index.is_computed(itemref_index); }
+
+    /**
+     * @brief Table of content filename for the current formatting parameters
+     */
+    inline std::string get_toc_filename() const { return profiles.get_filename(profile_key, ".toc"); }
 
     void check_for_format_changes(int16_t count, int16_t itemref_index, bool force = false);
     void    computation_completed();
     void       start_new_document(int16_t count, int16_t itemref_index);
     void            stop_document();
 
-    inline const PageInfo* get_page_info(const PageId & page_id) {
-      std::scoped_lock   guard(mutex);
-      PagesMap::iterator it = check_and_find(page_id);
-      return it == pages_map.end() ? nullptr : &it->second;
-    }
-
-    bool insert(PageId & id, PageInfo & info);
-
     inline void clear() { 
-      std::scoped_lock guard(mutex);
-      pages_map.clear(); 
-      items_set.clear();
+      std::scoped_lock guard(mutex, merge_mutex);
+      page_index.clear(item_count);
+      checkpoints.clear(item_count);
+      release_locs_data();
       completed = false; 
     }
 
     inline int16_t get_page_count() { return completed ? page_count : -1; }
 
-    inline int16_t get_page_nbr(const PageId & id) {
-      std::scoped_lock guard(mutex);
-      if (!completed) return -1; 
-      const PageInfo * info = get_page_info(id);
-      return info == nullptr ? -1 : info->page_number;
-    };
 };
 
 #if __PAGE_LOCS__
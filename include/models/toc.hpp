@@ -126,10 +126,19 @@ class TOC
      * page_id received.
      * 
      * @param id HTML id attribute that is part of an item.
+     * @param itemref_index The item being processed (multiple retrievers may run at once).
      * @param current_offset The location offset of the id in the item
      */
-    void set(std::string & id, int32_t current_offset);
-    void set(int32_t current_offset);
+    void set(std::string & id, int16_t itemref_index, int32_t current_offset);
+    void set(int16_t itemref_index, int32_t current_offset);
+
+    /**
+     * @brief set the offset of a table of content entry
+     * 
+     * Used to restore the entries located by a previous computation
+     * (see LocsJournal).
+     */
+    void set_entry_offset(int16_t entry_index, int32_t offset);
     
   private:
     static constexpr char const * TAG            = "TOC";
@@ -6,6 +6,9 @@
 #include "global.hpp"
 
 #include "models/font.hpp"
+#include "models/glyph_atlas.hpp"
+#include "models/font_stream.hpp"
+#include "models/kern_table.hpp"
 #include "memory_pool.hpp"
 
 #include <ft2build.h>
@@ -16,20 +19,37 @@
 #include <unordered_map>
 #include <forward_list>
 #include <mutex>
+#include <atomic>
+
+// Font files read on demand (FontStream) instead of being loaded in memory
+#ifndef TTF_STREAMING
+  #define TTF_STREAMING 1
+#endif
 
 class TTF : public Font
 {
   private:
     static constexpr char const * TAG = "TTF";
 
-    FT_Face    face;
-    std::mutex mutex;
+    FT_Face      face;
+    FontStream * font_stream;
+    uint32_t     font_hash;   ///< Identifies the font data in the glyph atlases
+
+    typedef std::unordered_map<uint32_t, GlyphAtlas *> Atlases;   ///< By pixel resolution and size
+    Atlases      atlases;
+
+    KernTable         kern_table;    ///< Retrieved when a pair is first required
+    KernPairs         kern_pairs;    ///< Pairs met, by size
+    std::atomic<bool> has_kerning;   ///< False once the face is known to have no kerning
 
   public:
     TTF(const std::string & filename);
     TTF(unsigned char * buffer, int32_t size);
+    TTF(FontStream * stream);
    ~TTF();
 
+    inline uint32_t get_font_hash() const { return font_hash; }
+
     // /**
     //  * @brief Get a glyph object
     //  * 
@@ -46,36 +66,44 @@ class TTF : public Font
     //   Glyph * get_glyph(int32_t charcode, int16_t glyph_size);
     // #endif
 
-    Glyph * adjust_ligature_and_kern(Glyph   * glyph, 
-                                     uint16_t  glyph_size, 
-                                     uint32_t  next_charcode,
-                                     int16_t & kern, 
-                                     bool    & ignore_next) { 
-      kern = 0; ignore_next = false; return glyph; 
-    }
+    using Font::get_glyph;
 
-  /**
-     * @brief Face normal line height
-     * 
+    /**
+     * @brief Get a glyph and its advance, kerned with the next glyph
      * 
-     * @return int32_t Normal line height of the face in pixels
+     * The kern returned is the glyph advance adjusted by the kerning of
+     * the pair (see get_kern()).
      */
-    int32_t get_line_height(int16_t glyph_size)  {
-      std::scoped_lock guard(mutex);
-      if (current_font_size != glyph_size) set_font_size(glyph_size); 
-      return (face == nullptr) ? 0 : (face->size->metrics.height >> 6); 
-    }
+    Glyph * get_glyph(uint32_t  charcode, 
+                      uint32_t  next_charcode, 
+                      int16_t   glyph_size,
+                      int16_t & kern,  
+                      bool    & ignore_next);
+
+    Glyph * get_glyph_metrics(uint32_t charcode, int16_t glyph_size);
+    Glyph * get_glyph_metrics(uint32_t  charcode, 
+                              uint32_t  next_charcode, 
+                              int16_t   glyph_size,
+                              int16_t & kern,  
+                              bool    & ignore_next);
 
     /**
-     * @brief Face descender height
+     * @brief Kerning of a pair of code points
+     * 
+     * Lock-free once the pair has been met at this size. The pairs are
+     * kept in the glyph atlas of the size, such that the kerning tables of
+     * the face are rarely required.
      * 
-     * @return int32_t The face descender height in pixels related to
-     *                 the current font size.
+     * @return int16_t The adjustment of the advance of charcode, in pixels
      */
-    int32_t get_descender_height(int16_t glyph_size) {
-      std::scoped_lock guard(mutex);
-      if (current_font_size != glyph_size) set_font_size(glyph_size);
-      return (face == nullptr) ? 0 : (face->size->metrics.descender >> 6); 
+    int16_t get_kern(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size);
+
+    Glyph * adjust_ligature_and_kern(Glyph   * glyph, 
+                                     uint16_t  glyph_size, 
+                                     uint32_t  next_charcode,
+                                     int16_t & kern, 
+                                     bool    & ignore_next) { 
+      kern = 0; ignore_next = false; return glyph; 
     }
 
   private:
@@ -95,6 +123,20 @@ class TTF : public Font
      */
     bool set_font_face_from_memory(unsigned char * buffer, int32_t size);
 
+    /**
+     * @brief Set the font face object from a stream
+     * 
+     * The font data is read when required by FreeType. The stream will be
+     * deleted when the face will be removed.
+     * 
+     * @param stream The font data stream
+     * @return true The font was retrieved.
+     * @return false Some error (file not found, unsupported format).
+     */
+    bool set_font_face_from_stream(FontStream * stream);
+
+    void set_font_hash(const uint8_t * head, int32_t head_size, int32_t font_size);
+
     /**
      * @brief Set the font size
      * 
@@ -107,5 +149,18 @@ class TTF : public Font
      */
     bool set_font_size(int16_t size);
 
-    Glyph * get_glyph_internal(uint32_t charcode, int16_t glyph_size);
+    bool          compute_size_metrics(int16_t glyph_size, int16_t & line_height, int16_t & descender_height);
+    Glyph *         get_glyph_internal(uint32_t charcode, int16_t glyph_size);
+    Glyph * get_glyph_metrics_internal(uint32_t charcode, int16_t glyph_size);
+
+    GlyphAtlas * get_atlas(int16_t glyph_size);
+
+    /**
+     * @brief Retrieve the glyphs of the charcode block from the atlas
+     * 
+     * @return Glyph * The charcode glyph, nullptr if not in the atlas
+     */
+    Glyph * load_from_atlas(uint32_t charcode, int16_t glyph_size);
+    int16_t get_kern_internal(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size);
+    void        save_glyphs(bool release);
 };
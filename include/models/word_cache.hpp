@@ -0,0 +1,136 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include "models/font.hpp"
+
+#include <atomic>
+#include <mutex>
+
+#ifndef WORD_CACHE_SLOT_COUNT
+  #if EPUB_LINUX_BUILD
+    #define WORD_CACHE_SLOT_COUNT 8192
+  #else
+    #define WORD_CACHE_SLOT_COUNT 2048
+  #endif
+#endif
+
+/**
+ * class WordCache - Shaped words
+ *
+ * The same words are measured while computing the pages location, while
+ * moving to the start of a page and when a page is shown. Once shaped by
+ * Page::add_word(), a word is kept here with its glyphs, their advances
+ * (kerning included) and its total width, such that the next passes don't
+ * have to decode and look up every character again.
+ *
+ * Words are keyed by font index, size, text transform and UTF-8 bytes. Only
+ * words of at most MAX_WORD_LENGTH bytes are kept. The cache is a two-way
+ * set associative table of WORD_CACHE_SLOT_COUNT slots (0 = no cache): its
+ * size is bounded and a new word replaces the least recently used of its
+ * set.
+ *
+ * The glyphs are pointers into the fonts caches: they are forgotten when
+ * the fonts generation moves forward. A request made with an older
+ * generation is a miss and its run is not kept. A run shaped with glyph
+ * metrics only (see Font::get_glyph_metrics()) is good for the layout of
+ * pages, but not for pages to be shown: such a run is replaced with
+ * rasterized glyphs when required.
+ *
+ * All methods are thread safe.
+ */
+
+class WordCache
+{
+  public:
+    static constexpr int8_t MAX_WORD_LENGTH = 23;
+
+    struct Key {
+      int16_t  font_index;
+      int16_t  font_size;
+      uint8_t  transform;
+      uint16_t generation;  ///< Fonts generation
+    };
+
+    struct Run {
+      Font::Glyph * glyphs[MAX_WORD_LENGTH];
+      int16_t       kerns[MAX_WORD_LENGTH];   ///< Advance of each glyph, kerning included
+      int16_t       width;
+      int8_t        glyph_count;
+      bool          rasterized;               ///< False if glyphs are metrics only
+    };
+
+    struct Stats {
+      int32_t hits;
+      int32_t misses;
+      int32_t shaping_time;  ///< Time spent shaping the missed words, in us
+    };
+
+    WordCache(int32_t slot_count);
+   ~WordCache();
+
+    /**
+     * @brief Retrieve a shaped word
+     *
+     * @param rasterized True if the glyphs must be rasterized
+     * @return true The run was found
+     */
+    bool get(const Key & key, const char * word, bool rasterized, Run & run);
+
+    /**
+     * @brief Keep a shaped word
+     *
+     * @param shaping_time Time taken to shape the word, in us (statistics only,
+     *                     measured when SHOW_TIMING is set)
+     */
+    void put(const Key & key, const char * word, const Run & run, int32_t shaping_time);
+
+    void clear();
+
+    inline Stats get_stats() const {
+      return { .hits = hits, .misses = misses, .shaping_time = shaping_time };
+    }
+
+    /**
+     * @brief Estimated time saved by the cache, in us
+     *
+     * Each hit is accounted as the average time taken to shape a missed word.
+     */
+    int32_t get_time_saved() const;
+
+    inline int16_t get_hit_rate() const {
+      int32_t total = hits + misses;
+      return (total == 0) ? 0 : (int64_t) hits * 100 / total;
+    }
+
+  private:
+    static constexpr char const * TAG = "WordCache";
+
+    struct Slot {
+      uint32_t hash;         ///< 0 = empty
+      Key      key;
+      uint8_t  length;
+      char     word[MAX_WORD_LENGTH];
+      Run      run;
+    };
+
+    std::mutex           mutex;
+    Slot               * slots;
+    uint8_t            * recent;       ///< Most recently used slot of each set
+    int32_t              set_count;
+    uint16_t             generation;
+    std::atomic<int32_t> hits, misses, shaping_time;
+
+    static uint32_t hash_of(const Key & key, const char * word, uint8_t length);
+    Slot *             find(const Key & key, const char * word, uint8_t length, uint32_t hash);
+    bool   check_generation(uint16_t gen);
+};
+
+#if __WORD_CACHE__
+  WordCache word_cache(WORD_CACHE_SLOT_COUNT);
+#else
+  extern WordCache word_cache;
+#endif
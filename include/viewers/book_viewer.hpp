@@ -5,6 +5,7 @@
 #pragma once
 #include "global.hpp"
 
+#include <atomic>
 #include <mutex>
 #include <unordered_map>
 
@@ -17,6 +18,7 @@
 
 #include "pugixml.hpp"
 #include "viewers/page.hpp"
+#include "viewers/page_cache.hpp"
 #include "models/epub.hpp"
 #include "models/page_locs.hpp"
 #include "models/css.hpp"
@@ -34,11 +36,51 @@ class BookViewer
   private:
     static constexpr char const * TAG = "BookViewer";
 
-    std::mutex        mutex;
-    int16_t           page_bottom;
-    PageLocs::PageId  current_page_id;
+    std::mutex            mutex;
+    int16_t               page_bottom;
+    PageLocs::PageId      current_page_id;
+
+    PageCache             page_cache;
+    std::mutex            render_mutex;       ///< Held by the render-ahead task while preparing a page
+    std::atomic<uint16_t> render_generation;  ///< Incremented to cancel pending render-ahead requests
+    bool                  render_task_started;
+    bool                  shown_prepared;     ///< The last page shown was prepared in advance
+    std::atomic<bool>     warming_up;         ///< Cleared to stop the glyphs warm-up
+
+    static constexpr int32_t WARM_UP_SIZE      = 16384;  ///< Item bytes laid out by the warm-up
+    static constexpr int8_t  WARM_UP_MAX_ITEMS = 3;
+
+    #if SHOW_TIMING
+      int32_t             show_count[2];      ///< Pages built [0] and prepared [1]
+      int32_t             show_time[2];
+    #endif
+
+    uint32_t         get_format_key();
+    void            get_page_format(Page::Format & fmt, int16_t & title_baseline_offset);
+    bool            build_page_body(Page                   & the_page,
+                                    const PageLocs::PageId & page_id,
+                                    int32_t                  page_size,
+                                    const EPub::ItemInfo   & item,
+                                    const Page::Format     & fmt);
+    void       add_title_and_bottom(const PageLocs::PageId & page_id, Page::Format fmt, int16_t title_baseline_offset);
+    void              build_page_at(const PageLocs::PageId & page_id);
 
-    void build_page_at(const PageLocs::PageId & page_id);
+    /**
+     * @brief Request the render-ahead task to prepare the pages around a page
+     *
+     * The next and previous pages are laid out in the background into the
+     * page cache, such that a page turn only has to paint them.
+     */
+    void               render_ahead(const PageLocs::PageId & page_id, uint32_t format_key, const Page::Format & fmt);
+    void          start_render_task();
+    void                render_task();
+
+    /**
+     * @brief Lay out the text from a page, and the following items, in a 
+     *        scratch page such that the glyphs get rasterized. Run by the
+     *        render-ahead task.
+     */
+    void             warm_up_glyphs(const PageLocs::PageId & page_id, const Page::Format & fmt, EPub::ItemInfo & item);
 
     struct PageEnd {
       bool operator()(Page::Format & fmt) const {
@@ -48,12 +90,41 @@ class BookViewer
 
   public:
 
-    BookViewer() { }
+    BookViewer() : 
+      page_cache(PAGE_CACHE_BUDGET), 
+      render_generation(0), 
+      render_task_started(false), 
+      shown_prepared(false),
+      warming_up(false) {
+      #if SHOW_TIMING
+        show_count[0] = show_count[1] = 0;
+        show_time[0]  = show_time[1]  = 0;
+      #endif
+    }
    ~BookViewer() { }
 
-    void                     init() { current_page_id = PageLocs::PageId(-1, -1); }
+    void                     init() { cancel_render_ahead(); current_page_id = PageLocs::PageId(-1, -1); }
     inline std::mutex & get_mutex() { return mutex; }
 
+    /**
+     * @brief Forget the pages prepared in advance
+     *
+     * Pending requests are dropped and the page being prepared, if any, is
+     * completed before returning. To be called when the document is closed
+     * or the book is left.
+     */
+    void cancel_render_ahead();
+
+    /**
+     * @brief Rasterize in the background the glyphs of a page to be shown
+     * 
+     * Called when a book is opened: the text from the page is laid out by
+     * the render-ahead task (at low priority) with the fonts and sizes set
+     * by the book CSS, while the page locations are retrieved and the 
+     * loading message is on screen. Stopped as soon as a page is built.
+     */
+    void warm_up(const PageLocs::PageId & page_id);
+
     /**
      * @brief Show a page on the display.
      * 
@@ -7,7 +7,9 @@
 
 #include "models/dom.hpp"
 #include "models/epub.hpp"
+#include "models/page_checkpoints.hpp"
 #include "viewers/page.hpp"
+#include "helpers/shared_memory_pool.hpp"
 #include "pugixml.hpp"
 
 using namespace pugi;
@@ -18,6 +20,10 @@ using namespace pugi;
 //
 // Tags that are understood are used to create a partial DOM structure that is then passed through the
 // CSS match algorithm to transform the viewing parameters as gathered in a Page::Format struc.
+//
+// The path of nodes being processed is maintained such that the location of a page start
+// can be kept as a checkpoint (see PageCheckpoints). When a checkpoint is supplied through
+// set_resume_path(), the nodes preceding the path are bypassed.
 
 class HTMLInterpreter
 {
@@ -41,7 +47,15 @@ class HTMLInterpreter
     int16_t from_page, to_page;
     int16_t max_level;
 
-    static MemoryPool<Page::Format> fmt_pool;
+    static SharedMemoryPool<Page::Format> fmt_pool;
+
+    PageCheckpoints::Step   path[PageCheckpoints::MAX_PATH_LENGTH]; ///< Nodes being processed, below <body>
+    int16_t                 path_length;
+    const PageCheckpoints::Step * resume_path;  ///< Checkpoint of the page to reach
+    int16_t                 resume_length;
+    int16_t                 resume_depth;       ///< Number of resume path steps done
+
+    void add_dom_placeholder(xml_node node, DOM::Node * dom_node);
 
     // The page_end method is responsible of doing post-processing once
     // the end of a page has been detected (the page.is_full() method returns true or
@@ -63,7 +77,11 @@ class HTMLInterpreter
         show_the_state(false), 
              from_page(-1), 
                to_page(-1),
-            max_level(0) {}
+            max_level(0),
+          path_length(0),
+          resume_path(nullptr),
+        resume_length(0),
+         resume_depth(0) {}
 
     virtual ~HTMLInterpreter() {}
 
@@ -74,9 +92,34 @@ class HTMLInterpreter
       start_offset       = start;
       end_offset         = end;
       show_images        = show_imgs;
+      path_length        = 0;
+      resume_path        = nullptr;
+      resume_length      = 0;
+      resume_depth       = 0;
       page.set_compute_mode(Page::ComputeMode::MOVE);
     }
 
+    /**
+     * @brief Go directly to the page start. To be called after set_limits().
+     *
+     * @param steps The page checkpoint. Must stay available until the page is built.
+     */
+    void set_resume_path(const PageCheckpoints::Step * steps, int16_t length) {
+      resume_path   = steps;
+      resume_length = length;
+      resume_depth  = 0;
+    }
+
+    /**
+     * @brief Path to the node being processed
+     *
+     * @return int16_t The path length, truncated to MAX_PATH_LENGTH
+     */
+    inline int16_t get_path(const PageCheckpoints::Step * & steps) const {
+      steps = path;
+      return path_length < PageCheckpoints::MAX_PATH_LENGTH ? path_length : PageCheckpoints::MAX_PATH_LENGTH;
+    }
+
     bool build_pages_recurse(xml_node node, Page::Format & fmt, DOM::Node * dom_node, int16_t level);
 
     void check_for_completion() {
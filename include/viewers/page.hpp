@@ -6,12 +6,10 @@
 #include "global.hpp"
 
 #include <string>
-#include <forward_list>
 
 #include "models/image.hpp"
 #include "models/fonts.hpp"
 #include "models/css.hpp"
-#include "memory_pool.hpp"
 
 #include "pugixml.hpp"
 
@@ -91,7 +89,72 @@ class Page
       DisplayListCommand command;      ///< Command
     };
 
-    typedef std::forward_list<DisplayListEntry *> DisplayList;
+    /**
+     * @brief Display list arena
+     * 
+     * Contiguous array of entries, kept in drawing order. The memory is
+     * retained from one page to the next: once the arena is large enough
+     * for a page, building and painting pages don't allocate memory.
+     */
+    class DisplayList 
+    {
+      public:
+        DisplayList() : entries(nullptr), count(0), capacity(0), allocation_count(0) { }
+       ~DisplayList() { release(); }
+
+        DisplayList(const DisplayList &) = delete;
+        DisplayList & operator=(const DisplayList &) = delete;
+
+        /**
+         * @brief New entry at the end of the list
+         * 
+         * @return DisplayListEntry * The entry, nullptr if out of memory
+         */
+        inline DisplayListEntry * add() {
+          if ((count >= capacity) && !grow(count + 1)) return nullptr;
+          return &entries[count++];
+        }
+
+        /**
+         * @brief New entry at index, the following entries being moved up
+         */
+        DisplayListEntry * insert(int32_t index);
+
+        /**
+         * @brief Append all entries of another list
+         */
+        bool append(const DisplayList & other);
+
+        /**
+         * @brief Release the arena memory
+         */
+        void release();
+
+        inline void    truncate(int32_t new_count)       { count = new_count;       }
+        inline void                        clear()       { count = 0;               }
+        inline int32_t                      size() const { return count;            }
+        inline bool                        empty() const { return count == 0;       }
+        inline int32_t              get_capacity() const { return capacity;         }
+        inline int32_t      get_allocation_count() const { return allocation_count; }
+
+        inline DisplayListEntry &       operator[](int32_t idx)       { return entries[idx]; }
+        inline const DisplayListEntry & operator[](int32_t idx) const { return entries[idx]; }
+
+        inline DisplayListEntry *       begin()       { return entries;         }
+        inline DisplayListEntry *         end()       { return entries + count; }
+        inline const DisplayListEntry * begin() const { return entries;         }
+        inline const DisplayListEntry *   end() const { return entries + count; }
+
+      private:
+        static constexpr int32_t MIN_CAPACITY = 256;
+
+        DisplayListEntry * entries;
+        int32_t            count;
+        int32_t            capacity;
+        int32_t            allocation_count;
+
+        bool grow(int32_t min_capacity);
+    };
 
     /**
      * @brief Book Compute Mode
@@ -104,10 +167,13 @@ class Page
      */
     ComputeMode compute_mode;
 
-    MemoryPool <DisplayListEntry> display_list_entry_pool;
-
+    // The line being prepared for a paragraph is at the end of the display list,
+    // starting at line_start. The line is committed by moving line_start to the 
+    // end of the list.
     DisplayList display_list;            ///< The list of artefacts and their position to put on screen
-    DisplayList line_list;               ///< Line preparation for paragraphs
+    DisplayList word_list;               ///< Glyphs of the word being added to the line
+    int32_t     line_start;              ///< Index of the first entry of the line in preparation
+    int16_t     image_count;             ///< Number of IMAGE entries in the display list
 
     bool screen_is_full;                 ///< True if screen no more space to add characters
 
@@ -119,11 +185,12 @@ class Page
     float   line_height_factor;
     int16_t para_indent, top_margin;
 
-    // Entries of a line list are eventually migrated to the display_list. 
-    // So the don't need to be erased.  
-    inline void clear_line_list() { line_list.clear(); }
+    inline void clear_line_list() { drop_entries(line_start); }
 
-    void clear_display_list();
+    void        clear_display_list();
+    void              drop_entries(int32_t from);
+    DisplayListEntry *   new_entry();
+    void         draw_display_list() const;
     void           add_line(const Format & fmt, bool justifyable);
     void  add_glyph_to_line(Font::Glyph * glyph, const Format & fmt, Font & font, bool is_space);
     void  add_image_to_line(Image & image, int16_t advance, const Format & fmt);
@@ -132,8 +199,16 @@ class Page
   public:
 
     Page();
+
     void clean();
 
+    /**
+     * @brief Clear the page and release the display list memory
+     * 
+     * The memory is otherwise kept from one page to the next.
+     */
+    void release_memory();
+
     /**
      * @brief Start a new page
      * 
@@ -275,6 +350,28 @@ class Page
      */
     void paint(bool clear_screen = true, bool no_full = false, bool do_it = false);
 
+    /**
+     * @brief Paint a page prepared in advance, with this page display list over it.
+     * 
+     * The screen is first erased. The prepared page display list is consumed.
+     * 
+     * @param prepared The page prepared in advance (see PageCache)
+     * @param no_full  Bypass partial update count control.
+     */
+    void paint_with(Page & prepared, bool no_full = false);
+
+    /**
+     * @brief Memory used by the display list, images included
+     */
+    int32_t get_display_list_size() const;
+
+    /**
+     * @brief Number of times the display list memory was allocated since the page creation
+     */
+    inline int32_t get_allocation_count() const { 
+      return display_list.get_allocation_count() + word_list.get_allocation_count(); 
+    }
+
     void show_fmt(const Format & fmt, const char * spaces) const {
       #if DEBUGGING
         std::cout       << spaces                  <<
@@ -333,10 +430,8 @@ class Page
     inline ComputeMode          get_compute_mode() const { return compute_mode;           }
     inline int16_t                   paint_width() const { return max_x - min_x;          }
     inline bool                          is_full() const { return screen_is_full;         }
-    inline bool                         is_empty() const { return display_list.empty();   }
-    inline bool                some_data_waiting() const { return !line_list.empty();     }
-    inline const DisplayList &  get_display_list() const { return display_list;           }
-    inline const DisplayList &     get_line_list() const { return line_list;              }
+    inline bool                         is_empty() const { return line_start == 0;        }
+    inline bool                some_data_waiting() const { return line_start < display_list.size(); }
     inline int16_t                     get_pos_y() const { return pos.y;                  }
 
     int16_t       get_pixel_value(const CSS::Value & value, const Format & fmt, int16_t ref, bool vertical = false);
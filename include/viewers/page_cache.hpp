@@ -0,0 +1,111 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#pragma once
+#include "global.hpp"
+
+#include "models/page_locs.hpp"
+#include "viewers/page.hpp"
+
+#include <mutex>
+
+#ifndef PAGE_CACHE_BUDGET
+  #if EPUB_LINUX_BUILD
+    #define PAGE_CACHE_BUDGET (2 * 1024 * 1024)
+  #else
+    #define PAGE_CACHE_BUDGET (512 * 1024)
+  #endif
+#endif
+
+/**
+ * class PageCache - Pages prepared in advance
+ *
+ * The pages around the one being shown are laid out in the background by
+ * the book viewer (see BookViewer::render_ahead()), such that a page turn
+ * only has to paint a display list already built.
+ *
+ * A prepared page is kept in a slot with its own Page instance, keyed by
+ * its PageId and the formatting parameters it was built with (including
+ * the fonts generation, as the display list refers to glyphs in the fonts
+ * caches). The memory used by the prepared display lists (images included)
+ * is limited to the budget set with the PAGE_CACHE_BUDGET define (0 = no
+ * render-ahead).
+ *
+ * All methods are thread safe.
+ */
+
+class PageCache
+{
+  public:
+    static constexpr int8_t SLOT_COUNT = 2;  ///< Next and previous pages
+
+    struct Key {
+      PageLocs::PageId page_id;
+      uint32_t         format_key;
+
+      Key() : page_id(-1, -1), format_key(0) { }
+      Key(const PageLocs::PageId & id, uint32_t fmt_key) : page_id(id), format_key(fmt_key) { }
+      bool operator==(const Key & other) const {
+        return (page_id.itemref_index == other.page_id.itemref_index) &&
+               (page_id.offset        == other.page_id.offset       ) &&
+               (format_key            == other.format_key           );
+      }
+    };
+
+    PageCache(int32_t budget) : budget(budget), used(0) { }
+
+    inline bool is_enabled() const { return budget > 0; }
+
+    /**
+     * @brief Reserve a slot to prepare a page
+     *
+     * Slots prepared for pages not in the keep list are reused.
+     *
+     * @param keep The keys of the pages to keep (SLOT_COUNT entries)
+     * @return Page * The page to build, nullptr if the page is already prepared
+     *                or no slot is available
+     */
+    Page * reserve(const Key & key, const Key * keep);
+
+    /**
+     * @brief Make a reserved page available, if it fits in the budget
+     */
+    void ready(Page * page);
+
+    /**
+     * @brief Get a prepared page. It must be released once painted.
+     *
+     * @return Page * The prepared page, nullptr if not available
+     */
+    Page * take(const Key & key);
+    void release(Page * page);
+
+    /**
+     * @brief Forget all prepared pages. Pages being prepared are dropped
+     * when ready.
+     */
+    void invalidate();
+
+  private:
+    static constexpr const char * TAG = "PageCache";
+
+    enum class State : uint8_t { FREE, BUILDING, READY, IN_USE };
+
+    struct Slot {
+      Page    page;
+      Key     key;
+      State   state;
+      bool    stale;  ///< Invalidated while being built
+      int32_t size;
+      Slot() : state(State::FREE), stale(false), size(0) { }
+    };
+
+    std::mutex mutex;
+    Slot       slots[SLOT_COUNT];
+    int32_t    budget;
+    int32_t    used;    ///< Memory used by the READY and IN_USE slots
+
+    Slot * find(const Page * page);
+    void   free(Slot & slot);
+};
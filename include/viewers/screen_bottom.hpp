@@ -10,7 +10,12 @@ class ScreenBottom
     static constexpr int16_t FONT      = 1;
     static constexpr int16_t FONT_SIZE = 9;
 
-    static void show(int16_t page_nbr = -1, int16_t page_count = -1);
+    /**
+     * @brief Show the bottom line of the screen
+     *
+     * @param estimated The page number and count are estimations, shown with a '~'
+     */
+    static void show(int16_t page_nbr = -1, int16_t page_count = -1, bool estimated = false);
 
   private:
     static constexpr char const * TAG = "ScreenBottom";
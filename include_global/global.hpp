@@ -28,6 +28,13 @@
 
 #define USE_EPUB_FONTS 1  ///< 1: Embeded fonts in EPub books are loaded and used 0: Only preset fonts are used
 
+#ifndef TTF_KERNING
+  #define TTF_KERNING 1   ///< 1: TrueType glyphs are kerned using the GPOS or kern table of the font
+#endif
+
+/// Saved with the pages location: to be changed when the text layout changes
+#define LAYOUT_REVISION (TTF_KERNING ? 1 : 0)
+
 #if EPUB_LINUX_BUILD
   #define MAIN_FOLDER "/home/turgu1/Dev/EPub-InkPlate/SDCard"
 #endif
@@ -35,10 +35,9 @@ BookController::enter()
   LOG_D("===> Enter()...");
 
   page_locs.check_for_format_changes(epub.get_item_count(), current_page_id.itemref_index);
-  const PageLocs::PageId * id = page_locs.get_page_id(current_page_id);
-  if (id != nullptr) {
-    current_page_id.itemref_index = id->itemref_index;
-    current_page_id.offset        = id->offset;
+  PageLocs::PageId id;
+  if (page_locs.get_page_id(current_page_id, id)) {
+    current_page_id = id;
   }
   else {
     current_page_id.itemref_index = 0;
@@ -52,6 +51,8 @@ BookController::leave(bool going_to_deep_sleep)
 {
   LOG_D("===> leave()...");
   
+  // The fonts or formatting parameters may change before coming back
+  book_viewer.cancel_render_ahead();
   books_dir_controller.save_last_book(current_page_id, going_to_deep_sleep);
 }
 
@@ -78,10 +79,13 @@ BookController::open_book_file(
       page_locs.check_for_format_changes(epub.get_item_count(), page_id.itemref_index);
     }
     book_viewer.init();
-    const PageLocs::PageId * id = page_locs.get_page_id(page_id);
-    if (id != nullptr) {
-      current_page_id.itemref_index = id->itemref_index;
-      current_page_id.offset        = id->offset;
+
+    // Glyphs are rasterized in the background while the page location is retrieved
+    book_viewer.warm_up(page_id);
+
+    PageLocs::PageId id;
+    if (page_locs.get_page_id(page_id, id)) {
+      current_page_id = id;
       // book_viewer.show_page(current_page_id);
       return true;
     }
@@ -115,7 +119,8 @@ BookController::open_book_file(
 
   void BookController::handle_swipe(const EventMgr::Event & event)
   {
-      const PageLocs::PageId * page_id = nullptr;
+      PageLocs::PageId page_id;
+      bool             found = false;
       int16_t safe_height = Screen::get_height() - SYSTEM_ZONE_HEIGHT;
 
       if (event.kind == EventMgr::EventKind::SWIPE_DOWN) {
@@ -127,23 +132,22 @@ BookController::open_book_file(
       if (event.y < safe_height) {
           // Normal Page Turn
           if (event.kind == EventMgr::EventKind::SWIPE_RIGHT) {
-              page_id = page_locs.get_prev_page_id(current_page_id);
+              found = page_locs.get_prev_page_id(current_page_id, page_id);
           } else if (event.kind == EventMgr::EventKind::SWIPE_LEFT) {
-              page_id = page_locs.get_next_page_id(current_page_id);
+              found = page_locs.get_next_page_id(current_page_id, page_id);
           }
       } 
       else {
           // Fast Page Turn (10 pages)
           if (event.kind == EventMgr::EventKind::SWIPE_RIGHT) {
-              page_id = page_locs.get_prev_page_id(current_page_id, 10);
+              found = page_locs.get_prev_page_id(current_page_id, page_id, 10);
           } else if (event.kind == EventMgr::EventKind::SWIPE_LEFT) {
-              page_id = page_locs.get_next_page_id(current_page_id, 10);
+              found = page_locs.get_next_page_id(current_page_id, page_id, 10);
           }
       }
 
-      if (page_id != nullptr) {
-          current_page_id.itemref_index = page_id->itemref_index;
-          current_page_id.offset        = page_id->offset;
+      if (found) {
+          current_page_id = page_id;
           book_viewer.show_page(current_page_id);
       }
   }
@@ -170,22 +174,22 @@ BookController::open_book_file(
       int16_t left_zone = screen_width / 3;
       int16_t right_zone = (screen_width / 3) * 2;
 
-      const PageLocs::PageId * page_id = nullptr;
+      PageLocs::PageId page_id;
+      bool             found = false;
 
       if (event.y < safe_height) {
         if (event.x < left_zone) {
-          page_id = page_locs.get_prev_page_id(current_page_id);
+          found = page_locs.get_prev_page_id(current_page_id, page_id);
         }
         else if (event.x > right_zone) {
-          page_id = page_locs.get_next_page_id(current_page_id);
+          found = page_locs.get_next_page_id(current_page_id, page_id);
         } else {           
           app_controller.set_controller(AppController::Ctrl::PARAM);
           return;
         }
 
-        if (page_id != nullptr) {
-            current_page_id.itemref_index = page_id->itemref_index;
-            current_page_id.offset        = page_id->offset;
+        if (found) {
+            current_page_id = page_id;
             book_viewer.show_page(current_page_id);
         }
       } else {           
@@ -202,9 +206,9 @@ BookController::open_book_file(
 
             LOG_D("Jumping to page %d / %d (%.2f%%)", target_page_num, page_count, percentage * 100);
 
-            const PageLocs::PageId * pid = page_locs.get_page_id_from_nbr(target_page_num);
-            if (pid != nullptr) {
-            current_page_id = *pid;
+            PageLocs::PageId pid;
+            if (page_locs.get_page_id_from_nbr(target_page_num, pid)) {
+            current_page_id = pid;
             book_viewer.show_page(current_page_id);
             }
         }
@@ -214,17 +218,17 @@ BookController::open_book_file(
   void 
   BookController::input_event(const EventMgr::Event & event)
   {
-    const PageLocs::PageId * page_id;
+    PageLocs::PageId page_id;
+    bool             found;
     switch (event.kind) {
       #if EXTENDED_CASE
         case EventMgr::EventKind::DBL_PREV:
       #else
         case EventMgr::EventKind::PREV:
       #endif
-        page_id = page_locs.get_prev_page_id(current_page_id);
-        if (page_id != nullptr) {
-          current_page_id.itemref_index = page_id->itemref_index;
-          current_page_id.offset        = page_id->offset;
+        found = page_locs.get_prev_page_id(current_page_id, page_id);
+        if (found) {
+          current_page_id = page_id;
           book_viewer.show_page(current_page_id);
         }
         break;
@@ -234,10 +238,9 @@ BookController::open_book_file(
       #else
         case EventMgr::EventKind::DBL_PREV:
       #endif
-        page_id = page_locs.get_prev_page_id(current_page_id, 10);
-        if (page_id != nullptr) {
-          current_page_id.itemref_index = page_id->itemref_index;
-          current_page_id.offset        = page_id->offset;
+        found = page_locs.get_prev_page_id(current_page_id, page_id, 10);
+        if (found) {
+          current_page_id = page_id;
           book_viewer.show_page(current_page_id);
         }
         break;
@@ -247,10 +250,9 @@ BookController::open_book_file(
       #else
         case EventMgr::EventKind::NEXT:
       #endif
-        page_id = page_locs.get_next_page_id(current_page_id);
-        if (page_id != nullptr) {
-          current_page_id.itemref_index = page_id->itemref_index;
-          current_page_id.offset        = page_id->offset;
+        found = page_locs.get_next_page_id(current_page_id, page_id);
+        if (found) {
+          current_page_id = page_id;
           book_viewer.show_page(current_page_id);
         }
         break;
@@ -260,10 +262,9 @@ BookController::open_book_file(
       #else
         case EventMgr::EventKind::DBL_NEXT:
       #endif
-        page_id = page_locs.get_next_page_id(current_page_id, 10);
-        if (page_id != nullptr) {
-          current_page_id.itemref_index = page_id->itemref_index;
-          current_page_id.offset        = page_id->offset;
+        found = page_locs.get_next_page_id(current_page_id, page_id, 10);
+        if (found) {
+          current_page_id = page_id;
           book_viewer.show_page(current_page_id);
         }
         break;
@@ -279,6 +279,9 @@ BookParamController::input_event(const EventMgr::Event & event)
           epub.close_file();
           unlink(filepath.c_str());
 
+          // Fonts extracted from the book
+          EPub::remove_fonts(filepath);
+
           int16_t pos = filepath.find_last_of('.');
 
           filepath.replace(pos, 5, ".pars");
@@ -288,19 +291,12 @@ BookParamController::input_event(const EventMgr::Event & event)
             unlink(filepath.c_str());
           }
 
-          filepath.replace(pos, 5, ".locs");
-
-          if (stat(filepath.c_str(), &file_stat) != -1) {
-            LOG_I("Deleting file : %s", filepath.c_str());
-            unlink(filepath.c_str());
-          }
-
-          filepath.replace(pos, 5, ".toc");
+          // Zip content index
+          filepath.replace(pos, 5, ".zdx");
+          unlink(filepath.c_str());
 
-          if (stat(filepath.c_str(), &file_stat) != -1) {
-            LOG_I("Deleting file : %s", filepath.c_str());
-            unlink(filepath.c_str());
-          }
+          // Pages location and table of content files of every formatting profile
+          LocsProfiles::remove_all(filepath);
 
           int16_t dummy;
           books_dir.refresh(nullptr, dummy, false);
@@ -472,19 +472,15 @@ delete_handler(httpd_req_t * req)
       unlink(filepath.c_str());
     }
 
-    filepath.replace(pos, 5, ".locs");
+    // Zip content index
+    filepath.replace(pos, 5, ".zdx");
+    unlink(filepath.c_str());
 
-    if (stat(filepath.c_str(), &file_stat) != -1) {
-      LOG_I("Deleting file : %s", filepath.c_str());
-      unlink(filepath.c_str());
-    }
-
-    filepath.replace(pos, 5, ".toc");
+    // Pages location and table of content files of every formatting profile
+    LocsProfiles::remove_all(filepath);
 
-    if (stat(filepath.c_str(), &file_stat) != -1) {
-      LOG_I("Deleting file : %s", filepath.c_str());
-      unlink(filepath.c_str());
-    }
+    // Fonts extracted from the book
+    EPub::remove_fonts(filepath);
   }
 
   /* Redirect onto root to see the updated file list */
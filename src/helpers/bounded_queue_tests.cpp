@@ -0,0 +1,123 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "helpers/bounded_queue.hpp"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+struct Msg {
+  int16_t  sender;
+  int32_t  value;
+};
+
+TEST(BoundedQueueTest, send_and_receive) {
+  BoundedQueue<Msg, 4> queue;
+  Msg                  msg;
+
+  EXPECT_FALSE(queue.receive(msg, 0));
+  EXPECT_FALSE(queue.receive(msg, 10));
+
+  for (int32_t i = 0; i < 4; i++) EXPECT_TRUE(queue.send({ .sender = 0, .value = i }, 0));
+
+  for (int32_t i = 0; i < 4; i++) {
+    ASSERT_TRUE(queue.receive(msg, 0));
+    EXPECT_EQ(msg.value, i);
+  }
+  EXPECT_FALSE(queue.receive(msg, 0));
+}
+
+TEST(BoundedQueueTest, full_queue) {
+  BoundedQueue<Msg, 2> queue;
+  Msg                  msg;
+
+  EXPECT_TRUE(queue.send({ .sender = 0, .value = 1 }, 0));
+  EXPECT_TRUE(queue.send({ .sender = 0, .value = 2 }, 0));
+  EXPECT_FALSE(queue.send({ .sender = 0, .value = 3 }, 0));
+  EXPECT_FALSE(queue.send({ .sender = 0, .value = 3 }, 10));
+
+  // A blocked sender is released by a receiver
+  std::thread sender([&]() { EXPECT_TRUE(queue.send({ .sender = 0, .value = 3 })); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  for (int32_t i = 1; i <= 3; i++) {
+    ASSERT_TRUE(queue.receive(msg));
+    EXPECT_EQ(msg.value, i);
+  }
+  sender.join();
+}
+
+// Many senders, many receivers: every message is received exactly once.
+TEST(BoundedQueueTest, multiple_senders_and_receivers) {
+  const int16_t SENDERS   = 4;
+  const int16_t RECEIVERS = 3;
+  const int32_t COUNT     = 20000;
+
+  BoundedQueue<Msg, 10>    queue;
+  std::vector<std::thread> threads;
+  std::vector<int32_t>     received(SENDERS * COUNT, 0);
+  std::vector<int64_t>     sums(RECEIVERS, 0);
+
+  for (int16_t r = 0; r < RECEIVERS; r++) {
+    threads.push_back(std::thread([&, r]() {
+      Msg msg;
+      while (queue.receive(msg) && (msg.sender != -1)) {
+        received[msg.sender * COUNT + msg.value]++;
+        sums[r] += msg.value;
+      }
+    }));
+  }
+  for (int16_t s = 0; s < SENDERS; s++) {
+    threads.push_back(std::thread([&, s]() {
+      for (int32_t i = 0; i < COUNT; i++) queue.send({ .sender = s, .value = i });
+    }));
+  }
+  for (int16_t s = 0; s < SENDERS; s++) threads[RECEIVERS + s].join();
+  for (int16_t r = 0; r < RECEIVERS; r++) queue.send({ .sender = -1, .value = 0 });
+  for (int16_t r = 0; r < RECEIVERS; r++) threads[r].join();
+
+  int64_t total = 0;
+  for (auto sum : sums) total += sum;
+  EXPECT_EQ(total, (int64_t) SENDERS * COUNT * (COUNT - 1) / 2);
+  for (auto count : received) ASSERT_EQ(count, 1);
+}
+
+// Round trips between two threads, as done by the PageLocs class, and a
+// stream of messages from a single sender: messages are received in order.
+TEST(BoundedQueueTest, round_trips_and_stream) {
+  const int32_t ROUND_TRIPS = 10000;
+  const int32_t STREAM      = 200000;
+
+  BoundedQueue<Msg, 10> request, answer;
+
+  { std::thread echo([&]() {
+      Msg msg;
+      for (int32_t i = 0; i < ROUND_TRIPS; i++) {
+        ASSERT_TRUE(request.receive(msg));
+        msg.value = -msg.value;
+        ASSERT_TRUE(answer.send(msg));
+      }
+    });
+    Msg msg;
+    for (int32_t i = 0; i < ROUND_TRIPS; i++) {
+      ASSERT_TRUE(request.send({ .sender = 0, .value = i }));
+      ASSERT_TRUE(answer.receive(msg));
+      EXPECT_EQ(msg.value, -i);
+    }
+    echo.join();
+  }
+
+  { int32_t out_of_order = 0;
+    std::thread consumer([&]() {
+      Msg msg;
+      for (int32_t i = 0; i < STREAM; i++) {
+        if (!request.receive(msg) || (msg.value != i)) out_of_order++;
+      }
+    });
+    for (int32_t i = 0; i < STREAM; i++) request.send({ .sender = 0, .value = i });
+    consumer.join();
+    EXPECT_EQ(out_of_order, 0);
+  }
+}
+
+#endif
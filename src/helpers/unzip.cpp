@@ -19,22 +19,55 @@
 #include <cerrno>
 #include <iomanip>
 
-Unzip::Unzip()
+Unzip::Unzip() : stream_reader(*this)
 {
-  zip_file_is_open = false; 
+}
+
+uint32_t
+Unzip::hash(const char * str, uint32_t seed)
+{
+  uint32_t h = seed;
+
+  while (*str) h = (h ^ (uint8_t) *str++) * 16777619UL;
+  return h;
 }
 
 bool 
-Unzip::open_zip_file(const char * zip_filename)
+Unzip::open_zip_file(const char * zip_filename, const char * index_filename)
 {
+  close_zip_file();
+
+  std::shared_ptr<Directory> dir = std::make_shared<Directory>();
+
   // Open zip file
-  if (zip_file_is_open) close_zip_file();
-  if ((file = fopen(zip_filename, "r")) == nullptr) {
+  if ((dir->file = fopen(zip_filename, "r")) == nullptr) {
     LOG_E("Unable to open file: %s", zip_filename);
     return false;
   }
-  zip_file_is_open = true;
 
+  struct stat stat_buf;
+  if (fstat(fileno(dir->file), &stat_buf) != 0) stat_buf.st_size = stat_buf.st_mtime = 0;
+
+  if ((index_filename != nullptr) && 
+      load_index(*dir, index_filename, stat_buf.st_size, stat_buf.st_mtime)) {
+    LOG_D("open_zip_file completed from index!");
+  }
+  else {
+    if (!read_central_directory(*dir)) return false;
+
+    build_index(*dir);
+    if (index_filename != nullptr) save_index(*dir, index_filename, stat_buf.st_size, stat_buf.st_mtime);
+  }
+
+  std::scoped_lock guard(mutex);
+  directory = dir;
+
+  return true;
+}
+
+bool
+Unzip::read_central_directory(Directory & dir)
+{
   int err = 0;
 
   #define ERR(e) { err = e; break; }
@@ -66,17 +99,17 @@ Unzip::open_zip_file(const char * zip_filename)
 
     buffer[FILE_CENTRAL_SIZE] = 0;
 
-    if (fseek(file, 0, SEEK_END)) {
+    if (fseek(dir.file, 0, SEEK_END)) {
       LOG_E("Unable to seek to end of file. errno: %s", std::strerror(errno));
       err = 0;
       break;
     }
-    off_t length = ftell(file);
+    off_t length = ftell(dir.file);
     if (length < FILE_CENTRAL_SIZE) ERR(1); 
     off_t offset = length - FILE_CENTRAL_SIZE;
 
-    if (fseek(file, offset, SEEK_SET)) ERR(2);
-    if (fread(buffer, FILE_CENTRAL_SIZE, 1, file) != 1) ERR(3);
+    if (fseek(dir.file, offset, SEEK_SET)) ERR(2);
+    if (fread(buffer, FILE_CENTRAL_SIZE, 1, dir.file) != 1) ERR(3);
     if (!((buffer[0] == 'P') && (buffer[1] == 'K') && (buffer[2] == 5) && (buffer[3] == 6))) {
       // There must be a comment in the last entry. Search for the beginning of the entry
       off_t end_offset = offset - 65536;
@@ -84,13 +117,13 @@ Unzip::open_zip_file(const char * zip_filename)
       offset -= FILE_CENTRAL_SIZE;
       bool found = false;
       while (!found && (offset > end_offset)) {
-        if (fseek(file, offset, SEEK_SET)) ERR(4);
-        if (fread(buffer, FILE_CENTRAL_SIZE + 5, 1, file) != 1) ERR(5);
+        if (fseek(dir.file, offset, SEEK_SET)) ERR(4);
+        if (fread(buffer, FILE_CENTRAL_SIZE + 5, 1, dir.file) != 1) ERR(5);
         char * p;
         if ((p = (char *)memmem(buffer, FILE_CENTRAL_SIZE + 5, "PK\5\6", 4)) != nullptr) {
           offset += (p - buffer);
-          if (fseek(file, offset, SEEK_SET)) ERR(6);
-          if (fread(buffer, FILE_CENTRAL_SIZE, 1, file) != 1) ERR(7);
+          if (fseek(dir.file, offset, SEEK_SET)) ERR(6);
+          if (fread(buffer, FILE_CENTRAL_SIZE, 1, dir.file) != 1) ERR(7);
           found = true;
           break;
         }
@@ -140,43 +173,45 @@ Unzip::open_zip_file(const char * zip_filename)
 
       if (count == 0) ERR(8);
 
-      if (fseek(file, offset, SEEK_SET)) ERR(9);
+      if (fseek(dir.file, offset, SEEK_SET)) ERR(9);
       
-      //file_entries.resize(count);
+      dir.file_entries.reserve(count);
 
       while (true) {
-        if (fread(buffer, 4, 1, file) != 1) ERR(10);
+        if (fread(buffer, 4, 1, dir.file) != 1) ERR(10);
         if (!((buffer[0] == 'P') && (buffer[1] == 'K') && (buffer[2] == 1) && (buffer[3] == 2))) {
           // End of list...
           completed = true;
           break;
         }
-        if (fread(buffer, FILE_ENTRY_SIZE, 1, file) != 1) ERR(11);
+        if (fread(buffer, FILE_ENTRY_SIZE, 1, dir.file) != 1) ERR(11);
 
         uint16_t filename_size = getuint16((const unsigned char *) &buffer[24]);
         uint16_t extra_size    = getuint16((const unsigned char *) &buffer[26]);
         uint16_t comment_size  = getuint16((const unsigned char *) &buffer[28]);
         
-        char * fname = new char[filename_size + 1];
-        if (fread(fname, filename_size, 1, file) != 1) {
-          delete [] fname;
-          ERR(12);
-        }
-        fname[filename_size] = 0;
-
-        FileEntry * fe = new FileEntry;
-
-        fe->filename        = fname;
-        fe->start_pos       = getuint32((const unsigned char *) &buffer[38]);
-        fe->compressed_size = getuint32((const unsigned char *) &buffer[16]);
-        fe->size            = getuint32((const unsigned char *) &buffer[20]);
-        fe->method          = getuint16((const unsigned char *) &buffer[ 6]);
-
-        //LOG_D("File: %s %d %d %d %d", fe.filename, fe.start_pos, fe.compressed_size, fe.size, fe.method);
-        file_entries.push_front(fe);
+        if (dir.file_entries.size() >= EMPTY_SLOT) ERR(15);
+
+        uint32_t fname = dir.names.size();
+        dir.names.resize(fname + filename_size + 1);
+        if (fread(&dir.names[fname], filename_size, 1, dir.file) != 1) ERR(12);
+        dir.names[fname + filename_size] = 0;
+
+        FileEntry fe = {
+          .filename        = fname,
+          .hash            = hash(&dir.names[fname]),
+          .start_pos       = getuint32((const unsigned char *) &buffer[38]),
+          .compressed_size = getuint32((const unsigned char *) &buffer[16]),
+          .size            = getuint32((const unsigned char *) &buffer[20]),
+          .method          = getuint16((const unsigned char *) &buffer[ 6]),
+          .reserved        = 0
+        };
+
+        //LOG_D("File: %s %d %d %d %d", dir.get_name(fe), fe.start_pos, fe.compressed_size, fe.size, fe.method);
+        dir.file_entries.push_back(fe);
 
         offset += FILE_ENTRY_SIZE + 4 + filename_size + extra_size + comment_size;
-        if (fseek(file, extra_size + comment_size, SEEK_CUR)) ERR(13);
+        if (fseek(dir.file, extra_size + comment_size, SEEK_CUR)) ERR(13);
       }
     }
     else {
@@ -188,41 +223,137 @@ Unzip::open_zip_file(const char * zip_filename)
 
   if (!completed) {
     LOG_E("open_zip_file error: %d", err);
-    close_zip_file();
   }
   else {
     LOG_D("open_zip_file completed!");
     #if DEBUGGING
       std::cout << "---- Files available: ----" << std::endl;
-      for (auto * f : file_entries) {
+      for (auto & f : dir.file_entries) {
         std::cout << 
-          "pos: "        << std::setw(7) << f->start_pos <<
-          " zip size: "  << std::setw(7) << f->compressed_size <<
-          " out size: "  << std::setw(7) << f->size <<
-          " method: "    << std::setw(1) << f->method <<
-          " name: "      << f->filename <<  std::endl;
+          "pos: "        << std::setw(7) << f.start_pos <<
+          " zip size: "  << std::setw(7) << f.compressed_size <<
+          " out size: "  << std::setw(7) << f.size <<
+          " method: "    << std::setw(1) << f.method <<
+          " name: "      << dir.get_name(f) <<  std::endl;
       }
      std::cout << "[End of List]" << std::endl;
     #endif
   }
 
-  file_entries.reverse();
   return completed;
 }
 
-void 
-Unzip::close_zip_file()
+// Open addressing, linear probing. The table is kept at most half full.
+void
+Unzip::build_index(Directory & dir)
 {
-  if (zip_file_is_open) {
-    for (auto * entry : file_entries) {
-      delete [] entry->filename;
-      delete entry;
+  uint32_t capacity = 16;
+  while (capacity < (dir.file_entries.size() << 1)) capacity <<= 1;
+
+  dir.slots.assign(capacity, EMPTY_SLOT);
+
+  for (uint16_t i = 0; i < dir.file_entries.size(); i++) {
+    uint32_t slot = dir.file_entries[i].hash & (capacity - 1);
+    while (dir.slots[slot] != EMPTY_SLOT) slot = (slot + 1) & (capacity - 1);
+    dir.slots[slot] = i;
+  }
+
+  dir.names.shrink_to_fit();
+  dir.file_entries.shrink_to_fit();
+}
+
+uint32_t
+Unzip::index_checksum(const Directory & dir) const
+{
+  uint32_t h = 2166136261UL;
+
+  const uint8_t * p   = (const uint8_t *) dir.file_entries.data();
+  const uint8_t * end = p + dir.file_entries.size() * sizeof(FileEntry);
+  while (p < end) h = (h ^ *p++) * 16777619UL;
+
+  for (char ch : dir.names) h = (h ^ (uint8_t) ch) * 16777619UL;
+  return h;
+}
+
+bool
+Unzip::load_index(Directory & dir, const char * index_filename, uint32_t zip_size, uint32_t zip_mtime)
+{
+  FILE * f = fopen(index_filename, "rb");
+  if (f == nullptr) return false;
+
+  IndexHeader header;
+  bool ok = (fread(&header, sizeof(header), 1, f) == 1) &&
+            (memcmp(header.magic, "UZIX", 4) == 0) &&
+            (header.version   == INDEX_VERSION) &&
+            (header.zip_size  == zip_size) &&
+            (header.zip_mtime == zip_mtime) &&
+            (header.entry_count > 0) &&
+            (header.entry_count < EMPTY_SLOT);
+
+  if (ok) {
+    dir.file_entries.resize(header.entry_count);
+    dir.names.resize(header.names_size);
+    ok = (fread(dir.file_entries.data(), sizeof(FileEntry), dir.file_entries.size(), f) == dir.file_entries.size()) &&
+         (fread(dir.names.data(), 1, dir.names.size(), f) == dir.names.size());
+  }
+  fclose(f);
+
+  if (ok) {
+    ok = (index_checksum(dir) == header.checksum) && (dir.names.back() == 0);
+    for (auto & fe : dir.file_entries) {
+      if (fe.filename >= dir.names.size()) ok = false;
     }
-    file_entries.clear();
-    fclose(file);
-    zip_file_is_open = false;
   }
 
+  if (!ok) {
+    LOG_I("Zip index %s not usable.", index_filename);
+    dir.file_entries.clear();
+    dir.names.clear();
+    return false;
+  }
+
+  build_index(dir);
+  return true;
+}
+
+void
+Unzip::save_index(const Directory & dir, const char * index_filename, uint32_t zip_size, uint32_t zip_mtime)
+{
+  IndexHeader header = {
+    .magic       = { 'U', 'Z', 'I', 'X' },
+    .version     = INDEX_VERSION,
+    .reserved    = 0,
+    .entry_count = (uint16_t) dir.file_entries.size(),
+    .zip_size    = zip_size,
+    .zip_mtime   = zip_mtime,
+    .names_size  = (uint32_t) dir.names.size(),
+    .checksum    = index_checksum(dir)
+  };
+
+  FILE * f = fopen(index_filename, "wb");
+  if (f == nullptr) {
+    LOG_E("Unable to create zip index %s", index_filename);
+    return;
+  }
+
+  bool ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+            (fwrite(dir.file_entries.data(), sizeof(FileEntry), dir.file_entries.size(), f) == dir.file_entries.size()) &&
+            (fwrite(dir.names.data(), 1, dir.names.size(), f) == dir.names.size());
+
+  if ((fclose(f) != 0) || !ok) {
+    LOG_E("Unable to write zip index %s", index_filename);
+    remove(index_filename);
+  }
+}
+
+// Readers still using the directory keep it until they are closed
+void 
+Unzip::close_zip_file()
+{
+  std::scoped_lock guard(mutex);
+
+  directory.reset();
+
   // LOG_D("Zip file closed.");
 }
 
@@ -264,583 +395,401 @@ clean_fname(const char * filename)
   return str;
 }
 
-int32_t
-Unzip::get_file_size(const char * filename)
+const Unzip::FileEntry *
+Unzip::Directory::find(const char * filename) const
 {
-  LOG_D("Mutex lock...");
-  mutex.lock();
-  
-  if (!zip_file_is_open) return 0;
+  if (slots.empty()) return nullptr;
+
+  // Most names don't need to be cleaned up
+  char * the_filename = ((filename[0] == '/') || (strstr(filename, "/../") != nullptr)) ?
+                          clean_fname(filename) : nullptr;
+  const char * name = (the_filename == nullptr) ? filename : the_filename;
 
-  char * the_filename = clean_fname(filename);
-  current_fe = file_entries.begin();
+  uint32_t          h     = hash(name);
+  uint32_t          mask  = slots.size() - 1;
+  const FileEntry * found = nullptr;
 
-  while (current_fe != file_entries.end()) {
-    if (strcmp((*current_fe)->filename, the_filename) == 0) break;
-    current_fe++;
+  for (uint32_t slot = h & mask; slots[slot] != EMPTY_SLOT; slot = (slot + 1) & mask) {
+    const FileEntry & fe = file_entries[slots[slot]];
+    if ((fe.hash == h) && (strcmp(get_name(fe), name) == 0)) {
+      found = &fe;
+      break;
+    }
   }
 
-  if (current_fe == file_entries.end()) {
-    LOG_E("Unzip get_file_size: File not found: %s", the_filename);
-    #if DEBUGGING
-      std::cout << "---- Files available: ----" << std::endl;
-      for (auto * f : file_entries) {
-        std::cout << "  <" << f->filename << ">" << std::endl;
-      }
-      std::cout << "[End of List]" << std::endl;
-    #endif    
-    mutex.unlock();
+  if (the_filename != nullptr) delete [] the_filename;
+
+  return found;
+}
+
+int32_t
+Unzip::get_file_count()
+{
+  DirectoryPtr dir = get_directory();
+
+  return (dir == nullptr) ? 0 : dir->file_entries.size();
+}
+
+int32_t
+Unzip::get_file_size(const char * filename)
+{
+  DirectoryPtr dir = get_directory();
+  if (dir == nullptr) return 0;
+
+  const FileEntry * fe = dir->find(filename);
+  if (fe == nullptr) {
+    LOG_E("Unzip get_file_size: File not found: %s", filename);
     return 0;
   }
-  else {
-    mutex.unlock();
-    return (*current_fe)->size;
-  }
+
+  return fe->size;
 }
 
 bool
 Unzip::file_exists(const char * filename)
 {
-  if (!zip_file_is_open) return false;
+  DirectoryPtr dir = get_directory();
 
-  char * the_filename = clean_fname(filename);
+  return (dir != nullptr) && (dir->find(filename) != nullptr);
+}
 
-  Unzip::FileEntries::iterator fe = file_entries.begin();
+bool
+Unzip::get_file_location(const char * filename, uint32_t & offset, uint32_t & size, uint16_t & method)
+{
+  Reader   reader(*this);
+  uint32_t file_size;
 
-  while (fe != file_entries.end()) {
-    if (strcmp((*fe)->filename, the_filename) == 0) break;
-    fe++;
-  }
+  if (!reader.open(filename, file_size)) return false;
 
-  delete [] the_filename;
+  offset = reader.get_data_pos();
+  size   = reader.get_entry().compressed_size;
+  method = reader.get_entry().method;
 
-  return fe != file_entries.end();
+  return true;
 }
 
-bool
-Unzip::open_file(const char * filename)
+std::unique_ptr<char[], MallocDeleter> 
+Unzip::get_file(const char * filename, uint32_t & file_size, Filter * filter)
 {
-  LOG_D("Mutex lock...");
-  mutex.lock();
+  // LOG_D("get_file: %s", filename);
   
-  int err = 0;
-
-  if (!zip_file_is_open) return false;
-
-  char * the_filename = clean_fname(filename);
-  current_fe = file_entries.begin();
+  std::unique_ptr<char[], MallocDeleter> data;
+  Reader reader(*this);
 
-  while (current_fe != file_entries.end()) {
-    if (strcmp((*current_fe)->filename, the_filename) == 0) break;
-    current_fe++;
+  if (!reader.open(filename, file_size)) {
+    file_size = 0;
+    return data;
   }
 
-  if (current_fe == file_entries.end()) {
-    LOG_E("Unzip Get: File not found: %s", the_filename);
-    #if DEBUGGING
-      std::cout << "---- Files available: ----" << std::endl;
-      for (auto * f : file_entries) {
-        std::cout << "  <" << f->filename << ">" << std::endl;
-      }
-      std::cout << "[End of List]" << std::endl;
-    #endif
-    mutex.unlock();
-    return false;
+  data.reset((char *) allocate(file_size + 1));
+  if (!data) {
+    LOG_E("Unzip get: Unable to allocate %u bytes", file_size);
+    file_size = 0;
+    return data;
   }
-  // else {
-  //   LOG_D("File: %s at pos: %d", (*fe)->filename, (*fe)->start_pos);
-  // }
-
-  delete [] the_filename;
-
-  bool completed = false;
-  while (true) {
 
-    // Local header record.
-
-    // local file header signature     4 bytes  (0x04034b50)
-    // version needed to extract       2 bytes   0
-    // general purpose bit flag        2 bytes   2
-    // compression method              2 bytes   4
-    // last mod file time              2 bytes   6
-    // last mod file date              2 bytes   8
-    // crc-32                          4 bytes  10
-    // compressed size                 4 bytes  14
-    // uncompressed size               4 bytes  18
-    // file name length                2 bytes  22
-    // extra field length              2 bytes  24
-
-    // file name (variable size)
-    // extra field (variable size)
-    
-    const int LOCAL_HEADER_SIZE = 26;
-
-    if (fseek(file, (*current_fe)->start_pos, SEEK_SET)) ERR(13);
-    if (fread(buffer, 4, 1, file) != 1) ERR(14);
-    if (!((buffer[0] == 'P') && (buffer[1] == 'K') && (buffer[2] == 3) && (buffer[3] == 4))) ERR(15);
+  // With a filter, the file is inflated a part at a time, each part being
+  // processed by the filter right away.
+  uint32_t size = 0;
+  if (filter == nullptr) {
+    size = file_size;
+    if (!reader.read(data.get(), size)) size = 0;
+  }
+  else {
+    uint32_t processed = 0;
+    while (size < file_size) {
+      uint32_t part_size = ((file_size - size) < FILTER_PART_SIZE) ? (file_size - size) : FILTER_PART_SIZE;
+      if (!reader.read(data.get() + size, part_size) || (part_size == 0)) break;
+      size      += part_size;
+      processed += filter->process(data.get() + processed, size - processed, size == file_size);
+    }
+    if (file_size == 0) filter->process(data.get(), 0, true);
+  }
 
-    if (fread(buffer, LOCAL_HEADER_SIZE, 1, file) != 1) ERR(16);
+  if (size != file_size) {
+    LOG_E("Unzip get: Error reading %s: %u bytes of %u", filename, size, file_size);
+    data.reset();
+    file_size = 0;
+    return data;
+  }
 
-    uint16_t filename_size = getuint16((const unsigned char *) &buffer[22]);
-    uint16_t extra_size    = getuint16((const unsigned char *) &buffer[24]);
+  data[file_size] = 0;
+  return data;
+}
 
-    // bool has_data_descriptor = ((buffer[2] & 8) != 0);
-    // if (has_data_descriptor) {
-    //   LOG_D("Unzip: with data descriptor...");
-    // }
+#if !STB
 
-    if (fseek(file, filename_size + extra_size, SEEK_CUR)) ERR(17);
-    // LOG_D("Unzip Get Method: ", (*current_fe)->method);
-    
-    completed = true;
-    break;
-  }
+bool
+Unzip::open_stream_file(const char * filename, uint32_t & file_size)
+{
+  stream_mutex.lock();
 
-  if (completed) {
-    (*current_fe)->current_pos = 0;
-    return true;
-  }
-  else {
-    LOG_E("Unzip open_file: Error!: %d", err);
-    LOG_D("Mutex unlock...");
-    mutex.unlock();
+  if (!stream_reader.open(filename, file_size)) {
+    stream_mutex.unlock();
     return false;
   }
+
+  return true;
 }
 
-void
-Unzip::close_file()
+bool 
+Unzip::get_stream_data(char * data, uint32_t & data_size)
 {
-  LOG_D("Mutex unlock...");
-  mutex.unlock();
+  return stream_reader.read(data, data_size);
 }
 
-#if 0
-char * 
-Unzip::get_file(const char * filename, uint32_t & file_size)
+bool
+Unzip::stream_skip(uint32_t byte_count)
 {
-  // LOG_D("get_file: %s", filename);
-  
-  if (!open_file(filename)) return nullptr;
-
-  char * data = nullptr;
-  int    err  = 0;
-  file_size   = 0;
-  
-  bool completed = false;
-  while (true) {
-    data = (char *) allocate((*current_fe)->size + 1);
-
-    if (data == nullptr) ERR(18);
-    data[(*current_fe)->size] = 0;
-
-    if ((*current_fe)->method == 0) {
-      if (fread(data, (*current_fe)->size, 1, file) != 1) ERR(19);
-    }
-    else if ((*current_fe)->method == 8) {
-
-      #if MINIZ
-        repeat  = (*current_fe)->compressed_size / BUFFER_SIZE;
-        remains = (*current_fe)->compressed_size % BUFFER_SIZE;
-        current = 0;
-
-        zstr.zalloc    = nullptr;
-        zstr.zfree     = nullptr;
-        zstr.opaque    = nullptr;
-        zstr.next_in   = nullptr;
-        zstr.avail_in  = 0;
-        zstr.avail_out = (*current_fe)->size;
-        zstr.next_out  = (unsigned char *) data;
-
-        int zret;
-
-        // Use inflateInit2 with negative windowBits to get raw decompression
-        if ((zret = mz_inflateInit2(&zstr, -15)) != MZ_OK) {
-          ERR(23);
-        }
+  return stream_reader.skip(byte_count);
+}
 
-        // int szDecomp;
-
-        // Decompress until deflate stream ends or end of file
-        do {
-          uint16_t size = current < repeat ? BUFFER_SIZE : remains;
-          if (fread(buffer, size, 1, file) != 1) {
-            mz_inflateEnd(&zstr);
-            err = 24;
-            goto error;
-          }
-
-          current++;
-
-          zstr.avail_in = size;
-          zstr.next_in  = (unsigned char *) buffer;
-
-          zret = mz_inflate(&zstr, MZ_NO_FLUSH);
-
-          switch (zret) {
-            case MZ_NEED_DICT:
-            case MZ_DATA_ERROR:
-            case MZ_MEM_ERROR:
-              mz_inflateEnd(&zstr);
-              err = 25;
-              goto error;
-            default:
-              ;
-          }
-        } while (current <= repeat);
-
-        mz_inflateEnd(&zstr);
-      #endif
-
-      #if ZLIB
-        repeat  = ((*current_fe)->compressed_size + 2) / BUFFER_SIZE;
-        remains = ((*current_fe)->compressed_size + 2) % BUFFER_SIZE;
-        current = 0;
-
-        /* Allocate inflate state */
-        z_stream zstr;
-
-        zstr.zalloc    = nullptr;
-        zstr.zfree     = nullptr;
-        zstr.opaque    = nullptr;
-        zstr.next_in   = nullptr;
-        zstr.avail_in  = 0;
-        zstr.avail_out = (*current_fe)->size;
-        zstr.next_out  = (Bytef *) data;
-
-        int zret;
-
-        // Use inflateInit2 with negative windowBits to get raw decompression
-        if ((zret = inflateInit2(&zstr, -MAX_WBITS)) != Z_OK) { 
-          err = 23; 
-          goto error; 
-        }
+void
+Unzip::close_stream_file() 
+{
+  stream_reader.close();
+  stream_mutex.unlock();
+}
 
-        // int szDecomp;
-
-        // Decompress until deflate stream ends or end of file
-        do {
-          uint16_t size = current < repeat ? BUFFER_SIZE : remains;
-          if (fread(buffer, size, 1, file) != 1) {
-            inflateEnd(&zstr);
-            err = 24;
-            goto error;
-          }
-
-          // if (size <= (BUFFER_SIZE - 2)) {
-          //   buffer[size    ] = 0;
-          //   buffer[size + 1] = 0;
-          // }
-
-          current++;
-
-          zstr.avail_in = size;
-          zstr.next_in  = (Bytef *) buffer;
-
-          zret = inflate(&zstr, Z_NO_FLUSH);
-
-          switch (zret) {
-            case Z_NEED_DICT:
-            case Z_DATA_ERROR:
-            case Z_MEM_ERROR:
-              inflateEnd(&zstr);
-              err = 25;
-              goto error;
-            default:
-              ;
-          }
-        } while (current <= repeat);
-
-        inflateEnd(&zstr);
-      #endif
-      #if STB
-        char * compressed_data = (char *) allocate((*current_fe)->compressed_size + 2);
-        if (compressed_data == nullptr) {
-          // msg_viewer.out_of_memory("compressed data retrieval from epub");
-          ERR(21);
-        }
+bool
+Unzip::extract_file(const char * filename, const std::string & dest_filename)
+{
+  static constexpr uint32_t CHUNK_SIZE = 4096;
 
-        if (fread(compressed_data, (*current_fe)->compressed_size, 1, file) != 1) {
-          free(compressed_data);
-          ERR(22);
-        }
+  Reader   reader(*this);
+  uint32_t file_size;
 
-        compressed_data[(*current_fe)->compressed_size]     = 0;
-        compressed_data[(*current_fe)->compressed_size + 1] = 0;
+  if (!reader.open(filename, file_size)) return false;
 
-        int32_t result = stbi_zlib_decode_noheader_buffer(data, 
-                                                          (*current_fe)->size, 
-                                                          compressed_data, 
-                                                          (*current_fe)->compressed_size + 2);
+  FILE * dest  = fopen(dest_filename.c_str(), "wb");
+  char * chunk = (char *) allocate(CHUNK_SIZE);
+  uint32_t total = 0;
 
-        if (result != (*current_fe)->size) {
-          free(compressed_data);
-          ERR(23);
-        }
-
-        free(compressed_data);
-      #endif
+  if ((dest != nullptr) && (chunk != nullptr)) {
+    while (total < file_size) {
+      uint32_t size = ((file_size - total) < CHUNK_SIZE) ? (file_size - total) : CHUNK_SIZE;
+      if (!reader.read(chunk, size) || (size == 0)) break;
+      if (fwrite(chunk, size, 1, dest) != 1) break;
+      total += size;
     }
-    else break;
-
-    completed = true;
-    break;
   }
 
-error:
-  close_file();
-
-  if (!completed) {
-    if (data != nullptr) free(data);
-    data = nullptr;
-    file_size = 0;
-    LOG_E("Unzip get: Error!: %d", err);
+  if (chunk != nullptr) free(chunk);
+  if (dest  != nullptr) {
+    if (fclose(dest) != 0) total = 0;
   }
-  else {
-    file_size = (*current_fe)->size;
+
+  if (total != file_size) {
+    LOG_E("Unable to extract %s to %s", filename, dest_filename.c_str());
+    remove(dest_filename.c_str());
+    return false;
   }
 
-  return data;
+  return true;
 }
+
 #endif
 
-#if !STB
+// ----- Unzip::Reader -----
+
+Unzip::Reader::Reader(Unzip & the_unzip) : 
+  unzip(the_unzip),
+  entry(nullptr),
+  fd(-1),
+  buffer(nullptr),
+  inflating(false),
+  aborted(false)
+{
+}
 
 bool
-Unzip::open_stream_file(const char * filename, uint32_t & file_size)
+Unzip::Reader::open(const char * filename, uint32_t & file_size)
 {
-  if (!open_file(filename)) return false;
+  close();
 
-  repeat  = ((*current_fe)->compressed_size) / BUFFER_SIZE;
-  remains = ((*current_fe)->compressed_size) % BUFFER_SIZE;
-  current = 0;
-  aborted = false;
+  if ((dir = unzip.get_directory()) == nullptr) return false;
 
-  zstr.zalloc    = nullptr;
-  zstr.zfree     = nullptr;
-  zstr.opaque    = nullptr;
-  zstr.next_in   = nullptr;
-  zstr.next_out  = nullptr;
-  zstr.avail_in  = 0;
-  zstr.avail_out = 0;
+  if ((entry = dir->find(filename)) == nullptr) {
+    LOG_E("Unzip Get: File not found: %s", filename);
+    #if DEBUGGING
+      std::cout << "---- Files available: ----" << std::endl;
+      for (auto & f : dir->file_entries) {
+        std::cout << "  <" << dir->get_name(f) << ">" << std::endl;
+      }
+      std::cout << "[End of List]" << std::endl;
+    #endif
+    close();
+    return false;
+  }
 
-  int zret;
+  // Local header record.
+
+  // local file header signature     4 bytes  (0x04034b50)
+  // version needed to extract       2 bytes   4
+  // general purpose bit flag        2 bytes   6
+  // compression method              2 bytes   8
+  // last mod file time              2 bytes  10
+  // last mod file date              2 bytes  12
+  // crc-32                          4 bytes  14
+  // compressed size                 4 bytes  18
+  // uncompressed size               4 bytes  22
+  // file name length                2 bytes  26
+  // extra field length              2 bytes  28
+
+  // file name (variable size)
+  // extra field (variable size)
+    
+  const int LOCAL_HEADER_SIZE = 30;
 
-  #if ZLIB
-    if ((zret = inflateInit2(&zstr, -MAX_WBITS)) != Z_OK) {
-      aborted = true;
-      close_stream_file();
-      return false;
-    }
-  #else // MINIZ
-    if ((zret = mz_inflateInit2(&zstr, -15)) != MZ_OK) {
-      aborted = true;
-      close_stream_file();
+  unsigned char header[LOCAL_HEADER_SIZE];
+
+  fd = fileno(dir->file);
+  if ((pread(fd, header, LOCAL_HEADER_SIZE, entry->start_pos) != LOCAL_HEADER_SIZE) ||
+      !((header[0] == 'P') && (header[1] == 'K') && (header[2] == 3) && (header[3] == 4))) {
+    LOG_E("Unzip open: Unable to read local header of %s", filename);
+    close();
+    return false;
+  }
+
+  data_pos  = entry->start_pos + LOCAL_HEADER_SIZE + getuint16(&header[26]) + getuint16(&header[28]);
+  pos       = data_pos;
+  remaining = entry->compressed_size;
+  aborted   = false;
+
+  if (entry->method == 8) {
+    if ((buffer = (char *) allocate(BUFFER_SIZE)) == nullptr) {
+      LOG_E("Unzip open: Unable to allocate buffer.");
+      close();
       return false;
     }
-  #endif
 
-  file_size = (*current_fe)->size;
+    memset(&zstr, 0, sizeof(zstr));
 
-  uint16_t size = current < repeat ? BUFFER_SIZE : remains;
-  if (fread(buffer, size, 1, file) != 1) {
-    LOG_E("Error reading zip content.");
-    close_stream_file();
-    aborted = true;
+    #if ZLIB
+      inflating = inflateInit2(&zstr, -MAX_WBITS) == Z_OK;
+    #else // MINIZ
+      inflating = mz_inflateInit2(&zstr, -15) == MZ_OK;
+    #endif
+
+    if (!inflating) {
+      close();
+      return false;
+    }
+  }
+  else if (entry->method != 0) {
+    LOG_E("Unzip open: Unsupported compression method %d for %s", entry->method, filename);
+    close();
     return false;
   }
 
-  current++;
-
-  zstr.avail_in = size;
-  zstr.next_in  = (unsigned char *) buffer;
-
+  file_size = entry->size;
   return true;
 }
 
 void
-Unzip::close_stream_file() 
+Unzip::Reader::close()
 {
-  if (aborted) return;
+  if (inflating) {
+    #if ZLIB
+      inflateEnd(&zstr);
+    #else // MINIZ
+      mz_inflateEnd(&zstr);
+    #endif
+    inflating = false;
+  }
 
-  #if ZLIB
-    inflateEnd(&zstr);
-  #else // MINIZ
-    mz_inflateEnd(&zstr);
-  #endif
+  if (buffer != nullptr) {
+    free(buffer);
+    buffer = nullptr;
+  }
 
-  close_file();
+  entry = nullptr;
+  fd    = -1;
+  dir.reset();
 }
 
 bool
-Unzip::stream_skip(uint32_t byte_count)
+Unzip::Reader::fill_buffer()
 {
-  char * tmp = (char *) allocate(byte_count);
-  uint32_t size = byte_count;
+  uint32_t size = (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE;
+
+  if (pread(fd, buffer, size, pos) != (ssize_t) size) {
+    LOG_E("Error reading zip content.");
+    return false;
+  }
+
+  pos       += size;
+  remaining -= size;
+
+  zstr.next_in  = (unsigned char *) buffer;
+  zstr.avail_in = size;
 
-  do {
-    uint32_t s = size;
-    if (!get_stream_data(tmp, s)) {
-      free(tmp);
-      return false;
-    }
-    size -= s;
-  } while (size > 0);
-  free(tmp);
   return true;
 }
 
 bool 
-Unzip::get_stream_data(char * data, uint32_t & data_size)
+Unzip::Reader::read(char * data, uint32_t & data_size)
 {
-  zstr.next_out  = (unsigned char *) data;
-  zstr.avail_out = data_size;
-  
-  if ((*current_fe)->method == 0) {
-    while (!aborted && (zstr.avail_out > 0)) {
-      uint16_t copy_size = zstr.avail_in <= zstr.avail_out ? zstr.avail_in : zstr.avail_out;
-      memcpy(zstr.next_out, zstr.next_in, copy_size);
-
-      zstr.next_out  += copy_size;
-      zstr.next_in   += copy_size;
-      zstr.avail_out -= copy_size;
-      zstr.avail_in  -= copy_size;
-
-      if (zstr.avail_in == 0) {
-        if (current > repeat) break; // We are at the end
-        uint16_t size = current < repeat ? BUFFER_SIZE : remains;
-        if (fread(buffer, size, 1, file) != 1) {
-          LOG_E("Error reading zip content.");
-          close_stream_file();
-          aborted = true;
-          break;
-        }
-
-        current++;
-
-        zstr.avail_in = size;
-        zstr.next_in  = (unsigned char *) buffer;
-      }
+  if ((entry == nullptr) || aborted) {
+    data_size = 0;
+    return false;
+  }
 
+  if (entry->method == 0) {
+    uint32_t size = (remaining < data_size) ? remaining : data_size;
+    if ((size > 0) && (pread(fd, data, size, pos) != (ssize_t) size)) {
+      LOG_E("Error reading zip content.");
+      aborted = true;
+      size    = 0;
     }
+    pos       += size;
+    remaining -= size;
+    data_size  = size;
+    return !aborted;
   }
-  else if ((*current_fe)->method == 8) {
 
-    while (!aborted && (zstr.avail_out == data_size)) {
+  zstr.next_out  = (unsigned char *) data;
+  zstr.avail_out = data_size;
 
-      #if ZLIB
-        int zret = inflate(&zstr, Z_NO_FLUSH);
+  while (zstr.avail_out > 0) {
+    if ((zstr.avail_in == 0) && (remaining > 0) && !fill_buffer()) {
+      aborted = true;
+      break;
+    }
 
-        switch (zret) {
-          case Z_NEED_DICT:
-          case Z_DATA_ERROR:
-          case Z_MEM_ERROR:
-            LOG_E("Error inflating data: %d", zret);
-            close_stream_file();
-            aborted = true;
-          default:
-            ;   
-        }
-      #else // MINIZ
-        int zret = mz_inflate(&zstr, MZ_NO_FLUSH);
-
-        switch (zret) {
-          case MZ_NEED_DICT:
-          case MZ_DATA_ERROR:
-          case MZ_MEM_ERROR:
-            LOG_E("Error inflating data: %d", zret);
-            close_stream_file();
-            aborted = true;
-          default:
-            ;   
-        }
-      #endif
-
-      if (!aborted && (zstr.avail_out != 0)) {
-        if ((zstr.avail_in == 0) && (current <= repeat)) {
-          uint16_t size = current < repeat ? BUFFER_SIZE : remains;
-          if (fread(buffer, size, 1, file) != 1) {
-            LOG_E("Error reading zip content.");
-            close_stream_file();
-            aborted = true;
-          }
-          else {
-            current++;
-
-            zstr.avail_in = size;
-            zstr.next_in  = (unsigned char *) buffer;
-          }
-        }
-      }
+    #if ZLIB
+      int zret = inflate(&zstr, Z_NO_FLUSH);
+      if ((zret == Z_NEED_DICT) || (zret == Z_DATA_ERROR) || (zret == Z_MEM_ERROR)) {
+    #else // MINIZ
+      int zret = mz_inflate(&zstr, MZ_NO_FLUSH);
+      if ((zret == MZ_NEED_DICT) || (zret == MZ_DATA_ERROR) || (zret == MZ_MEM_ERROR)) {
+    #endif
+      LOG_E("Error inflating data: %d", zret);
+      aborted = true;
+      break;
     }
+
+    #if ZLIB
+      if ((zret == Z_STREAM_END) || ((zret == Z_BUF_ERROR) && (remaining == 0))) break;
+    #else // MINIZ
+      if ((zret == MZ_STREAM_END) || ((zret == MZ_BUF_ERROR) && (remaining == 0))) break;
+    #endif
   }
 
   data_size = data_size - zstr.avail_out;
   return !aborted;
 }
 
-// Test version of get_file using stream methods
-std::unique_ptr<char[], MallocDeleter> 
-Unzip::get_file(const char * filename, uint32_t & file_size)
+bool
+Unzip::Reader::skip(uint32_t byte_count)
 {
-  // LOG_D("get_file: %s", filename);
-  
-  std::unique_ptr<char[], MallocDeleter> data;
-  char * window      = nullptr;
-  int    total       = 0;
-  int    err         = 0;
-  
-  bool completed     = false;
-  bool stream_opened = false;
-
-  while (true) {
-    if (!open_stream_file(filename, file_size)) ERR(18);
-
-    stream_opened = true;
-
-    char *raw_mem = (char *) allocate(file_size + 1);
-    if (raw_mem == nullptr) ERR(19);
-    data.reset(raw_mem); // Take ownership
-    data[file_size] = 0;
-
-    char   * data_ptr = data.get();
-    uint32_t size     = file_size;
-
-    while (get_stream_data(data_ptr, size) && ((total + size) <= file_size)) {
-      if (size > 0) {
-        data_ptr += size;
-        total    += size;
-
-        LOG_D("Got %d bytes...", size);
-      }
-      else {
-        LOG_E("Got 0 bytes!!");
-      }
-
-      if (total == file_size) break;
-
-      size = file_size - total;
-    }
-
-    LOG_D("File size: %d, received: %d", file_size, total);
-    free(window);
-    completed = true;
-    break;
-  }
-
-  if (stream_opened) close_stream_file();
+  char     tmp[256];
+  uint32_t size = byte_count;
 
-  if (!completed) {
-    if (data) data.reset(); // Release and free memory
-    if (window != nullptr) free(window);
-    file_size = 0;
-    LOG_E("Unzip get (stream version): Error!: %d", err);
-  }
-  else {
-    file_size = total;
+  while (size > 0) {
+    uint32_t s = (size < sizeof(tmp)) ? size : sizeof(tmp);
+    if (!read(tmp, s) || (s == 0)) return false;
+    size -= s;
   }
-
-  return data;
+  return true;
 }
-
-#endif
\ No newline at end of file
@@ -0,0 +1,242 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "helpers/unzip.hpp"
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+static const char * ZIP_FILENAME   = "/tmp/unzip_tests.epub";
+static const char * INDEX_FILENAME = "/tmp/unzip_tests.zdx";
+static const int    FILE_COUNT     = 2000;
+
+static std::string
+content_of(const std::string & name)
+{
+  return "<html><body><p>" + name + "</p></body></html>";
+}
+
+// A minimal zip writer: files stored without compression
+class ZipWriter
+{
+  public:
+    ZipWriter(const char * filename) { file = fopen(filename, "wb"); }
+
+    void add(const std::string & name, const std::string & data) {
+      uint32_t crc = mz_crc32(MZ_CRC32_INIT, (const unsigned char *) data.c_str(), data.size());
+      uint32_t pos = ftell(file);
+
+      put32(0x04034b50); put16(10); put16(0); put16(0); put16(0); put16(0);
+      put32(crc); put32(data.size()); put32(data.size()); put16(name.size()); put16(0);
+      fwrite(name.c_str(), name.size(), 1, file);
+      fwrite(data.c_str(), data.size(), 1, file);
+
+      std::string & c = central;
+      c.append("PK\1\2", 4);
+      c.append(bytes(10, 2)); c.append(bytes(10, 2)); c.append(bytes(0, 2)); c.append(bytes(0, 2));
+      c.append(bytes(0, 2));  c.append(bytes(0, 2));  c.append(bytes(crc, 4));
+      c.append(bytes(data.size(), 4)); c.append(bytes(data.size(), 4));
+      c.append(bytes(name.size(), 2)); c.append(bytes(0, 2)); c.append(bytes(0, 2));
+      c.append(bytes(0, 2)); c.append(bytes(0, 2)); c.append(bytes(0, 4)); c.append(bytes(pos, 4));
+      c.append(name);
+      count++;
+    }
+
+    bool close() {
+      uint32_t pos = ftell(file);
+      fwrite(central.data(), central.size(), 1, file);
+      put32(0x06054b50); put16(0); put16(0); put16(count); put16(count);
+      put32(central.size()); put32(pos); put16(0);
+      return fclose(file) == 0;
+    }
+
+    bool is_open() const { return file != nullptr; }
+
+  private:
+    FILE      * file;
+    std::string central;
+    uint16_t    count = 0;
+
+    static std::string bytes(uint32_t value, int size) {
+      std::string s;
+      for (int i = 0; i < size; i++) s += (char) ((value >> (i * 8)) & 0xFF);
+      return s;
+    }
+    void put16(uint16_t value) { fwrite(bytes(value, 2).data(), 2, 1, file); }
+    void put32(uint32_t value) { fwrite(bytes(value, 4).data(), 4, 1, file); }
+};
+
+// A book with FILE_COUNT files: text, style sheets and images
+static bool
+create_book(std::vector<std::string> & names)
+{
+  ZipWriter zip(ZIP_FILENAME);
+  if (!zip.is_open()) return false;
+
+  names.clear();
+  names.push_back("mimetype");
+  zip.add("mimetype", "application/epub+zip");
+
+  char name[64];
+  for (int i = 1; i < FILE_COUNT; i++) {
+    switch (i % 4) {
+      case 0:  snprintf(name, 64, "OEBPS/styles/style%04d.css",   i); break;
+      case 1:  snprintf(name, 64, "OEBPS/images/image%04d.jpg",   i); break;
+      default: snprintf(name, 64, "OEBPS/text/chapter%04d.xhtml", i); break;
+    }
+    names.push_back(name);
+    zip.add(name, content_of(name));
+  }
+
+  return zip.close();
+}
+
+TEST(UnzipTest, index) {
+  std::vector<std::string> names;
+  ASSERT_TRUE(create_book(names));
+  remove(INDEX_FILENAME);
+
+  // Built from the central directory, then retrieved from the index file
+  for (int pass = 0; pass < 2; pass++) {
+    ASSERT_TRUE(unzip.open_zip_file(ZIP_FILENAME, INDEX_FILENAME));
+    EXPECT_EQ(unzip.get_file_count(), FILE_COUNT);
+
+    for (auto & name : names) ASSERT_TRUE(unzip.file_exists(name.c_str())) << name;
+    EXPECT_FALSE(unzip.file_exists("OEBPS/text/chapter9999.xhtml"));
+    EXPECT_FALSE(unzip.file_exists("OEBPS/text"));
+
+    EXPECT_TRUE(unzip.file_exists("/OEBPS/text/chapter0002.xhtml"));
+    EXPECT_TRUE(unzip.file_exists("OEBPS/text/../images/image0005.jpg"));
+
+    uint32_t size;
+    auto data = unzip.get_file("OEBPS/text/../text/chapter0006.xhtml", size);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(std::string(data.get(), size), content_of("OEBPS/text/chapter0006.xhtml"));
+    EXPECT_EQ(unzip.get_file_size("OEBPS/styles/style0004.css"), (int32_t) content_of("OEBPS/styles/style0004.css").size());
+
+    unzip.close_zip_file();
+
+    struct stat stat_buf;
+    EXPECT_EQ(stat(INDEX_FILENAME, &stat_buf), 0);
+  }
+
+  // A damaged index is not used
+  FILE * f = fopen(INDEX_FILENAME, "r+b");
+  ASSERT_NE(f, nullptr);
+  fseek(f, 100, SEEK_SET);
+  fputc(0x5A, f);
+  fclose(f);
+
+  ASSERT_TRUE(unzip.open_zip_file(ZIP_FILENAME, INDEX_FILENAME));
+  for (auto & name : names) ASSERT_TRUE(unzip.file_exists(name.c_str())) << name;
+  unzip.close_zip_file();
+
+  remove(ZIP_FILENAME);
+  remove(INDEX_FILENAME);
+}
+
+// The book is replaced: the index is built again
+TEST(UnzipTest, index_invalidation) {
+  std::vector<std::string> names;
+  ASSERT_TRUE(create_book(names));
+  remove(INDEX_FILENAME);
+
+  ASSERT_TRUE(unzip.open_zip_file(ZIP_FILENAME, INDEX_FILENAME));
+  unzip.close_zip_file();
+
+  ZipWriter zip(ZIP_FILENAME);
+  ASSERT_TRUE(zip.is_open());
+  zip.add("mimetype", "application/epub+zip");
+  zip.add("OEBPS/other.xhtml", "<html/>");
+  ASSERT_TRUE(zip.close());
+
+  ASSERT_TRUE(unzip.open_zip_file(ZIP_FILENAME, INDEX_FILENAME));
+  EXPECT_EQ(unzip.get_file_count(), 2);
+  EXPECT_TRUE(unzip.file_exists("OEBPS/other.xhtml"));
+  EXPECT_FALSE(unzip.file_exists(names[2].c_str()));
+  unzip.close_zip_file();
+
+  remove(ZIP_FILENAME);
+  remove(INDEX_FILENAME);
+}
+
+// Without an index file, the index is built from the central directory at
+// every opening: every name is found the same way.
+TEST(UnzipTest, no_index_file) {
+  std::vector<std::string> names;
+  ASSERT_TRUE(create_book(names));
+  remove(INDEX_FILENAME);
+
+  for (int pass = 0; pass < 2; pass++) {
+    ASSERT_TRUE(unzip.open_zip_file(ZIP_FILENAME));
+    EXPECT_EQ(unzip.get_file_count(), FILE_COUNT);
+    for (auto & name : names) ASSERT_TRUE(unzip.file_exists(name.c_str())) << name;
+    EXPECT_FALSE(unzip.file_exists("OEBPS/text/chapter9999.xhtml"));
+    unzip.close_zip_file();
+  }
+
+  struct stat stat_buf;
+  EXPECT_NE(stat(INDEX_FILENAME, &stat_buf), 0);
+
+  remove(ZIP_FILENAME);
+}
+
+// Files retrieved by several threads at the same time, while the
+// shared stream reader is in use.
+TEST(UnzipTest, concurrent_readers) {
+  static const int THREAD_COUNT = 4;
+
+  std::vector<std::string> names;
+  ASSERT_TRUE(create_book(names));
+
+  ASSERT_TRUE(unzip.open_zip_file(ZIP_FILENAME));
+
+  uint32_t size;
+  ASSERT_TRUE(unzip.open_stream_file(names[1].c_str(), size));
+
+  int32_t errors[THREAD_COUNT] = { 0 };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREAD_COUNT; t++) {
+    threads.emplace_back([&names, &errors, t]() {
+      for (int i = t; i < FILE_COUNT; i += THREAD_COUNT) {
+        uint32_t file_size;
+        auto data = unzip.get_file(names[i].c_str(), file_size);
+        std::string expected = (i == 0) ? "application/epub+zip" : content_of(names[i]);
+        if ((data == nullptr) || (std::string(data.get(), file_size) != expected)) errors[t]++;
+      }
+    });
+  }
+
+  char     chunk[8];
+  uint32_t chunk_size = sizeof(chunk);
+  std::string content;
+  while (unzip.get_stream_data(chunk, chunk_size) && (chunk_size > 0)) {
+    content.append(chunk, chunk_size);
+    chunk_size = sizeof(chunk);
+  }
+  unzip.close_stream_file();
+
+  for (auto & thread : threads) thread.join();
+
+  EXPECT_EQ(content, content_of(names[1]));
+  for (int t = 0; t < THREAD_COUNT; t++) EXPECT_EQ(errors[t], 0);
+
+  // A reader opened before the zip file is closed can still be used
+  Unzip::Reader reader(unzip);
+  ASSERT_TRUE(reader.open(names[2].c_str(), size));
+  unzip.close_zip_file();
+
+  std::string data(size, ' ');
+  ASSERT_TRUE(reader.read(&data[0], size));
+  EXPECT_EQ(data, content_of(names[2]));
+  reader.close();
+
+  EXPECT_FALSE(reader.open(names[2].c_str(), size));
+
+  remove(ZIP_FILENAME);
+}
+
+#endif
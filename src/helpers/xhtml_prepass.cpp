@@ -0,0 +1,105 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "helpers/xhtml_prepass.hpp"
+
+#include <cstring>
+
+static constexpr char    CDATA_START[]      = "/*<![CDATA[*/";
+static constexpr char    CDATA_END[]        = "/*]]>*/";
+static constexpr uint8_t CDATA_START_LENGTH = sizeof(CDATA_START) - 1;
+static constexpr uint8_t CDATA_END_LENGTH   = sizeof(CDATA_END)   - 1;
+
+// Bytes looked at past a '<' or '/': kept for the next call, unless at the
+// end of the item.
+static constexpr uint8_t LOOKAHEAD = CDATA_START_LENGTH;
+
+static inline bool
+is_tag(const char * s, const char * end, const char * name, uint8_t length)
+{
+  if ((s + length) >= end) return false;
+  if (memcmp(s, name, length) != 0) return false;
+
+  char ch = s[length];
+  return (ch == ' ') || (ch == '>') || (ch == '/') || (ch == '\t') || (ch == '\r') || (ch == '\n');
+}
+
+// The comment markers are replaced with spaces, keeping the CDATA markers:
+// "/*<![CDATA[*/" becomes "  <![CDATA[  ", "/*]]>*/" becomes "  ]]>  ".
+static inline void
+blank_markers(char * str, uint8_t length)
+{
+  str[0]          = str[1]          = ' ';
+  str[length - 2] = str[length - 1] = ' ';
+}
+
+// Not 0 if one of the bytes of the word has the value
+typedef size_t Word;
+
+static constexpr Word ONES  = ~(Word) 0 / 0xFF;
+static constexpr Word HIGHS = ONES * 0x80;
+
+static inline Word
+has_byte(Word w, uint8_t value)
+{
+  Word x = w ^ (ONES * value);
+  return (x - ONES) & ~x & HIGHS;
+}
+
+// The bytes are skipped a word at a time, up to the next '<', '>' or '/':
+// the tag delimiters and the start of the CDATA comment markers.
+uint32_t
+XHTMLPrepass::process(char * data, uint32_t size, bool last)
+{
+  const char * end   = data + size;
+  const char * limit = last ? end : ((size > LOOKAHEAD) ? end - LOOKAHEAD : data);
+  char       * str   = data;
+
+  while (str < limit) {
+    const char * text = str;
+    while ((str + sizeof(Word)) <= limit) {
+      Word w;
+      memcpy(&w, str, sizeof(Word));
+      if (has_byte(w, '<') | has_byte(w, '>') | has_byte(w, '/')) break;
+      str += sizeof(Word);
+    }
+    if (!in_tag) stats.text_size += str - text;
+    if (str >= limit) break;
+
+    char ch = *str;
+
+    if (ch == '<') {
+      in_tag = true;
+      stats.tag_count++;
+      if      (is_tag(str + 1, end, "link",  4)) stats.link_count++;
+      else if (is_tag(str + 1, end, "style", 5)) stats.style_count++;
+    }
+    else if (ch == '>') {
+      in_tag = false;
+    }
+    else if ((ch == '/') && ((str + 1) < end) && (str[1] == '*')) {
+      uint32_t left = end - str;
+      if ((left >= CDATA_START_LENGTH) && (memcmp(str, CDATA_START, CDATA_START_LENGTH) == 0)) {
+        blank_markers(str, CDATA_START_LENGTH);
+        str += CDATA_START_LENGTH;
+        stats.cdata_count++;
+        continue;
+      }
+      if ((left >= CDATA_END_LENGTH) && (memcmp(str, CDATA_END, CDATA_END_LENGTH) == 0)) {
+        blank_markers(str, CDATA_END_LENGTH);
+        str += CDATA_END_LENGTH;
+        stats.cdata_count++;
+        continue;
+      }
+      if (!in_tag) stats.text_size++;
+    }
+    else if (!in_tag) {
+      stats.text_size++;
+    }
+
+    str++;
+  }
+
+  return str - data;
+}
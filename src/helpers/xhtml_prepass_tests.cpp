@@ -0,0 +1,115 @@
+#if TESTING
+
+#include "gtest/gtest.h"
+#include "helpers/xhtml_prepass.hpp"
+#include "pugixml.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The processing done before the single pass: a copy of the item, then
+// each marker searched again from the start of the buffer.
+static void
+previous_prepare(char * dst, const char * src, uint32_t size)
+{
+  memcpy(dst, src, size);
+  dst[size] = 0;
+
+  char * str;
+  while ((str = strstr(dst, "/*<![CDATA[*/")) != nullptr) {
+    *str++ = ' ';
+    *str   = ' ';
+    str   +=  10;
+    *str++ = ' ';
+    *str   = ' ';
+  }
+  while ((str = strstr(dst, "/*]]>*/")) != nullptr) {
+    *str++ = ' ';
+    *str   = ' ';
+    str   +=   4;
+    *str++ = ' ';
+    *str   = ' ';
+  }
+}
+
+static std::string
+chapter(int paragraphs, int scripts)
+{
+  std::string s = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                  "<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Chapter</title>"
+                  "<link rel=\"stylesheet\" type=\"text/css\" href=\"style.css\"/>"
+                  "<link rel=\"stylesheet\" type=\"text/css\" href=\"page.css\"/>"
+                  "<style type=\"text/css\">/*<![CDATA[*/ p { margin: 0; } /*]]>*/</style>"
+                  "</head><body>";
+  for (int i = 0; i < scripts; i++) {
+    s += "<script type=\"text/javascript\">/*<![CDATA[*/ var a = 1 < 2; /*]]>*/</script>";
+  }
+  for (int i = 0; i < paragraphs; i++) {
+    s += "<p class=\"text\">It is a truth universally acknowledged, that a single man in possession "
+         "of a good fortune, must be in want of a wife.</p>\n";
+  }
+  return s + "</body></html>";
+}
+
+// The item is prepared as a whole, or in parts as when inflated
+static XHTMLPrepass::Stats
+prepare(std::string & item, uint32_t part_size)
+{
+  XHTMLPrepass prepass;
+  uint32_t     size      = 0;
+  uint32_t     processed = 0;
+
+  do {
+    size       = ((item.size() - size) < part_size) ? item.size() : size + part_size;
+    processed += prepass.process(&item[processed], size - processed, size == item.size());
+  } while (size < item.size());
+
+  EXPECT_EQ(processed, item.size());
+  return prepass.get_stats();
+}
+
+TEST(XHTMLPrepassTest, same_as_previous) {
+  std::vector<std::string> items = {
+    chapter(100, 0), chapter(10, 50), "", "/*", "/*<![CDATA[*", "x/*]]>*/", "/*]]>*//*<![CDATA[*/"
+  };
+
+  for (auto & item : items) {
+    std::vector<char> expected(item.size() + 1);
+    previous_prepare(expected.data(), item.c_str(), item.size());
+
+    for (uint32_t part_size : { (uint32_t) item.size() + 1, 1U, 5U, 13U, 100U }) {
+      std::string result = item;
+      prepare(result, part_size);
+      EXPECT_EQ(memcmp(expected.data(), result.c_str(), item.size() + 1), 0) << item << ", parts of " << part_size;
+    }
+  }
+}
+
+TEST(XHTMLPrepassTest, stats) {
+  std::string item = "<html><head><link href=\"a.css\"/><linked/><style>/*<![CDATA[*/a{}/*]]>*/</style></head>"
+                     "<body><p>Text</p><p>More text</p></body></html>";
+
+  for (uint32_t part_size : { (uint32_t) item.size(), 1U, 7U, 16U }) {
+    std::string result = item;
+    XHTMLPrepass::Stats stats = prepare(result, part_size);
+
+    EXPECT_EQ(stats.link_count,  1);
+    EXPECT_EQ(stats.style_count, 1);
+    EXPECT_EQ(stats.cdata_count, 2);
+    EXPECT_EQ(stats.tag_count,  14U);
+    EXPECT_EQ(stats.text_size,   (uint32_t) strlen("a{}TextMore text"));
+    EXPECT_STREQ(result.c_str() + item.find("/*<![CDATA[*/"), "  <![CDATA[  a{}  ]]>  </style></head><body><p>Text</p><p>More text</p></body></html>");
+  }
+}
+
+TEST(XHTMLPrepassTest, parsed) {
+  std::string item = chapter(20, 20);
+  prepare(item, 4096);
+
+  pugi::xml_document doc;
+  ASSERT_EQ(doc.load_buffer_inplace(&item[0], item.size()).status, pugi::status_ok);
+  EXPECT_STREQ(doc.child("html").child("body").child("script").first_child().value(), "   var a = 1 < 2;   ");
+}
+
+#endif
@@ -5,11 +5,11 @@
 #include "models/css.hpp"
 #include "models/css_parser.hpp"
 
-MemoryPool<CSS::Value>        CSS::value_pool;
-MemoryPool<CSS::Property>     CSS::property_pool;
-MemoryPool<CSS::Properties>   CSS::properties_pool;
-MemoryPool<CSS::SelectorNode> CSS::selector_node_pool;
-MemoryPool<CSS::Selector>     CSS::selector_pool;
+SharedMemoryPool<CSS::Value>        CSS::value_pool;
+SharedMemoryPool<CSS::Property>     CSS::property_pool;
+SharedMemoryPool<CSS::Properties>   CSS::properties_pool;
+SharedMemoryPool<CSS::SelectorNode> CSS::selector_node_pool;
+SharedMemoryPool<CSS::Selector>     CSS::selector_pool;
 
 CSS::PropertyMap CSS::property_map = {
   { "not-used",       CSS::PropertyId::NOT_USED       },
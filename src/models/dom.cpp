@@ -4,7 +4,8 @@
 
 #include "models/dom.hpp"
 
-MemoryPool<DOM::Node> * DOM::node_pool = nullptr;
+SharedMemoryPool<DOM::Node> * DOM::node_pool = nullptr;
+std::mutex                    DOM::pool_mutex;
 
 DOM::Tags DOM::tags
   = {{"p",           Tag::P}, {"div",               Tag::DIV}, {"span", Tag::SPAN}, {"br",   Tag::BREAK}, {"h1",                 Tag::H1},  
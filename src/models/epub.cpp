@@ -12,7 +12,9 @@
 #include "models/image_factory.hpp"
 #include "viewers/msg_viewer.hpp"
 #include "viewers/book_viewer.hpp"
+#include "models/ttf2.hpp"
 #include "helpers/unzip.hpp"
+#include "models/item_cache.hpp"
 
 #include "logging.hpp"
 #if EPUB_INKPLATE_BUILD
@@ -25,6 +27,8 @@
 #include <iterator>
 #include <algorithm>
 #include <cctype>
+#include <sys/stat.h>
+#include <dirent.h>
 
 using namespace pugi;
 
@@ -113,7 +117,6 @@ EPub::EPub()
   file_is_open           = false;
   fonts_size_too_large   = false;
   fonts_size             = 0;
-  current_itemref        = xml_node(NULL);
   opf_base_path.clear();
   current_filename.clear();
 }
@@ -155,25 +158,42 @@ EPub::check_mimetype()
 
 #define ERR(e) { err = e; break; }
 
+static inline const char *
+encrypted_uri(xml_node encrypted_data)
+{
+  return encrypted_data.child("enc:CipherData")
+                       .child("enc:CipherReference")
+                       .attribute("URI")
+                       .value();
+}
+
+static EPub::ObfuscationType
+obfuscation_of(xml_node encrypted_data)
+{
+  xml_attribute attr = encrypted_data.child("enc:EncryptionMethod").attribute("Algorithm");
+
+  if (strcmp(attr.value(), "http://ns.adobe.com/pdf/enc#RC") == 0) {
+    return EPub::ObfuscationType::ADOBE;
+  } 
+  else if (strcmp(attr.value(), "http://www.idpf.org/2008/embedding") == 0) {
+    return EPub::ObfuscationType::IDPF;
+  } 
+  return EPub::ObfuscationType::UNKNOWN;
+}
+
 EPub::ObfuscationType
 EPub::get_file_obfuscation(const char * filename)
 {
   ObfuscationType obf_type = ObfuscationType::NONE;
 
   if (encryption_is_present()) {
+    // Files of the manifest got their obfuscation when the book was opened
+    const ManifestEntry * entry = find_manifest_entry(filename);
+    if (entry != nullptr) return entry->obf_type;
+
     for (auto & n : encryption.child("encryption").children("enc:EncryptedData")) {
-      if (strcmp(n.child("enc:CipherData")
-                  .child("enc:CipherReference")
-                  .attribute("URI")
-                  .value(), filename) == 0) {
-        xml_attribute attr = n.child("enc:EncryptionMethod").attribute("Algorithm");
-        if (strcmp(attr.value(), "http://ns.adobe.com/pdf/enc#RC") == 0) {
-          obf_type = ObfuscationType::ADOBE;
-        } 
-        else if (strcmp(attr.value(), "http://www.idpf.org/2008/embedding") == 0) {
-          obf_type = ObfuscationType::IDPF;
-        } 
-        else obf_type = ObfuscationType::UNKNOWN;
+      if (strcmp(encrypted_uri(n), filename) == 0) {
+        obf_type = obfuscation_of(n);
         break;
       }
     }
@@ -416,6 +436,96 @@ EPub::get_opf(std::string & filename)
   return completed;
 }
 
+// The spine, manifest and encryption lookups are done through these tables
+// instead of searching the OPF document each time an item is retrieved.
+void
+EPub::build_opf_tables()
+{
+  clear_opf_tables();
+
+  xml_node package = opf.find_child(package_pred);
+  xml_node node;
+
+  if ((node = package.find_child(manifest_pred))) {
+    int16_t count = 0;
+    for (auto n : node.children()) if (item_pred(n)) count++;
+
+    // manifest_filenames refers to the entries filename: no reallocation
+    manifest.reserve(count);
+
+    for (auto n : node.children()) {
+      if (!item_pred(n)) continue;
+      const char * href = n.attribute("href").value();
+      manifest.push_back({
+        .id            = n.attribute("id").value(),
+        .href          = href,
+        .media_type    = n.attribute("media-type").value(),
+        .filename      = filename_locate(href),
+        .itemref_index = -1,
+        .obf_type      = ObfuscationType::NONE
+      });
+    }
+
+    // The first entry is kept for duplicates, as the OPF search did
+    for (int16_t i = 0; i < (int16_t) manifest.size(); i++) {
+      if (*manifest[i].id != 0) manifest_ids.emplace(manifest[i].id, i);
+      manifest_filenames.emplace(manifest[i].filename, i);
+    }
+  }
+
+  if ((node = package.find_child(spine_pred))) {
+    for (auto n : node.children()) {
+      auto    it    = manifest_ids.find(n.attribute("idref").value());
+      int16_t index = (it == manifest_ids.end()) ? -1 : it->second;
+      if ((index >= 0) && (manifest[index].itemref_index == -1)) manifest[index].itemref_index = spine.size();
+      spine.push_back(index);
+    }
+  }
+
+  if (encryption_is_present()) {
+    for (auto & n : encryption.child("encryption").children("enc:EncryptedData")) {
+      auto it = manifest_filenames.find(encrypted_uri(n));
+      if ((it != manifest_filenames.end()) && (manifest[it->second].obf_type == ObfuscationType::NONE)) {
+        manifest[it->second].obf_type = obfuscation_of(n);
+      }
+    }
+  }
+
+  LOG_D("OPF tables: %d manifest entries, %d itemrefs.", (int32_t) manifest.size(), (int32_t) spine.size());
+}
+
+void
+EPub::clear_opf_tables()
+{
+  manifest_ids.clear();
+  manifest_filenames.clear();
+  spine.clear();
+  manifest.clear();
+  manifest.shrink_to_fit();
+}
+
+const EPub::ManifestEntry *
+EPub::get_manifest_entry(const char * id)
+{
+  auto it = manifest_ids.find(id);
+  return (it == manifest_ids.end()) ? nullptr : &manifest[it->second];
+}
+
+const EPub::ManifestEntry *
+EPub::get_spine_entry(int16_t itemref_index)
+{
+  if ((itemref_index < 0) || (itemref_index >= (int16_t) spine.size()) || 
+      (spine[itemref_index] < 0)) return nullptr;
+  return &manifest[spine[itemref_index]];
+}
+
+const EPub::ManifestEntry *
+EPub::find_manifest_entry(const std::string & filename)
+{
+  auto it = manifest_filenames.find(filename);
+  return (it == manifest_filenames.end()) ? nullptr : &manifest[it->second];
+}
+
 std::string 
 EPub::filename_locate(const char * fname)
 {
@@ -469,24 +579,32 @@ EPub::load_fonts()
   }
 }
 
-void
-EPub::decrypt(void * buffer, const uint32_t size, ObfuscationType obf_type)
+bool
+EPub::get_key(ObfuscationType obf_type, const uint8_t *& key, uint8_t & key_size, uint16_t & length)
 {
-  uint16_t decrypt_length;
-  uint8_t * key;
-  uint8_t   key_size;
-
   if (obf_type == ObfuscationType::ADOBE) {
-    decrypt_length = 1024;
-    key_size       = 16;
-    key            = (uint8_t *) &bin_uuid;
+    length   = 1024;
+    key_size = 16;
+    key      = (const uint8_t *) &bin_uuid;
   }
   else if (obf_type == ObfuscationType::IDPF) {
-    decrypt_length = 1040;
-    key_size       = 20;
-    key            = (uint8_t *) &sha_uuid;
+    length   = 1040;
+    key_size = 20;
+    key      = (const uint8_t *) &sha_uuid;
   }
-  else return;
+  else return false;
+
+  return true;
+}
+
+void
+EPub::decrypt(void * buffer, const uint32_t size, ObfuscationType obf_type)
+{
+  uint16_t        decrypt_length;
+  const uint8_t * key;
+  uint8_t         key_size;
+
+  if (!get_key(obf_type, key, key_size, decrypt_length)) return;
 
   uint16_t  length = (size > decrypt_length) ? decrypt_length : size;
   uint8_t  key_idx = 0;
@@ -506,6 +624,13 @@ EPub::load_font(const std::string      filename,
   uint32_t size;
   LOG_D("Font file name: %s", filename.c_str());
   if ((size = unzip.get_file_size(filename.c_str())) > 0) {
+    #if TTF_STREAMING
+      // Read on demand, the font is not counted in the memory used by fonts
+      ObfuscationType obf_type = get_file_obfuscation(filename.c_str());
+      if ((obf_type != ObfuscationType::UNKNOWN) && 
+          stream_font(filename, font_family, style, obf_type)) return true;
+    #endif
+
     if ((fonts_size + size) > 800000) {
       fonts_size_too_large = true;
       LOG_E("Fonts are using too much space (max 800K). Kept the first fonts read.");
@@ -561,6 +686,105 @@ EPub::load_font(const std::string      filename,
   return false;
 }
 
+// The fonts extracted from a book have their name starting with this prefix
+static std::string
+extracted_fonts_prefix(const std::string & epub_filename)
+{
+  size_t start = epub_filename.find_last_of('/');
+  size_t end   = epub_filename.find_last_of('.');
+
+  start = (start == std::string::npos) ? 0 : start + 1;
+  if ((end == std::string::npos) || (end < start)) end = epub_filename.length();
+
+  char prefix[10];
+  snprintf(prefix, 10, "%08X_", 
+           (unsigned int) GlyphAtlas::hash(epub_filename.c_str() + start, end - start));
+  return prefix;
+}
+
+std::string
+EPub::extracted_font_filename(const std::string & epub_filename,
+                              const std::string & filename,
+                              uint32_t            offset)
+{
+  char name[24];
+  snprintf(name, 24, "%08X_%u.", 
+           (unsigned int) GlyphAtlas::hash(filename.c_str(), filename.length()), 
+           (unsigned int) offset);
+  return std::string(EPUB_FONTS_FOLDER "/") + extracted_fonts_prefix(epub_filename) + name +
+         filename.substr(filename.find_last_of('.') + 1);
+}
+
+void
+EPub::remove_fonts(const std::string & epub_filename)
+{
+  std::string prefix = extracted_fonts_prefix(epub_filename);
+
+  DIR * dir = opendir(EPUB_FONTS_FOLDER);
+  if (dir == nullptr) return;
+
+  std::vector<std::string> filenames;
+  struct dirent * de;
+  while ((de = readdir(dir)) != nullptr) {
+    if (strncmp(de->d_name, prefix.c_str(), prefix.length()) == 0) {
+      filenames.push_back(std::string(EPUB_FONTS_FOLDER "/") + de->d_name);
+    }
+  }
+  closedir(dir);
+
+  for (auto & filename : filenames) {
+    LOG_D("Deleting font file: %s", filename.c_str());
+    ::remove(filename.c_str());
+  }
+}
+
+// TrueType and OpenType fonts stored without compression are read directly
+// from the EPub file. The others are first extracted in EPUB_FONTS_FOLDER 
+// (once: the file is kept for the next time the book is opened, and removed
+// with the book, see remove_fonts()). The obfuscation key is applied as the
+// font data is read.
+bool
+EPub::stream_font(const std::string    & filename, 
+                  const std::string    & font_family, 
+                  const Fonts::FaceStyle style,
+                  ObfuscationType        obf_type)
+{
+  std::string ext = filename.substr(filename.find_last_of(".") + 1);
+  if ((ext != "ttf") && (ext != "otf")) return false;
+
+  uint32_t offset, size;
+  uint16_t method;
+  if (!unzip.get_file_location(filename.c_str(), offset, size, method)) return false;
+
+  FontStream * stream;
+
+  if (method == 0) {
+    stream = new FontStream(current_filename, offset, size);
+  }
+  else {
+    std::string font_filename = extracted_font_filename(current_filename, filename, offset);
+
+    struct stat stat_buf;
+    if ((stat(font_filename.c_str(), &stat_buf) != 0) || 
+        (stat_buf.st_size != unzip.get_file_size(filename.c_str()))) {
+      if ((stat(EPUB_FONTS_FOLDER, &stat_buf) != 0) && (mkdir(EPUB_FONTS_FOLDER, 0775) != 0)) {
+        LOG_E("Unable to create folder %s", EPUB_FONTS_FOLDER);
+        return false;
+      }
+      if (!unzip.extract_file(filename.c_str(), font_filename)) return false;
+    }
+
+    stream = new FontStream(font_filename);
+  }
+
+  const uint8_t * key;
+  uint8_t         key_size;
+  uint16_t        length;
+  if (get_key(obf_type, key, key_size, length)) stream->set_key(key, key_size, length);
+
+  return fonts.add(font_family, style, stream, filename);
+}
+
 void
 EPub::retrieve_fonts_from_css(CSS & css)
 {
@@ -652,7 +876,9 @@ EPub::retrieve_css(ItemInfo & item)
   xml_node      node;
   xml_attribute attr;
   
-  if ((node = item.xml_doc.child("html").child("head").child("link"))) {
+  // The <link> and <style> tags were counted when the item was prepared
+  if ((item.stats.link_count > 0) &&
+      (node = item.xml_doc.child("html").child("head").child("link"))) {
     do {
       if ((attr = node.attribute("type")) &&
           (strcmp(attr.value(), "text/css") == 0) &&
@@ -672,21 +898,19 @@ EPub::retrieve_css(ItemInfo & item)
         if (css_cache_it == css_cache.end()) {
 
           // The css file was not found. Load it in the cache.
-          uint32_t size;
           std::string fname = item.file_path;
           fname.append(css_id.c_str());
-          std::unique_ptr<char[], MallocDeleter> data = retrieve_file(fname.c_str(), size);
+          ItemCache::Handle data = item_cache.get(filename_locate(fname.c_str()));
 
           if (data != nullptr) {
             #if COMPUTE_SIZE
-              memory_used += size;
+              memory_used += data->size;
             #endif
             LOG_D("CSS Filename: %s", fname.c_str());
             std::string path;
             extract_path(fname.c_str(), path);
-            CSS * css_tmp = new CSS(css_id.c_str(), path.c_str(), data.get(), size, 0);
+            CSS * css_tmp = new CSS(css_id.c_str(), path.c_str(), data->data, data->size, 0);
             if (css_tmp == nullptr) msg_viewer.out_of_memory("css temp allocation");
-            // data auto freed
 
             // #if DEBUGGING
             //   css_tmp->show();
@@ -707,7 +931,8 @@ EPub::retrieve_css(ItemInfo & item)
   // Now look at <style> tags presents in the <html><head>, creating a temporary
   // css object for each of them.
 
-  if ((node = item.xml_doc.child("html").child("head" ).child("style"))) {
+  if ((item.stats.style_count > 0) &&
+      (node = item.xml_doc.child("html").child("head" ).child("style"))) {
     do {
       xml_node sub = node.first_child();
       const char * buffer;
@@ -744,32 +969,26 @@ EPub::retrieve_css(ItemInfo & item)
 
 
 bool 
-EPub::get_item(pugi::xml_node itemref, 
-               ItemInfo &     item)
+EPub::get_item(int16_t    itemref_index, 
+               ItemInfo & item)
 {
   int err = 0;
   #define ERR(e) { err = e; break; }
 
   if (!file_is_open) return false;
 
-  // if ((item.data != nullptr) && (current_itemref == itemref))
-  // return true;
-
   clear_item_data(item);
 
-  xml_node      node, node2;
-  xml_attribute attr;
-
-  const char * id = itemref.attribute("idref").value();
-
   bool completed = false;
 
   while (!completed) {
-    if (!((node = opf.find_child(package_pred).find_child(manifest_pred)) &&
-          (node = one_by_attr(node, "item", "opf:item", "id", id)))) ERR(1);
+    const ManifestEntry * spine_entry = get_spine_entry(itemref_index);
+    if (spine_entry == nullptr) ERR(1);
 
-    if (!(attr = node.attribute("media-type"))) ERR(2);
-    const char* media_type = attr.value();
+    const ManifestEntry & entry = *spine_entry;
+
+    if (*entry.media_type == 0) ERR(2);
+    const char* media_type = entry.media_type;
 
     if      (strcmp(media_type, "application/xhtml+xml") == 0) item.media_type = MediaType::XML;
     else if (strcmp(media_type, "image/jpeg"           ) == 0) item.media_type = MediaType::JPEG;
@@ -778,35 +997,35 @@ EPub::get_item(pugi::xml_node itemref,
     else if (strcmp(media_type, "image/gif"            ) == 0) item.media_type = MediaType::GIF;
     else ERR(3);
 
-    if (!(attr = node.attribute("href"))) ERR(5);
+    if (*entry.href == 0) ERR(5);
 
-    LOG_D("Retrieving file %s", attr.value());
+    LOG_D("Retrieving file %s", entry.href);
 
     uint32_t size;
-    extract_path(attr.value(), item.file_path);
+    extract_path(entry.href, item.file_path);
 
     // LOG_D("item.file_path: %s.", item.file_path.c_str());
 
-    if ((item.data = retrieve_file(attr.value(), size)) == nullptr) ERR(6);
+    // Decompressed (and prepared for parsing) once while in the item cache. 
+    // The copy is parsed in place.
+    if (item.media_type == MediaType::XML) {
+      ItemCache::Handle buffer = item_cache.get(entry.filename, true);
+      if (buffer == nullptr) ERR(6);
+
+      size = buffer->size;
+      item.data.reset((char *) allocate(size + 1));
+      if (item.data == nullptr) ERR(7);
+
+      memcpy(item.data.get(), buffer->data, size + 1);
+      item.stats = buffer->stats;
+    }
+    else {
+      if ((item.data = item_cache.get_copy(entry.filename, size)) == nullptr) ERR(6);
+    }
 
     if (item.media_type == MediaType::XML) {
 
-      char * str;
-      while ((str = strstr(item.data.get(), "/*<![CDATA[*/")) != nullptr) {
-        *str++ = ' ';
-        *str   = ' ';
-        str   +=  10;
-        *str++ = ' ';
-        *str   = ' ';
-      }
-      while ((str = strstr(item.data.get(), "/*]]>*/")) != nullptr) {
-        *str++ = ' ';
-        *str   = ' ';
-        str   +=   4;
-        *str++ = ' ';
-        *str   = ' ';
-      }
-      LOG_D("Reading file %s", attr.value());
+      LOG_D("Reading file %s: %u bytes of text, %u tags.", entry.href, item.stats.text_size, item.stats.tag_count);
 
       xml_parse_result res = item.xml_doc.load_buffer_inplace(item.data.get(), size);
       if (res.status != status_ok) {
@@ -816,7 +1035,7 @@ EPub::get_item(pugi::xml_node itemref,
         //   true, false, 
         //   "XML Error in eBook.", 
         //   "File %s contains XHTML errors and cannot be loaded.",
-        //   attr.value()
+        //   entry.href
         // );
         item.xml_doc.reset();
         if (item.data != nullptr) {
@@ -899,7 +1118,14 @@ EPub::open_file(const std::string & epub_filename)
   #endif
 
   LOG_D("Opening EPub file through unzip...");
-  if (!unzip.open_zip_file(epub_filename.c_str())) {
+  #if EPUB_ZIP_INDEX
+    std::string index_filename = epub_filename.substr(0, epub_filename.find_last_of('.')) + ".zdx";
+    bool        opened         = unzip.open_zip_file(epub_filename.c_str(), index_filename.c_str());
+  #else
+    bool        opened         = unzip.open_zip_file(epub_filename.c_str());
+  #endif
+
+  if (!opened) {
     LOG_E("EPub open_file: Unable to open zip file: %s", epub_filename.c_str());
     return false;
   }
@@ -917,6 +1143,7 @@ EPub::open_file(const std::string & epub_filename)
   }
 
   get_encryption_xml();
+  build_opf_tables();
 
   open_params(epub_filename);
   update_book_format_params();
@@ -939,6 +1166,7 @@ void
 EPub::clear_item_data(ItemInfo & item)
 {
   item.xml_doc.reset();
+  item.stats = {};
   // if (item.data != nullptr) {
   //   free(item.data);
   //   item.data = nullptr;
@@ -961,6 +1189,7 @@ EPub::close_file()
 {
   if (!file_is_open) return true;
 
+  book_viewer.cancel_render_ahead();
   clear_item_data(current_item_info);
 
   if (opf_data) {
@@ -968,6 +1197,7 @@ EPub::close_file()
     opf_data.reset();
   }
 
+  clear_opf_tables();
   opf_base_path.clear();
 
   if (encryption_data) {
@@ -976,6 +1206,7 @@ EPub::close_file()
   }
 
   unzip.close_zip_file();
+  item_cache.clear();
 
   for (auto * css : css_cache) delete css;
 
@@ -1066,41 +1297,47 @@ EPub::get_item_count()
 {
   if (!file_is_open) return 0;
 
-  auto it = opf.find_child(package_pred).find_child(spine_pred).children("itemref");
-  int16_t count = std::distance(it.begin(), it.end());
-  
-  if (count == 0) {
-    it = opf.find_child(package_pred).find_child(spine_pred).children("opf:itemref");
-    count = std::distance(it.begin(), it.end());
-  }
+  int16_t count = spine.size();
 
   LOG_D("Item count: %d", count);
   return count;
 }
 
+// Used to estimate the number of pages before the pages location are
+// computed. The sizes are taken from the zip central directory: no item is
+// decompressed.
+void
+EPub::get_item_sizes(std::vector<int32_t> & sizes)
+{
+  sizes.clear();
+
+  if (!file_is_open) return;
+
+  std::scoped_lock guard(mutex);
+
+  for (int16_t index : spine) {
+    int32_t size = -1;
+
+    if ((index >= 0) && 
+        (strcmp(manifest[index].media_type, "application/xhtml+xml") == 0)) {
+      size = unzip.get_file_size(manifest[index].filename.c_str());
+    }
+    sizes.push_back(size);
+  }
+}
+
 bool 
 EPub::get_item_at_index(int16_t itemref_index)
 {
   if (!file_is_open) return false;
 
   if (current_item_info.itemref_index == itemref_index) return true;
-  
-  xml_node node  = xml_node();
-  int16_t  index = 0;
-
-  for (auto n : opf.find_child(package_pred).find_child(spine_pred).children()) {
-    if (index == itemref_index) { node = n; break; }
-    index++;
-  }
 
-  if (node == nullptr) return false;
+  if ((itemref_index < 0) || (itemref_index >= (int16_t) spine.size())) return false;
 
-  bool res = false;
+  bool res = get_item(itemref_index, current_item_info);
+  current_item_info.itemref_index = itemref_index;
 
-  if ((current_item_info.data == nullptr) || (current_itemref != node)) {
-    if ((res = get_item(node, current_item_info))) current_itemref = node;
-    current_item_info.itemref_index = itemref_index;
-  }
   return res;
 }
 
@@ -1117,18 +1354,10 @@ EPub::get_item_at_index(int16_t    itemref_index,
   
   { std::scoped_lock guard(mutex);
     
-    xml_node node = xml_node();
-    int16_t index = 0;
-
-    for (auto n : opf.find_child(package_pred).find_child(spine_pred).children()) {
-      if (index == itemref_index) { node = n; break; }
-      index++;
-    }
-
     bool res = false;
 
-    if (node) {
-      res = get_item(node, item);
+    if ((itemref_index >= 0) && (itemref_index < (int16_t) spine.size())) {
+      res = get_item(itemref_index, item);
       item.itemref_index = itemref_index;
     }
 
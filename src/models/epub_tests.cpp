@@ -3,6 +3,8 @@
 #include "gtest/gtest.h"
 #include "models/epub.hpp"
 
+#include <sys/stat.h>
+
 TEST(EpubTest, opening_epub_file) {
   EXPECT_TRUE(epub.open_file(BOOKS_FOLDER "/Austen, Jane - Pride and Prejudice.epub"));
 }
@@ -35,4 +37,75 @@ TEST(EpubTest, check_adobe_idpf_file) {
   EXPECT_TRUE(epub.load_font("OEBPS/Fonts/Palatino-Roman.ttf", "Test", Fonts::FaceStyle::NORMAL));
 }
 
+// The manifest and spine lookup tables, checked against the OPF document.
+TEST(EpubTest, opf_tables) {
+  ASSERT_TRUE(epub.open_file(BOOKS_FOLDER "/Austen, Jane - Pride and Prejudice.epub"));
+
+  pugi::xml_node package  = epub.get_opf().child("package");
+  pugi::xml_node manifest = package.child("manifest");
+  ASSERT_TRUE(manifest);
+
+  int16_t index = 0;
+  for (auto n : package.child("spine").children("itemref")) {
+    pugi::xml_node item = manifest.find_child_by_attribute("item", "id", n.attribute("idref").value());
+    const EPub::ManifestEntry * entry = epub.get_spine_entry(index);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_STREQ(entry->id,         item.attribute("id").value());
+    EXPECT_STREQ(entry->href,       item.attribute("href").value());
+    EXPECT_STREQ(entry->media_type, item.attribute("media-type").value());
+    EXPECT_EQ(entry->itemref_index, index);
+    EXPECT_EQ(epub.get_manifest_entry(entry->id), entry);
+    EXPECT_EQ(epub.find_manifest_entry(entry->filename), entry);
+    index++;
+  }
+  EXPECT_GT(index, 0);
+  EXPECT_EQ(epub.get_item_count(), index);
+  EXPECT_EQ(epub.get_spine_entry(index), nullptr);
+  EXPECT_EQ(epub.get_spine_entry(-1),    nullptr);
+
+  // Manifest items outside of the spine
+  const char * toc_id = package.child("spine").attribute("toc").value();
+  const EPub::ManifestEntry * toc = epub.get_manifest_entry(toc_id);
+  ASSERT_NE(toc, nullptr);
+  EXPECT_EQ(toc->itemref_index, -1);
+
+  EXPECT_EQ(epub.get_manifest_entry("no-such-id"), nullptr);
+  EXPECT_EQ(epub.find_manifest_entry("OEBPS/no_such_file.xhtml"), nullptr);
+}
+
+// The fonts extracted from a book are removed with the book, and only them.
+TEST(EpubTest, remove_fonts) {
+  static const std::string BOOK  = BOOKS_FOLDER "/Book one.epub";
+  static const std::string OTHER = BOOKS_FOLDER "/Book two.epub";
+
+  std::string fonts[3] = {
+    EPub::extracted_font_filename(BOOK,  "OEBPS/fonts/a.otf", 1000),
+    EPub::extracted_font_filename(BOOK,  "OEBPS/fonts/b.ttf", 2000),
+    EPub::extracted_font_filename(OTHER, "OEBPS/fonts/a.otf", 1000)
+  };
+  EXPECT_NE(fonts[0], fonts[1]);
+  EXPECT_NE(fonts[0], fonts[2]);
+  EXPECT_EQ(fonts[1].substr(fonts[1].length() - 4), ".ttf");
+
+  struct stat stat_buf;
+  if (stat(EPUB_FONTS_FOLDER, &stat_buf) != 0) {
+    ASSERT_EQ(mkdir(EPUB_FONTS_FOLDER, 0775), 0);
+  }
+  for (auto & font : fonts) {
+    FILE * f = fopen(font.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    fclose(f);
+  }
+
+  // As called once the book extension has been replaced
+  EPub::remove_fonts(BOOKS_FOLDER "/Book one.zdx");
+
+  EXPECT_NE(stat(fonts[0].c_str(), &stat_buf), 0);
+  EXPECT_NE(stat(fonts[1].c_str(), &stat_buf), 0);
+  EXPECT_EQ(stat(fonts[2].c_str(), &stat_buf), 0);
+
+  EPub::remove_fonts(OTHER);
+  EXPECT_NE(stat(fonts[2].c_str(), &stat_buf), 0);
+}
+
 #endif
@@ -18,63 +18,191 @@ Font::Font()
   memory_font       = nullptr;
   current_font_size = -1;
   ready             = false;
- }
+  last_slab         = NO_SLAB;
+  rasterized_count  = 0;
 
-void
-Font::add_buff_to_byte_pool()
-{
-  BytePool * pool = (BytePool *) allocate(BYTE_POOL_SIZE);
-  if (pool == nullptr) {
-    LOG_E("Unable to allocated memory for bytes pool.");
-    msg_viewer.out_of_memory("ttf pool allocation");
-  }
-  byte_pools.push_front(pool);
-
-  byte_pool_idx = 0;
+  for (auto & m : size_metrics) m.glyph_size.store(-1, std::memory_order_relaxed);
+  for (auto & r : slab_references) r.store(0, std::memory_order_relaxed);
 }
 
+std::atomic<int32_t> Font::slabs_size{ 0 };
+std::atomic<int32_t> Font::slabs_peak_size{ 0 };
+
 uint8_t * 
-Font::byte_pool_alloc(uint16_t size)
+Font::byte_pool_alloc(uint16_t size, int16_t glyph_size)
 {
-  if (size > BYTE_POOL_SIZE) {
-    LOG_E("Byte Pool Size NOT BIG ENOUGH!!!");
-    std::abort();
+  int16_t idx = -1;
+
+  // The last slab opened for the size is usually the one with some room
+  for (int16_t i = slabs.size() - 1; i >= 0; i--) {
+    Slab & slab = slabs[i];
+    if ((slab.pool != nullptr) && 
+        (slab.glyph_size == glyph_size) && 
+        ((slab.used + size) <= slab.capacity)) {
+      idx = i;
+      break;
+    }
   }
-  if (byte_pools.empty() || (byte_pool_idx + size) > BYTE_POOL_SIZE) {
-    LOG_D("Adding new Byte Pool buffer.");
-    add_buff_to_byte_pool();
+
+  if (idx == -1) {
+    uint16_t capacity = (size > SLAB_SIZE) ? size : SLAB_SIZE;
+    uint8_t * pool    = (uint8_t *) allocate(capacity);
+    if (pool == nullptr) {
+      LOG_E("Unable to allocate memory for a glyph slab.");
+      msg_viewer.out_of_memory("glyph slab allocation");
+    }
+
+    for (int16_t i = 0; i < (int16_t) slabs.size(); i++) {
+      if (slabs[i].pool == nullptr) { idx = i; break; }
+    }
+    if (idx == -1) {
+      idx = slabs.size();
+      slabs.push_back(Slab());
+    }
+
+    slabs[idx] = { .pool = pool, .capacity = capacity, .used = 0, .glyph_size = glyph_size };
+
+    int32_t total = (slabs_size += capacity);
+    int32_t peak  = slabs_peak_size;
+    while ((total > peak) && !slabs_peak_size.compare_exchange_weak(peak, total)) { }
+
+    LOG_D("New slab %d for size %d.", idx, glyph_size);
   }
 
-  uint8_t * buff = &(*byte_pools.front())[byte_pool_idx];
-  byte_pool_idx += size;
+  Slab    & slab = slabs[idx];
+  uint8_t * buff = &slab.pool[slab.used];
+  slab.used += size;
+  last_slab  = idx;
 
   return buff;
 }
 
+int32_t
+Font::get_byte_pool_size()
+{
+  std::scoped_lock guard(mutex);
+
+  int32_t size = 0;
+  for (auto & slab : slabs) {
+    if (slab.pool != nullptr) size += slab.capacity;
+  }
+  return size;
+}
+
+int32_t
+Font::evict_slab(int16_t idx)
+{
+  std::scoped_lock guard(mutex);
+
+  if ((idx < 0) || (idx >= (int16_t) slabs.size()) || (slabs[idx].pool == nullptr)) return 0;
+
+  cache.for_each([idx](Glyph * glyph) {
+    if (glyph->slab.load(std::memory_order_relaxed) == idx) {
+      glyph->slab.store(EVICTED_SLAB, std::memory_order_release);
+      glyph->buffer = nullptr;
+    }
+  });
+
+  Slab & slab = slabs[idx];
+  int32_t size = slab.capacity;
+
+  free(slab.pool);
+  slab.pool  = nullptr;
+  slab.used  = 0;
+  slabs_size -= size;
+
+  return size;
+}
+
+int16_t
+Font::get_resident_slab_count()
+{
+  std::scoped_lock guard(mutex);
+
+  int16_t count = 0;
+  for (auto & slab : slabs) if (slab.pool != nullptr) count++;
+  return count;
+}
+
+void
+Font::release_slabs()
+{
+  for (auto & slab : slabs) {
+    if (slab.pool != nullptr) {
+      free(slab.pool);
+      slabs_size -= slab.capacity;
+    }
+  }
+  slabs.clear();
+  for (auto & r : slab_references) r.store(0, std::memory_order_relaxed);
+}
+
 void
 Font::clear_cache()
 {
   std::scoped_lock guard(mutex);
   
   LOG_D("Clear cache...");
-  for (auto const & entry : cache) {
-    for (auto const & glyph : entry.second) {
-      bitmap_glyph_pool.deleteElement(glyph.second);      
+  save_glyphs(true);
+
+  cache.for_each(        [this](Glyph * glyph) { bitmap_glyph_pool.deleteElement(glyph); });
+  metrics_cache.for_each([this](Glyph * glyph) { bitmap_glyph_pool.deleteElement(glyph); });
+
+  release_slabs();
+  
+  cache.clear();
+  metrics_cache.clear();
+
+  for (auto & m : size_metrics) m.glyph_size.store(-1, std::memory_order_relaxed);
+}
+
+bool
+Font::get_size_metrics(int16_t glyph_size, int16_t & line_height, int16_t & descender_height)
+{
+  for (auto & m : size_metrics) {
+    int16_t size = m.glyph_size.load(std::memory_order_acquire);
+    if (size == glyph_size) {
+      line_height      = m.line_height;
+      descender_height = m.descender_height;
+      return true;
     }
+    if (size == -1) break;
   }
 
-  for (auto * buff : byte_pools) {
-    free(buff);
+  std::scoped_lock guard(mutex);
+
+  if (!ready) return false;
+
+  for (auto & m : size_metrics) {
+    int16_t size = m.glyph_size.load(std::memory_order_relaxed);
+    if (size == glyph_size) {
+      line_height      = m.line_height;
+      descender_height = m.descender_height;
+      return true;
+    }
+    if (size == -1) {
+      if (!compute_size_metrics(glyph_size, m.line_height, m.descender_height)) return false;
+      m.glyph_size.store(glyph_size, std::memory_order_release);
+      line_height      = m.line_height;
+      descender_height = m.descender_height;
+      return true;
+    }
   }
-  byte_pools.clear();
-  
-  cache.clear();
-  cache.reserve(50);
+
+  // All entries used by other sizes
+  return compute_size_metrics(glyph_size, line_height, descender_height);
 }
 
 Font::Glyph *
 Font::get_glyph(uint32_t charcode, int16_t glyph_size)
 {
+  // Checked again once referenced: the slab may have been evicted in between
+  Glyph * glyph = cache.find(charcode, glyph_size);
+  if ((glyph != nullptr) && !glyph->is_evicted()) {
+    reference(glyph);
+    if (!glyph->is_evicted()) return glyph;
+  }
+
   std::scoped_lock guard(mutex);
 
   return ready ? get_glyph_internal(charcode, glyph_size) : nullptr;
@@ -84,10 +212,21 @@ Font::get_glyph(uint32_t charcode, int16_t glyph_size)
 Font::Glyph *
 Font::get_glyph(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size, int16_t & kern, bool & ignore_next)
 {
+  ignore_next = false;
+
+  // Without ligature nor kerning program, the face is not needed
+  Font::Glyph * glyph = cache.find(charcode, glyph_size);
+  if ((glyph != nullptr) && !glyph->is_evicted() && (glyph->ligature_and_kern_pgm_index < 0)) {
+    reference(glyph);
+    if (!glyph->is_evicted()) {
+      kern = glyph->advance;
+      return glyph;
+    }
+  }
+
   std::scoped_lock guard(mutex);
 
-  ignore_next = false;
-  Font::Glyph * glyph = get_glyph_internal(charcode, glyph_size);
+  glyph = get_glyph_internal(charcode, glyph_size);
 
   if (glyph != nullptr) {
     if (glyph->ligature_and_kern_pgm_index >= 0) {
@@ -0,0 +1,190 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/font_stream.hpp"
+#include "alloc.hpp"
+#include "logging.hpp"
+
+#include <cstring>
+#include <sys/stat.h>
+
+std::mutex               FontStream::files_mutex;
+std::list<FontStream *>  FontStream::open_streams;
+
+FontStream::FontStream(const std::string & the_filename, uint32_t the_offset, uint32_t the_size) :
+  filename(the_filename),
+  file(nullptr),
+  offset(the_offset),
+  size(the_size),
+  ready(false),
+  stamp(0),
+  block_reads(0),
+  allocated_blocks(0),
+  key_size(0),
+  key_length(0)
+{
+  for (auto & block : blocks) {
+    block.index = -1;
+    block.stamp =  0;
+    block.data  = nullptr;
+  }
+
+  struct stat stat_buf;
+  if (stat(filename.c_str(), &stat_buf) != 0) {
+    LOG_E("Unable to find font file '%s'", filename.c_str());
+  }
+  else {
+    if (size == 0) size = stat_buf.st_size - offset;
+    ready = (size > 0) && ((offset + size) <= (uint32_t) stat_buf.st_size);
+  }
+
+  memset(&stream, 0, sizeof(stream));
+  stream.size               = size;
+  stream.descriptor.pointer = this;
+  stream.read               = read_stream;
+}
+
+FontStream::~FontStream()
+{
+  close_file();
+  for (auto & block : blocks) {
+    if (block.data != nullptr) free(block.data);
+  }
+}
+
+void
+FontStream::set_key(const uint8_t * the_key, uint8_t the_key_size, uint16_t length)
+{
+  key_size   = (the_key_size > sizeof(key)) ? sizeof(key) : the_key_size;
+  key_length = length;
+  memcpy(key, the_key, key_size);
+}
+
+void
+FontStream::close_file()
+{
+  std::scoped_lock guard(files_mutex);
+
+  if (file != nullptr) {
+    fclose(file);
+    file = nullptr;
+    open_streams.remove(this);
+  }
+}
+
+bool
+FontStream::read_file(uint32_t pos, uint8_t * buffer, uint32_t count)
+{
+  { std::scoped_lock guard(files_mutex);
+
+    if (file == nullptr) {
+      if ((file = fopen(filename.c_str(), "rb")) == nullptr) {
+        LOG_E("Unable to open font file '%s'", filename.c_str());
+        return false;
+      }
+      if (open_streams.size() >= MAX_OPEN_FILES) {
+        FontStream * last = open_streams.back();
+        fclose(last->file);
+        last->file = nullptr;
+        open_streams.pop_back();
+      }
+    }
+    else {
+      open_streams.remove(this);
+    }
+    open_streams.push_front(this);
+
+    if (fseek(file, offset + pos, SEEK_SET) || (fread(buffer, count, 1, file) != 1)) {
+      LOG_E("Unable to read font file '%s' at %u", filename.c_str(), pos);
+      return false;
+    }
+  }
+
+  block_reads++;
+
+  if ((key_size > 0) && (pos < key_length)) {
+    uint32_t end = ((pos + count) < key_length) ? (pos + count) : key_length;
+    for (uint32_t p = pos; p < end; p++) buffer[p - pos] ^= key[p % key_size];
+  }
+
+  return true;
+}
+
+FontStream::Block *
+FontStream::get_block(int32_t index)
+{
+  Block * lru = &blocks[0];
+
+  for (auto & block : blocks) {
+    if (block.index == index) {
+      block.stamp = ++stamp;
+      return &block;
+    }
+    if (block.stamp < lru->stamp) lru = &block;
+  }
+
+  if (lru->data == nullptr) {
+    if ((lru->data = (uint8_t *) allocate(BLOCK_SIZE)) == nullptr) {
+      LOG_E("Unable to allocate a font block.");
+      return nullptr;
+    }
+    allocated_blocks++;
+  }
+
+  uint32_t pos   = index * BLOCK_SIZE;
+  uint32_t count = ((pos + BLOCK_SIZE) <= size) ? BLOCK_SIZE : (size - pos);
+
+  if (!read_file(pos, lru->data, count)) {
+    lru->index = -1;
+    lru->stamp =  0;
+    return nullptr;
+  }
+
+  lru->index = index;
+  lru->stamp = ++stamp;
+
+  return lru;
+}
+
+uint32_t
+FontStream::read(uint32_t pos, uint8_t * buffer, uint32_t count)
+{
+  if (pos >= size) return 0;
+  if ((pos + count) > size) count = size - pos;
+
+  // Large reads (whole tables) would flush the blocks: read directly
+  if (count > (BLOCK_SIZE << 1)) {
+    return read_file(pos, buffer, count) ? count : 0;
+  }
+
+  uint32_t done = 0;
+
+  while (done < count) {
+    Block * block = get_block((pos + done) / BLOCK_SIZE);
+    if (block == nullptr) break;
+
+    uint32_t start = (pos + done) % BLOCK_SIZE;
+    uint32_t len   = BLOCK_SIZE - start;
+    if (len > (count - done)) len = count - done;
+
+    memcpy(buffer + done, block->data + start, len);
+    done += len;
+  }
+
+  return done;
+}
+
+// FreeType calls it with count == 0 to seek: the seek is valid if in the font.
+unsigned long
+FontStream::read_stream(FT_Stream       stream,
+                        unsigned long   offset,
+                        unsigned char * buffer,
+                        unsigned long   count)
+{
+  FontStream * font_stream = (FontStream *) stream->descriptor.pointer;
+
+  if (count == 0) return (offset > font_stream->size) ? 1 : 0;
+
+  return font_stream->read(offset, buffer, count);
+}
@@ -42,7 +42,7 @@ static constexpr const char * font_labels[8] = {
   "DEJAVU COND"
 };
 
-Fonts::Fonts()
+Fonts::Fonts() : generation(0), clock_font(0), clock_slab(0)
 {
   #if USE_EPUB_FONTS
     font_cache.reserve(20);
@@ -238,6 +238,8 @@ Fonts::clear(bool all)
 {
   std::scoped_lock guard(mutex);
   
+  generation++;
+
   // LOG_D("Fonts Clear!");
   // Keep the first 7 fonts as they are reused. Caches will be cleared.
   #if USE_EPUB_FONTS
@@ -257,6 +259,8 @@ Fonts::clear_everything()
 {
   std::scoped_lock guard(mutex);
   
+  generation++;
+
   // LOG_D("Fonts Clear!");
   // Keep the first 7 fonts as they are reused. Caches will be cleared.
   for (auto & entry : font_cache) {
@@ -287,11 +291,76 @@ Fonts::adjust_default_font(uint8_t font_index)
 void
 Fonts::clear_glyph_caches()
 {
+  generation++;
+
   for (auto & entry : font_cache) {
     entry.font->clear_cache();
   }
 }
 
+bool
+Fonts::trim_glyph_caches(int32_t budget)
+{
+  if (Font::get_slabs_size() <= budget) return false;
+
+  std::scoped_lock guard(mutex);
+
+  int32_t to_release = Font::get_slabs_size() - (budget - (budget >> 2));
+  int32_t released   = 0;
+  int16_t evicted    = 0;
+  int32_t slab_count = 0;
+
+  for (auto & entry : font_cache) slab_count += entry.font->get_slab_count();
+
+  // Two turns at most: the slabs referenced are released on the second one
+  for (int32_t i = 0; (i < (slab_count << 1)) && (released < to_release); i++) {
+    while ((clock_font >= (int16_t) font_cache.size()) || 
+           (clock_slab >= font_cache[clock_font].font->get_slab_count())) {
+      clock_slab = 0;
+      clock_font = (clock_font + 1 >= (int16_t) font_cache.size()) ? 0 : clock_font + 1;
+    }
+
+    Font * font = font_cache[clock_font].font;
+    if (!font->test_and_clear_slab_reference(clock_slab)) {
+      int32_t size = font->evict_slab(clock_slab);
+      if (size > 0) {
+        released += size;
+        evicted++;
+      }
+    }
+    clock_slab++;
+  }
+
+  if (evicted > 0) generation++;
+
+  #if SHOW_TIMING
+    LOG_I("Glyph cache: %d slab(s) evicted, %d KB released, %d KB in use, peak: %d KB.",
+          evicted, released / 1024, Font::get_slabs_size() / 1024, Font::get_slabs_peak_size() / 1024);
+  #endif
+
+  return evicted > 0;
+}
+
+void
+Fonts::save_glyphs()
+{
+  std::scoped_lock guard(mutex);
+
+  for (auto & entry : font_cache) {
+    entry.font->flush_glyphs();
+  }
+}
+
+int32_t
+Fonts::get_rasterized_count()
+{
+  std::scoped_lock guard(mutex);
+
+  int32_t count = 0;
+  for (auto & entry : font_cache) count += entry.font->get_rasterized_count();
+  return count;
+}
+
 int16_t
 Fonts::get_index(const std::string & name, FaceStyle style)
 {
@@ -322,6 +391,7 @@ Fonts::replace(int16_t             index,
       f.name  = name;
       f.style = style;
       f.font->set_fonts_cache_index(index);
+      generation++;
       delete font_cache.at(index).font;
       font_cache.at(index) = f;
 
@@ -425,6 +495,50 @@ Fonts::add(const std::string & name,
   return false;
 }
 
+bool 
+Fonts::add(const std::string & name, 
+           FaceStyle           style,
+           FontStream        * stream,
+           const std::string & filename)
+{
+  std::scoped_lock guard(mutex);
+  
+  // If the font is already loaded, return promptly
+  for (auto & font : font_cache) {
+    if ((name.compare(font.name) == 0) && 
+        (font.style == style)) {
+      delete stream;
+      return true;
+    }
+  }
+
+  FontEntry f;
+
+  if ((f.font = FontFactory::create(filename, stream))) {
+    if (f.font->is_ready()) {
+      f.name  = name;
+      f.style = style;
+      f.font->set_fonts_cache_index(font_cache.size());
+      font_cache.push_back(f);
+
+      LOG_D("Font %s added to cache at index %d and style %d.",
+        f.name.c_str(), 
+        f.font->get_fonts_cache_index(),
+        (int)f.style);
+      return true;
+    }
+    else {
+      delete f.font;
+    }
+  }
+  else {
+    LOG_E("Unable to allocate memory.");
+    // msg_viewer.out_of_memory("font allocation");
+  }
+
+  return false;
+}
+
 Fonts::FaceStyle
 Fonts::adjust_font_style(FaceStyle style, FaceStyle font_style, FaceStyle font_weight) const
 {
@@ -0,0 +1,244 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/glyph_atlas.hpp"
+#include "screen.hpp"
+#include "logging.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+
+std::string GlyphAtlas::folder = GLYPH_ATLAS_FOLDER;
+
+GlyphAtlas::GlyphAtlas(uint32_t font_hash, int16_t glyph_size, uint8_t pixel_resolution) :
+  opened(false),
+  usable(false)
+{
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "GLAT", 4);
+  header.version          = VERSION;
+  header.pixel_resolution = pixel_resolution;
+  header.glyph_size       = glyph_size;
+  header.font_hash        = font_hash;
+  header.resolution       = Screen::RESOLUTION;
+
+  filename = filename_of(font_hash, glyph_size, pixel_resolution);
+}
+
+std::string
+GlyphAtlas::filename_of(uint32_t font_hash, int16_t glyph_size, uint8_t pixel_resolution)
+{
+  char name[40];
+  snprintf(name, 40, "/%08X_%d_%d.gla", (unsigned int) font_hash, glyph_size, pixel_resolution);
+  return folder + name;
+}
+
+uint32_t
+GlyphAtlas::hash(const void * data, int32_t size, uint32_t seed)
+{
+  const uint8_t * bytes = (const uint8_t *) data;
+  uint32_t        h     = seed;
+
+  for (int32_t i = 0; i < size; i++) h = (h ^ bytes[i]) * 16777619UL;
+  return h;
+}
+
+bool
+GlyphAtlas::create()
+{
+  struct stat stat_buf;
+  if ((stat(folder.c_str(), &stat_buf) != 0) && (mkdir(folder.c_str(), 0775) != 0)) {
+    LOG_E("Unable to create folder %s", folder.c_str());
+    return false;
+  }
+
+  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) return false;
+
+  file.write((const char *) &header, sizeof(header));
+  file.close();
+  return !file.fail();
+}
+
+// Only the records headers are read: the glyphs are retrieved by block
+// when required.
+bool
+GlyphAtlas::open()
+{
+  opened = true;
+  blocks.clear();
+
+  std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+  if (file.is_open()) {
+    uint32_t file_size = file.tellg();
+    Header   file_header;
+
+    file.seekg(0);
+    bool valid = (file_size >= sizeof(Header)) &&
+                 !file.read((char *) &file_header, sizeof(Header)).fail() &&
+                 (memcmp(&file_header, &header, sizeof(Header)) == 0);
+
+    uint32_t pos = sizeof(Header);
+    while (valid && ((pos + sizeof(BlockHeader)) <= file_size)) {
+      BlockHeader block_header;
+      file.seekg(pos);
+      if (file.read((char *) &block_header, sizeof(block_header)).fail() ||
+          ((pos + sizeof(block_header) + block_header.size) > file_size)) {
+        valid = false;
+        break;
+      }
+      blocks[block_header.block].push_back(pos);
+      pos += sizeof(block_header) + block_header.size;
+    }
+
+    if (valid && (pos == file_size)) {
+      LOG_D("Atlas %s: %d blocks.", filename.c_str(), (int32_t) blocks.size());
+      usable = true;
+      return true;
+    }
+
+    LOG_I("Atlas %s not usable. Started over.", filename.c_str());
+    blocks.clear();
+  }
+
+  usable = create();
+  return usable;
+}
+
+// The records of a block, checksum verified. The block is forgotten such
+// that it is read only once.
+bool
+GlyphAtlas::read_block(uint32_t block, std::vector<uint8_t> & data)
+{
+  if (!opened) open();
+
+  BlockIndex::iterator it = blocks.find(block);
+  if (it == blocks.end()) return false;
+
+  std::vector<uint32_t> offsets = it->second;
+  blocks.erase(it);
+
+  std::ifstream file(filename, std::ios::in | std::ios::binary);
+  if (!file.is_open()) return false;
+
+  data.clear();
+
+  for (uint32_t offset : offsets) {
+    BlockHeader block_header;
+    size_t      pos = data.size();
+
+    file.seekg(offset);
+    if (file.read((char *) &block_header, sizeof(block_header)).fail()) break;
+
+    data.resize(pos + block_header.size);
+    if (file.read((char *) &data[pos], block_header.size).fail() ||
+        (hash(&data[pos], block_header.size) != block_header.checksum)) {
+      LOG_E("Atlas %s: damaged record at %u, ignored.", filename.c_str(), offset);
+      data.resize(pos);
+    }
+  }
+
+  return !data.empty();
+}
+
+bool
+GlyphAtlas::load_block(uint32_t code, std::vector<uint8_t> & data)
+{
+  if (!read_block(code >> BLOCK_SHIFT, data)) return false;
+
+  // Every record is checked to be complete before use
+  for (size_t p = 0; (p + sizeof(GlyphRecord)) <= data.size(); ) {
+    GlyphRecord rec;
+    memcpy(&rec, &data[p], sizeof(rec));
+    size_t size = sizeof(rec) + ((rec.pitch > 0) ? rec.pitch * rec.height : 0);
+    if ((p + size) > data.size()) {
+      data.resize(p);
+      break;
+    }
+    known.insert(rec.code);
+    p += size;
+  }
+
+  return !data.empty();
+}
+
+bool
+GlyphAtlas::load_kerns(std::vector<KernRecord> & kerns)
+{
+  std::vector<uint8_t> data;
+  if (!read_block(KERN_BLOCK, data)) return false;
+
+  kerns.resize(data.size() / sizeof(KernRecord));
+  memcpy(kerns.data(), data.data(), kerns.size() * sizeof(KernRecord));
+
+  return !kerns.empty();
+}
+
+void
+GlyphAtlas::add_kern(uint32_t left, uint32_t right, int16_t kern)
+{
+  KernRecord rec = { .left = left, .right = right, .kern = kern };
+
+  std::vector<uint8_t> & data = pending[KERN_BLOCK];
+  size_t pos = data.size();
+
+  data.resize(pos + sizeof(KernRecord));
+  memcpy(&data[pos], &rec, sizeof(KernRecord));
+}
+
+void
+GlyphAtlas::add(const GlyphRecord & glyph, const uint8_t * bitmap)
+{
+  if (known.find(glyph.code) != known.end()) return;
+  known.insert(glyph.code);
+
+  std::vector<uint8_t> & data = pending[glyph.code >> BLOCK_SHIFT];
+  size_t bitmap_size = ((glyph.pitch > 0) && (bitmap != nullptr)) ? glyph.pitch * glyph.height : 0;
+  size_t pos         = data.size();
+
+  data.resize(pos + sizeof(GlyphRecord) + bitmap_size);
+  memcpy(&data[pos], &glyph, sizeof(GlyphRecord));
+  if (bitmap_size == 0) {
+    ((GlyphRecord *) &data[pos])->pitch = 0;
+  }
+  else {
+    memcpy(&data[pos + sizeof(GlyphRecord)], bitmap, bitmap_size);
+  }
+}
+
+bool
+GlyphAtlas::save()
+{
+  if (pending.empty()) return true;
+  if (!opened) open();
+  if (!usable) {
+    pending.clear();
+    return false;
+  }
+
+  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::app);
+  if (!file.is_open()) {
+    LOG_E("Unable to open atlas %s", filename.c_str());
+    pending.clear();
+    return false;
+  }
+
+  for (auto & entry : pending) {
+    BlockHeader block_header = {
+      .block    = entry.first,
+      .size     = (uint32_t) entry.second.size(),
+      .checksum = hash(entry.second.data(), entry.second.size())
+    };
+    file.write((const char *) &block_header, sizeof(block_header));
+    file.write((const char *) entry.second.data(), entry.second.size());
+  }
+  file.close();
+
+  LOG_D("Atlas %s: %d blocks saved.", filename.c_str(), (int32_t) pending.size());
+  pending.clear();
+
+  return !file.fail();
+}
@@ -0,0 +1,141 @@
+#if TESTING
+
+#include "gtest/gtest.h"
+#include "models/glyph_table.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+struct TestGlyph {
+  uint32_t code;
+  int16_t  size;
+};
+
+TEST(GlyphTableTest, insert_and_find) {
+  GlyphTable<TestGlyph> table;
+  TestGlyph a = { 'a', 12 }, b = { 'a', 14 }, c = { 0x2019, 12 };
+
+  EXPECT_EQ(table.find('a', 12), nullptr);
+
+  ASSERT_TRUE(table.insert('a',    12, &a));
+  ASSERT_TRUE(table.insert('a',    14, &b));
+  ASSERT_TRUE(table.insert(0x2019, 12, &c));
+
+  EXPECT_EQ(table.find('a',    12), &a);
+  EXPECT_EQ(table.find('a',    14), &b);
+  EXPECT_EQ(table.find(0x2019, 12), &c);
+  EXPECT_EQ(table.find(0x2019, 14), nullptr);
+  EXPECT_EQ(table.find('b',    12), nullptr);
+  EXPECT_EQ(table.get_count(), 3);
+
+  // Replaced
+  TestGlyph d = { 'a', 12 };
+  ASSERT_TRUE(table.insert('a', 12, &d));
+  EXPECT_EQ(table.find('a', 12), &d);
+  EXPECT_EQ(table.get_count(), 3);
+}
+
+TEST(GlyphTableTest, growth) {
+  GlyphTable<TestGlyph> table;
+  std::vector<TestGlyph> glyphs;
+
+  for (int16_t size = 8; size < 20; size++) {
+    for (uint32_t code = 32; code < 600; code++) glyphs.push_back({ code, size });
+  }
+  for (auto & g : glyphs) ASSERT_TRUE(table.insert(g.code, g.size, &g));
+
+  EXPECT_EQ(table.get_count(), (int32_t) glyphs.size());
+  for (auto & g : glyphs) ASSERT_EQ(table.find(g.code, g.size), &g);
+
+  int32_t count = 0;
+  table.for_each([&count](TestGlyph * g) { count++; });
+  EXPECT_EQ(count, (int32_t) glyphs.size());
+}
+
+TEST(GlyphTableTest, latin1_size) {
+  GlyphTable<TestGlyph> table;
+  TestGlyph a12 = { 'a', 12 }, a10 = { 'a', 10 };
+
+  table.insert('a', 12, &a12);
+  table.insert('a', 10, &a10);
+  EXPECT_EQ(table.get_latin1_size(), -1);
+
+  // The first Latin-1 lookup selects the size
+  EXPECT_EQ(table.find('a', 12), &a12);
+  EXPECT_EQ(table.get_latin1_size(), 12);
+
+  // A few lookups at another size don't change it
+  for (int i = 0; i < 10; i++) EXPECT_EQ(table.find('a', 10), &a10);
+  EXPECT_EQ(table.find('a', 12), &a12);
+  EXPECT_EQ(table.get_latin1_size(), 12);
+
+  // Many do
+  for (int i = 0; i <= GlyphTable<TestGlyph>::LATIN1_SWITCH_THRESHOLD; i++) {
+    EXPECT_EQ(table.find('a', 10), &a10);
+  }
+  EXPECT_EQ(table.get_latin1_size(), 10);
+  EXPECT_EQ(table.find('a', 10), &a10);
+  EXPECT_EQ(table.find('a', 12), &a12);
+
+  // Glyphs inserted at the Latin-1 size are directly indexed
+  TestGlyph b10 = { 'b', 10 };
+  table.insert('b', 10, &b10);
+  EXPECT_EQ(table.find('b', 10), &b10);
+}
+
+TEST(GlyphTableTest, clear) {
+  GlyphTable<TestGlyph> table;
+  TestGlyph a = { 'a', 12 }, b = { 0x2019, 12 };
+
+  table.insert('a',    12, &a);
+  table.insert(0x2019, 12, &b);
+  EXPECT_EQ(table.find('a', 12), &a);
+
+  table.clear();
+  EXPECT_EQ(table.find('a',    12), nullptr);
+  EXPECT_EQ(table.find(0x2019, 12), nullptr);
+  EXPECT_EQ(table.get_count(), 0);
+
+  table.insert('a', 12, &a);
+  EXPECT_EQ(table.find('a', 12), &a);
+}
+
+// Readers never see a glyph of another code or size while the table grows
+// and the Latin-1 size changes.
+TEST(GlyphTableTest, concurrent_readers) {
+  GlyphTable<TestGlyph> table;
+  std::vector<TestGlyph> glyphs;
+
+  for (int16_t size = 8; size < 24; size++) {
+    for (uint32_t code = 32; code < 400; code++) glyphs.push_back({ code, size });
+  }
+
+  std::atomic<bool>    done(false);
+  std::atomic<int32_t> errors(0), found(0);
+  std::vector<std::thread> readers;
+
+  for (int r = 0; r < 4; r++) {
+    readers.emplace_back([&, r]() {
+      uint32_t i = r * 7919;
+      while (!done.load()) {
+        TestGlyph & g = glyphs[i++ % glyphs.size()];
+        TestGlyph * res = table.find(g.code, g.size);
+        if (res != nullptr) {
+          found++;
+          if ((res->code != g.code) || (res->size != g.size)) errors++;
+        }
+      }
+    });
+  }
+
+  for (auto & g : glyphs) table.insert(g.code, g.size, &g);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  done = true;
+  for (auto & t : readers) t.join();
+
+  EXPECT_EQ(errors.load(), 0);
+  EXPECT_GT(found.load(), 0);
+}
+
+#endif
@@ -408,30 +408,46 @@ IBMF::get_glyph(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size, i
 Font::Glyph *
 IBMF::get_glyph(uint32_t charcode, int16_t glyph_size)
 {
-  std::scoped_lock guard(mutex);
-  
   uint32_t glyph_code = translate(charcode);
 
+  Glyph * glyph = cache.find(glyph_code, glyph_size);
+  if ((glyph != nullptr) && !glyph->is_evicted()) {
+    reference(glyph);
+    if (!glyph->is_evicted()) return glyph;
+  }
+
+  std::scoped_lock guard(mutex);
+
   return get_glyph_internal(glyph_code, glyph_size);
 }
 
 Font::Glyph *
 IBMF::get_glyph_internal(uint32_t glyph_code, int16_t glyph_size)
 {
-  Glyphs::iterator git;
-
   if (face == nullptr) return nullptr;
 
   if (current_font_size != glyph_size) set_font_size(glyph_size);
 
-  GlyphsCache::iterator cache_it = cache.find(glyph_size);
-
-  bool found = (cache_it != cache.end()) &&
-               ((git = cache_it->second.find(glyph_code)) != cache_it->second.end());
+  Glyph * found = cache.find(glyph_code, glyph_size);
 
-  if (found) {
+  if ((found != nullptr) && !found->is_evicted()) {
     glyph_data = face->get_glyph_info(glyph_code & 0x000000FF);
-    return git->second;
+    reference(found);
+    return found;
+  }
+  else if (found != nullptr) {
+    // Its bitmap was evicted. Rasterized apart: other threads may be 
+    // reading its metrics.
+    Glyph reloaded;
+    if (!face->get_glyph(glyph_code, reloaded, &glyph_data, true)) {
+      LOG_E("Unable to render glyph for glyph_code: %d", glyph_code);
+      return nullptr;
+    }
+    rasterized_count++;
+    found->buffer = reloaded.buffer;
+    found->slab.store((reloaded.buffer != nullptr) ? last_slab : NO_SLAB, std::memory_order_release);
+    reference(found);
+    return found;
   }
   else {
     Glyph * glyph = bitmap_glyph_pool.newElement();
@@ -452,12 +468,20 @@ IBMF::get_glyph_internal(uint32_t glyph_code, int16_t glyph_size)
       glyph->yoff        =  0;
       glyph->advance     =  8;
       glyph->ligature_and_kern_pgm_index = -1;
+      glyph->slab        =  NO_SLAB;
+      glyph->buffer      =  nullptr;
     }
     else if (!face->get_glyph(glyph_code, *glyph, &glyph_data, true)) {
       bitmap_glyph_pool.deallocate(glyph);
       LOG_E("Unable to render glyph for glyph_code: %d", glyph_code);
       return nullptr;
     }
+    else {
+      glyph->slab = (glyph->buffer != nullptr) ? last_slab : NO_SLAB;
+    }
+
+    rasterized_count++;
+    reference(glyph);
 
     // std::cout << "Glyph: " <<
     //   " w:"  << glyph->dim.width <<
@@ -469,11 +493,22 @@ IBMF::get_glyph_internal(uint32_t glyph_code, int16_t glyph_size)
     //   " y:"  << glyph->yoff <<
     //   " a:"  << glyph->advance << std::endl;
 
-    cache[current_font_size][glyph_code] = glyph;
+    cache.insert(glyph_code, glyph_size, glyph);
     return glyph;
   }
 }
 
+bool
+IBMF::compute_size_metrics(int16_t glyph_size, int16_t & line_height, int16_t & descender_height)
+{
+  if (face == nullptr) return false;
+  if ((current_font_size != glyph_size) && !set_font_size(glyph_size)) return false;
+
+  line_height      = face->get_line_height();
+  descender_height = face->get_descender_height();
+  return true;
+}
+
 bool 
 IBMF::set_font_size(int16_t size)
 {
@@ -0,0 +1,131 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#define __ITEM_CACHE__ 1
+#include "models/item_cache.hpp"
+
+#include "alloc.hpp"
+#include "logging.hpp"
+
+#include <chrono>
+#include <cstring>
+
+ItemCache::ItemCache(uint32_t the_budget) :
+  budget(the_budget),
+  used_size(0),
+  hits(0),
+  misses(0),
+  inflate_time(0),
+  time_saved(0)
+{
+}
+
+// An item retrieved as prepared XHTML and otherwise is not the same: the
+// one found is replaced.
+ItemCache::Handle
+ItemCache::find(const std::string & filename, bool xhtml)
+{
+  std::scoped_lock guard(mutex);
+
+  for (auto it = entries.begin(); it != entries.end(); it++) {
+    if (it->filename == filename) {
+      if (it->buffer->xhtml != xhtml) return nullptr;
+      if (it != entries.begin()) entries.splice(entries.begin(), entries, it);
+      return entries.front().buffer;
+    }
+  }
+  return nullptr;
+}
+
+// The buffer may have been added by another thread in the meantime: the
+// new one replaces it.
+void
+ItemCache::add(const std::string & filename, Handle buffer)
+{
+  std::scoped_lock guard(mutex);
+
+  for (auto it = entries.begin(); it != entries.end(); it++) {
+    if (it->filename == filename) {
+      used_size -= it->buffer->size;
+      entries.erase(it);
+      break;
+    }
+  }
+
+  while (!entries.empty() && ((used_size + buffer->size) > budget)) {
+    used_size -= entries.back().buffer->size;
+    entries.pop_back();
+  }
+
+  entries.push_front({ filename, buffer });
+  used_size += buffer->size;
+}
+
+ItemCache::Handle
+ItemCache::get(const std::string & filename, bool xhtml)
+{
+  Handle buffer = find(filename, xhtml);
+
+  if (buffer != nullptr) {
+    hits++;
+    time_saved += buffer->inflate_time;
+    return buffer;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  uint32_t     size;
+  XHTMLPrepass prepass;
+  std::unique_ptr<char[], MallocDeleter> data = unzip.get_file(filename.c_str(), size, xhtml ? &prepass : nullptr);
+  if (data == nullptr) return nullptr;
+
+  std::shared_ptr<Buffer> new_buffer = std::make_shared<Buffer>();
+  new_buffer->data         = data.release();
+  new_buffer->size         = size;
+  new_buffer->xhtml        = xhtml;
+  new_buffer->stats        = prepass.get_stats();
+  new_buffer->inflate_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+  misses++;
+  inflate_time += new_buffer->inflate_time;
+
+  // Items larger than half the budget would flush the cache
+  if ((budget > 0) && (size <= (budget >> 1))) add(filename, new_buffer);
+
+  return new_buffer;
+}
+
+std::unique_ptr<char[], MallocDeleter>
+ItemCache::get_copy(const std::string & filename, uint32_t & size)
+{
+  std::unique_ptr<char[], MallocDeleter> data;
+
+  Handle buffer = get(filename);
+  if (buffer == nullptr) {
+    size = 0;
+    return data;
+  }
+
+  data.reset((char *) allocate(buffer->size + 1));
+  if (data == nullptr) {
+    LOG_E("Unable to allocate %u bytes for %s", buffer->size, filename.c_str());
+    size = 0;
+    return data;
+  }
+
+  memcpy(data.get(), buffer->data, buffer->size + 1);
+  size = buffer->size;
+
+  return data;
+}
+
+void
+ItemCache::clear()
+{
+  std::scoped_lock guard(mutex);
+
+  entries.clear();
+  used_size = 0;
+  hits = misses = inflate_time = time_saved = 0;
+}
@@ -0,0 +1,148 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/item_cache.hpp"
+
+#include <cstring>
+
+static const char * BOOK = "SDCard/books/Austen, Jane - Orgueil et préjugés.epub";
+
+static const char * ITEMS[] = {
+  "epub_split_000.xhtml", "epub_split_001.xhtml", "epub_split_003.xhtml",
+  "epub_split_008.xhtml", "epub_split_015.xhtml", "epub_split_047.xhtml"
+};
+
+TEST(ItemCacheTest, get_and_copy) {
+  ASSERT_TRUE(unzip.open_zip_file(BOOK));
+
+  ItemCache cache(256 * 1024);
+
+  uint32_t size;
+  auto expected = unzip.get_file(ITEMS[0], size);
+  ASSERT_NE(expected, nullptr);
+
+  ItemCache::Handle h1 = cache.get(ITEMS[0]);
+  ASSERT_NE(h1, nullptr);
+  EXPECT_EQ(h1->size, size);
+  EXPECT_EQ(memcmp(h1->data, expected.get(), size + 1), 0);
+
+  // The same buffer is shared
+  ItemCache::Handle h2 = cache.get(ITEMS[0]);
+  EXPECT_EQ(h1, h2);
+  EXPECT_EQ(cache.get_stats().hits,   1);
+  EXPECT_EQ(cache.get_stats().misses, 1);
+
+  // A copy can be modified without changing the cached buffer
+  uint32_t copy_size;
+  auto copy = cache.get_copy(ITEMS[0], copy_size);
+  ASSERT_NE(copy, nullptr);
+  EXPECT_EQ(copy_size, size);
+  EXPECT_NE(copy.get(), h1->data);
+  copy[0] = '#';
+  EXPECT_EQ(memcmp(h1->data, expected.get(), size + 1), 0);
+
+  EXPECT_EQ(cache.get("not_there.xhtml"), nullptr);
+
+  cache.clear();
+  EXPECT_EQ(cache.get_used_size(), 0U);
+
+  // A handle remains valid once out of the cache
+  EXPECT_EQ(memcmp(h1->data, expected.get(), size + 1), 0);
+
+  unzip.close_zip_file();
+}
+
+TEST(ItemCacheTest, budget) {
+  ASSERT_TRUE(unzip.open_zip_file(BOOK));
+
+  // Room for about two items
+  ItemCache cache(30000);
+
+  for (auto * item : ITEMS) {
+    ASSERT_NE(cache.get(item), nullptr) << item;
+    EXPECT_LE(cache.get_used_size(), 30000U);
+  }
+
+  // The most recent ones are kept
+  int32_t misses = cache.get_stats().misses;
+  cache.get(ITEMS[5]);
+  EXPECT_EQ(cache.get_stats().misses, misses);
+  cache.get(ITEMS[0]);
+  EXPECT_EQ(cache.get_stats().misses, misses + 1);
+
+  // No cache
+  ItemCache none(0);
+  EXPECT_NE(none.get(ITEMS[0]), nullptr);
+  EXPECT_NE(none.get(ITEMS[0]), nullptr);
+  EXPECT_EQ(none.get_stats().hits, 0);
+  EXPECT_EQ(none.get_used_size(), 0U);
+
+  unzip.close_zip_file();
+}
+
+TEST(ItemCacheTest, xhtml_prepared) {
+  static const char * LONG_ITEM = "epub_split_042.xhtml";
+
+  ASSERT_TRUE(unzip.open_zip_file(BOOK));
+
+  ItemCache cache(256 * 1024);
+
+  // Prepared while inflated, a part at a time, as when prepared at once
+  uint32_t size;
+  auto expected = unzip.get_file(LONG_ITEM, size);
+  ASSERT_NE(expected, nullptr);
+  ASSERT_GT(size, 16U * 1024);
+
+  XHTMLPrepass prepass;
+  EXPECT_EQ(prepass.process(expected.get(), size, true), size);
+
+  ItemCache::Handle h1 = cache.get(LONG_ITEM, true);
+  ASSERT_NE(h1, nullptr);
+  EXPECT_TRUE(h1->xhtml);
+  EXPECT_EQ(h1->size, size);
+  EXPECT_EQ(memcmp(h1->data, expected.get(), size + 1), 0);
+  EXPECT_EQ(h1->stats.tag_count,   prepass.get_stats().tag_count);
+  EXPECT_EQ(h1->stats.text_size,   prepass.get_stats().text_size);
+  EXPECT_EQ(h1->stats.link_count,  prepass.get_stats().link_count);
+  EXPECT_EQ(h1->stats.style_count, prepass.get_stats().style_count);
+  EXPECT_GT(h1->stats.tag_count,   0U);
+
+  EXPECT_EQ(cache.get(LONG_ITEM, true), h1);
+
+  // Not the same item when not prepared
+  ItemCache::Handle h2 = cache.get(LONG_ITEM);
+  ASSERT_NE(h2, nullptr);
+  EXPECT_FALSE(h2->xhtml);
+  EXPECT_EQ(cache.get_stats().misses, 2);
+
+  unzip.close_zip_file();
+}
+
+// The viewer going back and forth between neighbouring chapters: after the
+// first visit, the chapters are copied out of the cache, unchanged.
+TEST(ItemCacheTest, back_and_forth) {
+  static const int REPEAT = 10;
+
+  ASSERT_TRUE(unzip.open_zip_file(BOOK));
+
+  ItemCache cache(ITEM_CACHE_SIZE);
+
+  for (int i = 0; i < REPEAT; i++) {
+    for (auto * item : ITEMS) {
+      uint32_t size, copy_size;
+      auto expected = unzip.get_file(item, size);
+      auto copy     = cache.get_copy(item, copy_size);
+      ASSERT_NE(expected, nullptr);
+      ASSERT_NE(copy,     nullptr);
+      ASSERT_EQ(copy_size, size);
+      ASSERT_EQ(memcmp(copy.get(), expected.get(), size + 1), 0) << item;
+    }
+  }
+
+  EXPECT_EQ(cache.get_stats().misses, 6);
+  EXPECT_EQ(cache.get_hit_rate(), (REPEAT - 1) * 100 / REPEAT);
+
+  unzip.close_zip_file();
+}
+
+#endif
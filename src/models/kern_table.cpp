@@ -0,0 +1,315 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/kern_table.hpp"
+#include "logging.hpp"
+
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
+
+#include <algorithm>
+
+// Big-endian fields, bounds checked: out of the table reads as 0.
+static inline uint16_t
+u16(const uint8_t * t, uint32_t size, uint32_t pos)
+{
+  return ((pos + 2) <= size) ? ((t[pos] << 8) | t[pos + 1]) : 0;
+}
+
+static inline uint32_t
+u32(const uint8_t * t, uint32_t size, uint32_t pos)
+{
+  return ((uint32_t) u16(t, size, pos) << 16) | u16(t, size, pos + 2);
+}
+
+static inline uint8_t
+value_record_size(uint16_t value_format)
+{
+  uint8_t count = 0;
+  for (uint16_t f = value_format & 0xFF; f; f >>= 1) count += f & 1;
+  return count << 1;
+}
+
+/// Position of the XAdvance field in a value record, -1 if not present
+static inline int8_t
+x_advance_pos(uint16_t value_format)
+{
+  if ((value_format & 0x0004) == 0) return -1;
+  return value_record_size(value_format & 0x0003);
+}
+
+static uint8_t *
+load_sfnt_table(FT_Face face, FT_ULong tag, uint32_t & size)
+{
+  FT_ULong length = 0;
+  if (FT_Load_Sfnt_Table(face, tag, 0, nullptr, &length) || (length == 0)) return nullptr;
+
+  uint8_t * table = (uint8_t *) allocate(length);
+  if (table == nullptr) return nullptr;
+
+  if (FT_Load_Sfnt_Table(face, tag, 0, table, &length)) {
+    free(table);
+    return nullptr;
+  }
+
+  size = length;
+  return table;
+}
+
+void
+KernTable::clear()
+{
+  pairs.clear();
+  pairs.shrink_to_fit();
+  class_subtables.clear();
+  class_subtables.shrink_to_fit();
+  loaded = false;
+}
+
+bool
+KernTable::load(FT_Face face)
+{
+  clear();
+
+  if (!load_gpos(face)) load_kern(face);
+
+  // Sorted by pair, then subtable order: the first one is kept
+  std::stable_sort(pairs.begin(), pairs.end(),
+                   [](const Pair & a, const Pair & b) { return a.key < b.key; });
+  pairs.erase(std::unique(pairs.begin(), pairs.end(),
+                          [](const Pair & a, const Pair & b) { return a.key == b.key; }),
+              pairs.end());
+  pairs.shrink_to_fit();
+
+  LOG_D("Kerning: %d pairs, %d class subtables.", (int32_t) pairs.size(), (int32_t) class_subtables.size());
+
+  loaded = true;
+  return !is_empty();
+}
+
+bool
+KernTable::find_range(const std::vector<ClassRange> & ranges, uint16_t glyph, uint16_t & value)
+{
+  auto it = std::upper_bound(ranges.begin(), ranges.end(), glyph,
+                             [](uint16_t g, const ClassRange & r) { return g < r.first; });
+  if (it == ranges.begin()) return false;
+  --it;
+  if (glyph > it->last) return false;
+  value = it->value;
+  return true;
+}
+
+int16_t
+KernTable::get(uint16_t left, uint16_t right) const
+{
+  uint32_t key   = ((uint32_t) left << 16) | right;
+  uint16_t order = 0xFFFF;
+  int16_t  value = 0;
+
+  auto it = std::lower_bound(pairs.begin(), pairs.end(), key,
+                             [](const Pair & p, uint32_t k) { return p.key < k; });
+  if ((it != pairs.end()) && (it->key == key)) {
+    order = it->order;
+    value = it->value;
+  }
+
+  for (auto & sub : class_subtables) {
+    if (sub.order >= order) break;
+
+    uint16_t index, class1, class2;
+    if (!find_range(sub.coverage, left,  index )) continue;
+    if (!find_range(sub.class1,   left,  class1)) class1 = 0;
+    if (!find_range(sub.class2,   right, class2)) class2 = 0;
+
+    uint32_t pos = (uint32_t) class1 * sub.class2_count + class2;
+    return (pos < sub.values.size()) ? sub.values[pos] : 0;
+  }
+
+  return value;
+}
+
+// Coverage tables (coverage == true) and class definition tables have the
+// same formats: a glyph array (format 1) or glyph ranges (format 2). For
+// coverage ranges, value is the coverage index of the first glyph.
+bool
+KernTable::load_ranges(const uint8_t * t, uint32_t size, uint32_t offset, bool coverage, std::vector<ClassRange> & ranges)
+{
+  uint16_t format = u16(t, size, offset);
+
+  if (format == 1) {
+    if (coverage) {
+      uint16_t count = u16(t, size, offset + 2);
+      if ((offset + 4 + count * 2) > size) return false;
+      for (uint16_t i = 0; i < count; i++) {
+        uint16_t glyph = u16(t, size, offset + 4 + i * 2);
+        ranges.push_back({ glyph, glyph, i });
+      }
+    }
+    else {
+      uint16_t start = u16(t, size, offset + 2);
+      uint16_t count = u16(t, size, offset + 4);
+      if ((offset + 6 + count * 2) > size) return false;
+      for (uint16_t i = 0; i < count; i++) {
+        uint16_t cls = u16(t, size, offset + 6 + i * 2);
+        if (cls != 0) ranges.push_back({ (uint16_t)(start + i), (uint16_t)(start + i), cls });
+      }
+    }
+  }
+  else if (format == 2) {
+    uint16_t count = u16(t, size, offset + 2);
+    if ((offset + 4 + count * 6) > size) return false;
+    for (uint16_t i = 0; i < count; i++) {
+      uint32_t rec = offset + 4 + i * 6;
+      ranges.push_back({ u16(t, size, rec), u16(t, size, rec + 2), u16(t, size, rec + 4) });
+    }
+  }
+  else return false;
+
+  std::sort(ranges.begin(), ranges.end(),
+            [](const ClassRange & a, const ClassRange & b) { return a.first < b.first; });
+  ranges.shrink_to_fit();
+  return true;
+}
+
+void
+KernTable::load_pair_subtable(const uint8_t * t, uint32_t size, uint32_t offset, uint16_t order)
+{
+  uint16_t format        = u16(t, size, offset);
+  uint16_t value_format1 = u16(t, size, offset + 4);
+  uint16_t value_format2 = u16(t, size, offset + 6);
+  int8_t   x_advance     = x_advance_pos(value_format1);
+  uint8_t  record1_size  = value_record_size(value_format1);
+  uint8_t  record2_size  = value_record_size(value_format2);
+
+  if (x_advance < 0) return;   // No advance adjustment of the left glyph
+
+  std::vector<ClassRange> coverage;
+  if (!load_ranges(t, size, offset + u16(t, size, offset + 2), true, coverage)) return;
+
+  if (format == 1) {
+    uint16_t set_count = u16(t, size, offset + 8);
+    for (auto & range : coverage) {
+      for (uint32_t glyph = range.first; glyph <= range.last; glyph++) {
+        uint16_t index = range.value + (glyph - range.first);
+        if (index >= set_count) continue;
+
+        uint32_t set    = offset + u16(t, size, offset + 10 + index * 2);
+        uint16_t count  = u16(t, size, set);
+        uint16_t stride = 2 + record1_size + record2_size;
+
+        if ((set + 2 + count * stride) > size) continue;
+        for (uint16_t i = 0; i < count; i++) {
+          uint32_t rec   = set + 2 + i * stride;
+          int16_t  value = (int16_t) u16(t, size, rec + 2 + x_advance);
+
+          // Kept even when 0: it hides the pair in the next subtables
+          pairs.push_back({ (glyph << 16) | u16(t, size, rec), value, order });
+        }
+      }
+    }
+  }
+  else if (format == 2) {
+    ClassSubtable sub;
+
+    sub.order        = order;
+    sub.coverage     = std::move(coverage);
+    sub.class2_count = u16(t, size, offset + 14);
+
+    uint16_t class1_count = u16(t, size, offset + 12);
+    uint16_t stride       = record1_size + record2_size;
+
+    load_ranges(t, size, offset + u16(t, size, offset +  8), false, sub.class1);
+    load_ranges(t, size, offset + u16(t, size, offset + 10), false, sub.class2);
+
+    uint32_t records = offset + 16;
+    if ((records + (uint32_t) class1_count * sub.class2_count * stride) > size) return;
+
+    sub.values.resize((uint32_t) class1_count * sub.class2_count);
+    for (uint32_t i = 0; i < sub.values.size(); i++) {
+      sub.values[i] = (int16_t) u16(t, size, records + i * stride + x_advance);
+    }
+
+    class_subtables.push_back(std::move(sub));
+  }
+}
+
+bool
+KernTable::load_gpos(FT_Face face)
+{
+  uint32_t  size;
+  uint8_t * t = load_sfnt_table(face, TTAG_GPOS, size);
+  if (t == nullptr) return false;
+
+  uint32_t features = u16(t, size, 6);
+  uint32_t lookups  = u16(t, size, 8);
+
+  // Lookups of the 'kern' features, whatever the script
+  std::vector<uint16_t> indices;
+  uint16_t feature_count = u16(t, size, features);
+  for (uint16_t i = 0; i < feature_count; i++) {
+    uint32_t rec = features + 2 + i * 6;
+    if (u32(t, size, rec) != FT_MAKE_TAG('k', 'e', 'r', 'n')) continue;
+    uint32_t feature = features + u16(t, size, rec + 4);
+    uint16_t count   = u16(t, size, feature + 2);
+    for (uint16_t j = 0; j < count; j++) indices.push_back(u16(t, size, feature + 4 + j * 2));
+  }
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+  uint16_t order        = 0;
+  uint16_t lookup_count = u16(t, size, lookups);
+  for (uint16_t index : indices) {
+    if (index >= lookup_count) continue;
+
+    uint32_t lookup   = lookups + u16(t, size, lookups + 2 + index * 2);
+    uint16_t type     = u16(t, size, lookup);
+    uint16_t count    = u16(t, size, lookup + 4);
+
+    for (uint16_t j = 0; j < count; j++) {
+      uint32_t subtable = lookup + u16(t, size, lookup + 6 + j * 2);
+      if (type == 9) {   // Extension
+        if (u16(t, size, subtable + 2) != 2) continue;
+        subtable += u32(t, size, subtable + 4);
+      }
+      else if (type != 2) continue;
+
+      load_pair_subtable(t, size, subtable, order++);
+    }
+  }
+
+  free(t);
+  return !indices.empty();
+}
+
+bool
+KernTable::load_kern(FT_Face face)
+{
+  uint32_t  size;
+  uint8_t * t = load_sfnt_table(face, TTAG_kern, size);
+  if (t == nullptr) return false;
+
+  // Only the version 0 (Microsoft) table, with horizontal kerning values
+  if (u16(t, size, 0) == 0) {
+    uint16_t count  = u16(t, size, 2);
+    uint32_t offset = 4;
+    for (uint16_t i = 0; (i < count) && (offset < size); i++) {
+      uint16_t length   = u16(t, size, offset + 2);
+      uint16_t coverage = u16(t, size, offset + 4);
+      if (((coverage >> 8) == 0) && ((coverage & 0x0007) == 0x0001)) {
+        uint16_t pair_count = u16(t, size, offset + 6);
+        for (uint16_t j = 0; j < pair_count; j++) {
+          uint32_t rec   = offset + 14 + j * 6;
+          int16_t  value = (int16_t) u16(t, size, rec + 4);
+          if ((rec + 6) > size) break;
+          if (value != 0) pairs.push_back({ u32(t, size, rec), value, i });
+        }
+      }
+      if (length == 0) break;
+      offset += length;
+    }
+  }
+
+  free(t);
+  return !pairs.empty();
+}
@@ -0,0 +1,173 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/locs_journal.hpp"
+#include "logging.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+bool
+LocsJournal::create(const Header & header)
+{
+  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) return false;
+
+  file.write((const char *) &header, sizeof(header));
+  file.close();
+  return !file.fail();
+}
+
+int16_t
+LocsJournal::open(const std::string & the_filename, uint32_t key, int16_t item_count,
+                  PageIndex & page_index, PageCheckpoints & checkpoints, TocOffsets & toc_offsets)
+{
+  filename = the_filename;
+
+  Header header = {
+    .version    = JNL_VERSION,
+    .layout     = LAYOUT_REVISION,
+    .item_count = item_count,
+    .key        = key
+  };
+
+  std::string data;
+  { std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+    if (file.is_open()) {
+      data.resize(file.tellg());
+      file.seekg(0);
+      if (file.read(&data[0], data.size()).fail()) data.clear();
+    }
+  }
+
+  if ((data.size() < sizeof(Header)) || (memcmp(data.data(), &header, sizeof(Header)) != 0)) {
+    if (!create(header)) {
+      LOG_E("Unable to create journal %s", filename.c_str());
+      filename.clear();
+      return -1;
+    }
+    return 0;
+  }
+
+  // Replay the records, up to the first one not complete
+  int16_t replayed = 0;
+  size_t  pos      = sizeof(Header);
+
+  while ((pos + sizeof(RecordHeader)) <= data.size()) {
+    RecordHeader rec;
+    memcpy(&rec, data.data() + pos, sizeof(rec));
+
+    if ((rec.itemref_index < 0) || (rec.itemref_index >= item_count) ||
+        (rec.entry_count < 0) || (rec.toc_count < 0) ||
+        ((rec.page_count != 0) && (rec.page_count != rec.entry_count)) ||
+        (rec.step_count < 0) || (rec.step_count > rec.page_count * PageCheckpoints::MAX_PATH_LENGTH)) break;
+
+    size_t entries_size = rec.entry_count * sizeof(PageIndex::Entry);
+    size_t index_size   = (rec.page_count == 0) ? 0 : (rec.page_count + 1) * sizeof(int32_t);
+    size_t steps_size   = rec.step_count * sizeof(PageCheckpoints::Step);
+    size_t toc_size     = rec.toc_count  * sizeof(TocOffset);
+    size_t size         = entries_size + index_size + steps_size + toc_size;
+
+    const uint8_t * p = (const uint8_t *) data.data() + pos + sizeof(rec);
+    if (((pos + sizeof(rec) + size) > data.size()) ||
+        (PageIndex::checksum(p, size) != rec.checksum)) break;
+
+    PageIndex::Entries    entries(rec.entry_count);
+    PageCheckpoints::Item item;
+
+    memcpy(entries.data(), p, entries_size);
+    if (rec.page_count > 0) {
+      item.first_step.resize(rec.page_count + 1);
+      item.steps.resize(rec.step_count);
+      memcpy(item.first_step.data(), p + entries_size,              index_size);
+      memcpy(item.steps.data(),      p + entries_size + index_size, steps_size);
+    }
+    if (rec.toc_count > 0) {
+      size_t toc_pos = toc_offsets.size();
+      toc_offsets.resize(toc_pos + rec.toc_count);
+      memcpy(&toc_offsets[toc_pos], p + entries_size + index_size + steps_size, toc_size);
+    }
+
+    page_index.set_item(rec.itemref_index, entries);
+    checkpoints.set_item(rec.itemref_index, item);
+
+    replayed++;
+    pos += sizeof(rec) + size;
+  }
+
+  if (pos < data.size()) {
+    // Incomplete last record: rewrite the journal without it
+    LOG_I("Journal %s truncated: %d bytes dropped.", filename.c_str(), (int32_t) (data.size() - pos));
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(data.data(), pos);
+    file.close();
+    if (file.fail()) {
+      filename.clear();
+      return -1;
+    }
+  }
+
+  LOG_D("Journal %s: %d items retrieved.", filename.c_str(), replayed);
+  return replayed;
+}
+
+bool
+LocsJournal::append(int16_t                       itemref_index,
+                    const PageIndex::Entries    & entries,
+                    const PageCheckpoints::Item & item_checkpoints,
+                    const TocOffsets            & toc_offsets)
+{
+  if (filename.empty()) return false;
+
+  int32_t page_count = item_checkpoints.get_page_count();
+  if (page_count != (int32_t) entries.size()) page_count = 0;  // Checkpoints are optional
+
+  int32_t entries_size = entries.size() * sizeof(PageIndex::Entry);
+  int32_t index_size   = (page_count == 0) ? 0 : (page_count + 1) * sizeof(int32_t);
+  int32_t steps_size   = (page_count == 0) ? 0 : item_checkpoints.steps.size() * sizeof(PageCheckpoints::Step);
+  int32_t toc_size     = toc_offsets.size() * sizeof(TocOffset);
+
+  uint32_t hash = PageIndex::checksum(entries.data(), entries_size);
+  if (page_count > 0) {
+    hash = PageIndex::checksum(item_checkpoints.first_step.data(), index_size, hash);
+    hash = PageIndex::checksum(item_checkpoints.steps.data(),      steps_size, hash);
+  }
+  hash = PageIndex::checksum(toc_offsets.data(), toc_size, hash);
+
+  RecordHeader rec = {
+    .itemref_index = itemref_index,
+    .toc_count     = (int16_t) toc_offsets.size(),
+    .entry_count   = (int32_t) entries.size(),
+    .page_count    = page_count,
+    .step_count    = (page_count == 0) ? 0 : (int32_t) item_checkpoints.steps.size(),
+    .checksum      = hash
+  };
+
+  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::app);
+  if (!file.is_open()) {
+    LOG_E("Unable to open journal %s", filename.c_str());
+    return false;
+  }
+
+  file.write((const char *) &rec, sizeof(rec));
+  file.write((const char *) entries.data(), entries_size);
+  if (page_count > 0) {
+    file.write((const char *) item_checkpoints.first_step.data(), index_size);
+    file.write((const char *) item_checkpoints.steps.data(),      steps_size);
+  }
+  if (toc_size > 0) file.write((const char *) toc_offsets.data(), toc_size);
+  file.close();
+
+  return !file.fail();
+}
+
+void
+LocsJournal::remove()
+{
+  if (!filename.empty()) {
+    ::remove(filename.c_str());
+    filename.clear();
+  }
+}
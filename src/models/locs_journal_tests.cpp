@@ -0,0 +1,114 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/locs_journal.hpp"
+
+#include <fstream>
+#include <cstdio>
+
+static const char * JNL_FILE = "/tmp/locs_journal_test.jnl";
+
+static void
+make_item(int32_t page_count, PageIndex::Entries & entries, PageCheckpoints::Item & item)
+{
+  PageCheckpoints::Step step = { .offset = 0, .child_index = 0, .reserved = 0 };
+
+  entries.clear();
+  item.clear();
+  for (int32_t pg = 0; pg < page_count; pg++) {
+    entries.push_back({ pg * 100, 100 });
+    step.offset      = pg * 100;
+    step.child_index = pg;
+    item.add_page(&step, pg == 0 ? 0 : 1);
+  }
+}
+
+static int16_t
+open_journal(LocsJournal & journal, uint32_t key, PageIndex & index, PageCheckpoints & checkpoints,
+             LocsJournal::TocOffsets & toc_offsets)
+{
+  index.clear(4);
+  checkpoints.clear(4);
+  toc_offsets.clear();
+  return journal.open(JNL_FILE, key, 4, index, checkpoints, toc_offsets);
+}
+
+TEST(LocsJournalTest, append_and_replay) {
+  remove(JNL_FILE);
+
+  LocsJournal             journal;
+  PageIndex               index;
+  PageCheckpoints         checkpoints;
+  LocsJournal::TocOffsets toc_offsets;
+  PageIndex::Entries      entries;
+  PageCheckpoints::Item   item;
+
+  EXPECT_EQ(open_journal(journal, 1234, index, checkpoints, toc_offsets), 0);
+
+  make_item(10, entries, item);
+  EXPECT_TRUE(journal.append(2, entries, item, { { .entry_index = 3, .reserved = 0, .offset = 500 } }));
+  make_item(5, entries, item);
+  EXPECT_TRUE(journal.append(0, entries, item, {}));
+
+  // The book is opened again
+  LocsJournal reopened;
+  EXPECT_EQ(open_journal(reopened, 1234, index, checkpoints, toc_offsets), 2);
+
+  EXPECT_TRUE(index.is_computed(0));
+  EXPECT_FALSE(index.is_computed(1));
+  EXPECT_TRUE(index.is_computed(2));
+  EXPECT_EQ(index.get_item_size(2), 10);
+  EXPECT_EQ(index.get(2, 9).offset, 900);
+  EXPECT_TRUE(checkpoints.is_valid(2, 10));
+  ASSERT_EQ(toc_offsets.size(), 1u);
+  EXPECT_EQ(toc_offsets[0].entry_index, 3);
+  EXPECT_EQ(toc_offsets[0].offset,    500);
+
+  // Another formatting profile restarts the journal
+  EXPECT_EQ(open_journal(reopened, 4321, index, checkpoints, toc_offsets), 0);
+  EXPECT_EQ(open_journal(reopened, 4321, index, checkpoints, toc_offsets), 0);
+
+  reopened.remove();
+  EXPECT_FALSE(std::ifstream(JNL_FILE).is_open());
+}
+
+TEST(LocsJournalTest, incomplete_record_is_dropped) {
+  remove(JNL_FILE);
+
+  LocsJournal             journal;
+  PageIndex               index;
+  PageCheckpoints         checkpoints;
+  LocsJournal::TocOffsets toc_offsets;
+  PageIndex::Entries      entries;
+  PageCheckpoints::Item   item;
+
+  open_journal(journal, 1, index, checkpoints, toc_offsets);
+  make_item(10, entries, item);
+  journal.append(1, entries, item, {});
+  make_item(10, entries, item);
+  journal.append(3, entries, item, {});
+
+  // Simulate a power loss in the middle of the last record
+  { std::ifstream in(JNL_FILE, std::ios::binary | std::ios::ate);
+    std::string   data(in.tellg(), 0);
+    in.seekg(0);
+    in.read(&data[0], data.size());
+    in.close();
+    std::ofstream out(JNL_FILE, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size() - 20);
+  }
+
+  EXPECT_EQ(open_journal(journal, 1, index, checkpoints, toc_offsets), 1);
+  EXPECT_TRUE(index.is_computed(1));
+  EXPECT_FALSE(index.is_computed(3));
+
+  // New records are appended after the last complete one
+  make_item(3, entries, item);
+  journal.append(3, entries, item, {});
+  EXPECT_EQ(open_journal(journal, 1, index, checkpoints, toc_offsets), 2);
+  EXPECT_EQ(index.get_item_size(3), 3);
+
+  journal.remove();
+}
+
+#endif
@@ -0,0 +1,185 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/locs_profiles.hpp"
+#include "logging.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cinttypes>
+#include <cstring>
+#include <sys/stat.h>
+#include <dirent.h>
+
+void
+LocsProfiles::set_book(const std::string & epub_filename)
+{
+  base = epub_filename.substr(0, epub_filename.find_last_of('.'));
+  profiles.clear();
+
+  std::ifstream file(base + ".prof", std::ios::in | std::ios::binary);
+  if (!file.is_open()) return;
+
+  uint8_t version = 0;
+  uint8_t count   = 0;
+
+  if (file.read((char *) &version, 1).fail() ||
+      file.read((char *) &count,   1).fail() ||
+      (version != PROF_VERSION)) {
+    LOG_E("Profiles file format error.");
+    return;
+  }
+
+  profiles.resize(count);
+  if ((count > 0) && file.read((char *) profiles.data(), count * sizeof(Profile)).fail()) {
+    LOG_E("Profiles file read error.");
+    profiles.clear();
+  }
+}
+
+std::string
+LocsProfiles::get_filename(uint32_t key, const char * ext) const
+{
+  char str[12];
+  snprintf(str, sizeof(str), "-%08" PRIx32, key);
+  return base + str + ext;
+}
+
+bool
+LocsProfiles::save() const
+{
+  std::ofstream file(base + ".prof", std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    LOG_E("Unable to save profiles file.");
+    return false;
+  }
+
+  uint8_t version = PROF_VERSION;
+  uint8_t count   = profiles.size();
+
+  file.write((const char *) &version, 1);
+  file.write((const char *) &count,   1);
+  if (count > 0) file.write((const char *) profiles.data(), count * sizeof(Profile));
+
+  file.close();
+  return !file.fail();
+}
+
+bool
+LocsProfiles::touch(uint32_t key)
+{
+  auto it = std::find_if(profiles.begin(), profiles.end(),
+                         [key](const Profile & p) { return p.key == key; });
+  if (it == profiles.end()) return false;
+
+  if (it != profiles.begin()) {
+    std::rotate(profiles.begin(), it, it + 1);
+    save();
+  }
+  return true;
+}
+
+void
+LocsProfiles::add(uint32_t key)
+{
+  Profile profile = {
+    .key  = key,
+    .size = file_size(get_filename(key, ".locs")) + 
+            file_size(get_filename(key, ".chk" )) + 
+            file_size(get_filename(key, ".toc" ))
+  };
+
+  auto it = std::find_if(profiles.begin(), profiles.end(),
+                         [key](const Profile & p) { return p.key == key; });
+  if (it != profiles.end()) profiles.erase(it);
+  profiles.insert(profiles.begin(), profile);
+
+  int32_t total = 0;
+  for (auto & p : profiles) total += p.size;
+
+  while ((profiles.size() > 1) &&
+         (((int8_t) profiles.size() > max_count) || (total > budget))) {
+    LOG_D("Removing pages location profile %08" PRIx32, profiles.back().key);
+    total -= profiles.back().size;
+    remove_files(profiles.back().key);
+    profiles.pop_back();
+  }
+
+  save();
+}
+
+void
+LocsProfiles::remove(uint32_t key)
+{
+  auto it = std::find_if(profiles.begin(), profiles.end(),
+                         [key](const Profile & p) { return p.key == key; });
+  if (it != profiles.end()) profiles.erase(it);
+
+  remove_files(key);
+  save();
+}
+
+void
+LocsProfiles::remove_files(uint32_t key) const
+{
+  ::remove(get_filename(key, ".locs").c_str());
+  ::remove(get_filename(key, ".chk" ).c_str());
+  ::remove(get_filename(key, ".jnl" ).c_str());
+  ::remove(get_filename(key, ".toc" ).c_str());
+}
+
+void
+LocsProfiles::remove_all(const std::string & epub_filename)
+{
+  LocsProfiles book_profiles(0, 0);
+
+  book_profiles.set_book(epub_filename);
+  for (auto & p : book_profiles.profiles) book_profiles.remove_files(p.key);
+
+  ::remove((book_profiles.base + ".prof").c_str());
+  ::remove((book_profiles.base + ".locs").c_str());
+  ::remove((book_profiles.base + ".toc" ).c_str());
+
+  // The journal of a computation not completed belongs to no profile:
+  // <book>-<key>.jnl files are looked for in the book folder.
+  size_t      pos    = book_profiles.base.find_last_of('/');
+  std::string folder = (pos == std::string::npos) ? "." : book_profiles.base.substr(0, pos);
+  std::string prefix = book_profiles.base.substr(pos + 1) + '-';
+
+  DIR * dir = opendir(folder.c_str());
+  if (dir == nullptr) return;
+
+  std::vector<std::string> journals;
+  struct dirent * de;
+  while ((de = readdir(dir)) != nullptr) {
+    if (strncmp(de->d_name, prefix.c_str(), prefix.length()) != 0) continue;
+    const char * key = de->d_name + prefix.length();
+    if ((strlen(key) == 12) && (strspn(key, "0123456789abcdef") == 8) && (strcmp(key + 8, ".jnl") == 0)) {
+      journals.push_back(folder + '/' + de->d_name);
+    }
+  }
+  closedir(dir);
+
+  for (auto & journal : journals) ::remove(journal.c_str());
+}
+
+uint32_t
+LocsProfiles::key_of(const void * params, int32_t size)
+{
+  const uint8_t * bytes = (const uint8_t *) params;
+  uint32_t        hash  = 2166136261UL;
+
+  for (int32_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+int32_t
+LocsProfiles::file_size(const std::string & filename)
+{
+  struct stat stat_buf;
+  return (stat(filename.c_str(), &stat_buf) == -1) ? 0 : stat_buf.st_size;
+}
@@ -0,0 +1,127 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/locs_profiles.hpp"
+
+#include <fstream>
+#include <sys/stat.h>
+
+static const char * BOOK = "/tmp/locs_profiles_test.epub";
+
+static void
+create_file(const std::string & filename, int32_t size)
+{
+  std::ofstream file(filename, std::ios::out | std::ios::binary);
+  std::string   data(size, 'x');
+  file.write(data.data(), size);
+}
+
+static bool
+file_exists(const std::string & filename)
+{
+  struct stat stat_buf;
+  return stat(filename.c_str(), &stat_buf) != -1;
+}
+
+// Simulate the save of a profile's files, as done by PageLocs
+static void
+add_profile(LocsProfiles & profiles, uint32_t key, int32_t size)
+{
+  create_file(profiles.get_filename(key, ".locs"), size);
+  create_file(profiles.get_filename(key, ".toc"),  0);
+  profiles.add(key);
+}
+
+TEST(LocsProfilesTest, key_and_filename) {
+  uint8_t params_a[7] = { 1, 0, 1, 1, 3, 0, 2 };
+  uint8_t params_b[7] = { 1, 0, 1, 1, 4, 0, 2 };
+
+  EXPECT_NE(LocsProfiles::key_of(params_a, 7), LocsProfiles::key_of(params_b, 7));
+  EXPECT_EQ(LocsProfiles::key_of(params_a, 7), LocsProfiles::key_of(params_a, 7));
+
+  LocsProfiles profiles(4, 1000);
+  profiles.set_book(BOOK);
+  EXPECT_EQ(profiles.get_filename(0x12ab, ".locs"), "/tmp/locs_profiles_test-000012ab.locs");
+}
+
+TEST(LocsProfilesTest, lru_by_count) {
+  LocsProfiles::remove_all(BOOK);
+
+  LocsProfiles profiles(3, 100000);
+  profiles.set_book(BOOK);
+
+  add_profile(profiles, 1, 100);
+  add_profile(profiles, 2, 100);
+  add_profile(profiles, 3, 100);
+
+  EXPECT_TRUE(profiles.touch(1));   // 1, 3, 2
+  EXPECT_FALSE(profiles.touch(9));
+
+  add_profile(profiles, 4, 100);    // 4, 1, 3 - 2 is evicted
+
+  ASSERT_EQ(profiles.get_profiles().size(), 3u);
+  EXPECT_EQ(profiles.get_profiles()[0].key, 4u);
+  EXPECT_EQ(profiles.get_profiles()[1].key, 1u);
+  EXPECT_EQ(profiles.get_profiles()[2].key, 3u);
+  EXPECT_FALSE(file_exists(profiles.get_filename(2, ".locs")));
+  EXPECT_FALSE(file_exists(profiles.get_filename(2, ".toc")));
+  EXPECT_TRUE(file_exists(profiles.get_filename(3, ".locs")));
+
+  // The list is retrieved from the .prof file
+  LocsProfiles reloaded(3, 100000);
+  reloaded.set_book(BOOK);
+  ASSERT_EQ(reloaded.get_profiles().size(), 3u);
+  EXPECT_EQ(reloaded.get_profiles()[0].key,  4u);
+  EXPECT_EQ(reloaded.get_profiles()[0].size, 100);
+
+  LocsProfiles::remove_all(BOOK);
+  EXPECT_FALSE(file_exists(profiles.get_filename(4, ".locs")));
+  EXPECT_FALSE(file_exists("/tmp/locs_profiles_test.prof"));
+}
+
+// The journal of a computation not completed is not part of the profiles
+TEST(LocsProfilesTest, remove_all_journals) {
+  static const char * OTHER_BOOK = "/tmp/locs_profiles_test-2.epub";
+
+  LocsProfiles::remove_all(BOOK);
+
+  LocsProfiles profiles(3, 100000);
+  profiles.set_book(BOOK);
+  add_profile(profiles, 1, 100);
+  create_file(profiles.get_filename(0x12ab, ".jnl"), 10);
+
+  LocsProfiles other(3, 100000);
+  other.set_book(OTHER_BOOK);
+  create_file(other.get_filename(0x12ab, ".jnl"), 10);
+
+  LocsProfiles::remove_all(BOOK);
+  EXPECT_FALSE(file_exists(profiles.get_filename(1, ".locs")));
+  EXPECT_FALSE(file_exists(profiles.get_filename(0x12ab, ".jnl")));
+  EXPECT_TRUE(file_exists(other.get_filename(0x12ab, ".jnl")));
+
+  LocsProfiles::remove_all(OTHER_BOOK);
+  EXPECT_FALSE(file_exists(other.get_filename(0x12ab, ".jnl")));
+}
+
+TEST(LocsProfilesTest, size_budget) {
+  LocsProfiles::remove_all(BOOK);
+
+  LocsProfiles profiles(8, 1000);
+  profiles.set_book(BOOK);
+
+  add_profile(profiles, 1, 400);
+  add_profile(profiles, 2, 400);
+  add_profile(profiles, 3, 400);    // 1 is evicted
+
+  ASSERT_EQ(profiles.get_profiles().size(), 2u);
+  EXPECT_EQ(profiles.get_profiles()[1].key, 2u);
+
+  // The most recent profile is kept, even when over budget
+  add_profile(profiles, 4, 2000);
+  ASSERT_EQ(profiles.get_profiles().size(), 1u);
+  EXPECT_EQ(profiles.get_profiles()[0].key, 4u);
+
+  LocsProfiles::remove_all(BOOK);
+}
+
+#endif
@@ -0,0 +1,125 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/page_checkpoints.hpp"
+#include "logging.hpp"
+
+#include <fstream>
+
+void
+PageCheckpoints::clear(int16_t item_count)
+{
+  items.clear();
+  items.resize(item_count < 0 ? 0 : item_count);
+}
+
+void
+PageCheckpoints::set_item(int16_t itemref_index, Item & item)
+{
+  if ((itemref_index < 0) || (itemref_index >= (int16_t) items.size())) return;
+
+  Item & dest = items[itemref_index];
+
+  dest.clear();
+  dest.first_step.swap(item.first_step);
+  dest.steps.swap(item.steps);
+  dest.first_step.shrink_to_fit();
+  dest.steps.shrink_to_fit();
+}
+
+bool
+PageCheckpoints::get(int16_t itemref_index, int32_t pg, const Step * & path, int16_t & length) const
+{
+  if ((itemref_index < 0) || (itemref_index >= (int16_t) items.size())) return false;
+
+  const Item & item = items[itemref_index];
+  if ((pg < 0) || (pg >= item.get_page_count())) return false;
+
+  int32_t first = item.first_step[pg];
+  int32_t last  = item.first_step[pg + 1];
+  if ((first < 0) || (last < first) || (last > (int32_t) item.steps.size()) ||
+      ((last - first) > MAX_PATH_LENGTH)) return false;
+
+  path   = item.steps.data() + first;
+  length = last - first;
+  return true;
+}
+
+// File layout: version (uint8), item count (int16), then for each item:
+// page count (int32), step count (int32), first steps (int32[page count + 1])
+// and steps.
+
+bool
+PageCheckpoints::save(const std::string & filename) const
+{
+  std::ofstream file(filename, std::ios::out | std::ios::binary);
+
+  if (!file.is_open()) {
+    LOG_E("Not able to open checkpoints file.");
+    return false;
+  }
+
+  uint8_t version    = CHK_VERSION;
+  int16_t item_count = items.size();
+
+  file.write((const char *) &version,    sizeof(version));
+  file.write((const char *) &item_count, sizeof(item_count));
+
+  for (auto & item : items) {
+    int32_t page_count = item.get_page_count();
+    int32_t step_count = item.steps.size();
+    file.write((const char *) &page_count, sizeof(page_count));
+    file.write((const char *) &step_count, sizeof(step_count));
+    if (page_count > 0) {
+      file.write((const char *) item.first_step.data(), (page_count + 1) * sizeof(int32_t));
+      file.write((const char *) item.steps.data(),      step_count * sizeof(Step));
+    }
+  }
+
+  file.close();
+  return !file.fail();
+}
+
+bool
+PageCheckpoints::load(const std::string & filename, int16_t item_count)
+{
+  clear(item_count);
+
+  std::ifstream file(filename, std::ios::in | std::ios::binary);
+  if (!file.is_open()) return false;
+
+  uint8_t version;
+  int16_t count;
+
+  if (file.read((char *) &version, sizeof(version)).fail() ||
+      file.read((char *) &count,   sizeof(count)).fail() ||
+      (version != CHK_VERSION) ||
+      (count   != item_count)) {
+    LOG_E("Checkpoints file format error.");
+    return false;
+  }
+
+  for (auto & item : items) {
+    int32_t page_count, step_count;
+    if (file.read((char *) &page_count, sizeof(page_count)).fail() ||
+        file.read((char *) &step_count, sizeof(step_count)).fail() ||
+        (page_count < 0) || (step_count < 0) ||
+        (step_count > page_count * MAX_PATH_LENGTH)) {
+      clear(item_count);
+      return false;
+    }
+    if (page_count > 0) {
+      item.first_step.resize(page_count + 1);
+      item.steps.resize(step_count);
+      if (file.read((char *) item.first_step.data(), (page_count + 1) * sizeof(int32_t)).fail() ||
+          file.read((char *) item.steps.data(),      step_count * sizeof(Step)).fail() ||
+          (item.first_step[page_count] != step_count)) {
+        clear(item_count);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,80 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/page_checkpoints.hpp"
+
+#include <cstdio>
+
+static const char * CHK_FILE = "/tmp/page_checkpoints_test.chk";
+
+static void
+fill_item(PageCheckpoints::Item & item, int32_t page_count)
+{
+  PageCheckpoints::Step path[PageCheckpoints::MAX_PATH_LENGTH];
+
+  item.clear();
+  for (int32_t pg = 0; pg < page_count; pg++) {
+    int16_t length = pg % 4;  // The first page of an item has an empty path
+    for (int16_t i = 0; i < length; i++) {
+      path[i] = { .offset = pg * 100 + i, .child_index = (int16_t) i, .reserved = 0 };
+    }
+    item.add_page(path, length);
+  }
+}
+
+TEST(PageCheckpointsTest, set_and_get) {
+  PageCheckpoints       checkpoints;
+  PageCheckpoints::Item item;
+
+  checkpoints.clear(2);
+  fill_item(item, 10);
+  checkpoints.set_item(1, item);
+  EXPECT_EQ(item.get_page_count(), 0);
+
+  EXPECT_TRUE(checkpoints.is_valid(1, 10));
+  EXPECT_FALSE(checkpoints.is_valid(1, 11));
+  EXPECT_FALSE(checkpoints.is_valid(0, 10));
+
+  const PageCheckpoints::Step * path;
+  int16_t                       length;
+
+  EXPECT_TRUE(checkpoints.get(1, 0, path, length));
+  EXPECT_EQ(length, 0);
+  EXPECT_TRUE(checkpoints.get(1, 7, path, length));
+  ASSERT_EQ(length, 3);
+  EXPECT_EQ(path[2].offset,      702);
+  EXPECT_EQ(path[2].child_index, 2);
+  EXPECT_FALSE(checkpoints.get(1, 10, path, length));
+  EXPECT_FALSE(checkpoints.get(0,  0, path, length));
+}
+
+TEST(PageCheckpointsTest, save_and_load) {
+  PageCheckpoints       checkpoints;
+  PageCheckpoints::Item item;
+
+  checkpoints.clear(3);
+  fill_item(item, 5);
+  checkpoints.set_item(0, item);
+  fill_item(item, 20);
+  checkpoints.set_item(2, item);
+
+  EXPECT_TRUE(checkpoints.save(CHK_FILE));
+
+  PageCheckpoints loaded;
+  EXPECT_FALSE(loaded.load(CHK_FILE, 4));  // Not the same book
+  ASSERT_TRUE(loaded.load(CHK_FILE, 3));
+
+  EXPECT_TRUE(loaded.is_valid(0, 5));
+  EXPECT_TRUE(loaded.is_valid(1, 0));
+  EXPECT_TRUE(loaded.is_valid(2, 20));
+
+  const PageCheckpoints::Step * path;
+  int16_t                       length;
+  ASSERT_TRUE(loaded.get(2, 19, path, length));
+  ASSERT_EQ(length, 3);
+  EXPECT_EQ(path[0].offset, 1900);
+
+  remove(CHK_FILE);
+}
+
+#endif
@@ -0,0 +1,89 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/page_estimator.hpp"
+#include "logging.hpp"
+
+void
+PageEstimator::clear(const std::vector<int32_t> & item_sizes)
+{
+  std::scoped_lock guard(mutex);
+
+  items.clear();
+  items.reserve(item_sizes.size());
+  for (int32_t size : item_sizes) items.push_back({ .size = size, .page_count = -1 });
+
+  computed_size    = 0;
+  computed_pages   = 0;
+  computed_offsets = 0;
+}
+
+void
+PageEstimator::set_item(int16_t itemref_index, int32_t page_count, int32_t offset_count)
+{
+  std::scoped_lock guard(mutex);
+
+  if ((itemref_index < 0) || (itemref_index >= (int16_t) items.size())) return;
+
+  Item & item = items[itemref_index];
+  if (item.page_count != -1) return;
+
+  item.page_count = page_count;
+
+  // Items that are too small (title pages, etc.) or not XHTML are not
+  // representative of the book content.
+  if ((item.size > 0) && (page_count > 1)) {
+    computed_size    += item.size;
+    computed_pages   += page_count;
+    computed_offsets += offset_count;
+  }
+}
+
+int32_t
+PageEstimator::item_page_count(const Item & item) const
+{
+  if (item.page_count != -1) return item.page_count;
+  if (item.size < 0) return 1;
+  if (item.size == 0) return 0;
+
+  int64_t pages = (computed_pages == 0) ?
+    (item.size + DEFAULT_BYTES_PER_PAGE / 2) / DEFAULT_BYTES_PER_PAGE :
+    (item.size * computed_pages + computed_size / 2) / computed_size;
+
+  return (pages < 1) ? 1 : pages;
+}
+
+int16_t
+PageEstimator::get_page_count()
+{
+  std::scoped_lock guard(mutex);
+
+  int32_t count = 0;
+  for (auto & item : items) count += item_page_count(item);
+
+  return (count > 32767) ? 32767 : count;
+}
+
+int16_t
+PageEstimator::get_page_nbr(int16_t itemref_index, int32_t offset, int32_t pg)
+{
+  std::scoped_lock guard(mutex);
+
+  if ((itemref_index < 0) || (itemref_index >= (int16_t) items.size())) return -1;
+
+  int32_t page_nbr = 0;
+  for (int16_t idx = 0; idx < itemref_index; idx++) page_nbr += item_page_count(items[idx]);
+
+  int32_t count = item_page_count(items[itemref_index]);
+
+  if (pg == -1) {
+    pg = (computed_pages == 0) ?
+      offset / DEFAULT_OFFSETS_PER_PAGE :
+      (int64_t) offset * computed_pages / computed_offsets;
+  }
+  if (pg >= count) pg = count - 1;
+  if (pg > 0) page_nbr += pg;
+
+  return (page_nbr > 32767) ? 32767 : page_nbr;
+}
@@ -0,0 +1,261 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/page_estimator.hpp"
+#include "models/ttf2.hpp"
+#include "screen.hpp"
+#include "helpers/unzip.hpp"
+#include "pugixml.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+
+TEST(PageEstimatorTest, calibration) {
+  PageEstimator estimator;
+
+  estimator.clear({ 30000, 30000, -1, 60000, 0 });
+
+  // Default ratio: 3000 bytes per page, one page for the image
+  EXPECT_EQ(estimator.get_page_count(), 10 + 10 + 1 + 20);
+  EXPECT_EQ(estimator.get_page_nbr(3, 0), 21);
+  EXPECT_EQ(estimator.get_page_nbr(1, 4 * PageEstimator::DEFAULT_OFFSETS_PER_PAGE), 14);
+
+  // The first item is laid out in 15 pages, 24000 offsets
+  estimator.set_item(0, 15, 24000);
+  EXPECT_EQ(estimator.get_page_count(), 15 + 15 + 1 + 30);
+  EXPECT_EQ(estimator.get_page_nbr(1, 1600 * 4), 15 + 4);
+  EXPECT_EQ(estimator.get_page_nbr(1, 1000000), 15 + 14);  // Stays in the item
+  EXPECT_EQ(estimator.get_page_nbr(0, 0, 7), 7);           // Exact position
+
+  estimator.set_item(1, 14, 23000);
+  EXPECT_EQ(estimator.get_page_count(), 15 + 14 + 1 + 29);
+  EXPECT_EQ(estimator.get_page_nbr(4, 0), 59);
+  EXPECT_EQ(estimator.get_page_nbr(5, 0), -1);
+}
+
+// Reference layout of an XHTML item, as done by PageLocs with the default
+// parameters: the words are laid out with the glyph metrics of the default
+// font and size, in the screen width less the side margins, and the screen
+// height less the bottom line. Every block starts a new line. The CSS
+// margins and the headings sizes are not considered. Offsets are counted as
+// by the HTMLInterpreter: one per character and one per element.
+
+static constexpr int16_t FONT_SIZE = 12;
+
+struct Layout {
+  TTF   * font;
+  int32_t line_width;
+  int32_t lines_per_page;
+  int32_t x;          ///< Width of the current line, -1 if none started
+  int32_t lines;
+  int32_t offsets;
+  std::vector<int32_t> page_offsets;  ///< Offset at the start of each page
+};
+
+static int32_t
+word_width(TTF & font, const std::string & word)
+{
+  int32_t width = 0;
+  for (const char * s = word.c_str(); *s; ) {
+    uint32_t code = (uint8_t) *s++;
+    if (code >= 0x80) {
+      int count = (code >= 0xF0) ? 3 : (code >= 0xE0) ? 2 : 1;
+      code &= 0x3F >> count;
+      while ((count-- > 0) && ((*s & 0xC0) == 0x80)) code = (code << 6) | (*s++ & 0x3F);
+    }
+    Font::Glyph * glyph = font.get_glyph_metrics(code, FONT_SIZE);
+    if (glyph != nullptr) width += glyph->advance;
+  }
+  return width;
+}
+
+static void
+add_word(Layout & layout, const std::string & word, int32_t offset)
+{
+  int32_t width = word_width(*layout.font, word);
+  int32_t space = layout.font->get_glyph_metrics(' ', FONT_SIZE)->advance;
+
+  if ((layout.x < 0) || ((layout.x + space + width) > layout.line_width)) {
+    if ((layout.lines % layout.lines_per_page) == 0) layout.page_offsets.push_back(offset);
+    layout.lines++;
+    layout.x = width;
+  }
+  else {
+    layout.x += space + width;
+  }
+}
+
+static void
+layout_node(pugi::xml_node node, Layout & layout)
+{
+  static const char * blocks[] = { "p", "div", "h1", "h2", "h3", "h4", "h5", "h6",
+                                   "li", "br", "blockquote", "tr", "pre", nullptr };
+  for (auto n : node.children()) {
+    if (n.type() == pugi::node_pcdata) {
+      std::string word;
+      int32_t     offset = 0;
+      for (const char * s = n.value(); ; s++) {
+        if ((*s == 0) || isspace(*s)) {
+          if (!word.empty()) add_word(layout, word, offset);
+          word.clear();
+          if (*s == 0) break;
+          continue;
+        }
+        if (word.empty()) offset = layout.offsets;
+        word += *s;
+        layout.offsets++;
+      }
+    }
+    else if (n.type() == pugi::node_element) {
+      bool block = false;
+      for (const char ** b = blocks; *b; b++) {
+        if (strcmp(n.name(), *b) == 0) { block = true; break; }
+      }
+      layout.offsets++;
+      if (block) layout.x = -1;
+      layout_node(n, layout);
+      if (block) layout.x = -1;
+    }
+  }
+}
+
+struct RefItem {
+  int32_t size;
+  int32_t page_count;
+  int32_t offset_count;
+  std::vector<int32_t> page_offsets;
+};
+
+static bool
+load_book(const char * filename, TTF & font, std::vector<RefItem> & items)
+{
+  if (!unzip.open_zip_file(filename)) return false;
+
+  uint32_t size;
+  pugi::xml_document container, opf;
+
+  auto data = unzip.get_file("META-INF/container.xml", size);
+  if ((data == nullptr) || !container.load_buffer(data.get(), size)) return false;
+
+  std::string opf_name = container.child("container").child("rootfiles").child("rootfile").attribute("full-path").value();
+  std::string base     = opf_name.substr(0, opf_name.find_last_of('/') + 1);
+
+  data = unzip.get_file(opf_name.c_str(), size);
+  if ((data == nullptr) || !opf.load_buffer(data.get(), size)) return false;
+
+  pugi::xml_node package = opf.child("package");
+  for (auto itemref : package.child("spine").children("itemref")) {
+    pugi::xml_node item = package.child("manifest").find_child_by_attribute("item", "id", itemref.attribute("idref").value());
+    RefItem ref = { .size = -1, .page_count = 1, .offset_count = 0, .page_offsets = { 0 } };
+    if (strcmp(item.attribute("media-type").value(), "application/xhtml+xml") == 0) {
+      std::string fname = base + item.attribute("href").value();
+      ref.size = unzip.get_file_size(fname.c_str());
+      data     = unzip.get_file(fname.c_str(), size);
+      pugi::xml_document doc;
+      if ((data == nullptr) || !doc.load_buffer(data.get(), size)) return false;
+      int32_t line_height = font.get_line_height(FONT_SIZE);
+      Layout  layout = { 
+        .font           = &font, 
+        .line_width     = Screen::get_width() - 20,
+        .lines_per_page = (int32_t)((Screen::get_height() - (line_height * 3 / 2)) / (line_height * 0.95)),
+        .x              = -1, 
+        .lines          = 0, 
+        .offsets        = 0, 
+        .page_offsets   = {} 
+      };
+      layout_node(doc.child("html").child("body"), layout);
+      ref.page_count   = layout.page_offsets.size();
+      ref.offset_count = layout.offsets;
+      ref.page_offsets = layout.page_offsets;
+    }
+    items.push_back(ref);
+  }
+
+  unzip.close_zip_file();
+  return !items.empty();
+}
+
+// A file of the tree, whatever the current directory
+static std::string
+tree(const char * name)
+{
+  std::string path(__FILE__);
+  size_t      pos = path.rfind("src/models/");
+  return path.substr(0, (pos == std::string::npos) ? 0 : pos) + name;
+}
+
+// Estimation error against the books in the SDCard folder, while items are
+// computed in reading order. The position error is the mean distance of
+// the estimated page number of every page to its exact value. The errors
+// measured are reported as test properties.
+TEST(PageEstimatorTest, known_books) {
+  static const struct { const char * name; const char * filename; } books[] = {
+    { "en", "SDCard/books/Austen, Jane - Pride and Prejudice.epub" },
+    { "fr", "SDCard/books/Austen, Jane - Orgueil et préjugés.epub"  }
+  };
+
+  std::string font_filename = tree("SDCard/fonts/DejaVuSerif-Regular.otf");
+  TTF font(font_filename);
+  if (!font.is_ready()) GTEST_SKIP() << font_filename << " not available.";
+
+  for (auto & book : books) {
+    std::string filename = tree(book.filename);
+
+    std::vector<RefItem> items;
+    if (!load_book(filename.c_str(), font, items)) GTEST_SKIP() << filename << " not available.";
+
+    SCOPED_TRACE(book.filename);
+
+    int32_t exact_count = 0;
+    for (auto & item : items) exact_count += item.page_count;
+
+    PageEstimator        estimator;
+    std::vector<int32_t> sizes;
+    for (auto & item : items) sizes.push_back(item.size);
+    estimator.clear(sizes);
+
+    // The first items (title, table of content) are not representative of
+    // the rest of the book: the estimation is expected to be reliable once
+    // a quarter of the book is computed.
+    struct Stage { int percent; double max_count_error; double max_pos_error; };
+    static const Stage stages[] = {
+      { 0, 70.0, 35.0 }, { 5, 55.0, 27.0 }, { 10, 25.0, 12.0 }, { 25, 7.5, 3.0 }, { 50, 3.0, 0.75 }
+    };
+
+    int16_t computed = 0;
+    for (auto & stage : stages) {
+      int percent = stage.percent;
+      SCOPED_TRACE(testing::Message() << percent << "% computed");
+
+      while (computed < (int16_t) (items.size() * percent / 100)) {
+        estimator.set_item(computed, items[computed].page_count, items[computed].offset_count);
+        computed++;
+      }
+
+      double  count_error = std::abs(estimator.get_page_count() - exact_count) * 100.0 / exact_count;
+      double  pos_error   = 0;
+      int32_t page_nbr    = 0;
+      for (int16_t idx = 0; idx < (int16_t) items.size(); idx++) {
+        for (int32_t pg = 0; pg < items[idx].page_count; pg++, page_nbr++) {
+          int16_t estimated = estimator.get_page_nbr(idx, items[idx].page_offsets[pg], idx < computed ? pg : -1);
+          pos_error += std::abs(estimated - page_nbr);
+        }
+      }
+      pos_error = pos_error * 100.0 / exact_count / exact_count;
+
+      char key[32], value[16];
+      snprintf(key,   sizeof(key),   "%s_count_error_%d", book.name, percent);
+      snprintf(value, sizeof(value), "%.2f%%", count_error);
+      RecordProperty(key, value);
+      snprintf(key,   sizeof(key),   "%s_pos_error_%d", book.name, percent);
+      snprintf(value, sizeof(value), "%.2f%%", pos_error);
+      RecordProperty(key, value);
+
+      EXPECT_LT(count_error, stage.max_count_error);
+      EXPECT_LT(pos_error,   stage.max_pos_error);
+    }
+  }
+}
+
+#endif
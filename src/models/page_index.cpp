@@ -0,0 +1,227 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "models/page_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void
+PageIndex::clear(int16_t item_count)
+{
+  items.clear();
+  items.resize(item_count < 0 ? 0 : item_count);
+  entry_count = 0;
+  page_count  = 0;
+}
+
+bool
+PageIndex::set_item(int16_t itemref_index, Entries & entries)
+{
+  if ((itemref_index < 0) || (itemref_index >= (int16_t) items.size())) return false;
+
+  Item & item = items[itemref_index];
+
+  entry_count -= item.size;
+  item.entries.clear();
+  item.entries.swap(entries);
+  item.entries.shrink_to_fit();
+  item.data    = item.entries.data();
+  item.size    = item.entries.size();
+  entry_count += item.size;
+
+  item.hidden_count = 0;
+  for (auto & entry : item.entries) {
+    if (entry.size < 0) item.hidden_count++;
+  }
+
+  // Publish the item: its content is now visible to readers
+  item.computed.store(true, std::memory_order_release);
+
+  return true;
+}
+
+bool
+PageIndex::attach(const uint8_t * block, int16_t item_count, int32_t the_entry_count)
+{
+  clear(item_count);
+
+  const ItemRecord * records = reinterpret_cast<const ItemRecord *>(block);
+  const Entry      * data    = reinterpret_cast<const Entry *>(block + item_count * sizeof(ItemRecord));
+
+  for (int16_t idx = 0; idx < item_count; idx++) {
+    int32_t first = records[idx].first_entry;
+    int32_t last  = (idx + 1) < item_count ? records[idx + 1].first_entry : the_entry_count;
+
+    if ((first < 0) || (last < first) || (last > the_entry_count)) {
+      clear(item_count);
+      return false;
+    }
+
+    Item & item = items[idx];
+
+    item.data           = data + first;
+    item.size           = last - first;
+    item.first_page_nbr = records[idx].first_page_nbr;
+    item.hidden_count   = records[idx].hidden_count;
+    item.computed       = true;
+  }
+
+  entry_count = the_entry_count;
+  if (item_count > 0) {
+    const Item & item = items.back();
+    page_count = item.first_page_nbr + item.size - item.hidden_count;
+  }
+
+  return true;
+}
+
+bool
+PageIndex::write(std::ostream & out) const
+{
+  int32_t first_entry = 0;
+
+  for (auto & item : items) {
+    ItemRecord record = {
+      .first_entry    = first_entry,
+      .first_page_nbr = item.first_page_nbr,
+      .hidden_count   = item.hidden_count
+    };
+    if (out.write(reinterpret_cast<const char *>(&record), sizeof(record)).fail()) return false;
+    first_entry += item.size;
+  }
+
+  for (auto & item : items) {
+    if (item.size == 0) continue;
+    if (out.write(reinterpret_cast<const char *>(item.data), item.size * sizeof(Entry)).fail()) return false;
+  }
+
+  return true;
+}
+
+uint32_t
+PageIndex::checksum(const void * data, int32_t size, uint32_t hash)
+{
+  // FNV-1a, 32 bits at a time. All records are made of 32 bits words.
+  // Words are fetched with memcpy to stay clear of strict aliasing issues.
+  const uint8_t * bytes = reinterpret_cast<const uint8_t *>(data);
+  for (int32_t i = 0; i < (size >> 2); i++, bytes += 4) {
+    uint32_t word;
+    memcpy(&word, bytes, 4);
+    hash = (hash ^ word) * 16777619UL;
+  }
+  return hash;
+}
+
+uint32_t
+PageIndex::get_checksum() const
+{
+  uint32_t hash        = checksum(nullptr, 0);
+  int32_t  first_entry = 0;
+
+  for (auto & item : items) {
+    ItemRecord record = {
+      .first_entry    = first_entry,
+      .first_page_nbr = item.first_page_nbr,
+      .hidden_count   = item.hidden_count
+    };
+    hash = checksum(&record, sizeof(record), hash);
+    first_entry += item.size;
+  }
+
+  for (auto & item : items) {
+    hash = checksum(item.data, item.size * sizeof(Entry), hash);
+  }
+
+  return hash;
+}
+
+int16_t
+PageIndex::compute_page_numbers()
+{
+  int16_t page_nbr = 0;
+  for (auto & item : items) {
+    item.first_page_nbr = page_nbr;
+    page_nbr += item.size - item.hidden_count;
+  }
+  return page_count = page_nbr;
+}
+
+int32_t
+PageIndex::find(int16_t itemref_index, int32_t offset) const
+{
+  if (!is_computed(itemref_index)) return -1;
+
+  const Item  & item = items[itemref_index];
+  const Entry * end  = item.data + item.size;
+  const Entry * it   = std::lower_bound(
+    item.data, end, offset,
+    [](const Entry & entry, int32_t off) { return entry.offset < off; });
+
+  return ((it == end) || (it->offset != offset)) ? -1 : (it - item.data);
+}
+
+int32_t
+PageIndex::find_containing(int16_t itemref_index, int32_t offset) const
+{
+  if (!is_computed(itemref_index)) return -1;
+
+  const Item  & item = items[itemref_index];
+  const Entry * it   = std::upper_bound(
+    item.data, item.data + item.size, offset,
+    [](int32_t off, const Entry & entry) { return off < entry.offset; });
+
+  if (it == item.data) return -1;
+  it--;
+
+  return ((it->offset == offset) || ((it->offset + abs(it->size)) > offset)) ?
+           (it - item.data) : -1;
+}
+
+int16_t
+PageIndex::get_page_nbr(int16_t itemref_index, int32_t pg) const
+{
+  const Item & item = items[itemref_index];
+
+  if (item.data[pg].size < 0) return -1;
+  if (item.hidden_count == 0) return item.first_page_nbr + pg;
+
+  int16_t page_nbr = item.first_page_nbr;
+  for (int32_t i = 0; i < pg; i++) {
+    if (item.data[i].size >= 0) page_nbr++;
+  }
+  return page_nbr;
+}
+
+bool
+PageIndex::get_page_pos(int16_t page_nbr, int16_t & itemref_index, int32_t & pg) const
+{
+  if ((page_nbr < 0) || (page_nbr >= page_count)) return false;
+
+  // Last item starting at or before page_nbr. Items without visible pages
+  // share their first page number with the next item and are skipped this way.
+  std::vector<Item>::const_iterator it = std::upper_bound(
+    items.begin(), items.end(), page_nbr,
+    [](int16_t nbr, const Item & item) { return nbr < item.first_page_nbr; });
+
+  if (it == items.begin()) return false;
+  it--;
+
+  int32_t visible_idx = page_nbr - it->first_page_nbr;
+
+  itemref_index = it - items.begin();
+
+  if (it->hidden_count == 0) {
+    pg = visible_idx;
+    return pg < it->size;
+  }
+
+  for (pg = 0; pg < it->size; pg++) {
+    if (it->data[pg].size >= 0) {
+      if (visible_idx == 0) return true;
+      visible_idx--;
+    }
+  }
+  return false;
+}
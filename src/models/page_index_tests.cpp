@@ -0,0 +1,265 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/page_index.hpp"
+
+#include <atomic>
+#include <map>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+// Build an index of item_count items, pages_per_item pages each, every page
+// being page_size bytes long. Every hidden_every page (if not 0) is hidden.
+static void
+fill_index(PageIndex & index, int16_t item_count, int32_t pages_per_item, int32_t page_size, int32_t hidden_every = 0)
+{
+  index.clear(item_count);
+  for (int16_t idx = 0; idx < item_count; idx++) {
+    PageIndex::Entries entries;
+    for (int32_t pg = 0; pg < pages_per_item; pg++) {
+      bool hidden = (hidden_every != 0) && (pg > 0) && ((pg % hidden_every) == 0);
+      entries.push_back({ pg * page_size, hidden ? -page_size : page_size });
+    }
+    EXPECT_TRUE(index.set_item(idx, entries));
+    EXPECT_TRUE(entries.empty());
+  }
+  index.compute_page_numbers();
+}
+
+TEST(PageIndexTest, find_by_offset) {
+  PageIndex index;
+  fill_index(index, 3, 10, 100);
+
+  EXPECT_TRUE(index.is_computed(2));
+  EXPECT_FALSE(index.is_computed(3));
+  EXPECT_EQ(index.get_entry_count(), 30);
+
+  EXPECT_EQ(index.find(1, 0),    0);
+  EXPECT_EQ(index.find(1, 500),  5);
+  EXPECT_EQ(index.find(1, 550), -1);
+  EXPECT_EQ(index.find(5, 0),   -1);
+
+  EXPECT_EQ(index.find_containing(1, 550),  5);
+  EXPECT_EQ(index.find_containing(1, 999),  9);
+  EXPECT_EQ(index.find_containing(1, 1000), -1);
+}
+
+TEST(PageIndexTest, page_numbers_with_hidden_pages) {
+  PageIndex index;
+  fill_index(index, 4, 10, 100, 4); // pages 4 and 8 of each item are hidden
+
+  EXPECT_EQ(index.get_page_count(), 4 * 8);
+  EXPECT_EQ(index.get_page_nbr(0, 0),  0);
+  EXPECT_EQ(index.get_page_nbr(0, 4), -1);
+  EXPECT_EQ(index.get_page_nbr(0, 5),  4);
+  EXPECT_EQ(index.get_page_nbr(1, 0),  8);
+
+  // Every visible page must be found back from its page number
+  for (int16_t idx = 0; idx < 4; idx++) {
+    for (int32_t pg = 0; pg < 10; pg++) {
+      int16_t page_nbr = index.get_page_nbr(idx, pg);
+      if (page_nbr == -1) continue;
+      int16_t found_idx;
+      int32_t found_pg;
+      EXPECT_TRUE(index.get_page_pos(page_nbr, found_idx, found_pg));
+      EXPECT_EQ(found_idx, idx);
+      EXPECT_EQ(found_pg,  pg);
+    }
+  }
+  int16_t idx; int32_t pg;
+  EXPECT_FALSE(index.get_page_pos(4 * 8, idx, pg));
+}
+
+TEST(PageIndexTest, empty_items_are_skipped) {
+  PageIndex index;
+  PageIndex::Entries entries;
+
+  index.clear(3);
+  entries.push_back({ 0, 100 });
+  index.set_item(0, entries);
+  index.set_item(1, entries); // empty
+  entries.push_back({ 0, 100 });
+  index.set_item(2, entries);
+  index.compute_page_numbers();
+
+  int16_t idx; int32_t pg;
+  EXPECT_TRUE(index.get_page_pos(1, idx, pg));
+  EXPECT_EQ(idx, 2);
+  EXPECT_EQ(pg,  0);
+}
+
+// Pages looked up by number in a 10k pages book give the same result as
+// with the previous std::map based pages map.
+TEST(PageIndexTest, pages_by_number_10k_pages) {
+  struct PageId { int16_t itemref_index; int32_t offset; };
+  struct PageCompare {
+    bool operator() (const PageId & lhs, const PageId & rhs) const {
+      if (lhs.itemref_index < rhs.itemref_index) return true;
+      if (lhs.itemref_index > rhs.itemref_index) return false;
+      return lhs.offset < rhs.offset;
+    }
+  };
+  typedef std::map<PageId, int32_t, PageCompare> PagesMap;
+
+  const int16_t ITEMS     = 100;
+  const int32_t PAGES     = 100;
+  const int32_t PAGE_SIZE = 1500;
+
+  PageIndex index;
+  PagesMap  pages_map;
+
+  fill_index(index, ITEMS, PAGES, PAGE_SIZE);
+  for (int16_t idx = 0; idx < ITEMS; idx++) {
+    for (int32_t pg = 0; pg < PAGES; pg++) pages_map[{ idx, pg * PAGE_SIZE }] = PAGE_SIZE;
+  }
+
+  ASSERT_EQ(index.get_page_count(), 10000);
+  EXPECT_EQ(index.get_entry_count(), (int32_t) pages_map.size());
+
+  int16_t nbr = 0;
+  for (auto & entry : pages_map) {
+    int16_t idx; int32_t pg;
+    ASSERT_TRUE(index.get_page_pos(nbr, idx, pg));
+    EXPECT_EQ(idx, entry.first.itemref_index);
+    EXPECT_EQ(index.get(idx, pg).offset, entry.first.offset);
+    EXPECT_EQ(index.find(idx, entry.first.offset), pg);
+    EXPECT_EQ(index.get(idx, pg).size, entry.second);
+    nbr++;
+  }
+}
+
+TEST(PageIndexTest, write_and_attach) {
+  PageIndex index;
+  fill_index(index, 5, 20, 100, 7);
+
+  std::ostringstream out;
+  EXPECT_TRUE(index.write(out));
+
+  std::string block = out.str();
+  ASSERT_EQ((int32_t) block.size(), index.get_serialized_size());
+  EXPECT_EQ(PageIndex::checksum(block.data(), block.size()), index.get_checksum());
+
+  PageIndex attached;
+  EXPECT_TRUE(attached.attach((const uint8_t *) block.data(), 5, index.get_entry_count()));
+  EXPECT_EQ(attached.get_page_count(), index.get_page_count());
+  for (int16_t idx = 0; idx < 5; idx++) {
+    ASSERT_EQ(attached.get_item_size(idx), index.get_item_size(idx));
+    for (int32_t pg = 0; pg < index.get_item_size(idx); pg++) {
+      EXPECT_EQ(attached.get(idx, pg).offset, index.get(idx, pg).offset);
+      EXPECT_EQ(attached.get_page_nbr(idx, pg), index.get_page_nbr(idx, pg));
+    }
+  }
+
+  // Incoherent item records are refused
+  PageIndex::ItemRecord * records = (PageIndex::ItemRecord *) &block[0];
+  records[2].first_entry = 10000;
+  EXPECT_FALSE(attached.attach((const uint8_t *) block.data(), 5, index.get_entry_count()));
+}
+
+// A 10k pages book read back with per record reads, as done with the
+// version 3 .locs file, and attached from a single read of the version 4
+// layout gives the same index.
+TEST(PageIndexTest, load_10k_pages) {
+  const char  * V3_FILE = "/tmp/page_index_v3.bin";
+  const char  * V4_FILE = "/tmp/page_index_v4.bin";
+  const int16_t ITEMS   = 100;
+  const int32_t PAGES   = 100;
+
+  PageIndex index;
+  fill_index(index, ITEMS, PAGES, 1500);
+
+  { std::ofstream v3(V3_FILE, std::ios::out | std::ios::binary);
+    for (int16_t idx = 0; idx < ITEMS; idx++) {
+      for (int32_t pg = 0; pg < PAGES; pg++) {
+        const PageIndex::Entry & entry = index.get(idx, pg);
+        v3.write((const char *) &idx,          sizeof(idx));
+        v3.write((const char *) &entry.offset, sizeof(entry.offset));
+        v3.write((const char *) &entry.size,   sizeof(entry.size));
+      }
+    }
+    std::ofstream v4(V4_FILE, std::ios::out | std::ios::binary);
+    EXPECT_TRUE(index.write(v4));
+  }
+
+  PageIndex v3_index;
+  { std::ifstream v3(V3_FILE, std::ios::in | std::ios::binary);
+    v3_index.clear(ITEMS);
+    PageIndex::Entries entries;
+    int16_t current_idx = -1;
+    for (int32_t i = 0; i < ITEMS * PAGES; i++) {
+      int16_t idx;
+      PageIndex::Entry entry;
+      v3.read((char *) &idx,          sizeof(idx));
+      v3.read((char *) &entry.offset, sizeof(entry.offset));
+      v3.read((char *) &entry.size,   sizeof(entry.size));
+      if (idx != current_idx) {
+        if (current_idx != -1) v3_index.set_item(current_idx, entries);
+        current_idx = idx;
+      }
+      entries.push_back(entry);
+    }
+    v3_index.set_item(current_idx, entries);
+    v3_index.compute_page_numbers();
+  }
+
+  PageIndex v4_index;
+  std::string block;
+  { std::ifstream v4(V4_FILE, std::ios::in | std::ios::binary);
+    block.resize(index.get_serialized_size());
+    v4.read(&block[0], block.size());
+    EXPECT_EQ(PageIndex::checksum(block.data(), block.size()), index.get_checksum());
+    EXPECT_TRUE(v4_index.attach((const uint8_t *) block.data(), ITEMS, ITEMS * PAGES));
+  }
+
+  ASSERT_EQ(v3_index.get_page_count(), v4_index.get_page_count());
+  for (int16_t idx = 0; idx < ITEMS; idx++) {
+    ASSERT_EQ(v3_index.get_item_size(idx), v4_index.get_item_size(idx));
+    for (int32_t pg = 0; pg < PAGES; pg++) {
+      EXPECT_EQ(v3_index.get(idx, pg).offset, v4_index.get(idx, pg).offset);
+      EXPECT_EQ(v3_index.get(idx, pg).size,   v4_index.get(idx, pg).size);
+    }
+  }
+
+  remove(V3_FILE);
+  remove(V4_FILE);
+}
+
+// A writer publishes items while a reader looks for pages, without a
+// mutex. The reader must only see complete items.
+TEST(PageIndexTest, concurrent_publish) {
+  const int16_t ITEMS = 100;
+  const int32_t PAGES = 100;
+
+  PageIndex         index;
+  std::atomic<bool> done(false);
+
+  index.clear(ITEMS);
+
+  std::thread writer([&]() {
+    for (int16_t idx = 0; idx < ITEMS; idx++) {
+      PageIndex::Entries entries;
+      for (int32_t pg = 0; pg < PAGES; pg++) {
+        entries.push_back({ .offset = pg * 1000, .size = 1000 });
+      }
+      index.set_item(idx, entries);
+    }
+    done = true;
+  });
+
+  while (!done) {
+    for (int16_t idx = 0; idx < ITEMS; idx++) {
+      int32_t pg = index.find(idx, (PAGES - 1) * 1000);
+      if (pg != -1) {
+        EXPECT_EQ(pg, PAGES - 1);
+        EXPECT_EQ(index.get_item_size(idx), PAGES);
+      }
+    }
+  }
+  writer.join();
+
+  EXPECT_EQ(index.get_entry_count(), ITEMS * PAGES);
+}
+
+#endif
@@ -8,15 +8,27 @@
 #include "models/toc.hpp"
 #include "models/config.hpp"
 #include "models/fonts.hpp"
+#include "models/word_cache.hpp"
+#include "models/item_cache.hpp"
 #include "controllers/event_mgr.hpp"
 #include "viewers/screen_bottom.hpp"
+#include "viewers/msg_viewer.hpp"
 
 #include "viewers/book_viewer.hpp"
 #include "viewers/page.hpp"
+#include "helpers/bounded_queue.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <ios>
+#include <sys/stat.h>
+
+#if EPUB_LINUX_BUILD
+  #include <sys/mman.h>
+  #include <unistd.h>
+#else
+  #include "alloc.hpp"
+#endif
 
 enum class MgrReq : int8_t { ASAP_READY, STOPPED };
 
@@ -25,35 +37,31 @@ struct MgrQueueData {
   int16_t itemref_index;
 };
 
-enum class StateReq  : int8_t { ABORT, STOP, START_DOCUMENT, GET_ASAP, ITEM_READY, ASAP_READY };
+enum class StateReq  : int8_t { ABORT, STOP, START_DOCUMENT, GET_ASAP, ITEM_READY, SET_POSITION };
 
 struct StateQueueData {
   StateReq req;
   int16_t itemref_index;
   int16_t itemref_count;
+  uint16_t generation;
 };
 
-enum class RetrieveReq  : int8_t { ABORT, RETRIEVE_ITEM, GET_ASAP, SHOW_HEAP };
+enum class RetrieveReq  : int8_t { ABORT, RETRIEVE_ITEM, SHOW_HEAP };
 
 struct RetrieveQueueData {
   RetrieveReq req;
   int16_t itemref_index;
+  uint16_t generation;
 };
 
-#if EPUB_LINUX_BUILD
-  #include <chrono>
-
-  static mqd_t mgr_queue;
-  static mqd_t state_queue;
-  static mqd_t retrieve_queue;
+#include <chrono>
 
-  static mq_attr mgr_attr      = { 0, 5, sizeof(     MgrQueueData), 0 };
-  static mq_attr state_attr    = { 0, 5, sizeof(   StateQueueData), 0 };
-  static mq_attr retrieve_attr = { 0, 5, sizeof(RetrieveQueueData), 0 };
+// The retrieve and state queues must be able to keep one request per retriever
+static BoundedQueue<     MgrQueueData, 5                                > mgr_queue;
+static BoundedQueue<   StateQueueData, PageLocs::MAX_RETRIEVER_COUNT + 2> state_queue;
+static BoundedQueue<RetrieveQueueData, PageLocs::MAX_RETRIEVER_COUNT + 2> retrieve_queue;
 
-  #define QUEUE_SEND(q, m, t)        mq_send(q, (const char *) &m, sizeof(m),       1)
-  #define QUEUE_RECEIVE(q, m, t)  mq_receive(q,       (char *) &m, sizeof(m), nullptr)
-#else
+#if !EPUB_LINUX_BUILD
   #include <esp_pthread.h>
 
   static esp_pthread_cfg_t create_config(const char *name, int core_id, int stack, int prio)
@@ -65,13 +73,6 @@ struct RetrieveQueueData {
       cfg.prio = prio;
       return cfg;
   }
-
-  static QueueHandle_t mgr_queue      = nullptr;
-  static QueueHandle_t state_queue    = nullptr;
-  static QueueHandle_t retrieve_queue = nullptr;
-
-  #define QUEUE_SEND(q, m, t)        xQueueSend(q, &m, t)
-  #define QUEUE_RECEIVE(q, m, t)  xQueueReceive(q, &m, t)
 #endif
 
 class StateTask
@@ -82,115 +83,155 @@ class StateTask
     bool retriever_iddle;
 
     int16_t   itemref_count;       // Number of items in the document
-    int16_t   waiting_for_itemref; // Current item being processed by retrieval task
-    int16_t   next_itemref_to_get; // Non prioritize item to get next
-    int16_t   asap_itemref;        // Prioritize item to get next
+    int8_t    retriever_count;     // Number of retriever threads
+    int8_t    busy_count;          // Number of retrievers currently processing an item
+    int16_t   current_itemref;     // Item being read by the user
+    int16_t   asap_itemref;        // Prioritize item required by the Mgr
     uint8_t * bitset;              // Set of all items processed so far
+    uint8_t * busy_bitset;         // Set of all items being processed by retrievers
     uint8_t   bitset_size;         // bitset byte length
     bool      stopping;
-    bool      forget_retrieval;    // Forget current item begin processed by retrieval task
+
+    // Incremented every time the current document is stopped or restarted. Items
+    // computed by the retrievers for an older generation are forgotten.
+    volatile uint16_t generation;
+
+    #if SHOW_TIMING
+      std::chrono::steady_clock::time_point start_time;
+    #endif
 
     StateQueueData       state_queue_data;
     RetrieveQueueData retrieve_queue_data;
     MgrQueueData           mgr_queue_data;
 
+    inline bool is_set(const uint8_t * set, int16_t itemref) { 
+      return (set[itemref >> 3] & (1 << (itemref & 7))) != 0; 
+    }
+    inline void    set(uint8_t * set, int16_t itemref) { set[itemref >> 3] |=  (1 << (itemref & 7)); }
+    inline void  reset(uint8_t * set, int16_t itemref) { set[itemref >> 3] &= ~(1 << (itemref & 7)); }
+
+    void send_to_mgr(MgrReq req, int16_t itemref) {
+      mgr_queue_data = {
+        .req           = req,
+        .itemref_index = itemref
+      };
+      mgr_queue.send(mgr_queue_data);
+      LOG_D("Sent %s to Mgr", (req == MgrReq::ASAP_READY) ? "ASAP_READY" : "STOPPED");
+    }
+
+    void send_to_retriever(int16_t itemref) {
+      set(busy_bitset, itemref);
+      busy_count++;
+      retrieve_queue_data = {
+        .req           = RetrieveReq::RETRIEVE_ITEM,
+        .itemref_index = itemref,
+        .generation    = generation
+      };
+      retrieve_queue.send(retrieve_queue_data);
+      LOG_D("Sent RETRIEVE_ITEM %d to Retriever", itemref);
+    }
+
+    inline bool to_be_retrieved(int16_t itemref) {
+      return (itemref >= 0) && (itemref < itemref_count) && 
+             !is_set(bitset, itemref) && !is_set(busy_bitset, itemref);
+    }
+
     /**
-     * @brief Request next item to be retrieved
+     * @brief Find the next item to be retrieved
+     * 
+     * The item requested by the Mgr has priority. Then the items around the
+     * user's reading position: the current one, then the next and previous
+     * ones, up to 2 items away. Then the items following the reading
+     * position, in sequence. Items already done or currently being processed
+     * are skipped.
+     * 
+     * @return int16_t The item index, or -1 if nothing left to be sent
+     */
+    int16_t next_item() {
+      static constexpr int8_t WINDOW[] = { 0, 1, -1, 2, -2 };
+
+      if ((asap_itemref != -1) && to_be_retrieved(asap_itemref)) return asap_itemref;
+
+      int16_t current = (current_itemref == -1) ? 0 : current_itemref;
+
+      for (int8_t delta : WINDOW) {
+        if (to_be_retrieved(current + delta)) return current + delta;
+      }
+
+      int16_t itemref = current;
+      for (int16_t i = 0; i < itemref_count; i++) {
+        if (to_be_retrieved(itemref)) return itemref;
+        itemref = (itemref + 1) % itemref_count;
+      }
+      return -1;
+    }
+
+    /**
+     * @brief Request next items to be retrieved
      *
      * This function is called to identify and send the
-     * next request for retrieval of pages location. It also
-     * identify when the whole process is completed, as all items from
-     * the document have been done. It will then send this information
-     * to the appliction through the Mgr queue.
-     *
-     * When this function is called, the retrieval task is waiting for
-     * the next task to do.
-     *
-     * @param itemref The last itemref index that was processed
+     * next requests for retrieval of pages location, until all retrievers
+     * are busy. It also identify when the whole process is completed, as 
+     * all items from the document have been done. It will then inform
+     * the application.
      */
-    void request_next_item(int16_t itemref,
-                          bool already_sent_to_mgr = false)
+    void request_next_items()
     {
-      if (asap_itemref != -1) {
-        if (itemref == asap_itemref) {
-          asap_itemref = -1;
-          if (!already_sent_to_mgr) {
-            mgr_queue_data = {
-              .req           = MgrReq::ASAP_READY,
-              .itemref_index = itemref
-            };
-            QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-            LOG_D("Sent ASAP_READY to Mgr");
-          }
-        } else {
-          waiting_for_itemref = asap_itemref;
-          asap_itemref        = -1;
-          retrieve_queue_data = {
-            .req           = RetrieveReq::GET_ASAP,
-            .itemref_index = waiting_for_itemref
-          };
-          QUEUE_SEND(retrieve_queue, retrieve_queue_data, 0);
-          retriever_iddle = false;
-          LOG_D("Sent GET_ASAP to Retriever");
-          return;
-        }
+      while (busy_count < retriever_count) {
+        int16_t itemref = next_item();
+        if (itemref == -1) break;
+        send_to_retriever(itemref);
       }
-      if (next_itemref_to_get != -1) {
-        waiting_for_itemref = next_itemref_to_get;
-        next_itemref_to_get = -1;
-        retrieve_queue_data = {
-          .req           = RetrieveReq::RETRIEVE_ITEM,
-          .itemref_index = waiting_for_itemref
-        };
-        QUEUE_SEND(retrieve_queue, retrieve_queue_data, 0);
-        retriever_iddle = false;
-        LOG_D("Sent RETRIEVE_ITEM to Retriever");
-      } else {
-        int16_t newref;
-        if (itemref != -1) {
-          newref = (itemref + 1) % itemref_count;
-        } else {
-          itemref = 0;
-          newref = 0;
-        }
-        while ((bitset[newref >> 3] & (1 << (newref & 7))) != 0) {
-          newref = (newref + 1) % itemref_count;
-          if (newref == itemref)
-            break;
-        }
-        if (newref != itemref) {
-          waiting_for_itemref = newref;
-          retrieve_queue_data = {
-            .req           = RetrieveReq::RETRIEVE_ITEM,
-            .itemref_index = waiting_for_itemref
-          };
-          QUEUE_SEND(retrieve_queue, retrieve_queue_data, 0);
-          retriever_iddle = false;
-          LOG_D("Sent RETRIEVE_ITEM to Retriever");
-        } else {
-          page_locs.computation_completed();
-          retriever_iddle = true;
-        }
+      if (busy_count == 0) {
+        #if SHOW_TIMING
+          LOG_I("Pages location computed in %d ms by %d retriever(s).", 
+                (int32_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start_time).count(),
+                retriever_count);
+        #endif
+        page_locs.computation_completed();
+        retriever_iddle = true;
+      }
+    }
+
+    void stopped() {
+      if (stopping && (busy_count == 0)) {
+        stopping        = false;
+        retriever_iddle = true;
+        send_to_mgr(MgrReq::STOPPED, 0);
+      }
+    }
+
+    void clear_bitsets() {
+      if (bitset != nullptr) {
+        delete [] bitset;
+        bitset = nullptr;
+      }
+      if (busy_bitset != nullptr) {
+        delete [] busy_bitset;
+        busy_bitset = nullptr;
       }
     }
 
   public:
     StateTask() : 
-          retriever_iddle(   true), 
-            itemref_count(     -1),
-      waiting_for_itemref(     -1),
-      next_itemref_to_get(     -1),
-             asap_itemref(     -1),
-                   bitset(nullptr),
-              bitset_size(      0),
-                 stopping(  false),
-         forget_retrieval(  false)  { }
+      retriever_iddle(   true), 
+        itemref_count(     -1),
+      retriever_count(      1),
+           busy_count(      0),
+      current_itemref(     -1),
+         asap_itemref(     -1),
+               bitset(nullptr),
+          busy_bitset(nullptr),
+          bitset_size(      0),
+             stopping(  false),
+           generation(      0)  { }
 
     void operator()() {
       for(;;) {
         LOG_D("==> Waiting for request... <==");
-        if (QUEUE_RECEIVE(state_queue, state_queue_data, portMAX_DELAY) == -1) {
-          LOG_E("Receive error: %d: %s", errno, strerror(errno));
+        if (!state_queue.receive(state_queue_data)) {
+          LOG_E("Receive error.");
         }
         else switch (state_queue_data.req) {
           case StateReq::ABORT:
@@ -198,18 +239,13 @@ class StateTask
 
           case StateReq::STOP:
             LOG_D("-> STOP <-");
-            itemref_count    = -1;
-            forget_retrieval = true;
-            if (bitset != nullptr) {
-              delete [] bitset;
-              bitset = nullptr;
-            }
-            if (retriever_iddle) {
-              mgr_queue_data = {
-                .req           = MgrReq::STOPPED,
-                .itemref_index = 0
-              };
-              QUEUE_SEND(mgr_queue, mgr_queue_data, 0); 
+            itemref_count = -1;
+            asap_itemref  = -1;
+            generation++;
+            clear_bitsets();
+            if (busy_count == 0) {
+              retriever_iddle = true;
+              send_to_mgr(MgrReq::STOPPED, 0);
             }
             else {
               stopping = true;
@@ -218,30 +254,33 @@ class StateTask
 
           case StateReq::START_DOCUMENT:
             LOG_D("-> START_DOCUMENT <-");
-            if (bitset) delete [] bitset;
-            itemref_count = state_queue_data.itemref_count;
-            bitset_size   = (itemref_count + 7) >> 3;
-            bitset        = new uint8_t[bitset_size];
-            if (bitset) {
-              memset(bitset, 0, bitset_size);
-              if (waiting_for_itemref == -1) {
-                retrieve_queue_data.req           = RetrieveReq::RETRIEVE_ITEM;
-                retrieve_queue_data.itemref_index = waiting_for_itemref =
-                                                    state_queue_data.itemref_index;
-                forget_retrieval                  = false;
-                QUEUE_SEND(retrieve_queue, retrieve_queue_data, 0);
-                LOG_D("Sent RETRIEVE_ITEM to retriever");
-              }
-              else {
-                forget_retrieval    = true;
-                next_itemref_to_get = state_queue_data.itemref_index;
+            clear_bitsets();
+            generation++;
+            itemref_count       = state_queue_data.itemref_count;
+            bitset_size         = (itemref_count + 7) >> 3;
+            bitset              = new uint8_t[bitset_size];
+            busy_bitset         = new uint8_t[bitset_size];
+            asap_itemref        = -1;
+            current_itemref     = state_queue_data.itemref_index;
+            if ((bitset != nullptr) && (busy_bitset != nullptr)) {
+              memset(bitset,      0, bitset_size);
+              memset(busy_bitset, 0, bitset_size);
+              // Items retrieved from the journal are not computed again
+              for (int16_t i = 0; i < itemref_count; i++) {
+                if (page_locs.is_item_computed(i)) set(bitset, i);
               }
+              #if SHOW_TIMING
+                start_time = std::chrono::steady_clock::now();
+              #endif
               retriever_iddle = false;
+              // Retrievers still busy with the previous generation will 
+              // be given new items when they come back.
+              request_next_items();
             }
             else {
-              itemref_count    = -1;
-              retriever_iddle  = true;
-              forget_retrieval = true;
+              clear_bitsets();
+              itemref_count   = -1;
+              retriever_iddle = true;
             }
             break;
 
@@ -252,133 +291,63 @@ class StateTask
             // If already done, let it know it a.s.a.p. If currently being processed,
             // keep a mark when it will be back. If not, queue the request.
             if (itemref_count == -1) {
-              mgr_queue_data = {
-                .req           = MgrReq::ASAP_READY,
-                .itemref_index = (int16_t) -(state_queue_data.itemref_index + 1)
-              };
-              QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-              LOG_D("Sent ASAP_READY to Mgr");
+              send_to_mgr(MgrReq::ASAP_READY, (int16_t) -(state_queue_data.itemref_index + 1));
             }
             else {
               int16_t itemref = state_queue_data.itemref_index;
-              if ((bitset[itemref >> 3] & ( 1 << (itemref & 7))) != 0) {
-                mgr_queue_data = {
-                  .req           = MgrReq::ASAP_READY,
-                  .itemref_index = itemref
-                };
-                QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-                LOG_D("Sent ASAP_READY to Mgr");
-              }
-              else if (waiting_for_itemref != -1) {
-                asap_itemref = itemref;
+              if (is_set(bitset, itemref)) {
+                send_to_mgr(MgrReq::ASAP_READY, itemref);
               }
               else {
-                asap_itemref        = -1;
-                waiting_for_itemref = itemref;
-                retriever_iddle     = false;
-                retrieve_queue_data = {
-                  .req           = RetrieveReq::GET_ASAP,
-                  .itemref_index = itemref
-                };
-                QUEUE_SEND(retrieve_queue, retrieve_queue_data, 0);       
-                LOG_D("Sent GET_ASAP to Retriever"); 
+                asap_itemref = itemref;
+                if (!is_set(busy_bitset, itemref) && (busy_count < retriever_count)) {
+                  send_to_retriever(itemref);
+                }
               }
             }
             break;
 
-          // This is sent by the retrieval task, indicating that an item has been
+          // This is sent by a retrieval task, indicating that an item has been
           // processed.
           case StateReq::ITEM_READY:
             LOG_D("-> ITEM_READY <-");
-            waiting_for_itemref = -1;
-            if (itemref_count != -1) {
-              int16_t itemref = -1;
-              if (forget_retrieval) {
-                forget_retrieval = false;
-              }
-              else {
-                itemref = state_queue_data.itemref_index;
-                if (itemref < 0) {
-                  itemref = -(itemref + 1);
-                  LOG_E("Unable to retrieve pages location for item %d", itemref);
-                }
-                bitset[itemref >> 3] |= (1 << (itemref & 7));
-              }
-              if (stopping) {
-                stopping = false;
-                retriever_iddle  = true;
-                mgr_queue_data = {
-                  .req           = MgrReq::STOPPED,
-                  .itemref_index = 0
-                };
-                QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-              }
-              else {
-                request_next_item(itemref);
-              }
-            }
-            else {
-              if (stopping) {
-                stopping = false;
-                retriever_iddle  = true;
-                mgr_queue_data = {
-                  .req           = MgrReq::STOPPED,
-                  .itemref_index = 0
-                };
-                QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-              }
-            }
-            break;
-
-          // This is sent by the retrieval task, indicating that an ASAP item has been
-          // processed.
-          case StateReq::ASAP_READY:
-            LOG_D("-> ASAP_READY <-");
-            waiting_for_itemref = -1;
-            if (itemref_count != -1) {
-              int16_t itemref              = state_queue_data.itemref_index;
-              mgr_queue_data = {
-                .req           = MgrReq::ASAP_READY,
-                .itemref_index = itemref
-              };
-              QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-              LOG_D("Sent ASAP_READY to Mgr");
+            busy_count--;
+            if ((itemref_count != -1) && (state_queue_data.generation == generation)) {
+              int16_t itemref = state_queue_data.itemref_index;
               if (itemref < 0) {
                 itemref = -(itemref + 1);
                 LOG_E("Unable to retrieve pages location for item %d", itemref);
               }
-              bitset[itemref >> 3] |= (1 << (itemref & 7));
-              if (stopping) {
-                stopping = false;
-                retriever_iddle  = true;
-                mgr_queue_data = {
-                  .req           = MgrReq::STOPPED,
-                  .itemref_index = 0
-                };
-                QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-              }
-              else {
-                request_next_item(itemref, true);
+              set(bitset, itemref);
+              reset(busy_bitset, itemref);
+              if (itemref == asap_itemref) {
+                asap_itemref = -1;
+                send_to_mgr(MgrReq::ASAP_READY, state_queue_data.itemref_index);
               }
+              request_next_items();
+            }
+            else if (itemref_count != -1) {
+              // A retriever is back from an item of a previous generation
+              request_next_items();
             }
             else {
-              if (stopping) {
-                stopping = false;
-                retriever_iddle  = true;
-                mgr_queue_data = {
-                  .req           = MgrReq::STOPPED,
-                  .itemref_index = 0
-                };
-                QUEUE_SEND(mgr_queue, mgr_queue_data, 0);
-              }
+              stopped();
             }
             break;
+
+          // The user moved to another item. The items around it will be
+          // retrieved first.
+          case StateReq::SET_POSITION:
+            LOG_D("-> SET_POSITION <-");
+            if (itemref_count != -1) current_itemref = state_queue_data.itemref_index;
+            break;
         }
       }
     }
 
     inline bool   retriever_is_iddle() { return retriever_iddle;  } 
-    inline bool forgetting_retrieval() { return forget_retrieval; }
+    inline bool is_current(uint16_t gen) { return gen == generation; }
+    inline void set_retriever_count(int8_t count) { retriever_count = count; }
 
 } state_task;
 
@@ -392,13 +361,21 @@ class RetrieverTask
       RetrieveQueueData retrieve_queue_data;
       StateQueueData    state_queue_data;
 
+      // Every retriever has its own context to compute items in parallel
+      PageLocs::RetrieverContext * ctx = new PageLocs::RetrieverContext;
+
+      if (ctx == nullptr) {
+        LOG_E("Unable to allocate retriever context.");
+        msg_viewer.out_of_memory("retriever context allocation");
+      }
+
       for (;;) {
         LOG_D("==> Waiting for request... <==");
-        if (QUEUE_RECEIVE(retrieve_queue, retrieve_queue_data, portMAX_DELAY) == -1) {
-          LOG_E("Receive error: %d: %s", errno, strerror(errno));
+        if (!retrieve_queue.receive(retrieve_queue_data)) {
+          LOG_E("Receive error.");
         }
         else {
-          if (retrieve_queue_data.req == RetrieveReq::ABORT) return;
+          if (retrieve_queue_data.req == RetrieveReq::ABORT) break;
           if (retrieve_queue_data.req == RetrieveReq::SHOW_HEAP) {
             #if EPUB_INKPLATE_BUILD && (LOG_LOCAL_LEVEL == ESP_LOG_VERBOSE)
               ESP::show_heaps_info();
@@ -406,12 +383,15 @@ class RetrieverTask
             continue;
           }
 
-          LOG_D("-> %s <-", (retrieve_queue_data.req == RetrieveReq::GET_ASAP) ? "GET_ASAP" : "RETRIEVE_ITEM");
-
           LOG_D("Retrieving itemref --> %d <--", retrieve_queue_data.itemref_index);
           
+          ctx->generation = retrieve_queue_data.generation;
+          ctx->pages.clear();
+          ctx->checkpoints.clear();
+
           int16_t itemref_index;
-          if (!page_locs.build_page_locs(retrieve_queue_data.itemref_index)) {
+          if (!page_locs.build_page_locs(*ctx, retrieve_queue_data.itemref_index) ||
+              !page_locs.merge(*ctx)) {
             // Unable to retrieve pages location for the requested index. Send back
             // a negative value to indicate the issue to the state task
             itemref_index = -(retrieve_queue_data.itemref_index + 1);
@@ -420,53 +400,58 @@ class RetrieverTask
             itemref_index = retrieve_queue_data.itemref_index;
           }
 
-          //std::this_thread::sleep_for(std::chrono::seconds(5));
           state_queue_data = {
-            .req = (retrieve_queue_data.req == RetrieveReq::GET_ASAP) ? 
-                     StateReq::ASAP_READY : StateReq::ITEM_READY,
+            .req           = StateReq::ITEM_READY,
             .itemref_index = itemref_index,
-            .itemref_count = 0
+            .itemref_count = 0,
+            .generation    = retrieve_queue_data.generation
           };
 
-          QUEUE_SEND(state_queue, state_queue_data, 0);
-          LOG_D("Sent %s to State", (state_queue_data.req == StateReq::ASAP_READY) ? "ASAP_READY" : "ITEM_READY");
+          state_queue.send(state_queue_data);
+          LOG_D("Sent ITEM_READY to State");
         }
       }
+
+      delete ctx;
     }
 } retriever_task;
 
 void
 PageLocs::setup()
 {
-  #if EPUB_LINUX_BUILD
-    mq_unlink("/mgr");
-    mq_unlink("/state");
-    mq_unlink("/retrieve");
+  #if PAGE_LOCS_RETRIEVER_COUNT > 0
+    retriever_count = PAGE_LOCS_RETRIEVER_COUNT;
+  #elif EPUB_LINUX_BUILD
+    retriever_count = std::thread::hardware_concurrency();
+  #elif defined(BOARD_TYPE_PAPER_S3)
+    retriever_count = 2; // One per ESP32-S3 core
+  #else
+    retriever_count = 1;
+  #endif
 
-    mgr_queue      = mq_open("/mgr",      O_RDWR|O_CREAT, S_IRWXU, &mgr_attr);
-    if (mgr_queue == -1) { LOG_E("Unable to open mgr_queue: %d", errno); return; }
+  if (retriever_count < 1) retriever_count = 1;
+  if (retriever_count > MAX_RETRIEVER_COUNT) retriever_count = MAX_RETRIEVER_COUNT;
 
-    state_queue    = mq_open("/state",    O_RDWR|O_CREAT, S_IRWXU, &state_attr);
-    if (state_queue == -1) { LOG_E("Unable to open state_queue: %d", errno); return; }
+  LOG_I("Pages location retrievers: %d", retriever_count);
 
-    retrieve_queue = mq_open("/retrieve", O_RDWR|O_CREAT, S_IRWXU, &retrieve_attr);
-    if (retrieve_queue == -1) { LOG_E("Unable to open retrieve_queue: %d", errno); return; }
+  state_task.set_retriever_count(retriever_count);
 
-    retriever_thread = std::thread(retriever_task);
-    state_thread     = std::thread(state_task);
+  #if EPUB_LINUX_BUILD
+    for (int8_t i = 0; i < retriever_count; i++) {
+      retriever_threads[i] = std::thread(retriever_task);
+    }
+    state_thread = std::thread(state_task);
   #else
     esp_pthread_init();
-    
-    if (mgr_queue      == nullptr) mgr_queue      = xQueueCreate(5, sizeof(MgrQueueData));
-    if (state_queue    == nullptr) state_queue    = xQueueCreate(5, sizeof(StateQueueData));
-    if (retrieve_queue == nullptr) retrieve_queue = xQueueCreate(5, sizeof(RetrieveQueueData));
 
-    auto cfg = create_config("retrieverTask", 0, 60 * 1024, configMAX_PRIORITIES - 2);
-    cfg.inherit_cfg = true;
-    esp_pthread_set_cfg(&cfg);
-    retriever_thread = std::thread(retriever_task);
+    for (int8_t i = 0; i < retriever_count; i++) {
+      auto cfg = create_config("retrieverTask", i % portNUM_PROCESSORS, 60 * 1024, configMAX_PRIORITIES - 2);
+      cfg.inherit_cfg = true;
+      esp_pthread_set_cfg(&cfg);
+      retriever_threads[i] = std::thread(retriever_task);
+    }
     
-    cfg = create_config("stateTask", 0, 10 * 1024, configMAX_PRIORITIES - 2);
+    auto cfg = create_config("stateTask", 0, 10 * 1024, configMAX_PRIORITIES - 2);
     cfg.inherit_cfg = true;
     esp_pthread_set_cfg(&cfg);
     state_thread = std::thread(state_task);
@@ -479,22 +464,28 @@ PageLocs::abort_threads()
   RetrieveQueueData retrieve_queue_data;
   retrieve_queue_data = {
     .req           = RetrieveReq::ABORT,
-    .itemref_index = 0
+    .itemref_index = 0,
+    .generation    = 0
   };
-  LOG_D("abort_threads: Sending ABORT to Retriever");
-  QUEUE_SEND(retrieve_queue, retrieve_queue_data, 0);
+  LOG_D("abort_threads: Sending ABORT to Retrievers");
+  for (int8_t i = 0; i < retriever_count; i++) {
+    retrieve_queue.send(retrieve_queue_data);
+  }
 
-  retriever_thread.join();
-  retriever_thread.~thread();
+  for (int8_t i = 0; i < retriever_count; i++) {
+    retriever_threads[i].join();
+    retriever_threads[i].~thread();
+  }
   
   StateQueueData state_queue_data;
   state_queue_data = {
     .req           = StateReq::ABORT,
     .itemref_index = 0,
-    .itemref_count = 0
+    .itemref_count = 0,
+    .generation    = 0
   };
   LOG_D("abort_threads: Sending ABORT to State");
-  QUEUE_SEND(state_queue, state_queue_data, 0);
+  state_queue.send(state_queue_data);
 
   state_thread.join();
   state_thread.~thread();
@@ -503,75 +494,80 @@ PageLocs::abort_threads()
 class PageLocsInterp : public HTMLInterpreter 
 {
   public:
-    PageLocsInterp(Page & the_page, DOM & the_dom, Page::ComputeMode the_comp_mode, const EPub::ItemInfo & the_item) : 
-      HTMLInterpreter(the_page, the_dom, the_comp_mode, the_item) {}
+    PageLocsInterp(PageLocs::RetrieverContext & the_ctx, DOM & the_dom) : 
+      HTMLInterpreter(the_ctx.page_out, the_dom, Page::ComputeMode::LOCATION, the_ctx.item_info),
+      ctx(the_ctx),
+      page_path_length(0) {}
     ~PageLocsInterp() {}
     
     void doc_end(const Page::Format & fmt) { page_end(fmt); }
 
+  private:
+    PageLocs::RetrieverContext & ctx;
+    PageCheckpoints::Step        page_path[PageCheckpoints::MAX_PATH_LENGTH]; ///< Checkpoint of the current page
+    int16_t                      page_path_length;
+
   protected:
     bool page_end(const Page::Format & fmt) {
 
-      // if (page_locs.get_pages_map().size() == 38) {
-      //   LOG_D("PAGE END!!");
-      // }
+      PageLocs::PageId   page_id   = PageLocs::PageId(item_info.itemref_index, start_offset);
+      PageLocs::PageInfo page_info = PageLocs::PageInfo(current_offset - start_offset, -1);
       
-      bool res = true;
-      // if ((item_info.itemref_index == 0) || !page_out.is_empty()) {
-
-        PageLocs::PageId   page_id   = PageLocs::PageId(page_locs.get_item_info().itemref_index, start_offset);
-        PageLocs::PageInfo page_info = PageLocs::PageInfo(current_offset - start_offset, -1);
-        
-        if ((page_info.size > 0) || ((page_id.itemref_index == 0) && (page_id.offset == 0))) {
-          if (page_info.size == 0) page_info.size = 1; // Patch for the case when it's the title page and no image is to be shown
-          if ((page_locs.get_item_info().itemref_index > 0) && (page.is_empty())) {
-            page_info.size = -page_info.size; // The page will not be counted nor displayed
-          }
-          res = page_locs.insert(page_id, page_info);
-          #if DEBUGGING
-            std::cout << page_id.offset << '|' 
-                      << page_id.offset + page_info.size << ", " 
-                      << page_info.page_number << ", " 
-                      << page_info.size << std::endl;
-          #endif
+      if ((page_info.size > 0) || ((page_id.itemref_index == 0) && (page_id.offset == 0))) {
+        if (page_info.size == 0) page_info.size = 1; // Patch for the case when it's the title page and no image is to be shown
+        if ((item_info.itemref_index > 0) && (page.is_empty())) {
+          page_info.size = -page_info.size; // The page will not be counted nor displayed
+        }
+        // As for a map insertion, a page already present at this offset is kept
+        if (ctx.pages.empty() || (ctx.pages.back().offset != page_id.offset)) {
+          ctx.pages.push_back({ page_id.offset, page_info.size });
+          ctx.checkpoints.add_page(page_path, page_path_length);
         }
-        // Gives the chance to book_viewer to show a page if required
-        book_viewer.get_mutex().unlock();
-        std::this_thread::yield();
-        book_viewer.get_mutex().lock();
-
-        // LOG_D("Page %d, offset: %d, size: %d", epub.get_page_count(), loc.offset, loc.size);
-    
         #if DEBUGGING
-          std::cout << page_locs.get_pages_map().size() << std::endl;
+          std::cout << page_id.offset << '|' 
+                    << page_id.offset + page_info.size << ", " 
+                    << page_info.page_number << ", " 
+                    << page_info.size << std::endl;
         #endif
-        check_page_to_show(page_locs.get_pages_map().size()); // Debugging stuff
-      //}
+      }
+
+      // Gives the chance to book_viewer to show a page if required. The 
+      // mutex is only held for a moment such that retrievers don't wait 
+      // for each other.
+      { std::scoped_lock guard(book_viewer.get_mutex()); }
+      std::this_thread::yield();
+
+      // LOG_D("Page %d, offset: %d, size: %d", epub.get_page_count(), loc.offset, loc.size);
+  
+      #if DEBUGGING
+        std::cout << ctx.pages.size() << std::endl;
+      #endif
+      check_page_to_show(page_locs.get_computed_page_count() + ctx.pages.size()); // Debugging stuff
 
       start_offset = current_offset;
 
+      // The nodes being processed lead to the start of the next page
+      const PageCheckpoints::Step * steps;
+      page_path_length = get_path(steps);
+      std::copy(steps, steps + page_path_length, page_path);
+
       page.start(fmt); // Start a new page
       // beginning_of_page = true;
 
-      return res;
+      // The document was stopped or restarted: no need to go further
+      return state_task.is_current(ctx.generation);
     }
 };
 
 bool
-PageLocs::build_page_locs(int16_t itemref_index)
+PageLocs::build_page_locs(RetrieverContext & ctx, int16_t itemref_index)
 {
-  std::scoped_lock guard(book_viewer.get_mutex());
-
   Font * font = fonts.get(ScreenBottom::FONT);
-  page_bottom = font->get_line_height(ScreenBottom::FONT_SIZE) + (font->get_line_height(ScreenBottom::FONT_SIZE) >> 1);
+  int16_t page_bottom = font->get_line_height(ScreenBottom::FONT_SIZE) + (font->get_line_height(ScreenBottom::FONT_SIZE) >> 1);
   
-  //page_out.set_compute_mode(Page::ComputeMode::LOCATION);
-
-  //show_images = current_format_params.show_images == 1;
-
   bool done = false;
 
-  if (epub.get_item_at_index(itemref_index, item_info)) {
+  if (epub.get_item_at_index(itemref_index, ctx.item_info)) {
 
     int16_t idx;
 
@@ -616,14 +612,11 @@ PageLocs::build_page_locs(int16_t itemref_index)
     };
 
     DOM            * dom    = new DOM;
-    PageLocsInterp * interp = new PageLocsInterp(page_out, 
-                                                 *dom, 
-                                                 Page::ComputeMode::LOCATION, 
-                                                 item_info);
+    PageLocsInterp * interp = new PageLocsInterp(ctx, *dom);
 
     #if DEBUGGING_AID
       interp->set_pages_to_show_state(PAGE_FROM, PAGE_TO);
-      interp->check_page_to_show(pages_map.size());
+      interp->check_page_to_show(page_index.get_entry_count());
     #endif
 
     interp->set_limits(0, 
@@ -632,13 +625,11 @@ PageLocs::build_page_locs(int16_t itemref_index)
 
     while (!done) {
 
-      // current_offset       = 0;
-      // start_of_page_offset = 0;
       xml_node node;
 
-      if ((node = item_info.xml_doc.child("html").child("body"))) {
+      if ((node = ctx.item_info.xml_doc.child("html").child("body"))) {
 
-        page_out.start(fmt);
+        ctx.page_out.start(fmt);
 
         #if EPUB_INKPLATE_BUILD && !defined(BOARD_TYPE_PAPER_S3)
           esp_task_wdt_reset();
@@ -652,7 +643,7 @@ PageLocs::build_page_locs(int16_t itemref_index)
         }
         interp->release_fmt(new_fmt);
 
-        if (page_out.some_data_waiting()) page_out.end_paragraph(fmt);
+        if (ctx.page_out.some_data_waiting()) ctx.page_out.end_paragraph(fmt);
       }
       else {
         LOG_D("No <body>");
@@ -664,23 +655,18 @@ PageLocs::build_page_locs(int16_t itemref_index)
       done = true;
     }
 
-    //dom->show();
+    delete interp;
     delete dom;
-    dom = nullptr;
   }
 
-  //page_out.set_compute_mode(Page::ComputeMode::DISPLAY);
-
-  if (item_info.css != nullptr) {
-    delete item_info.css;
-    item_info.css = nullptr;
+  if (ctx.item_info.css != nullptr) {
+    delete ctx.item_info.css;
+    ctx.item_info.css = nullptr;
   }
 
   return done;
 }
 
-volatile bool relax = false;
-
 bool 
 PageLocs::retrieve_asap(int16_t itemref_index) 
 {
@@ -688,21 +674,46 @@ PageLocs::retrieve_asap(int16_t itemref_index)
   state_queue_data = {
     .req           = StateReq::GET_ASAP,
     .itemref_index = itemref_index,
-    .itemref_count = 0
+    .itemref_count = 0,
+    .generation    = 0
   };
   LOG_D("retrieve_asap: Sending GET_ASAP");
-  QUEUE_SEND(state_queue, state_queue_data, 0);
 
-  relax = true;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  state_queue.send(state_queue_data);
+
+  // The item is published by its retriever without the need of the mutex
+  // we are holding (see insert_item()).
   MgrQueueData mgr_queue_data;
   LOG_D("==> Waiting for answer... <==");
-  QUEUE_RECEIVE(mgr_queue, mgr_queue_data, portMAX_DELAY);
+  mgr_queue.receive(mgr_queue_data);
   LOG_D("-> %s <-", mgr_queue_data.req == MgrReq::ASAP_READY ? "ASAP_READY" : "ERROR!!!");
-  relax = false;
+
+  asap_wait_count++;
+  asap_wait_time += std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start).count();
 
   return true;
 }
 
+void
+PageLocs::set_reading_position(int16_t itemref_index)
+{
+  if ((itemref_index == reading_itemref) || completed) return;
+
+  reading_itemref = itemref_index;
+
+  StateQueueData state_queue_data = {
+    .req           = StateReq::SET_POSITION,
+    .itemref_index = itemref_index,
+    .itemref_count = 0,
+    .generation    = 0
+  };
+  LOG_D("set_reading_position: Sending SET_POSITION");
+  state_queue.send(state_queue_data);
+}
+
 void
 PageLocs::stop_document()
 {
@@ -712,13 +723,14 @@ PageLocs::stop_document()
   state_queue_data = {
     .req           = StateReq::STOP,
     .itemref_index = 0,
-    .itemref_count = 0
+    .itemref_count = 0,
+    .generation    = 0
   };
-  QUEUE_SEND(state_queue, state_queue_data, 0);
+  state_queue.send(state_queue_data);
 
   MgrQueueData mgr_queue_data;
   LOG_D("==> Waiting for STOPPED... <==");
-  QUEUE_RECEIVE(mgr_queue, mgr_queue_data, portMAX_DELAY);
+  mgr_queue.receive(mgr_queue_data);
   LOG_D("-> %s <-", (mgr_queue_data.req == MgrReq::STOPPED) ? "STOPPED" : "ERROR!!!");
 }
 
@@ -727,138 +739,308 @@ PageLocs::start_new_document(int16_t count, int16_t itemref_index)
 { 
   if (!state_task.retriever_is_iddle()) stop_document();
 
-  check_for_format_changes(count, itemref_index, !load(epub.get_current_filename()));
+  item_count = count;
+  profiles.set_book(epub.get_current_filename());
+  check_for_format_changes(count, itemref_index, !load());
+}
+
+// The item's pages are published as a whole, without taking the mutex used
+// by the readers: the checkpoints are set first, then the page index item,
+// whose computed flag is the publication point (see PageIndex). The readers
+// never access an item before it is published. The caller must hold the
+// merge_mutex.
+void
+PageLocs::insert_item(int16_t itemref_index, PageIndex::Entries & entries, PageCheckpoints::Item & item_checkpoints)
+{
+  checkpoints.set_item(itemref_index, item_checkpoints);
+  page_index.set_item(itemref_index, entries);
 }
 
 bool 
-PageLocs::insert(PageId & id, PageInfo & info) 
+PageLocs::merge(RetrieverContext & ctx) 
 {
-  if (!state_task.forgetting_retrieval()) {
-    while (true) {
-      if (relax) {
-        // The page_locs class is still in control of the mutex, but is waiting
-        // for the completion of an GET_ASAP item. As such, it is safe to insert
-        // a new page info in the list.
-        LOG_D("Relaxed page info insert...");
-        pages_map.insert(std::make_pair(id, info));
-        items_set.insert(id.itemref_index);
-        break;
-      }
-      else {
-        if (mutex.try_lock_for(std::chrono::milliseconds(10))) {
-          pages_map.insert(std::make_pair(id, info));
-          items_set.insert(id.itemref_index);
-          mutex.unlock();
-          break;
-        }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::scoped_lock guard(merge_mutex);
+
+  merge_wait_time += std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start).count();
+
+  if (!state_task.is_current(ctx.generation)) return false;
+
+  // The table of content entries located in the item are journaled with it
+  LocsJournal::TocOffsets toc_offsets;
+  if (toc.there_is_some_ids()) {
+    for (int16_t i = 0; i < toc.get_entry_count(); i++) {
+      const TOC::EntryRecord & entry = toc.get_entry(i);
+      if (entry.page_id.itemref_index == ctx.item_info.itemref_index) {
+        toc_offsets.push_back({ .entry_index = i, .reserved = 0, .offset = entry.page_id.offset });
       }
     }
-    return true;
   }
-  return false;
+
+  journal.append(ctx.item_info.itemref_index, ctx.pages, ctx.checkpoints, toc_offsets);
+  insert_item(ctx.item_info.itemref_index, ctx.pages, ctx.checkpoints);
+  calibrate_estimator(ctx.item_info.itemref_index);
+  return true;
 }
 
-PageLocs::PagesMap::iterator 
-PageLocs::check_and_find(const PageId & page_id) 
+void
+PageLocs::calibrate_estimator(int16_t itemref_index)
 {
-  PagesMap::iterator it = pages_map.find(page_id);
-  if (!completed && (it == pages_map.end())) {
-    if (retrieve_asap(page_id.itemref_index)) it = pages_map.find(page_id);
+  int32_t size         = page_index.get_item_size(itemref_index);
+  int32_t page_count   = 0;
+  int32_t offset_count = 0;
+
+  for (int32_t pg = 0; pg < size; pg++) {
+    const PageIndex::Entry & entry = page_index.get(itemref_index, pg);
+    if (entry.size >= 0) page_count++;
+    offset_count = entry.offset + abs(entry.size);
   }
-  return it;
+
+  estimator.set_item(itemref_index, page_count, offset_count);
 }
 
-const PageLocs::PageId * 
-PageLocs::get_next_page_id(const PageId & page_id, int16_t count)
+bool
+PageLocs::item_ready(int16_t itemref_index)
 {
-  std::scoped_lock guard(mutex);
+  if ((itemref_index < 0) || (itemref_index >= page_index.get_item_count())) return false;
+  if (!completed && !page_index.is_computed(itemref_index)) retrieve_asap(itemref_index);
+  return page_index.is_computed(itemref_index);
+}
+
+int32_t
+PageLocs::check_and_find(const PageId & page_id) 
+{
+  return item_ready(page_id.itemref_index) ? page_index.find(page_id.itemref_index, page_id.offset) : -1;
+}
 
-  PagesMap::iterator it = check_and_find(page_id);
-  if (it == pages_map.end()) {
-    it = check_and_find(PageId(0,0));
+bool
+PageLocs::step_forward(int16_t & itemref_index, int32_t & pg)
+{
+  if ((pg + 1) < page_index.get_item_size(itemref_index)) {
+    pg++;
+    return true;
   }
-  else {
-    PageId id = page_id;
-    bool done = false;
-    for (int16_t cptr = count; cptr > 0; cptr--) {
-      PagesMap::iterator prev = it;
-      do {
-        id.offset += abs(it->second.size);
-        it = pages_map.find(id);
-        if (it == pages_map.end()) {
-          // We have reached the end of the current item. Move to the next
-          // item and try again
-          id.itemref_index += 1; id.offset = 0;
-          it = check_and_find(id);
-          if (it == pages_map.end()) {
-            // We have reached the end of the list. If stepping one page at a time, go
-            // to the first page
-            it = (count > 1) ? prev : check_and_find(PageId(0,0));
-            done = true;
-          }
-        }
-      } while ((it->second.size < 0) && !done);
-      if (done) break;
+  // We have reached the end of the current item. Move to the next
+  // non-empty item.
+  for (int16_t idx = itemref_index + 1; idx < page_index.get_item_count(); idx++) {
+    if (item_ready(idx) && (page_index.get_item_size(idx) > 0)) {
+      itemref_index = idx;
+      pg            = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+PageLocs::step_backward(int16_t & itemref_index, int32_t & pg)
+{
+  if (pg > 0) {
+    pg--;
+    return true;
+  }
+  // We have reached the beginning of the current item. Move to the 
+  // previous non-empty item.
+  for (int16_t idx = itemref_index - 1; idx >= 0; idx--) {
+    if (item_ready(idx) && (page_index.get_item_size(idx) > 0)) {
+      itemref_index = idx;
+      pg            = page_index.get_item_size(idx) - 1;
+      return true;
     }
   }
-  return (it == pages_map.end()) ? nullptr : &it->first;
+  return false;
 }
 
-const PageLocs::PageId * 
-PageLocs::get_prev_page_id(const PageId & page_id, int count) 
+bool
+PageLocs::get_first_page_id(PageId & id)
+{
+  if (check_and_find(PageId(0, 0)) == -1) return false;
+  id = PageId(0, 0);
+  return true;
+}
+
+bool
+PageLocs::get_next_page_id(const PageId & page_id, PageId & next_id, int16_t count)
 {
   std::scoped_lock guard(mutex);
 
-  PagesMap::iterator it = check_and_find(page_id);
-  if (it == pages_map.end()) {
-    it = check_and_find(PageId(0, 0));
+  int16_t idx = page_id.itemref_index;
+  int32_t pg  = check_and_find(page_id);
+
+  if (pg == -1) return get_first_page_id(next_id);
+
+  for (int16_t cptr = count; cptr > 0; cptr--) {
+    int16_t prev_idx = idx;
+    int32_t prev_pg  = pg;
+    bool    moved;
+    do {
+      moved = step_forward(idx, pg);
+    } while (moved && (page_index.get(idx, pg).size < 0));
+    if (!moved) {
+      // We have reached the end of the list. If stepping one page at a time, go
+      // to the first page
+      if (count == 1) return get_first_page_id(next_id);
+      idx = prev_idx;
+      pg  = prev_pg;
+      break;
+    }
   }
-  else {
-    PageId id = it->first;
-    
-    bool done = false;
-    for (int16_t cptr = count; cptr > 0; cptr--) {
-      do {
-        if (id.offset == 0) {
-          if (id.itemref_index == 0) {
-            if (count == 1) id.itemref_index = item_count - 1;
-            else done = true;
-          }
-          else id.itemref_index--;
 
-          if (items_set.find(id.itemref_index) == items_set.end()) {
-            retrieve_asap(id.itemref_index);
-          }
-        }
-        
-        if (!done) {
-          if (it == pages_map.begin()) it = pages_map.end();
-          it--;
-          id = it->first;
-        }
-      } while ((it->second.size < 0) && !done);
-      if (done) break;
+  next_id = PageId(idx, page_index.get(idx, pg).offset);
+  return true;
+}
+
+bool
+PageLocs::get_prev_page_id(const PageId & page_id, PageId & prev_id, int count) 
+{
+  std::scoped_lock guard(mutex);
+
+  int16_t idx = page_id.itemref_index;
+  int32_t pg  = check_and_find(page_id);
+
+  if (pg == -1) return get_first_page_id(prev_id);
+
+  for (int16_t cptr = count; cptr > 0; cptr--) {
+    int16_t prev_idx = idx;
+    int32_t prev_pg  = pg;
+    bool    moved;
+    do {
+      moved = step_backward(idx, pg);
+    } while (moved && (page_index.get(idx, pg).size < 0));
+    if (!moved) {
+      if (count == 1) {
+        // Wrap around to the last page of the book
+        idx = page_index.get_item_count();
+        pg  = 0;
+        do {
+          moved = step_backward(idx, pg);
+        } while (moved && (page_index.get(idx, pg).size < 0));
+        if (!moved) return false;
+      }
+      else {
+        idx = prev_idx;
+        pg  = prev_pg;
+      }
+      break;
     }
   }
-  return (it == pages_map.end()) ? nullptr : &it->first;
+
+  prev_id = PageId(idx, page_index.get(idx, pg).offset);
+  return true;
 }
 
-const PageLocs::PageId * 
-PageLocs::get_page_id(const PageId & page_id) 
+bool
+PageLocs::peek_page(const PageId & page_id, bool forward, PageId & id, PageInfo & info)
 {
   std::scoped_lock guard(mutex);
 
-  PagesMap::iterator it     = check_and_find(PageId(page_id.itemref_index, 0));
-  PagesMap::iterator result = pages_map.end();
-  while ((it != pages_map.end()) && (it->first.itemref_index == page_id.itemref_index)) {
-    if ((it->first.offset == page_id.offset) ||
-        ((it->first.offset < page_id.offset) && ((it->first.offset + abs(it->second.size)) > page_id.offset))) { 
-      result = it; 
-      break; 
+  int16_t idx = page_id.itemref_index;
+  if ((idx < 0) || (idx >= page_index.get_item_count()) || !page_index.is_computed(idx)) return false;
+
+  int32_t pg = page_index.find(idx, page_id.offset);
+  if (pg == -1) return false;
+
+  do {
+    if (forward ? ((pg + 1) < page_index.get_item_size(idx)) : (pg > 0)) {
+      pg += forward ? 1 : -1;
+      continue;
     }
-    it++;
+    // Move to the next non-empty item, if already computed
+    do {
+      idx += forward ? 1 : -1;
+      if ((idx < 0) || (idx >= page_index.get_item_count()) || !page_index.is_computed(idx)) return false;
+    } while (page_index.get_item_size(idx) <= 0);
+    pg = forward ? 0 : page_index.get_item_size(idx) - 1;
+  } while (page_index.get(idx, pg).size < 0);
+
+  id               = PageId(idx, page_index.get(idx, pg).offset);
+  info.size        = page_index.get(idx, pg).size;
+  info.page_number = completed ? page_index.get_page_nbr(idx, pg) : -1;
+  return true;
+}
+
+bool
+PageLocs::get_page_id(const PageId & page_id, PageId & id) 
+{
+  std::scoped_lock guard(mutex);
+
+  if (!item_ready(page_id.itemref_index)) return false;
+
+  int32_t pg = page_index.find_containing(page_id.itemref_index, page_id.offset);
+  if (pg == -1) return false;
+
+  id = PageId(page_id.itemref_index, page_index.get(page_id.itemref_index, pg).offset);
+  return true;
+}
+
+bool
+PageLocs::get_page_info(const PageId & page_id, PageInfo & info)
+{
+  std::scoped_lock guard(mutex);
+
+  int32_t pg = check_and_find(page_id);
+  if (pg == -1) return false;
+
+  info.size        = page_index.get(page_id.itemref_index, pg).size;
+  info.page_number = completed ? page_index.get_page_nbr(page_id.itemref_index, pg) : -1;
+  return true;
+}
+
+bool
+PageLocs::get_page_checkpoint(const PageId & page_id, PageCheckpoints::Step * path, int16_t & length)
+{
+  std::scoped_lock guard(mutex);
+
+  int32_t pg = page_index.find(page_id.itemref_index, page_id.offset);
+  if ((pg == -1) || 
+      !checkpoints.is_valid(page_id.itemref_index, page_index.get_item_size(page_id.itemref_index))) {
+    return false;
   }
-  return (result == pages_map.end()) ? nullptr : &result->first ;
+
+  const PageCheckpoints::Step * steps;
+  if (!checkpoints.get(page_id.itemref_index, pg, steps, length)) return false;
+
+  std::copy(steps, steps + length, path);
+  return true;
+}
+
+int16_t
+PageLocs::get_page_nbr(const PageId & page_id)
+{
+  std::scoped_lock guard(mutex);
+
+  if (!completed) return -1; 
+
+  int32_t pg = page_index.find(page_id.itemref_index, page_id.offset);
+  return (pg == -1) ? -1 : page_index.get_page_nbr(page_id.itemref_index, pg);
+}
+
+int16_t
+PageLocs::get_estimated_page_nbr(const PageId & page_id)
+{
+  if (completed) return get_page_nbr(page_id);
+
+  return estimator.get_page_nbr(page_id.itemref_index, page_id.offset,
+                                page_index.find(page_id.itemref_index, page_id.offset));
+}
+
+bool
+PageLocs::get_page_id_from_nbr(int16_t page_nbr, PageId & id)
+{
+  std::scoped_lock guard(mutex);
+  
+  // page_nbr starts at 1
+  if (!completed || (page_nbr < 1)) return false;
+
+  int16_t idx;
+  int32_t pg;
+
+  if (!page_index.get_page_pos(page_nbr - 1, idx, pg)) return false;
+
+  id = PageId(idx, page_index.get(idx, pg).offset);
+  return true;
 }
 
 void
@@ -867,19 +1049,25 @@ PageLocs::computation_completed()
   std::scoped_lock guard(mutex);
 
   if (!completed) {
-    int16_t page_nbr = 0;
-    for (auto & entry : pages_map) {
-      if (entry.second.size >= 0) entry.second.page_number = page_nbr++;
-    }
-
-    page_count = page_nbr;
+    page_count = page_index.compute_page_numbers();
 
-    save(epub.get_current_filename());
+    // The journal is no longer required once the complete pages location are saved
+    if (save()) journal.remove();
   
     //show();
 
     completed = true;
     toc.save();
+    profiles.add(profile_key);
+
+    #if SHOW_TIMING
+      LOG_I("Waited %d time(s) for pages location, for a total of %d ms.", asap_wait_count, asap_wait_time);
+      LOG_I("Retrievers waited %d us to merge their pages.", merge_wait_time);
+      LOG_I("Word cache: %d%% hits, ~%d ms saved.", 
+            word_cache.get_hit_rate(), word_cache.get_time_saved() / 1000);
+      LOG_I("Item cache: %d%% hits, ~%d ms of inflate saved.", 
+            item_cache.get_hit_rate(), item_cache.get_stats().time_saved / 1000);
+    #endif
     event_mgr.set_stay_on(false);
     // #if EPUB_INKPLATE_BUILD && (LOG_LOCAL_LEVEL == ESP_LOG_VERBOSE)
     //   ESP::show_heaps_info();
@@ -888,7 +1076,7 @@ PageLocs::computation_completed()
     //     .itemref_index = 0
     //   };
     //   LOG_D("Sending SHOW_HEAP to Retriever");
-    //   QUEUE_SEND(retrieve_queue, retrieve_queue_data, 0);
+    //   retrieve_queue.send(retrieve_queue_data);
     // #endif
   }
 }
@@ -898,11 +1086,14 @@ PageLocs::computation_completed()
   PageLocs::show()
   {
     std::cout << "----- Page Locations -----" << std::endl;
-    for (auto& entry : pages_map) {
-      std::cout << " idx: " << entry.first.itemref_index
-                << " off: " << entry.first.offset 
-                << " siz: " << entry.second.size
-                << " pg: "  << entry.second.page_number << std::endl;
+    for (int16_t idx = 0; idx < page_index.get_item_count(); idx++) {
+      for (int32_t pg = 0; pg < page_index.get_item_size(idx); pg++) {
+        const PageIndex::Entry & entry = page_index.get(idx, pg);
+        std::cout << " idx: " << idx
+                  << " off: " << entry.offset 
+                  << " siz: " << entry.size
+                  << " pg: "  << (completed ? page_index.get_page_nbr(idx, pg) : -1) << std::endl;
+      }
     }
     std::cout << "----- End Page Locations -----" << std::endl;
   }
@@ -911,17 +1102,32 @@ PageLocs::computation_completed()
 void
 PageLocs::check_for_format_changes(int16_t count, int16_t itemref_index, bool force)
 {
-  if (force || 
-      (memcmp(epub.get_book_format_params(), &current_format_params, sizeof(current_format_params)) != 0) ||
-      !toc.load()) {
+  if (!force &&
+      (memcmp(epub.get_book_format_params(), &current_format_params, sizeof(current_format_params)) != 0)) {
+    // The pages location may have been kept from a previous computation
+    // with these formatting parameters.
+    if (!state_task.retriever_is_iddle()) stop_document();
+
+    item_count = count;
+    force      = !load();
+  }
+
+  if (force || !toc.load()) {
 
     LOG_D("==> Page locations recalc. <==");
 
     if (!state_task.retriever_is_iddle()) stop_document();
 
+    item_count = count;
     clear();  
 
+    reading_itemref = itemref_index;
+    asap_wait_count = 0;
+    asap_wait_time  = 0;
+    merge_wait_time = 0;
+
     current_format_params = *epub.get_book_format_params();
+    profile_key           = LocsProfiles::key_of(&current_format_params, sizeof(current_format_params));
 
     if (toc.load_from_epub() && !toc.there_is_some_ids()) {
       // The table of content doesn't need to be synch with the
@@ -931,127 +1137,230 @@ PageLocs::check_for_format_changes(int16_t count, int16_t itemref_index, bool fo
       toc.save();
     }
 
-    item_count = count;
+    // Items computed before the book was closed (or the device restarted)
+    { std::scoped_lock guard(mutex, merge_mutex);
+      LocsJournal::TocOffsets toc_offsets;
+      int16_t replayed = journal.open(profiles.get_filename(profile_key, ".jnl"), profile_key, item_count,
+                                      page_index, checkpoints, toc_offsets);
+      for (auto & toc_offset : toc_offsets) toc.set_entry_offset(toc_offset.entry_index, toc_offset.offset);
+      if (replayed > 0) LOG_I("Pages location of %d items retrieved from journal.", replayed);
+    }
+
+    // The page count is estimated from the items size until all items are computed
+    { std::vector<int32_t> item_sizes;
+      epub.get_item_sizes(item_sizes);
+      item_sizes.resize(item_count, 0);
+      estimator.clear(item_sizes);
+      for (int16_t idx = 0; idx < item_count; idx++) {
+        if (page_index.is_computed(idx)) calibrate_estimator(idx);
+      }
+    }
+
     StateQueueData state_queue_data;  
 
     state_queue_data = {
-      .req = StateReq::START_DOCUMENT,
+      .req           = StateReq::START_DOCUMENT,
       .itemref_index = itemref_index,
-      .itemref_count = item_count
+      .itemref_count = item_count,
+      .generation    = 0
     };
     LOG_D("start_new_document: Sending START_DOCUMENT");
-    QUEUE_SEND(state_queue, state_queue_data, 0);
+    state_queue.send(state_queue_data);
 
     event_mgr.set_stay_on(true);
   }
 }
 
-bool PageLocs::load(const std::string & epub_filename)
+void
+PageLocs::release_locs_data()
 {
-  std::string   filename = epub_filename.substr(0, epub_filename.find_last_of('.')) + ".locs";
-  std::ifstream file(filename, std::ios::in | std::ios::binary);
+  if (locs_data != nullptr) {
+    #if EPUB_LINUX_BUILD
+      munmap(locs_data, locs_data_size);
+    #else
+      free(locs_data);
+    #endif
+    locs_data      = nullptr;
+    locs_data_size = 0;
+  }
+}
 
-  LOG_D("Loading pages location from file %s.", filename.c_str());
+bool
+PageLocs::map_locs_file(const std::string & filename)
+{
+  release_locs_data();
 
-  int8_t  version;
-  int16_t pg_count;
+  #if EPUB_LINUX_BUILD
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) return false;
 
-  if (!file.is_open()) {
-    LOG_I("Unable to open pages location file. Calculing locations...");
+    struct stat stat_buf;
+    if ((fstat(fd, &stat_buf) == -1) || (stat_buf.st_size == 0)) {
+      close(fd);
+      return false;
+    }
+
+    void * data = mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    locs_data      = (uint8_t *) data;
+    locs_data_size = stat_buf.st_size;
+  #else
+    // A single read into a PSRAM block
+    FILE * file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) return false;
+
+    struct stat stat_buf;
+    if ((fstat(fileno(file), &stat_buf) == -1) || (stat_buf.st_size == 0)) {
+      fclose(file);
+      return false;
+    }
+
+    locs_data = (uint8_t *) allocate(stat_buf.st_size);
+    if (locs_data == nullptr) {
+      LOG_E("Unable to allocate memory for pages location: %d", (int32_t) stat_buf.st_size);
+      fclose(file);
+      return false;
+    }
+    locs_data_size = stat_buf.st_size;
+
+    bool ok = fread(locs_data, locs_data_size, 1, file) == 1;
+    fclose(file);
+    if (!ok) {
+      release_locs_data();
+      return false;
+    }
+  #endif
+
+  return true;
+}
+
+bool
+PageLocs::attach_locs_data()
+{
+  int8_t version = locs_data[0];
+
+  if ((version != LOCS_FILE_VERSION) || (locs_data_size < (int32_t) sizeof(LocsHeader))) return false;
+
+  const LocsHeader * header = reinterpret_cast<const LocsHeader *>(locs_data);
+  const uint8_t    * block  = locs_data + sizeof(LocsHeader);
+  int32_t            size   = header->item_count  * sizeof(PageIndex::ItemRecord) + 
+                              header->entry_count * sizeof(PageIndex::Entry);
+
+  if ((header->item_count != item_count) || 
+      (header->entry_count < 0) ||
+      (header->layout != LAYOUT_REVISION) ||
+      (locs_data_size != (int32_t) sizeof(LocsHeader) + size)) return false;
+  if (memcmp(&header->format_params, &current_format_params, sizeof(current_format_params)) != 0) {
+    return false;
+  }
+  if (PageIndex::checksum(block, size) != header->checksum) {
+    LOG_E("Pages location file checksum error.");
     return false;
   }
+  if (!page_index.attach(block, header->item_count, header->entry_count)) return false;
 
-  bool ok = false;
-  while (true) {
-    if (file.read(reinterpret_cast<char *>(&version), 1).fail()) break;
-    if (version != LOCS_FILE_VERSION) break;
+  page_count = header->page_count;
+  return page_index.get_page_count() == page_count;
+}
+
+bool 
+PageLocs::load()
+{
+  current_format_params = *epub.get_book_format_params();
+  profile_key           = LocsProfiles::key_of(&current_format_params, sizeof(current_format_params));
 
-    if (file.read(reinterpret_cast<char *>(&current_format_params), sizeof(current_format_params)).fail()) break;
-    if (file.read(reinterpret_cast<char *>(&pg_count),              sizeof(pg_count)             ).fail()) break;
+  std::string filename = profiles.get_filename(profile_key, ".locs");
 
-    pages_map.clear();
+  LOG_D("Loading pages location from file %s.", filename.c_str());
 
-    int16_t page_nbr = 0;
+  std::scoped_lock guard(mutex, merge_mutex);
 
-    for (int16_t i = 0; i < pg_count; i++) {
-      PageId   page_id;
-      PageInfo page_info;
-      
-      if (file.read(reinterpret_cast<char *>(&page_id.itemref_index), sizeof(page_id.itemref_index)).fail()) break;
-      if (file.read(reinterpret_cast<char *>(&page_id.offset),        sizeof(page_id.offset       )).fail()) break;
-      if (file.read(reinterpret_cast<char *>(&page_info.size),        sizeof(page_info.size       )).fail()) break;
-      page_info.page_number = (page_info.size >= 0) ? page_nbr++ : -1;
+  page_index.clear(item_count);
+  checkpoints.clear(item_count);
 
-      page_locs.insert(page_id, page_info);
+  bool ok = false;
+
+  if (map_locs_file(filename)) {
+    ok = attach_locs_data();
+    if (ok && !profiles.touch(profile_key)) profiles.add(profile_key);
+  }
+  else {
+    // A single <book>.locs file (version 3) was used by previous versions.
+    // It is not read anymore: its locations are computed again.
+    std::string legacy_filename = profiles.get_base() + ".locs";
+    if (remove(legacy_filename.c_str()) == 0) {
+      LOG_I("Previous version pages location file %s removed.", legacy_filename.c_str());
+      remove((profiles.get_base() + ".toc").c_str());
     }
+    LOG_I("Unable to open pages location file. Calculing locations...");
+  }
 
-    page_count = page_nbr;
-    ok = !file.fail();
-    break;
+  if (!ok) {
+    page_index.clear(item_count);
+    release_locs_data();
   }
 
-  file.close();
+  // Checkpoints are optional: without them, pages are laid out from the
+  // beginning of their item.
+  if (!ok || !checkpoints.load(profiles.get_filename(profile_key, ".chk"), item_count)) {
+    checkpoints.clear(item_count);
+  }
 
   LOG_D("Page locations load %s.", ok ? "Success" : "Error");
 
   completed = ok;
-  
+
   return ok;
 }
 
 bool 
-PageLocs::save(const std::string & epub_filename)
+PageLocs::save()
 {
-  std::string   filename = epub_filename.substr(0, epub_filename.find_last_of('.')) + ".locs";
-  std::ofstream file(filename, std::ios::out | std::ios::binary);
+  std::string filename = profiles.get_filename(profile_key, ".locs");
 
   LOG_D("Saving pages location to file %s", filename.c_str());
 
+  // Written in a temporary file first: a partially written file will never be 
+  // used, and a memory mapped previous version stays valid.
+  std::string   tmp_filename = filename + ".tmp";
+  std::ofstream file(tmp_filename, std::ios::out | std::ios::binary);
+
   if (!file.is_open()) {
     LOG_E("Not able to open pages location file.");
     return false;
   }
 
-  int16_t page_count = pages_map.size();
+  LocsHeader header = {
+    .version       = LOCS_FILE_VERSION,
+    .format_params = current_format_params,
+    .item_count    = page_index.get_item_count(),
+    .page_count    = page_index.get_page_count(),
+    .entry_count   = page_index.get_entry_count(),
+    .checksum      = page_index.get_checksum(),
+    .layout        = LAYOUT_REVISION
+  };
 
-  while (true) {
-    if (file.write(reinterpret_cast<const char *>(&LOCS_FILE_VERSION),     1                            ).fail()) break;
-    if (file.write(reinterpret_cast<const char *>(&current_format_params), sizeof(current_format_params)).fail()) break;
-    if (file.write(reinterpret_cast<const char *>(&page_count),            sizeof(page_count)           ).fail()) break;
+  bool res = !file.write(reinterpret_cast<const char *>(&header), sizeof(header)).fail() &&
+             page_index.write(file);
 
-    for (auto & page : pages_map) {
-      if (file.write(reinterpret_cast<const char *>(&page.first.itemref_index), sizeof(page.first.itemref_index)).fail()) break;
-      if (file.write(reinterpret_cast<const char *>(&page.first.offset),        sizeof(page.first.offset       )).fail()) break;
-      if (file.write(reinterpret_cast<const char *>(&page.second.size),         sizeof(page.second.size        )).fail()) break;
-    }
+  file.close();
+  res = res && !file.fail();
 
-    break;
+  if (res) {
+    remove(filename.c_str());
+    res = rename(tmp_filename.c_str(), filename.c_str()) == 0;
+  }
+  else {
+    remove(tmp_filename.c_str());
   }
 
-  bool res = !file.fail();
-  file.close();
+  if (res && !checkpoints.save(profiles.get_filename(profile_key, ".chk"))) {
+    LOG_E("Unable to save pages checkpoints.");
+  }
 
   LOG_D("Page locations save %s.", res ? "Success" : "Error");
 
   return res;
 }
-
-const PageLocs::PageId * 
-PageLocs::get_page_id_from_nbr(int16_t page_nbr)
-{
-  std::scoped_lock guard(mutex);
-  
-  if (page_nbr < 1) return nullptr;
-  
-  int16_t current_page = 0;
-  
-  for (auto it = pages_map.begin(); it != pages_map.end(); ++it) {
-      if (it->second.size > 0) {
-          current_page++;
-          if (current_page == page_nbr) {
-              return &it->first;
-          }
-      }
-  }
-  return nullptr;
-}
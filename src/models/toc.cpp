@@ -22,8 +22,8 @@ extern xml_node one_by_attr(xml_node n, const char * name1, const char * name2,
 std::string 
 TOC::build_filename()
 {
-  std::string epub_fname = epub.get_current_filename();
-  return epub_fname.substr(0, epub_fname.find_last_of('.')) + ".toc";
+  // The table of content page ids depend on the formatting parameters
+  return page_locs.get_toc_filename();
 }
 
 bool
@@ -198,8 +198,6 @@ TOC::do_nav_points(pugi::xml_node & node, uint8_t level)
 {
   LOG_D("do_nav_points()");
 
-  xml_attribute attr;
-
   do {
     const char * label = node.child("navLabel").child("text").text().as_string();
     const char * fname = node.child("content").attribute("src").value();
@@ -229,44 +227,29 @@ TOC::do_nav_points(pugi::xml_node & node, uint8_t level)
 
     clean_filename(filename_to_find);
 
-    if ((n = opf->find_child(package_pred).find_child(manifest_pred)) &&
-        (n = one_by_attr(n, "item", "opf:item", "href", filename_to_find))) {
-      // Is the node with the same filename is found, we then search the
-      // itemref in the spine with the same id associated with the item.
-      if ((attr = n.attribute("id"))) {
-        const char * idref = attr.value();
-
-        if ((n = opf->find_child(package_pred).find_child(spine_pred))) {
-
-          int16_t index = 0;
-          bool    found = false;
-
-          for (auto nn: n.children()) {
-            if (strcmp(nn.attribute("idref").value(), idref) == 0) { found = true; break; }
-            index++;
-          }
-
-          if (found) {
-            entry.page_id.itemref_index = index;
-            if (!the_id.empty()) {
-              infos.insert(std::make_pair(
-                std::make_pair(index, the_id),
-                (int16_t)entries.size()
-              ));
-              some_ids = true;
-            }
-            else {
-              entry.page_id.offset = 0;
-            }
-            entries.push_back(entry);
+    // The manifest entry with the same filename supplies its position in
+    // the spine.
+    const EPub::ManifestEntry * item = epub.find_manifest_entry(epub.filename_locate(filename_to_find));
+    if (item != nullptr) {
+      if (*item->id != 0) {
+        int16_t index = item->itemref_index;
+
+        if (index >= 0) {
+          entry.page_id.itemref_index = index;
+          if (!the_id.empty()) {
+            infos.insert(std::make_pair(
+              std::make_pair(index, the_id),
+              (int16_t)entries.size()
+            ));
+            some_ids = true;
           }
           else {
-            LOG_E("Unable to find reference %s in spine", idref);
-            return false;
+            entry.page_id.offset = 0;
           }
+          entries.push_back(entry);
         }
         else {
-          LOG_E("No spine in OPF!!");
+          LOG_E("Unable to find reference %s in spine", item->id);
           return false;
         }
       }
@@ -295,7 +278,7 @@ TOC::load_from_epub()
 {
   LOG_D("load_from_epub()");
 
-  xml_node      node, node2;
+  xml_node      node;
   xml_attribute attr;
   const char *  filename = nullptr;
 
@@ -306,11 +289,11 @@ TOC::load_from_epub()
   // Retrieve the ncx filename
   // Sometimes, the id is "ncx", sometimes "toc"
 
-  if (((node = opf->find_child(package_pred).find_child(manifest_pred)) &&
-       ((node2 = one_by_attr(node, "item", "opf:item", "id", "ncx")) ||
-        (node2 = one_by_attr(node, "item", "opf:item", "id", "toc")))) &&
-      (strcmp(node2.attribute("media-type").value(), "application/x-dtbncx+xml") == 0)) {
-    filename = node2.attribute("href").value();
+  const EPub::ManifestEntry * ncx;
+
+  if (((ncx = epub.get_manifest_entry("ncx")) != nullptr) || 
+      ((ncx = epub.get_manifest_entry("toc")) != nullptr)) {
+    if (strcmp(ncx->media_type, "application/x-dtbncx+xml") == 0) filename = ncx->href;
   }
 
   // If filename was not found, returns gracefully. This is usually related
@@ -438,10 +421,9 @@ TOC::clean()
 }
 
 void 
-TOC::set(std::string & id, int32_t current_offset)
+TOC::set(std::string & id, int16_t itemref_index, int32_t current_offset)
 {
-  int16_t         itemref_index = page_locs.get_current_itemref_index();
-  Infos::iterator infos_it      = infos.find(std::make_pair(itemref_index, id));
+  Infos::iterator infos_it = infos.find(std::make_pair(itemref_index, id));
 
   if (infos_it != infos.end()) {
     entries[infos_it->second].page_id.offset = current_offset;
@@ -449,9 +431,8 @@ TOC::set(std::string & id, int32_t current_offset)
 }
 
 void 
-TOC::set(int32_t current_offset)
+TOC::set(int16_t itemref_index, int32_t current_offset)
 {
-  int16_t itemref_index = page_locs.get_current_itemref_index();
   int16_t idx = -1;
 
   for (auto & e : entries) {
@@ -465,6 +446,14 @@ TOC::set(int32_t current_offset)
   }
 }
 
+void 
+TOC::set_entry_offset(int16_t entry_index, int32_t offset)
+{
+  if ((entry_index >= 0) && (entry_index < (int16_t) entries.size())) {
+    entries[entry_index].page_id.offset = offset;
+  }
+}
+
 #if DEBUGGING
 
 void
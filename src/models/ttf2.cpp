@@ -17,7 +17,10 @@ FT_Library TTF::library{ nullptr };
 
 TTF::TTF(const std::string & filename) : Font()
 {
-  face  = nullptr;
+  face        = nullptr;
+  font_stream = nullptr;
+  font_hash   = 0;
+  has_kerning = true;
 
   if (library == nullptr) {
     int error = FT_Init_FreeType(& library);
@@ -27,12 +30,19 @@ TTF::TTF(const std::string & filename) : Font()
     }
   }
 
-  set_font_face_from_file(filename);
+  #if TTF_STREAMING
+    set_font_face_from_stream(new FontStream(filename));
+  #else
+    set_font_face_from_file(filename);
+  #endif
 }
 
 TTF::TTF(unsigned char * buffer, int32_t buffer_size) : Font()
 {
-  face  = nullptr;
+  face        = nullptr;
+  font_stream = nullptr;
+  font_hash   = 0;
+  has_kerning = true;
  
   if (library == nullptr) {
     int error = FT_Init_FreeType(& library);
@@ -44,6 +54,23 @@ TTF::TTF(unsigned char * buffer, int32_t buffer_size) : Font()
   set_font_face_from_memory(buffer, buffer_size);
 }
 
+TTF::TTF(FontStream * stream) : Font()
+{
+  face        = nullptr;
+  font_stream = nullptr;
+  font_hash   = 0;
+  has_kerning = true;
+ 
+  if (library == nullptr) {
+    int error = FT_Init_FreeType(& library);
+    if (error) {
+      LOG_E("An error occurred during FreeType library initialization.");
+    }
+  }
+
+  set_font_face_from_stream(stream);
+}
+
 TTF::~TTF()
 {
   ready = false;
@@ -54,6 +81,8 @@ void
 TTF::clear_face()
 {
   clear_cache();
+  kern_pairs.clear();
+  kern_table.clear();
   if (face != nullptr) {
     FT_Done_Face(face);
     face = nullptr;
@@ -62,28 +91,35 @@ TTF::clear_face()
     free(memory_font);
     memory_font = nullptr;
   }
+  if (font_stream != nullptr) {
+    delete font_stream;
+    font_stream = nullptr;
+  }
   
   ready             = false;
   current_font_size = -1;
+  has_kerning       = true;
 }
 
 Font::Glyph *
 TTF::get_glyph_internal(uint32_t charcode, int16_t glyph_size)
 {
   int error;
-  Glyphs::iterator git;
 
   if (face == nullptr) return nullptr;
 
-  GlyphsCache::iterator cache_it = cache.find(glyph_size);
+  Glyph * found = cache.find(charcode, glyph_size);
 
-  bool found = (cache_it != cache.end()) &&
-               ((git = cache_it->second.find(charcode)) != cache_it->second.end());
-
-  if (found) {
-    return git->second;
+  if ((found != nullptr) && !found->is_evicted()) {
+    reference(found);
+    return found;
   }
   else {
+    if ((found == nullptr) && ((found = load_from_atlas(charcode, glyph_size)) != nullptr)) {
+      reference(found);
+      return found;
+    }
+
     if (current_font_size != glyph_size) set_font_size(glyph_size);
 
     int glyph_index = FT_Get_Char_Index(face, charcode);
@@ -102,7 +138,10 @@ TTF::get_glyph_internal(uint32_t charcode, int16_t glyph_size)
       }
     }
 
-    Glyph * glyph = bitmap_glyph_pool.newElement();
+    // An evicted glyph is rasterized apart: other threads may be reading
+    // its metrics.
+    Glyph   reloaded;
+    Glyph * glyph = (found != nullptr) ? &reloaded : bitmap_glyph_pool.newElement();
 
     if (glyph == nullptr) {
       LOG_E("Unable to allocate memory for glyph.");
@@ -141,6 +180,7 @@ TTF::get_glyph_internal(uint32_t charcode, int16_t glyph_size)
 
     if (size > 0) {
       glyph->buffer = byte_pool_alloc(size);
+      glyph->slab   = last_slab;
 
       if (glyph->buffer == nullptr) {
         LOG_E("Unable to allocate memory for glyph.");
@@ -154,6 +194,7 @@ TTF::get_glyph_internal(uint32_t charcode, int16_t glyph_size)
     }
     else {
       glyph->buffer = nullptr;
+      glyph->slab   = NO_SLAB;
     }
 
     glyph->xoff    =  slot->bitmap_left;
@@ -170,12 +211,272 @@ TTF::get_glyph_internal(uint32_t charcode, int16_t glyph_size)
     //   " y:"  << glyph->yoff <<
     //   " a:"  << glyph->advance << std::endl;
 
-    cache[current_font_size][charcode] = glyph;
+    rasterized_count++;
+    reference(glyph);
+
+    if (found != nullptr) {
+      found->buffer = glyph->buffer;
+      found->slab.store(glyph->slab.load(std::memory_order_relaxed), std::memory_order_release);
+      return found;
+    }
+
+    cache.insert(charcode, glyph_size, glyph);
+
+    GlyphAtlas * atlas = get_atlas(glyph_size);
+    if (atlas != nullptr) {
+      GlyphAtlas::GlyphRecord record = {
+        .code        = charcode,
+        .width       = glyph->dim.width,
+        .height      = glyph->dim.height,
+        .xoff        = glyph->xoff,
+        .yoff        = glyph->yoff,
+        .advance     = glyph->advance,
+        .pitch       = glyph->pitch,
+        .line_height = glyph->line_height
+      };
+      atlas->add(record, glyph->buffer);
+    }
 
     return glyph;
   }
 }
 
+GlyphAtlas *
+TTF::get_atlas(int16_t glyph_size)
+{
+  if (font_hash == 0) return nullptr;
+
+  uint8_t  pixel_resolution = (uint8_t) screen.get_pixel_resolution();
+  uint32_t key              = (pixel_resolution << 16) | (uint16_t) glyph_size;
+
+  Atlases::iterator it = atlases.find(key);
+  if (it != atlases.end()) return it->second;
+
+  GlyphAtlas * atlas = new GlyphAtlas(font_hash, glyph_size, pixel_resolution);
+  atlases[key] = atlas;
+  return atlas;
+}
+
+Font::Glyph *
+TTF::load_from_atlas(uint32_t charcode, int16_t glyph_size)
+{
+  GlyphAtlas * atlas = get_atlas(glyph_size);
+  if (atlas == nullptr) return nullptr;
+
+  std::vector<uint8_t> data;
+  if (!atlas->load_block(charcode, data)) return nullptr;
+
+  for (size_t pos = 0; pos < data.size(); ) {
+    GlyphAtlas::GlyphRecord rec;
+    memcpy(&rec, &data[pos], sizeof(rec));
+    pos += sizeof(rec);
+
+    int32_t size = rec.pitch * rec.height;
+    if (size < 0) size = 0;
+
+    if (cache.find(rec.code, glyph_size) == nullptr) {
+      Glyph * glyph = bitmap_glyph_pool.newElement();
+      if (glyph == nullptr) {
+        LOG_E("Unable to allocate memory for glyph.");
+        msg_viewer.out_of_memory("glyph allocation");
+      }
+
+      glyph->dim.width   = rec.width;
+      glyph->dim.height  = rec.height;
+      glyph->xoff        = rec.xoff;
+      glyph->yoff        = rec.yoff;
+      glyph->advance     = rec.advance;
+      glyph->pitch       = rec.pitch;
+      glyph->line_height = rec.line_height;
+      glyph->ligature_and_kern_pgm_index = -1;
+
+      if (size > 0) {
+        glyph->buffer = byte_pool_alloc(size, glyph_size);
+        glyph->slab   = last_slab;
+        if (glyph->buffer == nullptr) {
+          LOG_E("Unable to allocate memory for glyph.");
+          msg_viewer.out_of_memory("glyph allocation");
+        }
+        memcpy(glyph->buffer, &data[pos], size);
+      }
+      else {
+        glyph->buffer = nullptr;
+        glyph->slab   = NO_SLAB;
+      }
+
+      cache.insert(rec.code, glyph_size, glyph);
+    }
+
+    pos += size;
+  }
+
+  return cache.find(charcode, glyph_size);
+}
+
+void
+TTF::save_glyphs(bool release)
+{
+  for (auto & entry : atlases) {
+    entry.second->save();
+    if (release) delete entry.second;
+  }
+  if (release) atlases.clear();
+}
+
+Font::Glyph *
+TTF::get_glyph_metrics_internal(uint32_t charcode, int16_t glyph_size)
+{
+  if (face == nullptr) return nullptr;
+
+  Glyph * found = metrics_cache.find(charcode, glyph_size);
+  if (found != nullptr) return found;
+
+  if (current_font_size != glyph_size) set_font_size(glyph_size);
+
+  int glyph_index = FT_Get_Char_Index(face, charcode);
+  if (glyph_index == 0) {
+    LOG_D("Charcode not found in face: %d, font_index: %d", charcode, fonts_cache_index);
+    return nullptr;
+  }
+
+  // Same load flags as for the bitmap: the hinted advance is identical
+  if (FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT)) {
+    LOG_E("Unable to load glyph for charcode: %d", charcode);
+    return nullptr;
+  }
+
+  Glyph * glyph = bitmap_glyph_pool.newElement();
+
+  if (glyph == nullptr) {
+    LOG_E("Unable to allocate memory for glyph.");
+    msg_viewer.out_of_memory("glyph allocation");
+  }
+
+  FT_GlyphSlot slot = face->glyph;
+
+  glyph->dim.width   =   slot->metrics.width        >> 6;
+  glyph->dim.height  =   slot->metrics.height       >> 6;
+  glyph->xoff        =   slot->metrics.horiBearingX >> 6;
+  glyph->yoff        = -(slot->metrics.horiBearingY >> 6);
+  glyph->advance     =   slot->advance.x            >> 6;
+  glyph->line_height =   face->size->metrics.height >> 6;
+  glyph->pitch       =   0;
+  glyph->slab        =   NO_SLAB;
+  glyph->buffer      =   nullptr;
+  glyph->ligature_and_kern_pgm_index = -1;
+
+  metrics_cache.insert(charcode, glyph_size, glyph);
+
+  return glyph;
+}
+
+Font::Glyph *
+TTF::get_glyph_metrics(uint32_t charcode, int16_t glyph_size)
+{
+  Glyph * glyph = metrics_cache.find(charcode, glyph_size);
+  if (glyph != nullptr) return glyph;
+
+  std::scoped_lock guard(mutex);
+
+  return ready ? get_glyph_metrics_internal(charcode, glyph_size) : nullptr;
+}
+
+Font::Glyph *
+TTF::get_glyph_metrics(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size, int16_t & kern, bool & ignore_next)
+{
+  ignore_next = false;
+
+  Glyph * glyph = metrics_cache.find(charcode, glyph_size);
+
+  if (glyph == nullptr) {
+    std::scoped_lock guard(mutex);
+    glyph = ready ? get_glyph_metrics_internal(charcode, glyph_size) : nullptr;
+  }
+
+  if (glyph != nullptr) kern = glyph->advance + get_kern(charcode, next_charcode, glyph_size);
+
+  return glyph;
+}
+
+Font::Glyph *
+TTF::get_glyph(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size, int16_t & kern, bool & ignore_next)
+{
+  ignore_next = false;
+
+  Glyph * glyph = Font::get_glyph(charcode, glyph_size);
+
+  if (glyph != nullptr) kern = glyph->advance + get_kern(charcode, next_charcode, glyph_size);
+
+  return glyph;
+}
+
+int16_t
+TTF::get_kern(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size)
+{
+  #if TTF_KERNING
+    if ((next_charcode == 0) || !has_kerning.load(std::memory_order_relaxed)) return 0;
+
+    int16_t kern;
+    if (kern_pairs.find(charcode, next_charcode, glyph_size, kern)) return kern;
+
+    std::scoped_lock guard(mutex);
+
+    return ready ? get_kern_internal(charcode, next_charcode, glyph_size) : 0;
+  #else
+    return 0;
+  #endif
+}
+
+// The pairs saved in the atlas of the size are retrieved first. The face
+// kerning tables are only loaded for a pair not found there.
+int16_t
+TTF::get_kern_internal(uint32_t charcode, uint32_t next_charcode, int16_t glyph_size)
+{
+  int16_t kern;
+  if (kern_pairs.find(charcode, next_charcode, glyph_size, kern)) return kern;
+
+  GlyphAtlas * atlas = get_atlas(glyph_size);
+  if (atlas != nullptr) {
+    std::vector<GlyphAtlas::KernRecord> kerns;
+    if (atlas->load_kerns(kerns)) {
+      for (auto & rec : kerns) kern_pairs.insert(rec.left, rec.right, glyph_size, rec.kern);
+      if (kern_pairs.find(charcode, next_charcode, glyph_size, kern)) return kern;
+    }
+  }
+
+  if ((face == nullptr) || !has_kerning) return 0;
+
+  if (!kern_table.is_loaded() && !kern_table.load(face)) {
+    has_kerning = false;
+    return 0;
+  }
+
+  if ((current_font_size != glyph_size) && !set_font_size(glyph_size)) return 0;
+
+  int16_t value = kern_table.get(FT_Get_Char_Index(face, charcode), 
+                                 FT_Get_Char_Index(face, next_charcode));
+
+  // Font units to pixels, rounded
+  kern = (value == 0) ? 0 : (FT_MulFix(value, face->size->metrics.x_scale) + 32) >> 6;
+
+  if (kern_pairs.insert(charcode, next_charcode, glyph_size, kern) && (atlas != nullptr)) {
+    atlas->add_kern(charcode, next_charcode, kern);
+  }
+
+  return kern;
+}
+
+bool
+TTF::compute_size_metrics(int16_t glyph_size, int16_t & line_height, int16_t & descender_height)
+{
+  if (face == nullptr) return false;
+  if ((current_font_size != glyph_size) && !set_font_size(glyph_size)) return false;
+
+  line_height      = face->size->metrics.height    >> 6;
+  descender_height = face->size->metrics.descender >> 6;
+  return true;
+}
+
 bool 
 TTF::set_font_size(int16_t size)
 {
@@ -207,7 +508,50 @@ TTF::set_font_face_from_memory(unsigned char * buffer, int32_t buffer_size)
     return false;
   }
 
+  set_font_hash(buffer, (buffer_size < 1024) ? buffer_size : 1024, buffer_size);
+
   ready       = true;
   memory_font = buffer;
   return true;
 }
+
+bool 
+TTF::set_font_face_from_stream(FontStream * stream)
+{
+  if (face != nullptr) clear_face();
+
+  if (!stream->is_ready()) {
+    delete stream;
+    return false;
+  }
+
+  FT_Open_Args args;
+  memset(&args, 0, sizeof(args));
+  args.flags  = FT_OPEN_STREAM;
+  args.stream = stream->get_stream();
+
+  int error = FT_Open_Face(library, &args, 0, &face);
+  if (error) {
+    LOG_E("The font format is unsupported or is broken (%d).", error);
+    face = nullptr;
+    delete stream;
+    return false;
+  }
+
+  uint8_t  head[1024];
+  uint32_t head_size = stream->read(0, head, sizeof(head));
+  set_font_hash(head, head_size, stream->get_size());
+
+  ready       = true;
+  font_stream = stream;
+  return true;
+}
+
+// The table directory at the beginning of the font holds the checksum of
+// every table: with the font size, enough to identify the font data.
+void
+TTF::set_font_hash(const uint8_t * head, int32_t head_size, int32_t font_size)
+{
+  font_hash = GlyphAtlas::hash(head, head_size, GlyphAtlas::hash(&font_size, sizeof(font_size)));
+  if (font_hash == 0) font_hash = 1;
+}
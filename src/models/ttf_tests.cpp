@@ -0,0 +1,720 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/ttf2.hpp"
+#include "models/fonts.hpp"
+#include "screen.hpp"
+#include "helpers/unzip.hpp"
+#include "pugixml.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A file of the tree, whatever the current directory
+static std::string
+tree(const char * name)
+{
+  std::string path(__FILE__);
+  size_t      pos = path.rfind("src/models/");
+  return path.substr(0, (pos == std::string::npos) ? 0 : pos) + name;
+}
+
+static std::string
+sdcard(const char * name)
+{
+  return tree("SDCard/") + name;
+}
+
+static const std::string FONT_FILENAME = sdcard("fonts/DejaVuSerif-Regular.otf");
+static const std::string SANS_FILENAME = sdcard("fonts/DejaVuSans-Regular.otf");
+static const std::string BOOK          = sdcard("books/Austen, Jane - Pride and Prejudice.epub");
+
+// Restores the glyph atlas folder when leaving a test
+class AtlasFolder
+{
+  public:
+    AtlasFolder(const char * folder) : saved(GlyphAtlas::get_folder()) { GlyphAtlas::set_folder(folder); }
+   ~AtlasFolder() { GlyphAtlas::set_folder(saved); }
+  private:
+    std::string saved;
+};
+
+// The metrics must lay out pages exactly as the glyphs do
+TEST(TTFTest, metrics_match_glyphs) {
+  TTF font(FONT_FILENAME);
+  if (!font.is_ready()) GTEST_SKIP() << FONT_FILENAME << " not available.";
+
+  for (int16_t size : { 8, 10, 12, 15 }) {
+    for (uint32_t code = 32; code < 256; code++) {
+      Font::Glyph * glyph   = font.get_glyph(code, size);
+      Font::Glyph * metrics = font.get_glyph_metrics(code, size);
+      ASSERT_EQ(glyph == nullptr, metrics == nullptr) << "code " << code;
+      if (glyph == nullptr) continue;
+      EXPECT_EQ(glyph->advance,     metrics->advance    ) << "code " << code << " size " << size;
+      EXPECT_EQ(glyph->line_height, metrics->line_height) << "code " << code << " size " << size;
+      EXPECT_EQ(metrics->buffer, nullptr);
+
+      int16_t kern, metrics_kern;
+      bool    ignore_next, metrics_ignore_next;
+      font.get_glyph(code, 'a', size, kern, ignore_next);
+      font.get_glyph_metrics(code, 'a', size, metrics_kern, metrics_ignore_next);
+      EXPECT_EQ(kern,        metrics_kern       );
+      EXPECT_EQ(ignore_next, metrics_ignore_next);
+    }
+  }
+}
+
+static void
+collect_words(pugi::xml_node node, std::vector<std::string> & words)
+{
+  for (auto n : node.children()) {
+    if (n.type() == pugi::node_element) {
+      collect_words(n, words);
+    }
+    else if (n.type() == pugi::node_pcdata) {
+      std::string word;
+      for (const char * s = n.value(); ; s++) {
+        if ((*s == 0) || isspace(*s)) {
+          if (!word.empty()) words.push_back(word);
+          word.clear();
+          if (*s == 0) break;
+        }
+        else word += *s;
+      }
+    }
+  }
+}
+
+static bool
+load_book_text(const char * filename, std::vector<std::string> & words)
+{
+  if (!unzip.open_zip_file(filename)) return false;
+
+  uint32_t size;
+  pugi::xml_document container, opf;
+
+  auto data = unzip.get_file("META-INF/container.xml", size);
+  if ((data == nullptr) || !container.load_buffer(data.get(), size)) return false;
+
+  std::string opf_name = container.child("container").child("rootfiles").child("rootfile").attribute("full-path").value();
+  std::string base     = opf_name.substr(0, opf_name.find_last_of('/') + 1);
+
+  data = unzip.get_file(opf_name.c_str(), size);
+  if ((data == nullptr) || !opf.load_buffer(data.get(), size)) return false;
+
+  pugi::xml_node package = opf.child("package");
+  for (auto itemref : package.child("spine").children("itemref")) {
+    pugi::xml_node item = package.child("manifest").find_child_by_attribute("item", "id", itemref.attribute("idref").value());
+    if (strcmp(item.attribute("media-type").value(), "application/xhtml+xml") != 0) continue;
+    std::string fname = base + item.attribute("href").value();
+    data = unzip.get_file(fname.c_str(), size);
+    pugi::xml_document doc;
+    if ((data == nullptr) || !doc.load_buffer(data.get(), size)) return false;
+    collect_words(doc.child("html").child("body"), words);
+  }
+
+  unzip.close_zip_file();
+  return !words.empty();
+}
+
+// The words of a book laid out as done by the Page class in LOCATION mode,
+// with glyph bitmaps (as before) and with metrics only: same widths, and no
+// bitmap is allocated for the metrics. Regular, italic and bold faces being
+// usually all used in a book, three sizes are used.
+TEST(TTFTest, location_pass) {
+  std::vector<std::string> words;
+  if (!load_book_text(BOOK.c_str(), words)) GTEST_SKIP() << BOOK << " not available.";
+
+  int64_t widths[2];
+
+  for (bool metrics : { false, true }) {
+    TTF font(FONT_FILENAME);
+    if (!font.is_ready()) GTEST_SKIP() << FONT_FILENAME << " not available.";
+
+    int64_t width = 0;
+
+    for (int16_t size : { 10, 12, 15 }) {
+      for (auto & word : words) {
+        for (const char * s = word.c_str(); *s; s++) {
+          int16_t kern;
+          bool    ignore_next;
+          uint32_t code = (uint8_t) *s;
+          Font::Glyph * glyph = metrics ? font.get_glyph_metrics(code, s[1], size, kern, ignore_next) :
+                                          font.get_glyph(code, s[1], size, kern, ignore_next);
+          if (glyph != nullptr) width += kern;
+        }
+      }
+    }
+
+    widths[metrics] = width;
+
+    if (metrics) {
+      EXPECT_EQ(font.get_byte_pool_size(), 0);
+    }
+    else {
+      EXPECT_GT(font.get_byte_pool_size(), 0);
+    }
+  }
+
+  EXPECT_GT(widths[0], 0);
+  EXPECT_EQ(widths[0], widths[1]);
+}
+
+// Glyph lookups for the characters of a book, all glyphs being already in
+// the cache, as when a page is shown: the font's glyph table returns the
+// glyphs kept by the previous cache (a map of maps by size).
+TEST(TTFTest, glyph_lookup) {
+  std::vector<std::string> words;
+  if (!load_book_text(BOOK.c_str(), words)) GTEST_SKIP() << BOOK << " not available.";
+
+  TTF font(FONT_FILENAME);
+  if (!font.is_ready()) GTEST_SKIP() << FONT_FILENAME << " not available.";
+
+  typedef std::unordered_map<uint32_t, Font::Glyph *> Glyphs;
+  std::unordered_map<int16_t, Glyphs> map_cache;
+
+  static constexpr int16_t SIZES[] = { 12, 15 };
+
+  for (int16_t size : SIZES) {
+    for (auto & word : words) {
+      for (const char * s = word.c_str(); *s; s++) {
+        uint32_t code = (uint8_t) *s;
+        map_cache[size][code] = font.get_glyph(code, size);
+      }
+    }
+  }
+
+  int32_t rasterized = font.get_rasterized_count();
+  int32_t lookups    = 0;
+
+  for (int16_t size : SIZES) {
+    for (auto & word : words) {
+      for (const char * s = word.c_str(); *s; s++) {
+        uint32_t code = (uint8_t) *s;
+        ASSERT_EQ(font.get_glyph(code, size), map_cache[size][code]) << "code " << code << " size " << size;
+        lookups++;
+      }
+    }
+  }
+
+  EXPECT_GT(lookups, 0);
+  EXPECT_EQ(font.get_rasterized_count(), rasterized);
+}
+
+static int16_t
+resident_slab_count(Fonts & book_fonts, int16_t font_count)
+{
+  int16_t count = 0;
+  for (int16_t idx = 0; idx < font_count; idx++) count += book_fonts.get(idx)->get_resident_slab_count();
+  return count;
+}
+
+// The slabs referenced since the last sweep are kept, the others evicted
+// until a quarter of the budget is available.
+TEST(TTFTest, trim_glyph_caches) {
+  Fonts book_fonts;
+  if (!book_fonts.add("Serif", Fonts::FaceStyle::NORMAL, FONT_FILENAME)) GTEST_SKIP() << FONT_FILENAME << " not available.";
+  Font * font = book_fonts.get(0);
+
+  int32_t start_size = Font::get_slabs_size();
+  for (int16_t size = 10; size < 40; size++) {
+    for (uint32_t code = 'A'; code <= 'z'; code++) ASSERT_NE(font->get_glyph(code, size), nullptr);
+  }
+  int32_t used = Font::get_slabs_size() - start_size;
+  ASSERT_GT(used, 0);
+
+  int16_t slab_count = font->get_slab_count();
+  ASSERT_EQ(font->get_resident_slab_count(), slab_count);
+  EXPECT_FALSE(book_fonts.trim_glyph_caches(Font::get_slabs_size()));
+
+  // A new sweep: only the glyphs of size 12 are used again. The hand starts
+  // with the first slab, of size 10.
+  for (int16_t idx = 0; idx < slab_count; idx++) font->test_and_clear_slab_reference(idx);
+  Font::Glyph * hot = font->get_glyph('a', 12);
+  Font::Glyph * old = font->get_glyph('a', 10);
+  ASSERT_NE(hot, nullptr);
+  ASSERT_NE(old, nullptr);
+  font->test_and_clear_slab_reference(old->slab);
+
+  uint16_t generation = book_fonts.get_generation();
+  int32_t  budget     = start_size + used / 2;
+
+  EXPECT_TRUE(book_fonts.trim_glyph_caches(budget));
+  EXPECT_EQ(book_fonts.get_generation(), (uint16_t)(generation + 1));
+  EXPECT_LE(Font::get_slabs_size(), budget - (budget >> 2));
+  EXPECT_LT(font->get_resident_slab_count(), slab_count);
+  EXPECT_GT(font->get_resident_slab_count(), 0);
+  EXPECT_FALSE(hot->is_evicted());
+  EXPECT_NE(hot->buffer, nullptr);
+  EXPECT_TRUE(old->is_evicted());
+  EXPECT_EQ(old->buffer, nullptr);
+
+  // Under budget: nothing to do, same generation
+  EXPECT_FALSE(book_fonts.trim_glyph_caches(budget));
+  EXPECT_EQ(book_fonts.get_generation(), (uint16_t)(generation + 1));
+
+  // An evicted glyph is rasterized again
+  Font::Glyph * again = font->get_glyph('a', 10);
+  ASSERT_NE(again, nullptr);
+  EXPECT_NE(again->buffer, nullptr);
+}
+
+// No CJK font or book is part of the tree: the thousands of glyphs of a CJK
+// book are simulated with the glyphs of four faces at 16 sizes, their
+// frequency following Zipf's law. Pages of 800 characters are shown, the
+// cache being trimmed between pages.
+TEST(TTFTest, glyph_cache_budget) {
+  static const char * FONTS[] = {
+    "fonts/DejaVuSans-Regular.otf",  "fonts/DejaVuSans-Bold.otf",
+    "fonts/DejaVuSerif-Regular.otf", "fonts/DejaVuSerif-Italic.otf"
+  };
+  static constexpr int32_t PAGES = 200;
+
+  struct Entry {
+    int8_t               font;
+    int16_t              size;
+    uint32_t             code;
+    std::vector<uint8_t> bitmap;
+  };
+  std::vector<Entry> entries;
+
+  for (int8_t f = 0; f < 4; f++) {
+    TTF font(sdcard(FONTS[f]));
+    if (!font.is_ready()) GTEST_SKIP() << FONTS[f] << " not available.";
+    for (int16_t size = 16; size < 48; size += 2) {
+      for (uint32_t code = 0x21; code < 0x2100; code++) {
+        Font::Glyph * glyph = font.get_glyph(code, size);
+        if ((glyph == nullptr) || (glyph->buffer == nullptr)) continue;
+        entries.push_back({ f, size, code, 
+          std::vector<uint8_t>(glyph->buffer, glyph->buffer + glyph->pitch * glyph->dim.height) });
+      }
+    }
+  }
+
+  // Mix the entries: the most frequent glyphs are of any face and size
+  std::mt19937 gen(1234);
+  std::shuffle(entries.begin(), entries.end(), gen);
+
+  std::vector<double> weights;
+  for (size_t i = 0; i < entries.size(); i++) weights.push_back(1.0 / (i + 1));
+
+  int32_t unlimited_peak = 0;
+
+  for (int32_t budget : { 0x7FFFFFFF, 2048 * 1024, 1024 * 1024 }) {
+    Fonts book_fonts;
+    for (auto * name : FONTS) ASSERT_TRUE(book_fonts.add(name, Fonts::FaceStyle::NORMAL, sdcard(name)));
+
+    std::discrete_distribution<> dist(weights.begin(), weights.end());
+    gen.seed(4321);
+
+    int32_t  lookups = 0, peak = 0, trims = 0, mismatches = 0;
+    int16_t  slab_count = 0;
+    uint16_t generation = book_fonts.get_generation();
+
+    for (int32_t page = 0; page < PAGES; page++) {
+      for (int16_t i = 0; i < 800; i++) {
+        Entry       & e     = entries[dist(gen)];
+        Font::Glyph * glyph = book_fonts.get(e.font)->get_glyph(e.code, e.size);
+        lookups++;
+        if ((glyph == nullptr) || (glyph->buffer == nullptr) ||
+            (memcmp(glyph->buffer, e.bitmap.data(), e.bitmap.size()) != 0)) mismatches++;
+      }
+      if (Font::get_slabs_size() > peak) peak = Font::get_slabs_size();
+
+      slab_count = resident_slab_count(book_fonts, 4);
+      if (book_fonts.trim_glyph_caches(budget)) {
+        trims++;
+        EXPECT_EQ(book_fonts.get_generation(), (uint16_t)(generation + 1));
+        EXPECT_LT(resident_slab_count(book_fonts, 4), slab_count);
+        EXPECT_LE(Font::get_slabs_size(), budget);
+      }
+      else {
+        EXPECT_EQ(book_fonts.get_generation(), generation);
+        EXPECT_EQ(resident_slab_count(book_fonts, 4), slab_count);
+      }
+      generation = book_fonts.get_generation();
+    }
+
+    int32_t rasterized = 0;
+    for (int16_t idx = 0; idx < 4; idx++) rasterized += book_fonts.get(idx)->get_rasterized_count();
+
+    if (budget == 0x7FFFFFFF) unlimited_peak = peak;
+
+    EXPECT_EQ(mismatches, 0);
+    EXPECT_LT(rasterized, lookups);
+    if (budget == 0x7FFFFFFF) {
+      EXPECT_EQ(trims, 0);
+    }
+    else {
+      EXPECT_GT(trims, 0);
+      EXPECT_LE(Font::get_slabs_size(), budget);
+      EXPECT_LT(peak, unlimited_peak);
+    }
+  }
+}
+
+static const char * ATLAS_FOLDER = "/tmp/glyph_atlas_tests";
+
+static void
+clear_atlas_folder()
+{
+  DIR * dir = opendir(ATLAS_FOLDER);
+  if (dir == nullptr) return;
+  struct dirent * de;
+  while ((de = readdir(dir)) != nullptr) {
+    if (de->d_name[0] != '.') remove((std::string(ATLAS_FOLDER) + '/' + de->d_name).c_str());
+  }
+  closedir(dir);
+}
+
+// The first page of a book: every glyph is rasterized, then retrieved
+// unchanged from the atlas saved in a previous session.
+TEST(TTFTest, glyph_atlas) {
+  std::vector<std::string> words;
+  if (!load_book_text(BOOK.c_str(), words)) GTEST_SKIP() << BOOK << " not available.";
+  if (words.size() > 400) words.resize(400);
+
+  std::vector<uint32_t> codes;
+  for (auto & word : words) {
+    for (const char * s = word.c_str(); *s; s++) codes.push_back((uint8_t) *s);
+  }
+  for (uint32_t code : { 0x2019, 0x201C, 0x201D, 0x3B1, 0x416 }) codes.push_back(code);
+
+  static constexpr int16_t SIZES[] = { 12, 15 };
+
+  AtlasFolder atlas_folder(ATLAS_FOLDER);
+  clear_atlas_folder();
+
+  std::vector<std::vector<uint8_t>> bitmaps;
+  std::vector<int16_t>              advances;
+
+  for (int session = 0; session < 2; session++) {
+    TTF font(FONT_FILENAME);
+    if (!font.is_ready()) GTEST_SKIP() << FONT_FILENAME << " not available.";
+
+    int32_t i = 0;
+    for (int16_t size : SIZES) {
+      for (uint32_t code : codes) {
+        Font::Glyph * glyph   = font.get_glyph(code, size);
+        int16_t       advance = -1;
+        std::vector<uint8_t> bitmap;
+        if (glyph != nullptr) {
+          advance = glyph->advance;
+          if (glyph->buffer != nullptr) bitmap.assign(glyph->buffer, glyph->buffer + glyph->pitch * glyph->dim.height);
+        }
+        if (session == 0) {
+          bitmaps.push_back(bitmap);
+          advances.push_back(advance);
+        }
+        else {
+          ASSERT_EQ(bitmaps[i], bitmap);
+          ASSERT_EQ(advances[i], advance);
+        }
+        i++;
+      }
+    }
+
+    if (session == 0) EXPECT_GT(font.get_rasterized_count(), 0);
+    else              EXPECT_EQ(font.get_rasterized_count(), 0);
+
+    font.flush_glyphs();
+  }
+}
+
+TEST(TTFTest, glyph_atlas_invalidation) {
+  AtlasFolder atlas_folder(ATLAS_FOLDER);
+  clear_atlas_folder();
+
+  std::string filename;
+  {
+    TTF font(FONT_FILENAME);
+    if (!font.is_ready()) GTEST_SKIP() << FONT_FILENAME << " not available.";
+    ASSERT_NE(font.get_glyph('a', 12), nullptr);
+    font.flush_glyphs();
+    filename = GlyphAtlas::filename_of(font.get_font_hash(), 12, (uint8_t) screen.get_pixel_resolution());
+  }
+
+  // Another font has another atlas
+  {
+    TTF font(SANS_FILENAME);
+    if (font.is_ready()) {
+      ASSERT_NE(font.get_glyph('a', 12), nullptr);
+      EXPECT_EQ(font.get_rasterized_count(), 1);
+    }
+  }
+
+  // Damaged header: started over
+  {
+    FILE * f = fopen(filename.c_str(), "r+b");
+    ASSERT_NE(f, nullptr);
+    fputc('X', f);
+    fclose(f);
+  }
+  for (int i = 0; i < 2; i++) {
+    TTF font1(FONT_FILENAME);
+    TTF font2(SANS_FILENAME);
+    ASSERT_NE(font1.get_glyph('a', 12), nullptr);
+    ASSERT_NE(font2.get_glyph('a', 12), nullptr);
+    EXPECT_EQ(font1.get_rasterized_count() + font2.get_rasterized_count(), (i == 0) ? 1 : 0);
+  }
+
+  // Partially written record: started over
+  struct stat stat_buf;
+  ASSERT_EQ(stat(filename.c_str(), &stat_buf), 0);
+  ASSERT_EQ(truncate(filename.c_str(), stat_buf.st_size - 1), 0);
+  for (int i = 0; i < 2; i++) {
+    TTF font1(FONT_FILENAME);
+    TTF font2(SANS_FILENAME);
+    ASSERT_NE(font1.get_glyph('a', 12), nullptr);
+    ASSERT_NE(font2.get_glyph('a', 12), nullptr);
+    EXPECT_EQ(font1.get_rasterized_count() + font2.get_rasterized_count(), (i == 0) ? 1 : 0);
+  }
+}
+
+static bool
+read_file(const char * filename, std::vector<uint8_t> & data)
+{
+  FILE * f = fopen(filename, "rb");
+  if (f == nullptr) return false;
+  fseek(f, 0, SEEK_END);
+  data.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  bool ok = fread(data.data(), data.size(), 1, f) == 1;
+  fclose(f);
+  return ok;
+}
+
+static void
+expect_same_glyphs(TTF & expected, TTF & font, const std::vector<uint32_t> & codes, int16_t size)
+{
+  for (uint32_t code : codes) {
+    Font::Glyph * e = expected.get_glyph(code, size);
+    Font::Glyph * g = font.get_glyph(code, size);
+    ASSERT_EQ(e == nullptr, g == nullptr);
+    if (e == nullptr) continue;
+    ASSERT_EQ(e->advance,    g->advance);
+    ASSERT_EQ(e->dim.height, g->dim.height);
+    ASSERT_EQ(e->pitch,      g->pitch);
+    if (e->buffer != nullptr) {
+      ASSERT_EQ(memcmp(e->buffer, g->buffer, e->pitch * e->dim.height), 0);
+    }
+  }
+}
+
+// A font read on demand: the resident memory stays within the block cache,
+// and the glyphs are the same as with the font loaded in memory. The font
+// used is larger than the block cache.
+TEST(TTFTest, font_stream) {
+  const char * filename = SANS_FILENAME.c_str();
+
+  std::vector<uint8_t> data;
+  if (!read_file(filename, data)) GTEST_SKIP() << SANS_FILENAME << " not available.";
+  ASSERT_GT(data.size(), (size_t) FontStream::BLOCK_SIZE * FontStream::BLOCK_COUNT);
+
+  // Latin, Greek and Cyrillic text
+  std::vector<uint32_t> codes;
+  for (uint32_t code = 32;    code < 0x17F; code++) codes.push_back(code);
+  for (uint32_t code = 0x391; code < 0x3CA; code++) codes.push_back(code);
+  for (uint32_t code = 0x410; code < 0x450; code++) codes.push_back(code);
+  for (uint32_t code : { 0x2013, 0x2014, 0x2018, 0x2019, 0x201C, 0x201D, 0x2026 }) codes.push_back(code);
+
+  AtlasFolder atlas_folder("/tmp/no_such_dir/glyphs");   // No atlas: every glyph is rasterized
+
+  { FontStream * stream = new FontStream(filename);
+    TTF font(stream);
+    ASSERT_TRUE(font.is_ready());
+    for (int16_t size : { 10, 12, 14, 16 }) {
+      for (uint32_t code : codes) font.get_glyph(code, size);
+    }
+    EXPECT_GT(stream->get_block_reads(), 0);
+    EXPECT_LE(stream->get_resident_size(), FontStream::BLOCK_SIZE * FontStream::BLOCK_COUNT);
+    EXPECT_LT(stream->get_resident_size(), (int32_t) data.size());
+  }
+
+  unsigned char * copy = (unsigned char *) malloc(data.size());
+  memcpy(copy, data.data(), data.size());
+  TTF in_memory(copy, data.size());
+  TTF streamed(new FontStream(filename));
+  expect_same_glyphs(in_memory, streamed, codes, 12);
+}
+
+// A font inside a larger file, obfuscated as in EPub files
+TEST(TTFTest, font_stream_obfuscated) {
+  static const uint32_t OFFSET = 1234;
+
+  std::string filename = testing::TempDir() + "font_stream_tests.bin";
+
+  std::vector<uint8_t> data;
+  if (!read_file(FONT_FILENAME.c_str(), data)) GTEST_SKIP() << FONT_FILENAME << " not available.";
+
+  uint8_t key[20];
+  for (int i = 0; i < 20; i++) key[i] = 17 * i + 3;
+
+  std::vector<uint8_t> content(OFFSET + data.size() + 100, 0x55);
+  std::fill(content.begin(), content.begin() + OFFSET, 0xAA);
+  memcpy(&content[OFFSET], data.data(), data.size());
+  for (uint32_t i = 0; i < 1040; i++) content[OFFSET + i] ^= key[i % 20];
+
+  FILE * f = fopen(filename.c_str(), "wb");
+  ASSERT_NE(f, nullptr);
+  ASSERT_EQ(fwrite(content.data(), content.size(), 1, f), 1u);
+  fclose(f);
+
+  FontStream * stream = new FontStream(filename.c_str(), OFFSET, data.size());
+  stream->set_key(key, 20, 1040);
+
+  std::vector<uint8_t> read_back(3000);
+  ASSERT_EQ(stream->read(10, read_back.data(), read_back.size()), read_back.size());
+  EXPECT_EQ(memcmp(read_back.data(), &data[10], read_back.size()), 0);
+
+  std::vector<uint32_t> codes;
+  for (uint32_t code = 32; code < 127; code++) codes.push_back(code);
+
+  TTF expected(FONT_FILENAME);
+  TTF font(stream);
+  ASSERT_TRUE(font.is_ready());
+  expect_same_glyphs(expected, font, codes, 14);
+
+  remove(filename.c_str());
+}
+
+// The SDCard fonts are subsets without kerning: the complete font they are
+// made from is used.
+static const std::string KERN_FONT_FILENAME = tree("fonts/orig/DejaVuSans-Regular.ttf");
+
+// The GPOS kerning of a complete font, compared with its 'kern' table as
+// read by FreeType. Both are generated from the same data for this font.
+TEST(TTFTest, kern_table) {
+  FT_Library library;
+  FT_Face    face;
+  ASSERT_EQ(FT_Init_FreeType(&library), 0);
+  if (FT_New_Face(library, KERN_FONT_FILENAME.c_str(), 0, &face) != 0) {
+    FT_Done_FreeType(library);
+    GTEST_SKIP() << KERN_FONT_FILENAME << " not available.";
+  }
+
+  KernTable table;
+  ASSERT_TRUE(table.load(face));
+
+  int32_t pairs = 0, same = 0;
+  for (uint32_t left = 32; left < 127; left++) {
+    for (uint32_t right = 32; right < 127; right++) {
+      FT_UInt l = FT_Get_Char_Index(face, left);
+      FT_UInt r = FT_Get_Char_Index(face, right);
+      FT_Vector v;
+      ASSERT_EQ(FT_Get_Kerning(face, l, r, FT_KERNING_UNSCALED, &v), 0);
+      if ((v.x != 0) || (table.get(l, r) != 0)) {
+        pairs++;
+        if (v.x == table.get(l, r)) same++;
+      }
+    }
+  }
+
+  EXPECT_GT(pairs, 100);
+  EXPECT_GE(same * 100, pairs * 95);
+  EXPECT_LT(table.get(FT_Get_Char_Index(face, 'A'), FT_Get_Char_Index(face, 'V')), 0);
+  EXPECT_EQ(table.get(FT_Get_Char_Index(face, 'a'), FT_Get_Char_Index(face, 'b')), 0);
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+}
+
+TEST(TTFTest, kern_pairs) {
+  KernPairs pairs;
+  int16_t   kern;
+
+  EXPECT_FALSE(pairs.find('A', 'V', 12, kern));
+  for (uint32_t left = 0; left < 1000; left++) {
+    EXPECT_TRUE(pairs.insert(left, 0x10FFFF - left, 12, (int16_t)(left % 2047) - 1023));
+  }
+  EXPECT_TRUE(pairs.insert('A', 'V', 14, -3));
+  EXPECT_EQ(pairs.get_count(), 1001);
+
+  for (uint32_t left = 0; left < 1000; left++) {
+    ASSERT_TRUE(pairs.find(left, 0x10FFFF - left, 12, kern));
+    EXPECT_EQ(kern, (int16_t)(left % 2047) - 1023);
+  }
+  ASSERT_TRUE(pairs.find('A', 'V', 14, kern));
+  EXPECT_EQ(kern, -3);
+  EXPECT_FALSE(pairs.find('A', 'V', 12, kern));
+
+  pairs.clear();
+  EXPECT_FALSE(pairs.find('A', 'V', 14, kern));
+}
+
+// Kerned advances: same from the metrics and the bitmaps, and the same
+// once retrieved from the glyph atlas of a previous session.
+TEST(TTFTest, kerning) {
+  static const char * TEXT = "AVATAR Tomorrow, WAVE. Yes! \"LT\" fjord";
+
+  AtlasFolder atlas_folder(ATLAS_FOLDER);
+  clear_atlas_folder();
+
+  std::vector<int16_t> kerns[2];
+  for (int session = 0; session < 2; session++) {
+    TTF font(KERN_FONT_FILENAME);
+    if (!font.is_ready()) GTEST_SKIP() << KERN_FONT_FILENAME << " not available.";
+
+    for (const char * s = TEXT; *s; s++) {
+      int16_t kern, metrics_kern;
+      bool    ignore_next;
+      Font::Glyph * glyph = font.get_glyph(*s, s[1], 12, kern, ignore_next);
+      ASSERT_NE(glyph, nullptr);
+      font.get_glyph_metrics(*s, s[1], 12, metrics_kern, ignore_next);
+      EXPECT_EQ(kern, metrics_kern);
+      EXPECT_EQ(kern, glyph->advance + font.get_kern(*s, s[1], 12));
+      kerns[session].push_back(kern);
+    }
+
+    EXPECT_LT(font.get_kern('A', 'V', 12), 0);
+    EXPECT_EQ(font.get_kern('A', 0,   12), 0);
+    font.flush_glyphs();
+  }
+
+  EXPECT_EQ(kerns[0], kerns[1]);
+
+  // A font without kerning
+  TTF font(FONT_FILENAME);
+  if (font.is_ready()) {
+    EXPECT_EQ(font.get_kern('A', 'V', 12), 0);
+  }
+}
+
+// The words of a book laid out with kerning are narrower than without (the
+// next code point not supplied), and a second layout, every pair being then
+// known, gives the same width.
+TEST(TTFTest, kerning_layout) {
+  std::vector<std::string> words;
+  if (!load_book_text(BOOK.c_str(), words)) GTEST_SKIP() << BOOK << " not available.";
+
+  AtlasFolder atlas_folder("/tmp/no_such_dir/glyphs");
+
+  TTF font(KERN_FONT_FILENAME);
+  if (!font.is_ready()) GTEST_SKIP() << KERN_FONT_FILENAME << " not available.";
+
+  int64_t widths[3] = { 0, 0, 0 };
+
+  for (int pass = 0; pass < 3; pass++) {
+    bool kerning = pass > 0;
+    for (auto & word : words) {
+      for (const char * s = word.c_str(); *s; s++) {
+        int16_t kern;
+        bool    ignore_next;
+        if (font.get_glyph_metrics((uint8_t) *s, kerning ? (uint8_t) s[1] : 0, 12, kern, ignore_next) != nullptr) widths[pass] += kern;
+      }
+    }
+  }
+
+  EXPECT_LT(widths[1], widths[0]);
+  EXPECT_EQ(widths[1], widths[2]);
+}
+
+#endif
@@ -0,0 +1,171 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#define __WORD_CACHE__ 1
+#include "models/word_cache.hpp"
+
+#include "alloc.hpp"
+#include "logging.hpp"
+
+#include <cstring>
+
+WordCache::WordCache(int32_t slot_count) :
+  slots(nullptr),
+  recent(nullptr),
+  set_count(0),
+  generation(0),
+  hits(0),
+  misses(0),
+  shaping_time(0)
+{
+  // Two slots per set, the number of sets being a power of two
+  if (slot_count >= 2) {
+    set_count = 1;
+    while ((set_count << 1) <= (slot_count >> 1)) set_count <<= 1;
+  }
+}
+
+WordCache::~WordCache()
+{
+  if (slots  != nullptr) free(slots);
+  if (recent != nullptr) free(recent);
+}
+
+uint32_t
+WordCache::hash_of(const Key & key, const char * word, uint8_t length)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261U;
+  auto add = [&hash](uint8_t byte) { hash = (hash ^ byte) * 16777619U; };
+
+  add(key.font_index); add(key.font_index >> 8);
+  add(key.font_size);  add(key.font_size  >> 8);
+  add(key.transform);
+  for (uint8_t i = 0; i < length; i++) add(word[i]);
+
+  return (hash == 0) ? 1 : hash;
+}
+
+// The slots are allocated on first use: on ESP32, the PSRAM is not
+// available when the global instance is created. The generation only moves
+// forward (modulo 2^16): a caller still using an older one gets nothing and
+// doesn't change the cache, its glyphs being no longer valid.
+bool
+WordCache::check_generation(uint16_t gen)
+{
+  if (set_count == 0) return false;
+
+  if (slots == nullptr) {
+    slots  = (Slot *)    allocate(set_count * 2 * sizeof(Slot));
+    recent = (uint8_t *) allocate(set_count);
+    if ((slots == nullptr) || (recent == nullptr)) {
+      LOG_E("Unable to allocate the word cache.");
+      if (slots  != nullptr) free(slots);
+      if (recent != nullptr) free(recent);
+      slots     = nullptr;
+      recent    = nullptr;
+      set_count = 0;
+      return false;
+    }
+    memset(slots,  0, set_count * 2 * sizeof(Slot));
+    memset(recent, 0, set_count);
+    generation = gen;
+  }
+  else if (gen != generation) {
+    if ((int16_t)(gen - generation) < 0) return false;
+    memset(slots,  0, set_count * 2 * sizeof(Slot));
+    generation = gen;
+  }
+  return true;
+}
+
+WordCache::Slot *
+WordCache::find(const Key & key, const char * word, uint8_t length, uint32_t hash)
+{
+  Slot * set = &slots[(hash & (set_count - 1)) << 1];
+
+  for (int8_t i = 0; i < 2; i++) {
+    Slot & slot = set[i];
+    if ((slot.hash           == hash          ) &&
+        (slot.length         == length        ) &&
+        (slot.key.font_index == key.font_index) &&
+        (slot.key.font_size  == key.font_size ) &&
+        (slot.key.transform  == key.transform ) &&
+        (memcmp(slot.word, word, length) == 0)) {
+      recent[hash & (set_count - 1)] = i;
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+bool
+WordCache::get(const Key & key, const char * word, bool rasterized, Run & run)
+{
+  size_t length = strlen(word);
+  if (length > MAX_WORD_LENGTH) return false;
+
+  uint32_t hash = hash_of(key, word, length);
+  Slot   * slot;
+
+  { std::scoped_lock guard(mutex);
+
+    if (check_generation(key.generation)) {
+      slot = find(key, word, length, hash);
+      if ((slot != nullptr) && (slot->run.rasterized || !rasterized)) {
+        run = slot->run;
+        hits++;
+        return true;
+      }
+    }
+  }
+
+  misses++;
+  return false;
+}
+
+void
+WordCache::put(const Key & key, const char * word, const Run & run, int32_t time)
+{
+  shaping_time += time;
+
+  size_t length = strlen(word);
+  if (length > MAX_WORD_LENGTH) return;
+
+  uint32_t hash = hash_of(key, word, length);
+
+  std::scoped_lock guard(mutex);
+
+  if (!check_generation(key.generation)) return;
+
+  // The word may already be there with glyph metrics only
+  Slot * slot = find(key, word, length, hash);
+  if (slot == nullptr) {
+    int32_t set_idx = hash & (set_count - 1);
+    int8_t  i       = recent[set_idx] ^ 1;
+    slot            = &slots[(set_idx << 1) + i];
+    recent[set_idx] = i;
+  }
+
+  slot->hash   = hash;
+  slot->key    = key;
+  slot->length = length;
+  slot->run    = run;
+  memcpy(slot->word, word, length);
+}
+
+void
+WordCache::clear()
+{
+  std::scoped_lock guard(mutex);
+
+  if (slots != nullptr) memset(slots, 0, set_count * 2 * sizeof(Slot));
+  hits = misses = shaping_time = 0;
+}
+
+int32_t
+WordCache::get_time_saved() const
+{
+  return (misses == 0) ? 0 : (int64_t) shaping_time * hits / misses;
+}
@@ -0,0 +1,171 @@
+#if TESTING && EPUB_LINUX_BUILD
+
+#include "gtest/gtest.h"
+#include "models/word_cache.hpp"
+
+static Font::Glyph glyphs[4];
+
+static WordCache::Run
+make_run(int8_t count, bool rasterized)
+{
+  WordCache::Run run;
+  run.glyph_count = count;
+  run.width       = 0;
+  run.rasterized  = rasterized;
+  for (int8_t i = 0; i < count; i++) {
+    run.glyphs[i] = &glyphs[i & 3];
+    run.kerns[i]  = 5 + i;
+    run.width    += run.kerns[i];
+  }
+  return run;
+}
+
+TEST(WordCacheTest, put_and_get) {
+  WordCache cache(64);
+  WordCache::Key key = { 1, 12, 0, 0 };
+  WordCache::Run run;
+
+  EXPECT_FALSE(cache.get(key, "word", false, run));
+
+  cache.put(key, "word", make_run(4, true), 100);
+  ASSERT_TRUE(cache.get(key, "word", true, run));
+  EXPECT_EQ(run.glyph_count, 4);
+  EXPECT_EQ(run.width, 5 + 6 + 7 + 8);
+  EXPECT_EQ(run.glyphs[2], &glyphs[2]);
+  EXPECT_EQ(run.kerns[3], 8);
+
+  EXPECT_FALSE(cache.get(key, "words", false, run));
+  EXPECT_FALSE(cache.get(key, "wor",   false, run));
+}
+
+TEST(WordCacheTest, key_discrimination) {
+  WordCache cache(64);
+  WordCache::Key key = { 1, 12, 0, 0 };
+  WordCache::Run run;
+
+  cache.put(key, "word", make_run(4, true), 100);
+
+  WordCache::Key other_font      = { 2, 12, 0, 0 };
+  WordCache::Key other_size      = { 1, 14, 0, 0 };
+  WordCache::Key other_transform = { 1, 12, 1, 0 };
+
+  EXPECT_FALSE(cache.get(other_font,      "word", false, run));
+  EXPECT_FALSE(cache.get(other_size,      "word", false, run));
+  EXPECT_FALSE(cache.get(other_transform, "word", false, run));
+  EXPECT_TRUE (cache.get(key,             "word", false, run));
+}
+
+TEST(WordCacheTest, metrics_only_runs) {
+  WordCache cache(64);
+  WordCache::Key key = { 1, 12, 0, 0 };
+  WordCache::Run run;
+
+  cache.put(key, "word", make_run(4, false), 100);
+  EXPECT_TRUE (cache.get(key, "word", false, run));
+  EXPECT_FALSE(cache.get(key, "word", true,  run));
+
+  // Rasterized glyphs replace the metrics
+  cache.put(key, "word", make_run(4, true), 100);
+  EXPECT_TRUE(cache.get(key, "word", true,  run));
+  EXPECT_TRUE(run.rasterized);
+  EXPECT_TRUE(cache.get(key, "word", false, run));
+}
+
+TEST(WordCacheTest, fonts_generation) {
+  WordCache cache(64);
+  WordCache::Key key = { 1, 12, 0, 0 };
+  WordCache::Run run;
+
+  cache.put(key, "word", make_run(4, true), 100);
+  key.generation = 1;
+  EXPECT_FALSE(cache.get(key, "word", false, run));
+  key.generation = 0;
+  EXPECT_FALSE(cache.get(key, "word", false, run));
+}
+
+TEST(WordCacheTest, stale_generation) {
+  WordCache cache(64);
+  WordCache::Key old_key = { 1, 12, 0, 1 };
+  WordCache::Key new_key = { 1, 12, 0, 2 };
+  WordCache::Run run;
+
+  cache.put(old_key, "word", make_run(4, true), 100);
+
+  // A newer generation is seen, then a late caller still uses the old one
+  EXPECT_FALSE(cache.get(new_key, "word", false, run));
+  cache.put(new_key, "other", make_run(5, true), 100);
+  cache.put(old_key, "word",  make_run(4, true), 100);
+
+  EXPECT_FALSE(cache.get(old_key, "word",  false, run));
+  EXPECT_FALSE(cache.get(new_key, "word",  false, run));
+  EXPECT_TRUE (cache.get(new_key, "other", false, run));
+  EXPECT_EQ(run.glyph_count, 5);
+
+  // The generation wraps around
+  WordCache wrapping(64);
+  WordCache::Key last_key = { 1, 12, 0, 0xFFFF };
+  WordCache::Key next_key = { 1, 12, 0, 0      };
+  wrapping.put(last_key, "word", make_run(4, true), 100);
+  EXPECT_TRUE (wrapping.get(last_key, "word", false, run));
+  EXPECT_FALSE(wrapping.get(next_key, "word", false, run));
+  wrapping.put(last_key, "word", make_run(4, true), 100);
+  EXPECT_FALSE(wrapping.get(last_key, "word", false, run));
+  EXPECT_FALSE(wrapping.get(next_key, "word", false, run));
+}
+
+TEST(WordCacheTest, long_words_not_kept) {
+  WordCache cache(64);
+  WordCache::Key key = { 1, 12, 0, 0 };
+  WordCache::Run run;
+
+  const char * word = "abcdefghijklmnopqrstuvwxyz";
+  cache.put(key, word, make_run(WordCache::MAX_WORD_LENGTH, true), 100);
+  EXPECT_FALSE(cache.get(key, word, false, run));
+}
+
+TEST(WordCacheTest, bounded) {
+  WordCache cache(16);
+  WordCache::Key key = { 1, 12, 0, 0 };
+  WordCache::Run run;
+  char word[8];
+
+  for (int i = 0; i < 1000; i++) {
+    snprintf(word, 8, "w%d", i);
+    cache.put(key, word, make_run(3, true), 10);
+  }
+
+  int found = 0;
+  for (int i = 0; i < 1000; i++) {
+    snprintf(word, 8, "w%d", i);
+    if (cache.get(key, word, false, run)) found++;
+  }
+  EXPECT_GT(found, 0);
+  EXPECT_LE(found, 16);
+
+  // The most recently used word of a set is kept
+  cache.put(key, "last", make_run(3, true), 10);
+  EXPECT_TRUE(cache.get(key, "last", false, run));
+}
+
+TEST(WordCacheTest, stats) {
+  WordCache cache(64);
+  WordCache::Key key = { 1, 12, 0, 0 };
+  WordCache::Run run;
+
+  EXPECT_FALSE(cache.get(key, "word", false, run));
+  cache.put(key, "word", make_run(4, true), 200);
+  for (int i = 0; i < 3; i++) EXPECT_TRUE(cache.get(key, "word", false, run));
+
+  WordCache::Stats stats = cache.get_stats();
+  EXPECT_EQ(stats.hits,         3);
+  EXPECT_EQ(stats.misses,       1);
+  EXPECT_EQ(stats.shaping_time, 200);
+  EXPECT_EQ(cache.get_hit_rate(),   75);
+  EXPECT_EQ(cache.get_time_saved(), 600);
+
+  cache.clear();
+  EXPECT_EQ(cache.get_hit_rate(), 0);
+  EXPECT_FALSE(cache.get(key, "word", false, run));
+}
+
+#endif
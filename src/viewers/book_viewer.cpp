@@ -11,6 +11,7 @@
 #include "viewers/html_interpreter.hpp"
 #include "viewers/screen_bottom.hpp"
 #include "models/image_factory.hpp"
+#include "helpers/bounded_queue.hpp"
 
 #if EPUB_INKPLATE_BUILD
   #include "viewers/battery_viewer.hpp"
@@ -24,6 +25,7 @@
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include <chrono>
 
 #include "logging.hpp"
 
@@ -42,157 +44,488 @@ class BookViewerInterp : public HTMLInterpreter
     }
 };
 
-void
-BookViewer::build_page_at(const PageLocs::PageId & page_id)
+// Lays out pages one after the other, only for their glyphs to be
+// rasterized: the pages are not kept.
+class WarmUpInterp : public HTMLInterpreter 
 {
-  LOG_D("build_page_at()");
-  #if EPUB_INKPLATE_BUILD && (LOG_LOCAL_LEVEL == ESP_LOG_VERBOSE)
-    ESP::show_heaps_info();
-  #endif
+  public:
+    WarmUpInterp(Page & the_page, DOM & the_dom, const EPub::ItemInfo & the_item, const std::atomic<bool> & the_active) : 
+      HTMLInterpreter(the_page, the_dom, Page::ComputeMode::DISPLAY, the_item),
+      active(the_active) {}
+   ~WarmUpInterp() {}
+
+    inline int32_t get_current_offset() const { return current_offset; }
+
+  private:
+    const std::atomic<bool> & active;
+
+  protected:
+    bool page_end(const Page::Format & fmt) { 
+      page.start(fmt);
+      return active && !at_end(); 
+    }
+};
+
+// Requests sent to the render-ahead task after a page is shown, or to 
+// warm up the glyphs when a book is opened (next_page_id is the page to be
+// shown).
+struct RenderRequest {
+  bool               warm_up;
+  PageLocs::PageId   next_page_id;
+  PageLocs::PageId   prev_page_id;
+  PageLocs::PageInfo next_page_info;
+  PageLocs::PageInfo prev_page_info;
+  uint32_t           format_key;
+  uint16_t           generation;
+  Page::Format       fmt;
+};
+
+static BoundedQueue<RenderRequest, 4> render_queue;
+
+#if !EPUB_LINUX_BUILD
+  #include <esp_pthread.h>
+#endif
+
+uint32_t
+BookViewer::get_format_key()
+{
+  #pragma pack(push, 1)
+  struct {
+    EPub::BookFormatParams params;
+    uint16_t               fonts_generation;
+  } key_data;
+  #pragma pack(pop)
 
+  key_data.params           = *epub.get_book_format_params();
+  key_data.fonts_generation = fonts.get_generation();
+
+  return LocsProfiles::key_of(&key_data, sizeof(key_data));
+}
+
+void
+BookViewer::get_page_format(Page::Format & fmt, int16_t & title_baseline_offset)
+{
   Font * font = fonts.get(ScreenBottom::FONT);
   page_bottom = font->get_chars_height(ScreenBottom::FONT_SIZE) + 15;
 
-  //page.set_compute_mode(Page::ComputeMode::MOVE);
+  int16_t idx;
 
-  //show_images = epub.get_book_format_params()->show_images != 0;
+  int8_t show_title;
+  config.get(Config::Ident::SHOW_TITLE, &show_title);
 
-  if (epub.get_item_at_index(page_id.itemref_index)) {
+  int16_t page_top      = 0;
+  title_baseline_offset = 0;
 
-    int16_t idx;
+  if (show_title != 0) {
+    Font * title_font     = fonts.get(TITLE_FONT);
+    page_top              = title_font->get_chars_height(TITLE_FONT_SIZE) + 10;
+    title_baseline_offset = page_top + 
+                            title_font->get_descender_height(TITLE_FONT_SIZE);
+  }
 
-    int8_t show_title;
-    config.get(Config::Ident::SHOW_TITLE, &show_title);
+  if ((idx = fonts.get_index("Fontbase", Fonts::FaceStyle::NORMAL)) == -1) {
+    idx = 3;
+  }
 
-    int16_t page_top              = 0;
-    int16_t title_baseline_offset = 0;
+  int8_t font_size = epub.get_book_format_params()->font_size;
 
-    if (show_title != 0) {
-      Font * title_font     = fonts.get(TITLE_FONT);
-      page_top              = title_font->get_chars_height(TITLE_FONT_SIZE) + 10;
-      title_baseline_offset = page_top + 
-                              title_font->get_descender_height(TITLE_FONT_SIZE);
+  fmt = {
+    .line_height_factor = 0.95,
+    .font_index         = idx,
+    .font_size          = font_size,
+    .indent             =   0,
+    .margin_left        =   0,
+    .margin_right       =   0,
+    .margin_top         =   0,
+    .margin_bottom      =   0,
+    .screen_left        =  10,
+    .screen_right       =  10,
+    .screen_top         = page_top,
+    .screen_bottom      = page_bottom,
+    .width              =   0,
+    .height             =   0,
+    .vertical_align     =   0,
+    .trim               = true,
+    .pre                = false,
+    .font_style         = Fonts::FaceStyle::NORMAL,
+    .align              = CSS::Align::LEFT,
+    .text_transform     = CSS::TextTransform::NONE,
+    .display            = CSS::Display::INLINE
+  };
+}
+
+bool
+BookViewer::build_page_body(Page                   & the_page,
+                            const PageLocs::PageId & page_id,
+                            int32_t                  page_size,
+                            const EPub::ItemInfo   & item, 
+                            const Page::Format     & fmt)
+{
+  bool done = false;
+
+  DOM              * dom    = new DOM;
+  BookViewerInterp * interp = new BookViewerInterp(the_page, * dom, 
+                                                   Page::ComputeMode::DISPLAY, 
+                                                   item);
+  interp->set_limits(page_id.offset, 
+                     page_id.offset + page_size,
+                     epub.get_book_format_params()->show_images != 0);
+
+  // Go directly to the page start instead of laying out the item from its beginning
+  PageCheckpoints::Step path[PageCheckpoints::MAX_PATH_LENGTH];
+  int16_t               path_length;
+  if (page_locs.get_page_checkpoint(page_id, path, path_length)) {
+    interp->set_resume_path(path, path_length);
+  }
+
+  #if DEBUGGING_AID
+    interp->set_pages_to_show_state(PAGE_FROM, PAGE_TO);
+    interp->check_page_to_show(page_locs.get_page_nbr(page_id));
+  #endif
+
+  xml_node node;
+
+  if ((node = item.xml_doc.child("html").child("body"))) {
+
+    the_page.start(fmt);
+
+  #if EPUB_INKPLATE_BUILD && !defined(BOARD_TYPE_PAPER_S3)
+    esp_task_wdt_reset();
+  #endif
+
+    Page::Format * new_fmt = interp->duplicate_fmt(fmt);
+
+    if (interp->build_pages_recurse(node, *new_fmt, dom->body, 1)) {
+      if (the_page.some_data_waiting()) the_page.end_paragraph(fmt);
+      done = true;
     }
+    interp->show_stat();
+    interp->release_fmt(new_fmt);
+  }
+
+  interp->check_for_completion();
 
-    if ((idx = fonts.get_index("Fontbase", Fonts::FaceStyle::NORMAL)) == -1) {
-      idx = 3;
+  delete dom;
+  delete interp;
+
+  return done;
+}
+
+void
+BookViewer::add_title_and_bottom(const PageLocs::PageId & page_id, Page::Format fmt, int16_t title_baseline_offset)
+{
+  fmt.line_height_factor = 1.0;
+  fmt.font_index         = TITLE_FONT;
+  fmt.font_size          = TITLE_FONT_SIZE;
+  fmt.font_style         = Fonts::FaceStyle::ITALIC;
+  fmt.align              = CSS::Align::CENTER;
+  
+  std::ostringstream ostr;
+
+  if (title_baseline_offset != 0) {
+    const char * t = epub.get_title();
+    if (strlen(t) > 50) {
+      // Only the first 50 characters of the title will be shown
+      char str[55];
+      strncpy(str, t, 50);
+      str[50] = 0;
+      strcat(str, "...");
+      ostr << str;
     }
+    else {
+      ostr << t;
+    } 
+    // page.put_highlight(Dim(screen.get_width(), title_baseline_offset), Pos(0, 0));
+    page.put_str_at(ostr.str(), Pos(Page::HORIZONTAL_CENTER, title_baseline_offset), fmt);
+  }
 
-    int8_t font_size = epub.get_book_format_params()->font_size;
-
-    Page::Format fmt = {
-      .line_height_factor = 0.95,
-      .font_index         = idx,
-      .font_size          = font_size,
-      .indent             =   0,
-      .margin_left        =   0,
-      .margin_right       =   0,
-      .margin_top         =   0,
-      .margin_bottom      =   0,
-      .screen_left        =  10,
-      .screen_right       =  10,
-      .screen_top         = page_top,
-      .screen_bottom      = page_bottom,
-      .width              =   0,
-      .height             =   0,
-      .vertical_align     =   0,
-      .trim               = true,
-      .pre                = false,
-      .font_style         = Fonts::FaceStyle::NORMAL,
-      .align              = CSS::Align::LEFT,
-      .text_transform     = CSS::TextTransform::NONE,
-      .display            = CSS::Display::INLINE
-    };
+  ScreenBottom::show(page_locs.get_estimated_page_nbr(page_id), 
+                     page_locs.get_estimated_page_count(),
+                     !page_locs.is_completed());
+}
+
+void
+BookViewer::build_page_at(const PageLocs::PageId & page_id)
+{
+  LOG_D("build_page_at()");
+  #if EPUB_INKPLATE_BUILD && (LOG_LOCAL_LEVEL == ESP_LOG_VERBOSE)
+    ESP::show_heaps_info();
+  #endif
+
+  //page.set_compute_mode(Page::ComputeMode::MOVE);
+
+  //show_images = epub.get_book_format_params()->show_images != 0;
+
+  // The glyphs not rasterized by now will be when building the page
+  warming_up = false;
+
+  Page::Format fmt;
+  int16_t      title_baseline_offset;
+  uint32_t     format_key = get_format_key();
+
+  get_page_format(fmt, title_baseline_offset);
+
+  // The page may have been prepared by the render-ahead task
+  Page * prepared = page_cache.take(PageCache::Key(page_id, format_key));
+  if (prepared != nullptr) {
+    page.start(fmt);
+    add_title_and_bottom(page_id, fmt, title_baseline_offset);
+    page.paint_with(*prepared);
+    page_cache.release(prepared);
+    shown_prepared = true;
+  }
+  else if (epub.get_item_at_index(page_id.itemref_index)) {
 
     mutex.unlock();
     std::this_thread::yield();
-    const PageLocs::PageInfo * page_info = page_locs.get_page_info(page_id);
+    PageLocs::PageInfo page_info;
+    bool found = page_locs.get_page_info(page_id, page_info);
     mutex.lock();
     
-    if (page_info == nullptr) return;
-
-    // current_offset       = 0;
-    // start_of_page_offset = page_id.offset;
-    // end_of_page_offset   = page_id.offset + page_info->size;
-
-    DOM              * dom    = new DOM;
-    BookViewerInterp * interp = new BookViewerInterp(page, * dom, 
-                                                     Page::ComputeMode::DISPLAY, 
-                                                     epub.get_current_item_info());
-    interp->set_limits(page_id.offset, 
-                       page_id.offset + page_info->size,
-                       epub.get_book_format_params()->show_images != 0);
-
-    #if DEBUGGING_AID
-      interp->set_pages_to_show_state(PAGE_FROM, PAGE_TO);
-      interp->check_page_to_show(page_locs.get_page_nbr(page_id));
+    if (!found) return;
+
+    #if SHOW_TIMING
+      std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+      int32_t allocation_count = page.get_allocation_count();
+      int32_t rasterized_count = fonts.get_rasterized_count();
     #endif
 
-    xml_node node;
+    if (build_page_body(page, page_id, page_info.size, epub.get_current_item_info(), fmt)) {
+      add_title_and_bottom(page_id, fmt, title_baseline_offset);
+      page.paint();
+    }
 
-    if ((node = epub.get_current_item().child("html").child("body"))) {
+    #if SHOW_TIMING
+      LOG_I("Page %d:%d built in %d ms, %d display list allocations, %d glyphs rasterized.", 
+            page_id.itemref_index, page_id.offset,
+            (int32_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - start_time).count(),
+            page.get_allocation_count() - allocation_count,
+            fonts.get_rasterized_count() - rasterized_count);
+    #endif
+  }
+  else return;
+
+  // The page is shown: the glyphs rasterized for it can be saved
+  fonts.save_glyphs();
+
+  // The page will not be painted again: glyph bitmaps can be released, if
+  // over budget, before the next pages are prepared. The render-ahead task
+  // must not be laying out a page at that time. An eviction moves the fonts
+  // generation forward: the next pages are prepared with the new key.
+  {
+    std::scoped_lock guard(render_mutex);
+    if (fonts.trim_glyph_caches()) format_key = get_format_key();
+  }
 
-      page.start(fmt);
+  render_ahead(page_id, format_key, fmt);
 
-    #if EPUB_INKPLATE_BUILD && !defined(BOARD_TYPE_PAPER_S3)
-      esp_task_wdt_reset();
-    #endif
+  LOG_D("end of build_page_at()");
+  #if EPUB_INKPLATE_BUILD && (LOG_LOCAL_LEVEL == ESP_LOG_VERBOSE)
+    ESP::show_heaps_info();
+  #endif
+}
 
-      Page::Format * new_fmt = interp->duplicate_fmt(fmt);
+void
+BookViewer::start_render_task()
+{
+  if (render_task_started) return;
+
+  #if EPUB_LINUX_BUILD
+    std::thread(&BookViewer::render_task, this).detach();
+  #else
+    auto cfg = esp_pthread_get_default_config();
+    cfg.thread_name = "renderTask";
+    cfg.pin_to_core = 1;
+    cfg.stack_size  = 60 * 1024;
+    cfg.prio        = tskIDLE_PRIORITY + 1;
+    esp_pthread_set_cfg(&cfg);
+    std::thread(&BookViewer::render_task, this).detach();
+  #endif
+  render_task_started = true;
+}
 
-      if (interp->build_pages_recurse(node, *new_fmt, dom->body, 1)) {
-
-        if (page.some_data_waiting()) page.end_paragraph(fmt);
-
-        //TTF * font = fonts.get(0, 7);
-
-        fmt.line_height_factor = 1.0;
-        fmt.font_index         = TITLE_FONT;
-        fmt.font_size          = TITLE_FONT_SIZE;
-        fmt.font_style         = Fonts::FaceStyle::ITALIC;
-        fmt.align              = CSS::Align::CENTER;
-        
-        std::ostringstream ostr;
-
-        if (show_title != 0) {
-          const char * t = epub.get_title();
-          if (strlen(t) > 50) {
-            // Only the first 50 characters of the title will be shown
-            char str[55];
-            strncpy(str, t, 50);
-            str[50] = 0;
-            strcat(str, "...");
-            ostr << str;
-          }
-          else {
-            ostr << t;
-          } 
-          // page.put_highlight(Dim(screen.get_width(), title_baseline_offset), Pos(0, 0));
-          page.put_str_at(ostr.str(), Pos(Page::HORIZONTAL_CENTER, title_baseline_offset), fmt);
-        }
+void
+BookViewer::render_ahead(const PageLocs::PageId & page_id, uint32_t format_key, const Page::Format & fmt)
+{
+  if (!page_cache.is_enabled()) return;
+
+  start_render_task();
+
+  RenderRequest req;
+
+  req.warm_up      = false;
+  req.next_page_id = PageLocs::PageId(-1, -1);
+  req.prev_page_id = PageLocs::PageId(-1, -1);
+  req.format_key   = format_key;
+  req.generation   = render_generation;
+  req.fmt          = fmt;
+
+  // Only pages already located are prepared: the render-ahead task must
+  // never wait for the pages location computation.
+  bool next = page_locs.peek_page(page_id, true,  req.next_page_id, req.next_page_info);
+  bool prev = page_locs.peek_page(page_id, false, req.prev_page_id, req.prev_page_info);
+
+  if (next || prev) render_queue.send(req, 0);
+}
+
+void
+BookViewer::warm_up(const PageLocs::PageId & page_id)
+{
+  if (!page_cache.is_enabled() || (page_id.itemref_index < 0)) return;
+
+  start_render_task();
+
+  RenderRequest req;
+  int16_t       title_baseline_offset;
+
+  get_page_format(req.fmt, title_baseline_offset);
+
+  req.warm_up      = true;
+  req.next_page_id = page_id;
+  req.prev_page_id = PageLocs::PageId(-1, -1);
+  req.format_key   = get_format_key();
+  req.generation   = render_generation;
+
+  warming_up = true;
+  if (!render_queue.send(req, 0)) warming_up = false;
+}
+
+void
+BookViewer::warm_up_glyphs(const PageLocs::PageId & page_id, const Page::Format & fmt, EPub::ItemInfo & item)
+{
+  #if SHOW_TIMING
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    int32_t rasterized_count = fonts.get_rasterized_count();
+  #endif
+
+  Page    scratch;
+  int32_t offset    = page_id.offset;
+  int32_t remaining = WARM_UP_SIZE;
+
+  for (int16_t idx = page_id.itemref_index; 
+       warming_up && (remaining > 0) && (idx < page_id.itemref_index + WARM_UP_MAX_ITEMS) && (idx < epub.get_item_count()); 
+       idx++) {
+
+    if (!epub.get_item_at_index(idx, item)) break;
+
+    xml_node node = item.xml_doc.child("html").child("body");
+    if (node) {
+      DOM          * dom    = new DOM;
+      WarmUpInterp * interp = new WarmUpInterp(scratch, *dom, item, warming_up);
 
-        ScreenBottom::show(page_locs.get_page_nbr(page_id), page_locs.get_page_count());
+      interp->set_limits(offset, offset + remaining, false);
 
-        page.paint();
+      PageCheckpoints::Step path[PageCheckpoints::MAX_PATH_LENGTH];
+      int16_t               path_length;
+      if ((idx == page_id.itemref_index) && 
+          page_locs.get_page_checkpoint(page_id, path, path_length)) {
+        interp->set_resume_path(path, path_length);
       }
-      interp->show_stat();
+
+      scratch.start(fmt);
+
+      Page::Format * new_fmt = interp->duplicate_fmt(fmt);
+      interp->build_pages_recurse(node, *new_fmt, dom->body, 1);
       interp->release_fmt(new_fmt);
-    }
 
-    interp->check_for_completion();
+      if (interp->get_current_offset() > offset) remaining -= interp->get_current_offset() - offset;
 
-    delete dom;
-    dom = nullptr;
+      delete dom;
+      delete interp;
+    }
 
-    delete interp;
-    interp = nullptr;
+    offset = 0;
   }
-  LOG_D("end of build_page_at()");
-  #if EPUB_INKPLATE_BUILD && (LOG_LOCAL_LEVEL == ESP_LOG_VERBOSE)
-    ESP::show_heaps_info();
+
+  scratch.release_memory();
+  warming_up = false;
+
+  #if SHOW_TIMING
+    LOG_I("Warm-up: %d glyphs rasterized in %d ms.", 
+          fonts.get_rasterized_count() - rasterized_count,
+          (int32_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_time).count());
   #endif
 }
 
+void
+BookViewer::render_task()
+{
+  RenderRequest  req;
+  EPub::ItemInfo item;
+
+  item.itemref_index = -1;
+
+  for (;;) {
+    if (!render_queue.receive(req)) continue;
+    while (render_queue.receive(req, 0)) { }  // Only the last request is relevant
+
+    if (req.warm_up) {
+      std::scoped_lock guard(render_mutex);
+      if (req.generation == render_generation) warm_up_glyphs(req.next_page_id, req.fmt, item);
+      epub.clear_item_data(item);
+      item.itemref_index = -1;
+      continue;
+    }
+
+    PageCache::Key keep[PageCache::SLOT_COUNT] = {
+      PageCache::Key(req.next_page_id, req.format_key),
+      PageCache::Key(req.prev_page_id, req.format_key)
+    };
+
+    const PageLocs::PageInfo * infos[PageCache::SLOT_COUNT] = { &req.next_page_info, &req.prev_page_info };
+
+    for (int8_t i = 0; i < PageCache::SLOT_COUNT; i++) {
+      const PageCache::Key & key = keep[i];
+      std::scoped_lock guard(render_mutex);
+
+      if (req.generation != render_generation) break;
+      if (key.page_id.itemref_index == -1) continue;
+
+      Page * the_page = page_cache.reserve(key, keep);
+      if (the_page == nullptr) continue;
+
+      if ((item.itemref_index != key.page_id.itemref_index) &&
+          !epub.get_item_at_index(key.page_id.itemref_index, item)) {
+        epub.clear_item_data(item);
+        page_cache.ready(the_page);  // Empty page: dropped
+        continue;
+      }
+
+      #if SHOW_TIMING
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+      #endif
+
+      if (!build_page_body(*the_page, key.page_id, infos[i]->size, item, req.fmt)) the_page->clean();
+
+      // The glyphs may have been released while building the page
+      if (get_format_key() != req.format_key) the_page->clean();
+
+      page_cache.ready(the_page);
+
+      #if SHOW_TIMING
+        LOG_I("Page %d:%d prepared in %d ms.", key.page_id.itemref_index, key.page_id.offset,
+              (int32_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start_time).count());
+      #endif
+    }
+
+    std::scoped_lock guard(render_mutex);
+    epub.clear_item_data(item);
+    item.itemref_index = -1;
+  }
+}
+
+void
+BookViewer::cancel_render_ahead()
+{
+  warming_up = false;
+  render_generation++;  // Pending requests are ignored
+  { std::scoped_lock guard(render_mutex); }  // Wait for the page being prepared
+  page_cache.invalidate();
+}
+
 void
 BookViewer::show_fake_cover()
 {
@@ -247,7 +580,14 @@ BookViewer::show_page(const PageLocs::PageId & page_id)
 {
   std::scoped_lock guard(mutex);
 
+  #if SHOW_TIMING
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+  #endif
+
   current_page_id = page_id;
+  shown_prepared  = false;
+
+  page_locs.set_reading_position(page_id.itemref_index);
     
 //if (page_locs.get_page_nbr(page_id) == 0) {
   if ((page_id.itemref_index == 0) && 
@@ -280,4 +620,16 @@ BookViewer::show_page(const PageLocs::PageId & page_id)
   else {
     build_page_at(page_id);
   }
+
+  #if SHOW_TIMING
+    int32_t duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start_time).count();
+    int8_t  kind     = shown_prepared ? 1 : 0;
+    show_count[kind]++;
+    show_time[kind] += duration;
+    LOG_I("Page %d:%d shown in %d ms (%s). Average: %d ms prepared (%d), %d ms built (%d).",
+          page_id.itemref_index, page_id.offset, duration, shown_prepared ? "prepared" : "built",
+          show_count[1] ? show_time[1] / show_count[1] : 0, show_count[1],
+          show_count[0] ? show_time[0] / show_count[0] : 0, show_count[0]);
+  #endif
 }
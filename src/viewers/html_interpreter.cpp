@@ -11,7 +11,7 @@
   #include "esp.hpp"
 #endif
 
-MemoryPool<Page::Format> HTMLInterpreter::fmt_pool;
+SharedMemoryPool<Page::Format> HTMLInterpreter::fmt_pool;
 
 // This method process a single xml node and recurse for the associated children.
 // The method calls the page_end() method when it reachs the end of the page as 
@@ -33,6 +33,28 @@ MemoryPool<Page::Format> HTMLInterpreter::fmt_pool;
 // The offsets are not character indexes in the html file, but internal computation of the location,
 // depending on the kind of tag encountered and the strings of characters present in each
 // block to be displayed (paragraphs, headers, etc.)
+//
+// As the offsets only depend on the html file content, a page checkpoint (see set_resume_path())
+// allows to go directly down to the page start: the nodes preceding the checkpoint path
+// at each level are bypassed.
+
+// A bypassed node is added to the DOM as done by build_pages_recurse(), without its children,
+// such that the CSS selectors depending on preceding siblings (first-child, adjacent)
+// still match the path nodes.
+void
+HTMLInterpreter::add_dom_placeholder(xml_node node, DOM::Node * dom_node)
+{
+  const char * name = node.name();
+  if ((*name == 0) || node.attribute("hidden")) return;
+
+  DOM::Tags::iterator tag_it = DOM::tags.find(name);
+  if ((tag_it == DOM::tags.end()) || (tag_it->second == DOM::Tag::BODY)) return;
+
+  xml_attribute attr;
+  DOM::Node *   dom_placeholder = dom_node->add_child(tag_it->second);
+  if ((attr = node.attribute("id"   ))) dom_placeholder->add_id(attr.value());
+  if ((attr = node.attribute("class"))) dom_placeholder->add_classes(attr.value());
+}
 
 bool
 HTMLInterpreter::build_pages_recurse(xml_node       node, 
@@ -69,7 +91,7 @@ HTMLInterpreter::build_pages_recurse(xml_node       node,
         toc.there_is_some_ids() &&
         (attr = node.attribute("id"))) {
       std::string id = attr.value();
-      toc.set(id, current_offset);
+      toc.set(id, item_info.itemref_index, current_offset);
     }
     if (node.attribute("hidden")) return true;
 
@@ -317,19 +339,52 @@ HTMLInterpreter::build_pages_recurse(xml_node       node,
   if (named_element) { // The element possesses a tag
     // Here we recurse on each child of the currernt tag.
     current_offset++;
-    xml_node sub = node.first_child();
+    xml_node sub         = node.first_child();
+    int16_t  child_index = 0;
+    bool     resuming    = false;
+
+    if ((resume_depth < resume_length) && (resume_depth == (level - 1))) {
+      // Go directly to the next node of the page checkpoint path
+      const PageCheckpoints::Step & step = resume_path[resume_depth++];
+      if ((step.offset >= current_offset) && (step.offset <= start_offset)) {
+        while ((sub != nullptr) && (child_index < step.child_index)) {
+          add_dom_placeholder(sub, dom_current_node);
+          sub = sub.next_sibling();
+          child_index++;
+        }
+        current_offset = step.offset;
+        resuming       = true;
+      }
+      else {
+        LOG_E("Page checkpoint not coherent: %d", step.offset);
+        resume_length = 0;
+      }
+    }
+
     while (sub != nullptr) {
       if (page.is_full() && !page_end(fmt)) return false;
       if (at_end()) break;
+      if ((level - 1) < PageCheckpoints::MAX_PATH_LENGTH) {
+        path[level - 1] = { .offset = current_offset, .child_index = child_index, .reserved = 0 };
+      }
+      path_length = level;
       Page::Format * new_fmt = duplicate_fmt(fmt);
       if (!build_pages_recurse(sub, *new_fmt, dom_current_node, level + 1)) {
+        path_length = level - 1;
         release_fmt(new_fmt);
         if (page.is_full() && !page_end(fmt)) return false;
         if (at_end()) break;
         return false;
       }
+      path_length = level - 1;
       release_fmt(new_fmt);
+      if (resuming) {
+        // The checkpoint path has been processed
+        resume_length = 0;
+        resuming      = false;
+      }
       sub = sub.next_sibling();
+      child_index++;
     }
 
     // The sub-nodes have been processed. Complete the block if not Inline and check
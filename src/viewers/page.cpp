@@ -7,11 +7,13 @@
 
 #include "viewers/page.hpp"
 #include "viewers/msg_viewer.hpp"
+#include "models/word_cache.hpp"
 #include "screen.hpp"
 #include "alloc.hpp"
 
 #include <iostream>
 #include <sstream>
+#include <chrono>
 
 #include <algorithm>
 
@@ -21,35 +23,117 @@ no_mem()
   msg_viewer.out_of_memory("display list allocation");
 }
 
+bool
+Page::DisplayList::grow(int32_t min_capacity)
+{
+  int32_t new_capacity = (capacity == 0) ? MIN_CAPACITY : capacity << 1;
+  while (new_capacity < min_capacity) new_capacity <<= 1;
+
+  DisplayListEntry * new_entries = (DisplayListEntry *) allocate(new_capacity * sizeof(DisplayListEntry));
+  if (new_entries == nullptr) return false;
+
+  if (entries != nullptr) {
+    memcpy((void *) new_entries, (const void *) entries, count * sizeof(DisplayListEntry));
+    free(entries);
+  }
+
+  entries  = new_entries;
+  capacity = new_capacity;
+  allocation_count++;
+
+  return true;
+}
+
+Page::DisplayListEntry *
+Page::DisplayList::insert(int32_t index)
+{
+  if ((count >= capacity) && !grow(count + 1)) return nullptr;
+
+  memmove((void *) &entries[index + 1], (const void *) &entries[index], (count - index) * sizeof(DisplayListEntry));
+  count++;
+
+  return &entries[index];
+}
+
+bool
+Page::DisplayList::append(const DisplayList & other)
+{
+  if (((count + other.count) > capacity) && !grow(count + other.count)) return false;
+
+  memcpy((void *) &entries[count], (const void *) other.entries, other.count * sizeof(DisplayListEntry));
+  count += other.count;
+
+  return true;
+}
+
+void
+Page::DisplayList::release()
+{
+  if (entries != nullptr) free(entries);
+
+  entries  = nullptr;
+  count    = capacity = 0;
+}
+
 Page::Page() :
   compute_mode(ComputeMode::DISPLAY), 
+  line_start(0),
+  image_count(0),
   screen_is_full(false)
 {
-  clear_display_list();
-  clear_line_list();
 }
 
 void 
 Page::clean()
 {
   clear_display_list();
-  clear_line_list();
   para_indent = 0;
   top_margin  = 0;
 }
 
+void
+Page::release_memory()
+{
+  clean();
+  display_list.release();
+  word_list.release();
+}
+
 void
 Page::clear_display_list()
 {
-  for (auto * entry: display_list) {
-    if (entry->command == DisplayListCommand::IMAGE) {
-      if (entry->kind.image_entry.image.bitmap) {
-        delete [] entry->kind.image_entry.image.bitmap;
+  drop_entries(0);
+}
+
+// Images are the only entries owning memory: the scan is avoided when
+// there is none, such that clearing a page is done in constant time.
+void
+Page::drop_entries(int32_t from)
+{
+  if (image_count > 0) {
+    for (int32_t idx = from; idx < display_list.size(); idx++) {
+      DisplayListEntry & entry = display_list[idx];
+      if ((entry.command == DisplayListCommand::IMAGE) && 
+          (entry.kind.image_entry.image.bitmap != nullptr)) {
+        delete [] entry.kind.image_entry.image.bitmap;
+        image_count--;
       }
     }
-    display_list_entry_pool.deleteElement(entry);
   }
-  display_list.clear();
+  display_list.truncate(from);
+  if (line_start > from) line_start = from;
+}
+
+// Entries put directly on the page are inserted before the line being 
+// prepared, if any.
+Page::DisplayListEntry *
+Page::new_entry()
+{
+  DisplayListEntry * entry = (line_start == display_list.size()) ? 
+                               display_list.add() : display_list.insert(line_start);
+  if (entry == nullptr) no_mem();
+  line_start++;
+  return entry;
 }
 
 // 00000000 -- 0000007F: 	0xxxxxxx
@@ -146,8 +230,7 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
       glyph = font->get_glyph(to_unicode(s, fmt.text_transform, first, &s1), fmt.font_size);
       s = s1;
       if (glyph != nullptr) {
-        DisplayListEntry * entry = display_list_entry_pool.newElement();
-        if (entry == nullptr) no_mem();
+        DisplayListEntry * entry = new_entry();
         entry->command                   = DisplayListCommand::GLYPH;
         entry->kind.glyph_entry.glyph    = glyph;
         entry->kind.glyph_entry.kern     = glyph->advance;
@@ -164,7 +247,6 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
           }
         #endif
 
-        display_list.push_front(entry);
       
         pos.x += glyph->advance;
       }
@@ -211,8 +293,7 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
       s = s1;
       if (glyph != nullptr) {
         
-        DisplayListEntry * entry = display_list_entry_pool.newElement();
-        if (entry == nullptr) no_mem();
+        DisplayListEntry * entry = new_entry();
 
         entry->command                   = DisplayListCommand::GLYPH;
         entry->kind.glyph_entry.glyph    = glyph;
@@ -230,7 +311,6 @@ Page::put_str_at(const std::string & str, Pos pos, const Format & fmt)
           }
         #endif
 
-        display_list.push_front(entry);
       
         x += glyph->advance;
       }
@@ -248,8 +328,7 @@ Page::put_char_at(char ch, Pos pos, const Format & fmt)
 
   glyph = font->get_glyph(ch, fmt.font_size);
   if (glyph != nullptr) {
-    DisplayListEntry * entry = display_list_entry_pool.newElement();
-    if (entry == nullptr) no_mem();
+    DisplayListEntry * entry = new_entry();
     entry->command                   = DisplayListCommand::GLYPH;
     entry->kind.glyph_entry.glyph    = glyph;
     entry->kind.glyph_entry.kern     = glyph->advance;
@@ -266,20 +345,56 @@ Page::put_char_at(char ch, Pos pos, const Format & fmt)
       }
     #endif
 
-    display_list.push_front(entry);
   }  
 }
 
 void
 Page::paint(bool clear_screen, bool no_full, bool do_it)
 {
-  if (!do_it) if ((display_list.empty()) || (compute_mode != ComputeMode::DISPLAY)) return;
+  if (!do_it) if (is_empty() || (compute_mode != ComputeMode::DISPLAY)) return;
   
   if (clear_screen) screen.clear();
 
-  display_list.reverse();
+  draw_display_list();
+
+  screen.update(no_full);
+}
+
+void
+Page::paint_with(Page & prepared, bool no_full)
+{
+  screen.clear();
+
+  prepared.draw_display_list();
+  prepared.clear_display_list();
+
+  draw_display_list();
+
+  screen.update(no_full);
+}
+
+int32_t
+Page::get_display_list_size() const
+{
+  int32_t size = (display_list.get_capacity() + word_list.get_capacity()) * sizeof(DisplayListEntry);
+
+  if (image_count > 0) {
+    for (auto & entry : display_list) {
+      if ((entry.command == DisplayListCommand::IMAGE) && 
+          (entry.kind.image_entry.image.bitmap != nullptr)) {
+        size += entry.kind.image_entry.image.dim.width * entry.kind.image_entry.image.dim.height;
+      }
+    }
+  }
+  return size;
+}
 
-  for (auto * entry : display_list) {
+// Only the committed entries are drawn, not the line in preparation.
+void
+Page::draw_display_list() const
+{
+  for (int32_t idx = 0; idx < line_start; idx++) {
+    const DisplayListEntry * entry = &display_list[idx];
     if (entry->command == DisplayListCommand::GLYPH) {
       if (entry->kind.glyph_entry.glyph != nullptr) {
         screen.draw_glyph(
@@ -335,8 +450,6 @@ Page::paint(bool clear_screen, bool no_full, bool do_it)
         Screen::BLACK_COLOR);
     }
   }
-
-  screen.update(no_full);
 }
 
 void
@@ -356,7 +469,6 @@ Page::start(const Format & fmt)
   screen_is_full = false;
 
   clear_display_list();
-  clear_line_list();
 
   para_indent = 0;
   line_width  = 0;
@@ -386,7 +498,7 @@ Page::line_break(const Format & fmt, int8_t indent_next_line)
 {
   Font * font = fonts.get(fmt.font_index);
   
-  if (!line_list.empty()) {
+  if (some_data_waiting()) {
     add_line(fmt, false);
   }
   else {
@@ -442,7 +554,7 @@ Page::new_paragraph(const Format & fmt, bool recover)
 void
 Page::break_paragraph(const Format & fmt)
 {
-  if (!line_list.empty()) {
+  if (some_data_waiting()) {
     add_line(fmt, true);
   }
 }
@@ -452,7 +564,7 @@ Page::end_paragraph(const Format & fmt)
 {
   Font * font = fonts.get(fmt.font_index);
 
-  if (!line_list.empty()) {
+  if (some_data_waiting()) {
     add_line(fmt, false);
 
     int32_t descender = font->get_descender_height(fmt.font_size);
@@ -490,11 +602,10 @@ Page::add_line(const Format & fmt, bool justifyable)
   // Get rid of space characters that are at the end of the line.
   // This is mainly required for the JUSTIFY alignment algo.
 
-  while (!line_list.empty()) {
-    DisplayListEntry * entry = *(line_list.begin());
+  while (display_list.size() > line_start) {
+    DisplayListEntry * entry = &display_list[display_list.size() - 1];
     if ((entry->command == DisplayListCommand::GLYPH) && (entry->kind.glyph_entry.is_space)) {
-      display_list_entry_pool.deleteElement(entry);
-      line_list.pop_front(); 
+      display_list.truncate(display_list.size() - 1);
     }
     else break;
     // if (entry->pos.y > 0) {
@@ -507,16 +618,17 @@ Page::add_line(const Format & fmt, bool justifyable)
     // else break;
   }
 
-  line_list.reverse();
-  
-  if (!line_list.empty() && (compute_mode == ComputeMode::DISPLAY)) {
+  DisplayListEntry * line_begin = display_list.begin() + line_start;
+  DisplayListEntry * line_end   = display_list.end();
+
+  if ((line_begin != line_end) && (compute_mode == ComputeMode::DISPLAY)) {
   
     if ((fmt.align == CSS::Align::JUSTIFY) && justifyable) {
       int16_t target_width = (para_max_x - para_min_x - para_indent);
       int16_t loop_count = 0;
       while ((line_width < target_width) && (++loop_count < 50)) {
         bool at_least_once = false;
-        for (auto * entry : line_list) {
+        for (DisplayListEntry * entry = line_begin; entry != line_end; entry++) {
           if (entry->pos.x > 0) {  // This means it's a white space
             at_least_once = true;
             entry->pos.x++;
@@ -526,7 +638,7 @@ Page::add_line(const Format & fmt, bool justifyable)
         if (!at_least_once) break; // No space available in line to justify the line
       }
       if (loop_count >= 50) {
-        for (auto * entry : line_list) entry->pos.x = 0;
+        for (DisplayListEntry * entry = line_begin; entry != line_end; entry++) entry->pos.x = 0;
       }
     }
     else {
@@ -539,7 +651,7 @@ Page::add_line(const Format & fmt, bool justifyable)
     }
   }
   
-  for (auto * entry : line_list) {
+  for (DisplayListEntry * entry = line_begin; entry != line_end; entry++) {
     if (entry->command == DisplayListCommand::GLYPH) {
       int16_t x     = entry->pos.x; // x may contains the calculated gap between words
       entry->pos.x  = pos.x + entry->kind.glyph_entry.glyph->xoff;
@@ -572,13 +684,11 @@ Page::add_line(const Format & fmt, bool justifyable)
         show_fmt(fmt, "  -> ");
       }
     #endif
-
-    display_list.push_front(entry);
   };
   
   line_width = line_height = glyphs_height = 0;
   line_height_factor = 0.0;
-  clear_line_list();
+  line_start = display_list.size();  // The line is now part of the display list
 
   para_indent = 0;
   top_margin  = 0;
@@ -591,7 +701,7 @@ Page::add_glyph_to_line(Font::Glyph * glyph, const Format & fmt, Font & font, bo
 {
   if (is_space && (line_width == 0)) return;
 
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
+  DisplayListEntry * entry = display_list.add();
   if (entry == nullptr) no_mem();
 
   entry->command                   = DisplayListCommand::GLYPH;
@@ -605,20 +715,19 @@ Page::add_glyph_to_line(Font::Glyph * glyph, const Format & fmt, Font & font, bo
   if (line_height_factor < fmt.line_height_factor) line_height_factor = fmt.line_height_factor;
 
   line_width += (glyph->advance);
-
-  line_list.push_front(entry);
 }
 
 void 
 Page::add_image_to_line(Image & image, int16_t advance, const Format & fmt)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
+  DisplayListEntry * entry = display_list.add();
   if (entry == nullptr) no_mem();
 
   entry->command                  = DisplayListCommand::IMAGE;
   entry->kind.image_entry.advance = advance;
 
   image.retrieve_image_data(entry->kind.image_entry.image);
+  if (entry->kind.image_entry.image.bitmap != nullptr) image_count++;
   
   // if (compute_mode == ComputeMode::DISPLAY) {
   //   if (copy) {
@@ -655,8 +764,6 @@ Page::add_image_to_line(Image & image, int16_t advance, const Format & fmt)
   //   image.width, image.height,
   //   entry->kind.image_entry.advance
   // );
-
-  line_list.push_front(entry);
 }
 
 #define NEXT_LINE_REQUIRED_SPACE (pos.y + (fmt.line_height_factor * font->get_line_height(fmt.font_size)) - font->get_descender_height(fmt.font_size))
@@ -668,51 +775,105 @@ Page::add_word(const char * word,  const Format & fmt)
   Font * font = fonts.get(fmt.font_index);
   if (font == nullptr) return false;
 
-  if (line_list.empty()) {
+  if (!some_data_waiting()) {
     // We are about to start a new line. Check if it will fit on the page.
     if ((screen_is_full = NEXT_LINE_REQUIRED_SPACE > max_y)) return false;
   }
 
-  Font::Glyph * glyph;
-
-  DisplayList      * the_list = new DisplayList;
-  const char       * str      = word;
-  int16_t            height   = font->get_line_height(fmt.font_size);
-  int16_t            width    = 0;
-  bool               first    = true;
- 
-  while (*str) {
-    bool ignore_next;
-    const char * str1, * str2;
-    uint32_t uc1, uc2;
-    int16_t  kern;
+  // The word glyphs are prepared apart, as the current line may have to be
+  // committed before adding them.
+  word_list.clear();
 
-    uc1 = to_unicode(str,  fmt.text_transform, first, &str1);
-    uc2 = to_unicode(str1, fmt.text_transform, false, &str2);
-
-    glyph = font->get_glyph(uc1, uc2, fmt.font_size, kern, ignore_next);
-
-    str = ignore_next ? str2 : str1;    
-
-    if (glyph == nullptr) {
-      glyph = font->get_glyph(' ', fmt.font_size);
-    }
+  int16_t height  = font->get_line_height(fmt.font_size);
+  int16_t width   = 0;
+  bool    metrics = compute_mode != ComputeMode::DISPLAY;
 
-    if (glyph != nullptr) {
-      width += kern;
-      first  = false;
+  WordCache::Key key = {
+    .font_index = fmt.font_index,
+    .font_size  = fmt.font_size,
+    .transform  = (uint8_t) fmt.text_transform,
+    .generation = fonts.get_generation()
+  };
+  WordCache::Run run;
 
-      DisplayListEntry * entry = display_list_entry_pool.newElement();
+  if (word_cache.get(key, word, !metrics, run)) {
+    for (int8_t i = 0; i < run.glyph_count; i++) {
+      DisplayListEntry * entry = word_list.add();
       if (entry == nullptr) no_mem();
 
+      // The glyph slabs are in use, as if the glyphs were retrieved again
+      font->reference(run.glyphs[i]);
+
       entry->command                   = DisplayListCommand::GLYPH;
-      entry->kind.glyph_entry.glyph    = glyph;
-      entry->kind.glyph_entry.kern     = kern;
+      entry->kind.glyph_entry.glyph    = run.glyphs[i];
+      entry->kind.glyph_entry.kern     = run.kerns[i];
       entry->pos.x                     = 0;
       entry->kind.glyph_entry.is_space = false;
       entry->pos.y                     = fmt.vertical_align;
+    }
+    width = run.width;
+  }
+  else {
+    #if SHOW_TIMING
+      std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    #endif
+
+    Font::Glyph * glyph;
+    const char  * str   = word;
+    bool          first = true;
+ 
+    while (*str) {
+      bool ignore_next;
+      const char * str1, * str2;
+      uint32_t uc1, uc2;
+      int16_t  kern;
+
+      uc1 = to_unicode(str,  fmt.text_transform, first, &str1);
+      uc2 = to_unicode(str1, fmt.text_transform, false, &str2);
+
+      // Glyphs of a page that will not be shown are not rasterized
+      glyph = metrics ? font->get_glyph_metrics(uc1, uc2, fmt.font_size, kern, ignore_next) :
+                        font->get_glyph(uc1, uc2, fmt.font_size, kern, ignore_next);
+
+      str = ignore_next ? str2 : str1;    
+
+      if (glyph == nullptr) {
+        glyph = metrics ? font->get_glyph_metrics(' ', fmt.font_size) : 
+                          font->get_glyph(' ', fmt.font_size);
+        if (glyph != nullptr) kern = glyph->advance;
+      }
+
+      if (glyph != nullptr) {
+        width += kern;
+        first  = false;
 
-      the_list->push_front(entry);
+        DisplayListEntry * entry = word_list.add();
+        if (entry == nullptr) no_mem();
+
+        entry->command                   = DisplayListCommand::GLYPH;
+        entry->kind.glyph_entry.glyph    = glyph;
+        entry->kind.glyph_entry.kern     = kern;
+        entry->pos.x                     = 0;
+        entry->kind.glyph_entry.is_space = false;
+        entry->pos.y                     = fmt.vertical_align;
+      }
+    }
+
+    if (word_list.size() <= WordCache::MAX_WORD_LENGTH) {
+      run.glyph_count = word_list.size();
+      run.width       = width;
+      run.rasterized  = !metrics;
+      for (int8_t i = 0; i < run.glyph_count; i++) {
+        run.glyphs[i] = word_list[i].kind.glyph_entry.glyph;
+        run.kerns[i]  = word_list[i].kind.glyph_entry.kern;
+      }
+      #if SHOW_TIMING
+        word_cache.put(key, word, run, 
+                       std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start_time).count());
+      #else
+        word_cache.put(key, word, run, 0);
+      #endif
     }
   }
 
@@ -720,11 +881,6 @@ Page::add_word(const char * word,  const Format & fmt)
 
   if (width >= avail_width) {
     if (strncasecmp(word, "http", 4) == 0) {
-      for (auto * entry : *the_list) {
-        display_list_entry_pool.deleteElement(entry);
-      }
-      the_list->clear();
-      delete the_list;
       return add_word("[URL removed]", fmt);
     }
     else {
@@ -736,28 +892,15 @@ Page::add_word(const char * word,  const Format & fmt)
   if ((line_width + width) >= avail_width) {
     add_line(fmt, true);
     screen_is_full = NEXT_LINE_REQUIRED_SPACE > max_y;
-    if (screen_is_full) {
-      for (auto * entry : *the_list) {
-        display_list_entry_pool.deleteElement(entry);
-      }
-      the_list->clear();
-      delete the_list;
-      return false;
-    }
+    if (screen_is_full) return false;
   }
 
-  line_list.splice_after(line_list.before_begin(), *the_list);
+  if (!display_list.append(word_list)) no_mem();
 
   if (glyphs_height < height) glyphs_height = height;
   if (line_height_factor < fmt.line_height_factor) line_height_factor = fmt.line_height_factor;
   line_width += width;
 
-  for (auto * entry : *the_list) {
-    display_list_entry_pool.deleteElement(entry);
-  }
-  the_list->clear();
-  delete the_list;
-
   return true;
 }
 #else
@@ -773,7 +916,7 @@ Page::add_word(const char * word,  const Format & fmt)
 
   if (font == nullptr) return false;
 
-  if (line_list.empty()) {
+  if (!some_data_waiting()) {
     // We are about to start a new line. Check if it will fit on the page.
     screen_is_full = NEXT_LINE_REQUIRED_SPACE > max_y;
     if (screen_is_full) {
@@ -840,7 +983,7 @@ Page::add_char(const char * ch, const Format & fmt)
 
   if (screen_is_full) return false;
 
-  if (line_list.empty()) {
+  if (!some_data_waiting()) {
     
     // We are about to start a new line. Check if it will fit on the page.
 
@@ -853,7 +996,8 @@ Page::add_char(const char * ch, const Format & fmt)
   const char * s1;
   int32_t code = to_unicode(ch, fmt.text_transform, true, &s1);
 
-  glyph = font->get_glyph(code, fmt.font_size);
+  glyph = (compute_mode == ComputeMode::DISPLAY) ? font->get_glyph(code, fmt.font_size) :
+                                                   font->get_glyph_metrics(code, fmt.font_size);
 
   if (glyph != nullptr) {
     // Verify that there is enough space for the glyph on the line.
@@ -1001,8 +1145,7 @@ void
 Page::put_image(Image::ImageData & image, 
                 Pos                  pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = new_entry();
 
   if (compute_mode == ComputeMode::DISPLAY) {
     int32_t size = image.dim.width * image.dim.height;
@@ -1010,6 +1153,7 @@ Page::put_image(Image::ImageData & image,
       msg_viewer.out_of_memory("image allocation");
     }
     memcpy((void *)entry->kind.image_entry.image.bitmap, image.bitmap, size);
+    image_count++;
   }
   else {
     entry->kind.image_entry.image.bitmap = nullptr;
@@ -1027,15 +1171,12 @@ Page::put_image(Image::ImageData & image,
       LOG_E("draw_bitmap with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void 
 Page::put_highlight(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = new_entry();
 
   entry->command               = DisplayListCommand::HIGHLIGHT;
   entry->kind.region_entry.dim = dim;
@@ -1049,15 +1190,12 @@ Page::put_highlight(Dim dim, Pos pos)
       LOG_E("put_highlight with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void 
 Page::clear_highlight(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = new_entry();
 
   entry->command               = DisplayListCommand::CLEAR_HIGHLIGHT;
   entry->kind.region_entry.dim = dim;
@@ -1071,15 +1209,12 @@ Page::clear_highlight(Dim dim, Pos pos)
       LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void 
 Page::put_rounded(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = new_entry();
 
   entry->command               = DisplayListCommand::ROUNDED;
   entry->kind.region_entry.dim = dim;
@@ -1093,15 +1228,12 @@ Page::put_rounded(Dim dim, Pos pos)
       LOG_E("put_highlight with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void 
 Page::clear_rounded(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = new_entry();
 
   entry->command               = DisplayListCommand::CLEAR_ROUNDED;
   entry->kind.region_entry.dim = dim;
@@ -1115,15 +1247,12 @@ Page::clear_rounded(Dim dim, Pos pos)
       LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 void 
 Page::clear_region(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = new_entry();
 
   entry->command               = DisplayListCommand::CLEAR_REGION;
   entry->kind.region_entry.dim = dim;
@@ -1137,16 +1266,13 @@ Page::clear_region(Dim dim, Pos pos)
       LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 
 void 
 Page::set_region(Dim dim, Pos pos)
 {
-  DisplayListEntry * entry = display_list_entry_pool.newElement();
-  if (entry == nullptr) no_mem();
+  DisplayListEntry * entry = new_entry();
 
   entry->command               = DisplayListCommand::SET_REGION;
   entry->kind.region_entry.dim = dim;
@@ -1160,8 +1286,6 @@ Page::set_region(Dim dim, Pos pos)
       LOG_E("Put_str_at with a too large location: %d %d", entry->pos.x, entry->pos.y);
     }
   #endif
-
-  display_list.push_front(entry);
 }
 
 bool
@@ -1210,7 +1334,8 @@ Page::show_display_list(const DisplayList & list, const char * title) const
 {
   #if DEBUGGING
     std::cout << title << std::endl;
-    for (auto * entry : list) {
+    for (auto & e : list) {
+      const DisplayListEntry * entry = &e;
       if (entry->command == DisplayListCommand::GLYPH) {
         std::cout << "GLYPH" <<
           " x:" <<  entry->pos.x <<
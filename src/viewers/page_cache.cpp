@@ -0,0 +1,121 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+#include "viewers/page_cache.hpp"
+#include "logging.hpp"
+
+PageCache::Slot *
+PageCache::find(const Page * page)
+{
+  for (auto & slot : slots) {
+    if (&slot.page == page) return &slot;
+  }
+  return nullptr;
+}
+
+void
+PageCache::free(Slot & slot)
+{
+  if ((slot.state == State::READY) || (slot.state == State::IN_USE)) used -= slot.size;
+  slot.page.release_memory();
+  slot.state = State::FREE;
+  slot.stale = false;
+  slot.size  = 0;
+}
+
+Page *
+PageCache::reserve(const Key & key, const Key * keep)
+{
+  std::scoped_lock guard(mutex);
+
+  if (budget <= 0) return nullptr;
+
+  for (auto & slot : slots) {
+    if ((slot.state != State::FREE) && !slot.stale && (slot.key == key)) return nullptr;
+  }
+
+  Slot * found = nullptr;
+  for (auto & slot : slots) {
+    if (slot.state == State::FREE) { found = &slot; break; }
+  }
+  if (found == nullptr) {
+    for (auto & slot : slots) {
+      if (slot.state != State::READY) continue;
+      bool kept = false;
+      for (int8_t i = 0; i < SLOT_COUNT; i++) {
+        if (slot.key == keep[i]) { kept = true; break; }
+      }
+      if (!kept) {
+        free(slot);
+        found = &slot;
+        break;
+      }
+    }
+  }
+  if (found == nullptr) return nullptr;
+
+  found->key   = key;
+  found->state = State::BUILDING;
+  found->stale = false;
+  found->page.set_compute_mode(Page::ComputeMode::DISPLAY);
+  return &found->page;
+}
+
+void
+PageCache::ready(Page * page)
+{
+  std::scoped_lock guard(mutex);
+
+  Slot * slot = find(page);
+  if ((slot == nullptr) || (slot->state != State::BUILDING)) return;
+
+  int32_t size = page->get_display_list_size();
+
+  if (slot->stale || page->is_empty() || ((used + size) > budget)) {
+    if (!slot->stale && !page->is_empty()) {
+      LOG_D("Page %d:%d not kept: %d bytes over budget.",
+            slot->key.page_id.itemref_index, slot->key.page_id.offset, used + size - budget);
+    }
+    free(*slot);
+  }
+  else {
+    slot->size  = size;
+    slot->state = State::READY;
+    used       += size;
+  }
+}
+
+Page *
+PageCache::take(const Key & key)
+{
+  std::scoped_lock guard(mutex);
+
+  for (auto & slot : slots) {
+    if ((slot.state == State::READY) && (slot.key == key)) {
+      slot.state = State::IN_USE;
+      return &slot.page;
+    }
+  }
+  return nullptr;
+}
+
+void
+PageCache::release(Page * page)
+{
+  std::scoped_lock guard(mutex);
+
+  Slot * slot = find(page);
+  if ((slot != nullptr) && (slot->state == State::IN_USE)) free(*slot);
+}
+
+void
+PageCache::invalidate()
+{
+  std::scoped_lock guard(mutex);
+
+  for (auto & slot : slots) {
+    if      (slot.state == State::READY   ) free(slot);
+    else if (slot.state == State::BUILDING) slot.stale = true;
+  }
+}
@@ -12,7 +12,7 @@
 const std::string ScreenBottom::dw[7] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 
 void
-ScreenBottom::show(int16_t page_nbr, int16_t page_count)
+ScreenBottom::show(int16_t page_nbr, int16_t page_count, bool estimated)
 {
   Font * font = fonts.get(FONT);
 
@@ -54,6 +54,7 @@ ScreenBottom::show(int16_t page_nbr, int16_t page_count)
                     Pos(0, Screen::get_height() - h));
 
   if ((page_nbr != -1) && (page_count != -1)) {
+    if (estimated) ostr << '~';
     ostr << page_nbr + 1 << " / " << page_count;
 
     page.put_str_at(ostr.str(), 
@@ -0,0 +1,141 @@
+// Copyright (c) 2020 Guy Turcotte
+//
+// MIT License. Look at file licenses.txt for details.
+
+// Concurrent reads of a zip file, on the Linux host.
+//
+// All the files of an EPub book are retrieved by 1 .. max_threads threads,
+// with the independent readers of Unzip::get_file() and with the calls
+// serialized by a single lock (the previous single reader behaviour). The
+// gain can only show on a multi-core host.
+//
+// Build, from the repository root (the gtk headers are required by the Linux
+// screen definitions):
+//
+//   g++ -std=gnu++17 -O2 -DEPUB_LINUX_BUILD=1 -DEPUB_INKPLATE_BUILD=0
+//       -I include_global -I include -I lib/externals -I lib_linux/EPub_InkPlate/src
+//       `pkg-config --cflags gtk+-3.0`
+//       tools/unzip_bench.cpp src/helpers/unzip.cpp lib/externals/miniz.c
+//       lib/externals/strlcpy.cpp lib/externals/int_to_str.cpp
+//       lib_linux/EPub_InkPlate/src/logging.cpp -lpthread -o unzip_bench
+//
+// Usage: unzip_bench book.epub [max_threads [repeat]]
+
+#include "helpers/unzip.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static uint32_t get16(const uint8_t * p) { return p[0] | (p[1] << 8); }
+static uint32_t get32(const uint8_t * p) { return get16(p) | (get16(p + 2) << 16); }
+
+// The names of the files, from the zip central directory
+static bool
+file_names(const char * zip_filename, std::vector<std::string> & names)
+{
+  FILE * file = fopen(zip_filename, "rb");
+  if (file == nullptr) return false;
+
+  std::vector<uint8_t> data;
+  fseek(file, 0, SEEK_END);
+  data.resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  bool read = fread(data.data(), 1, data.size(), file) == data.size();
+  fclose(file);
+  if (!read || (data.size() < 22)) return false;
+
+  // End of central directory record, followed by a comment of at most 64K
+  int64_t end = data.size() - 22;
+  while ((end >= 0) && (get32(&data[end]) != 0x06054b50)) end--;
+  if (end < 0) return false;
+
+  uint32_t count = get16(&data[end + 10]);
+  uint32_t pos   = get32(&data[end + 16]);
+
+  for (uint32_t i = 0; i < count; i++) {
+    if ((pos + 46 > data.size()) || (get32(&data[pos]) != 0x02014b50)) return false;
+    uint32_t name_size = get16(&data[pos + 28]);
+    std::string name((const char *) &data[pos + 46], name_size);
+    if (name.back() != '/') names.push_back(name);
+    pos += 46 + name_size + get16(&data[pos + 30]) + get16(&data[pos + 32]);
+  }
+
+  return true;
+}
+
+// Milliseconds to read all the files repeat times, -1 if a file is missing
+static double
+read_all(const std::vector<std::string> & names, int thread_count, int repeat, bool serialized)
+{
+  std::mutex serialize;
+  bool       missing = false;
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t]() {
+      for (int r = 0; r < repeat; r++) {
+        for (size_t i = t; i < names.size(); i += thread_count) {
+          uint32_t file_size;
+          std::unique_ptr<char[], MallocDeleter> data;
+          if (serialized) {
+            std::scoped_lock guard(serialize);
+            data = unzip.get_file(names[i].c_str(), file_size);
+          }
+          else {
+            data = unzip.get_file(names[i].c_str(), file_size);
+          }
+          if (data == nullptr) missing = true;
+        }
+      }
+    });
+  }
+  for (auto & thread : threads) thread.join();
+
+  auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+  return missing ? -1.0 : duration.count();
+}
+
+int
+main(int argc, char ** argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s book.epub [max_threads [repeat]]\n", argv[0]);
+    return 1;
+  }
+
+  int max_threads = (argc > 2) ? atoi(argv[2]) : std::thread::hardware_concurrency();
+  int repeat      = (argc > 3) ? atoi(argv[3]) : 10;
+  if (max_threads < 1) max_threads = 1;
+  if (repeat      < 1) repeat      = 1;
+
+  std::vector<std::string> names;
+  if (!file_names(argv[1], names) || !unzip.open_zip_file(argv[1])) {
+    fprintf(stderr, "Unable to open %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("%s: %zu files read %d times, %u hardware threads\n",
+         argv[1], names.size(), repeat, std::thread::hardware_concurrency());
+  printf("threads  independent (ms)  serialized (ms)  speedup\n");
+
+  for (int thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+    double independent = read_all(names, thread_count, repeat, false);
+    double serialized  = read_all(names, thread_count, repeat, true);
+    if ((independent < 0) || (serialized < 0)) {
+      fprintf(stderr, "Some files could not be read\n");
+      unzip.close_zip_file();
+      return 1;
+    }
+    printf("%7d  %16.2f  %15.2f  %7.2f\n", thread_count, independent, serialized, serialized / independent);
+  }
+
+  unzip.close_zip_file();
+  return 0;
+}